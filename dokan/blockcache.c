@@ -0,0 +1,514 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// used when DOKAN_OPTIONS.BlockCacheBlockSize is 0
+#define DOKAN_BLOCK_CACHE_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// most blocks missing from the cache read by one ReadFile call
+#define DOKAN_BLOCK_CACHE_MAX_RUN 16
+
+#define DOKAN_BLOCK_CACHE_IN_QUEUE 0
+#define DOKAN_BLOCK_CACHE_MAIN_QUEUE 1
+#define DOKAN_BLOCK_CACHE_OUT_QUEUE 2
+
+// file, or alternate data stream, of which blocks are cached
+typedef struct _DOKAN_BLOCK_CACHE_FILE {
+  LIST_ENTRY HashListEntry;
+  // DOKAN_BLOCK_CACHE_BLOCK of the file, the file is freed with its last one
+  LIST_ENTRY Blocks;
+  // of the path without stream name, the streams of a file share its bucket
+  ULONG Hash;
+  ULONG PathLength;
+  WCHAR Path[1];
+} DOKAN_BLOCK_CACHE_FILE, *PDOKAN_BLOCK_CACHE_FILE;
+
+typedef struct _DOKAN_BLOCK_CACHE_BLOCK {
+  LIST_ENTRY HashListEntry;
+  LIST_ENTRY FileListEntry;
+  // in the queue of the cache given by Queue
+  LIST_ENTRY QueueListEntry;
+  PDOKAN_BLOCK_CACHE_FILE File;
+  // offset of the block in the file divided by the block size
+  LONGLONG Index;
+  UCHAR Queue;
+  // NULL in the out queue
+  PCHAR Data;
+  // shorter than the block size for the block at the end of the file
+  ULONG Length;
+} DOKAN_BLOCK_CACHE_BLOCK, *PDOKAN_BLOCK_CACHE_BLOCK;
+
+VOID DokanInitBlockCache(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_BLOCK_CACHE cache = &DokanInstance->BlockCache;
+  ULONG i;
+
+  InitializeCriticalSection(&cache->Lock);
+  for (i = 0; i < DOKAN_BLOCK_CACHE_FILE_BUCKETS; ++i)
+    InitializeListHead(&cache->FileBuckets[i]);
+  for (i = 0; i < DOKAN_BLOCK_CACHE_BUCKETS; ++i)
+    InitializeListHead(&cache->Buckets[i]);
+  InitializeListHead(&cache->InQueue);
+  InitializeListHead(&cache->MainQueue);
+  InitializeListHead(&cache->OutQueue);
+  cache->InSize = 0;
+  cache->Size = 0;
+  cache->OutCount = 0;
+  cache->Hits = 0;
+  cache->Misses = 0;
+  cache->Evictions = 0;
+}
+
+ULONG DokanBlockCacheBlockSize(PDOKAN_INSTANCE DokanInstance) {
+  ULONG blockSize = DokanInstance->DokanOptions->BlockCacheBlockSize;
+  return blockSize != 0 ? blockSize : DOKAN_BLOCK_CACHE_DEFAULT_BLOCK_SIZE;
+}
+
+ULONG DokanBlockCacheBlockHash(PDOKAN_BLOCK_CACHE_FILE File, LONGLONG Index) {
+  return (ULONG)(((ULONG_PTR)File >> 4) ^ (ULONG_PTR)(Index * 2654435761));
+}
+
+// Unlink the block from its queue, without freeing it
+VOID DokanBlockCacheDequeue(PDOKAN_BLOCK_CACHE Cache,
+                            PDOKAN_BLOCK_CACHE_BLOCK Block) {
+  RemoveEntryList(&Block->QueueListEntry);
+  if (Block->Queue == DOKAN_BLOCK_CACHE_OUT_QUEUE) {
+    Cache->OutCount--;
+  } else {
+    Cache->Size -= Block->Length;
+    if (Block->Queue == DOKAN_BLOCK_CACHE_IN_QUEUE)
+      Cache->InSize -= Block->Length;
+  }
+}
+
+// Free a block out of the queues, and its file when it was the last block of
+// it
+VOID DokanBlockCacheFree(PDOKAN_BLOCK_CACHE_BLOCK Block) {
+  PDOKAN_BLOCK_CACHE_FILE file = Block->File;
+
+  RemoveEntryList(&Block->HashListEntry);
+  RemoveEntryList(&Block->FileListEntry);
+  if (Block->Data != NULL)
+    free(Block->Data);
+  free(Block);
+
+  if (IsListEmpty(&file->Blocks)) {
+    RemoveEntryList(&file->HashListEntry);
+    free(file);
+  }
+}
+
+VOID DokanBlockCacheRemove(PDOKAN_BLOCK_CACHE Cache,
+                           PDOKAN_BLOCK_CACHE_BLOCK Block) {
+  DokanBlockCacheDequeue(Cache, Block);
+  DokanBlockCacheFree(Block);
+}
+
+VOID DokanBlockCacheRemoveFile(PDOKAN_BLOCK_CACHE Cache,
+                               PDOKAN_BLOCK_CACHE_FILE File) {
+  BOOL last;
+
+  do {
+    PLIST_ENTRY listEntry = File->Blocks.Flink;
+    last = listEntry->Flink == &File->Blocks;
+    DokanBlockCacheRemove(Cache, CONTAINING_RECORD(listEntry,
+                                                   DOKAN_BLOCK_CACHE_BLOCK,
+                                                   FileListEntry));
+  } while (!last);
+}
+
+VOID DokanDeleteBlockCache(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_BLOCK_CACHE cache = &DokanInstance->BlockCache;
+  ULONG i;
+
+  for (i = 0; i < DOKAN_BLOCK_CACHE_FILE_BUCKETS; ++i) {
+    while (!IsListEmpty(&cache->FileBuckets[i])) {
+      DokanBlockCacheRemoveFile(
+          cache, CONTAINING_RECORD(cache->FileBuckets[i].Flink,
+                                   DOKAN_BLOCK_CACHE_FILE, HashListEntry));
+    }
+  }
+  DeleteCriticalSection(&cache->Lock);
+}
+
+PDOKAN_BLOCK_CACHE_FILE DokanBlockCacheFindFile(PDOKAN_BLOCK_CACHE Cache,
+                                                LPCWSTR FileName,
+                                                ULONG Length, ULONG Hash,
+                                                BOOL IgnoreCase) {
+  PLIST_ENTRY bucket =
+      &Cache->FileBuckets[Hash % DOKAN_BLOCK_CACHE_FILE_BUCKETS];
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_BLOCK_CACHE_FILE file =
+        CONTAINING_RECORD(listEntry, DOKAN_BLOCK_CACHE_FILE, HashListEntry);
+    if (file->Hash == Hash &&
+        DokanCachePathEqual(file->Path, file->PathLength, FileName, Length,
+                            IgnoreCase))
+      return file;
+  }
+  return NULL;
+}
+
+PDOKAN_BLOCK_CACHE_BLOCK DokanBlockCacheFindBlock(PDOKAN_BLOCK_CACHE Cache,
+                                                  PDOKAN_BLOCK_CACHE_FILE File,
+                                                  LONGLONG Index) {
+  PLIST_ENTRY bucket =
+      &Cache->Buckets[DokanBlockCacheBlockHash(File, Index) %
+                      DOKAN_BLOCK_CACHE_BUCKETS];
+  PLIST_ENTRY listEntry;
+
+  if (File == NULL)
+    return NULL;
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_BLOCK_CACHE_BLOCK block =
+        CONTAINING_RECORD(listEntry, DOKAN_BLOCK_CACHE_BLOCK, HashListEntry);
+    if (block->File == File && block->Index == Index)
+      return block;
+  }
+  return NULL;
+}
+
+// Evict blocks until Needed more bytes fit in the budget. Blocks read once
+// go first while they use more than a quarter of it, and are remembered in
+// the out queue: read again, they go to the main queue.
+BOOL DokanBlockCacheMakeRoom(PDOKAN_BLOCK_CACHE Cache, ULONG64 Budget,
+                             ULONG BlockSize, ULONG Needed) {
+  ULONG maxOutCount = (ULONG)(Budget / BlockSize / 2);
+
+  if (Needed > Budget)
+    return FALSE;
+
+  while (Cache->Size + Needed > Budget) {
+    PDOKAN_BLOCK_CACHE_BLOCK block;
+
+    if (!IsListEmpty(&Cache->InQueue) &&
+        (Cache->InSize > Budget / 4 || IsListEmpty(&Cache->MainQueue))) {
+      block = CONTAINING_RECORD(Cache->InQueue.Blink, DOKAN_BLOCK_CACHE_BLOCK,
+                                QueueListEntry);
+      DokanBlockCacheDequeue(Cache, block);
+      free(block->Data);
+      block->Data = NULL;
+      block->Length = 0;
+      block->Queue = DOKAN_BLOCK_CACHE_OUT_QUEUE;
+      InsertHeadList(&Cache->OutQueue, &block->QueueListEntry);
+      Cache->OutCount++;
+
+      while (Cache->OutCount > maxOutCount) {
+        DokanBlockCacheRemove(
+            Cache, CONTAINING_RECORD(Cache->OutQueue.Blink,
+                                     DOKAN_BLOCK_CACHE_BLOCK, QueueListEntry));
+      }
+    } else if (!IsListEmpty(&Cache->MainQueue)) {
+      DokanBlockCacheRemove(
+          Cache, CONTAINING_RECORD(Cache->MainQueue.Blink,
+                                   DOKAN_BLOCK_CACHE_BLOCK, QueueListEntry));
+    } else {
+      return FALSE;
+    }
+    Cache->Evictions++;
+  }
+  return TRUE;
+}
+
+// Store Length bytes of Data as the block Index of the file. Called with the
+// lock held.
+VOID DokanBlockCacheInsert(PDOKAN_BLOCK_CACHE Cache, ULONG64 Budget,
+                           ULONG BlockSize, LPCWSTR FileName, ULONG PathLength,
+                           ULONG Hash, BOOL IgnoreCase, LONGLONG Index,
+                           PCHAR Data, ULONG Length) {
+  PDOKAN_BLOCK_CACHE_FILE file;
+  PDOKAN_BLOCK_CACHE_BLOCK block;
+  PCHAR blockData = NULL;
+
+  file = DokanBlockCacheFindFile(Cache, FileName, PathLength, Hash,
+                                 IgnoreCase);
+  block = DokanBlockCacheFindBlock(Cache, file, Index);
+
+  // read meanwhile by another request
+  if (block != NULL && block->Data != NULL)
+    return;
+
+  // out of the queues, the block is not evicted to make room for itself
+  if (block != NULL)
+    DokanBlockCacheDequeue(Cache, block);
+
+  if (Length > 0) {
+    if (!DokanBlockCacheMakeRoom(Cache, Budget, BlockSize, Length) ||
+        (blockData = (PCHAR)malloc(Length)) == NULL) {
+      if (block != NULL)
+        DokanBlockCacheFree(block);
+      return;
+    }
+    RtlCopyMemory(blockData, Data, Length);
+  }
+
+  if (block == NULL) {
+    // the eviction may have removed the file
+    file = DokanBlockCacheFindFile(Cache, FileName, PathLength, Hash,
+                                   IgnoreCase);
+
+    if (file == NULL) {
+      file = (PDOKAN_BLOCK_CACHE_FILE)malloc(sizeof(DOKAN_BLOCK_CACHE_FILE) +
+                                             PathLength * sizeof(WCHAR));
+      if (file == NULL) {
+        if (blockData != NULL)
+          free(blockData);
+        return;
+      }
+      InitializeListHead(&file->Blocks);
+      file->Hash = Hash;
+      file->PathLength = PathLength;
+      RtlCopyMemory(file->Path, FileName, PathLength * sizeof(WCHAR));
+      file->Path[PathLength] = L'\0';
+      InsertHeadList(&Cache->FileBuckets[Hash % DOKAN_BLOCK_CACHE_FILE_BUCKETS],
+                     &file->HashListEntry);
+    }
+
+    block = (PDOKAN_BLOCK_CACHE_BLOCK)malloc(sizeof(DOKAN_BLOCK_CACHE_BLOCK));
+    if (block == NULL) {
+      if (blockData != NULL)
+        free(blockData);
+      if (IsListEmpty(&file->Blocks)) {
+        RemoveEntryList(&file->HashListEntry);
+        free(file);
+      }
+      return;
+    }
+    block->File = file;
+    block->Index = Index;
+    block->Queue = DOKAN_BLOCK_CACHE_IN_QUEUE;
+    InsertTailList(&file->Blocks, &block->FileListEntry);
+    InsertHeadList(&Cache->Buckets[DokanBlockCacheBlockHash(file, Index) %
+                                   DOKAN_BLOCK_CACHE_BUCKETS],
+                   &block->HashListEntry);
+  } else {
+    // a block read again soon after its eviction is used often
+    block->Queue = DOKAN_BLOCK_CACHE_MAIN_QUEUE;
+  }
+
+  block->Data = blockData;
+  block->Length = Length;
+  Cache->Size += Length;
+  if (block->Queue == DOKAN_BLOCK_CACHE_IN_QUEUE) {
+    Cache->InSize += Length;
+    InsertHeadList(&Cache->InQueue, &block->QueueListEntry);
+  } else {
+    InsertHeadList(&Cache->MainQueue, &block->QueueListEntry);
+  }
+}
+
+// Copy in Buffer the cached data of the block at Offset, up to Length bytes.
+// Returns FALSE when the block is not cached. Eof is set when the copied
+// bytes end at the end of the file. Called with the lock held.
+BOOL DokanBlockCacheLookup(PDOKAN_BLOCK_CACHE Cache,
+                           PDOKAN_BLOCK_CACHE_FILE File, ULONG BlockSize,
+                           LONGLONG Offset, PCHAR Buffer, ULONG Length,
+                           PULONG Copied, PBOOLEAN Eof) {
+  PDOKAN_BLOCK_CACHE_BLOCK block =
+      DokanBlockCacheFindBlock(Cache, File, Offset / BlockSize);
+  ULONG start = (ULONG)(Offset % BlockSize);
+
+  if (block == NULL || block->Queue == DOKAN_BLOCK_CACHE_OUT_QUEUE)
+    return FALSE;
+
+  *Copied = 0;
+  if (start < block->Length) {
+    *Copied = block->Length - start;
+    if (*Copied > Length)
+      *Copied = Length;
+    RtlCopyMemory(Buffer, block->Data + start, *Copied);
+  }
+  *Eof = block->Length < BlockSize && start + *Copied >= block->Length;
+
+  // the in queue is a FIFO, a block is only promoted once it was evicted
+  if (block->Queue == DOKAN_BLOCK_CACHE_MAIN_QUEUE) {
+    RemoveEntryList(&block->QueueListEntry);
+    InsertHeadList(&Cache->MainQueue, &block->QueueListEntry);
+  }
+  return TRUE;
+}
+
+// Read Length bytes of FileName at Offset through the cache. Blocks which
+// are not cached are read with ReadFile, several at once when they follow
+// each other.
+NTSTATUS DokanBlockCacheRead(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                             PCHAR Buffer, ULONG Length, LONGLONG Offset,
+                             PULONG ReadLength, PDOKAN_FILE_INFO FileInfo) {
+  PDOKAN_BLOCK_CACHE cache = &DokanInstance->BlockCache;
+  ULONG64 budget = DokanInstance->DokanOptions->BlockCacheSize;
+  ULONG blockSize = DokanBlockCacheBlockSize(DokanInstance);
+  ULONG pathLength = DokanCachePathLength(FileName);
+  ULONG hash = DokanCacheHash(
+      FileName, DokanCacheStreamBaseLength(FileName, pathLength));
+  BOOL ignoreCase = DokanCacheIgnoreCase(DokanInstance);
+  ULONG generation = DokanDataGeneration(DokanInstance, FileName);
+  LONGLONG offset = Offset;
+  LONGLONG end = Offset + Length;
+  NTSTATUS status = STATUS_SUCCESS;
+
+  *ReadLength = 0;
+
+  while (offset < end) {
+    PDOKAN_BLOCK_CACHE_FILE file;
+    LONGLONG index = offset / blockSize;
+    ULONG start = (ULONG)(offset % blockSize);
+    ULONG copied = 0;
+    BOOLEAN eof = FALSE;
+    ULONG count;
+    ULONG runLength;
+    ULONG runRead = 0;
+    PCHAR runBuffer;
+    ULONG i;
+
+    EnterCriticalSection(&cache->Lock);
+
+    file = DokanBlockCacheFindFile(cache, FileName, pathLength, hash,
+                                   ignoreCase);
+    if (DokanBlockCacheLookup(cache, file, blockSize, offset,
+                              Buffer + *ReadLength, (ULONG)(end - offset),
+                              &copied, &eof)) {
+      cache->Hits++;
+      LeaveCriticalSection(&cache->Lock);
+
+      *ReadLength += copied;
+      offset += copied;
+      if (eof)
+        break;
+      continue;
+    }
+
+    // the blocks missing from here
+    count = 1;
+    while (count < DOKAN_BLOCK_CACHE_MAX_RUN &&
+           (index + count) * blockSize < end) {
+      PDOKAN_BLOCK_CACHE_BLOCK block =
+          DokanBlockCacheFindBlock(cache, file, index + count);
+      if (block != NULL && block->Queue != DOKAN_BLOCK_CACHE_OUT_QUEUE)
+        break;
+      count++;
+    }
+    cache->Misses += count;
+
+    LeaveCriticalSection(&cache->Lock);
+
+    runLength = count * blockSize;
+    runBuffer = (PCHAR)malloc(runLength);
+    if (runBuffer == NULL) {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+      break;
+    }
+
+    status = DokanCallReadFile(DokanInstance, FileName, runBuffer, runLength,
+                               &runRead, index * blockSize, FileInfo);
+    if (status != STATUS_SUCCESS) {
+      free(runBuffer);
+      break;
+    }
+    if (runRead > runLength)
+      runRead = runLength;
+
+    EnterCriticalSection(&cache->Lock);
+    // what was read is stale if the file changed meanwhile
+    if (DokanDataGeneration(DokanInstance, FileName) == generation) {
+      // the block holding the end of the file is kept even when empty
+      for (i = 0; i < count && i * blockSize <= runRead; ++i) {
+        ULONG blockLength = runRead - i * blockSize;
+        if (blockLength > blockSize)
+          blockLength = blockSize;
+        DokanBlockCacheInsert(cache, budget, blockSize, FileName, pathLength,
+                              hash, ignoreCase, index + i,
+                              runBuffer + i * blockSize, blockLength);
+      }
+    }
+    LeaveCriticalSection(&cache->Lock);
+
+    if (start < runRead) {
+      copied = runRead - start;
+      if (copied > end - offset)
+        copied = (ULONG)(end - offset);
+      RtlCopyMemory(Buffer + *ReadLength, runBuffer + start, copied);
+    }
+    free(runBuffer);
+
+    *ReadLength += copied;
+    offset += copied;
+    if (runRead < runLength)
+      break;
+  }
+
+  // the data read is returned, the error comes with the next read
+  if (status != STATUS_SUCCESS && *ReadLength > 0)
+    status = STATUS_SUCCESS;
+  return status;
+}
+
+// FileName was written, truncated, renamed or deleted: forget its blocks,
+// those of its alternate data streams, and those of the files under it when
+// Subtree is TRUE
+VOID DokanBlockCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                               LPCWSTR FileName, BOOL Subtree) {
+  PDOKAN_BLOCK_CACHE cache = &DokanInstance->BlockCache;
+  PLIST_ENTRY listEntry, nextEntry;
+  ULONG length;
+  ULONG baseLength;
+  ULONG first, last, i;
+
+  if (DokanInstance->DokanOptions->BlockCacheSize == 0)
+    return;
+
+  length = DokanCachePathLength(FileName);
+  baseLength = DokanCacheStreamBaseLength(FileName, length);
+
+  // the streams of the file are in the bucket of the file
+  first = 0;
+  last = DOKAN_BLOCK_CACHE_FILE_BUCKETS - 1;
+  if (!Subtree) {
+    first = DokanCacheHash(FileName, baseLength) %
+            DOKAN_BLOCK_CACHE_FILE_BUCKETS;
+    last = first;
+  }
+
+  EnterCriticalSection(&cache->Lock);
+
+  for (i = first; i <= last; ++i) {
+    PLIST_ENTRY bucket = &cache->FileBuckets[i];
+
+    for (listEntry = bucket->Flink; listEntry != bucket;
+         listEntry = nextEntry) {
+      PDOKAN_BLOCK_CACHE_FILE file =
+          CONTAINING_RECORD(listEntry, DOKAN_BLOCK_CACHE_FILE, HashListEntry);
+      nextEntry = listEntry->Flink;
+
+      if (file->PathLength >= length &&
+          _wcsnicmp(file->Path, FileName, length) == 0 &&
+          (file->PathLength == length ||
+           (baseLength == length && file->Path[length] == L':') ||
+           (Subtree && file->Path[length] == L'\\')))
+        DokanBlockCacheRemoveFile(cache, file);
+    }
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+}
@@ -0,0 +1,1202 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// used when DOKAN_OPTIONS.DirectoryCacheSize is 0
+#define DOKAN_DIRECTORY_CACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+// used when DOKAN_OPTIONS.AttributeCacheSize is 0
+#define DOKAN_ATTRIBUTE_CACHE_DEFAULT_SIZE 65536
+// used when DOKAN_OPTIONS.SecurityCacheSize is 0
+#define DOKAN_SECURITY_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+extern CRITICAL_SECTION g_InstanceCriticalSection;
+extern LIST_ENTRY g_InstanceList;
+
+typedef struct _DOKAN_DIRECTORY_CACHE_ENTRY {
+  LIST_ENTRY HashListEntry;
+  LIST_ENTRY LruListEntry;
+  ULONG Hash;
+  ULONGLONG ExpirationTime;
+  // bytes accounted in DOKAN_DIRECTORY_CACHE.Size
+  SIZE_T Size;
+  // both stored after the entry, Pattern is empty for a full listing
+  LPWSTR Path;
+  ULONG PathLength;
+  LPWSTR Pattern;
+  DOKAN_FIND_DATA_ARENA FindDataList;
+} DOKAN_DIRECTORY_CACHE_ENTRY, *PDOKAN_DIRECTORY_CACHE_ENTRY;
+
+typedef struct _DOKAN_ATTRIBUTE_CACHE_ENTRY {
+  LIST_ENTRY HashListEntry;
+  LIST_ENTRY LruListEntry;
+  ULONG Hash;
+  ULONGLONG ExpirationTime;
+  // nFileIndexHigh and nFileIndexLow are known, FALSE when made from a
+  // directory listing without FileId, see DokanFillFileDataWithId
+  BOOLEAN HasFileId;
+  // made from GetFileInformation, FALSE when made from a directory listing,
+  // which has no volume serial number nor number of links
+  BOOLEAN HasFullInfo;
+  // the file does not exist, see DokanNegativeCacheInsert
+  BOOLEAN Negative;
+  // Streams holds what FindStreams returned, see DokanStreamCacheInsert
+  BOOLEAN HasStreams;
+  BY_HANDLE_FILE_INFORMATION FileInfo;
+  DOKAN_FIND_DATA_ARENA Streams;
+  ULONG PathLength;
+  WCHAR Path[1];
+} DOKAN_ATTRIBUTE_CACHE_ENTRY, *PDOKAN_ATTRIBUTE_CACHE_ENTRY;
+
+// security descriptor shared by all the files and SECURITY_INFORMATION masks
+// that return the same bytes
+typedef struct _DOKAN_SECURITY_DESCRIPTOR_BLOB {
+  LIST_ENTRY HashListEntry;
+  ULONG Hash;
+  ULONG RefCount;
+  ULONG Length;
+  BYTE Data[1];
+} DOKAN_SECURITY_DESCRIPTOR_BLOB, *PDOKAN_SECURITY_DESCRIPTOR_BLOB;
+
+typedef struct _DOKAN_SECURITY_CACHE_ENTRY {
+  LIST_ENTRY HashListEntry;
+  LIST_ENTRY LruListEntry;
+  ULONG Hash;
+  ULONGLONG ExpirationTime;
+  SECURITY_INFORMATION SecurityInformation;
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB Descriptor;
+  ULONG PathLength;
+  WCHAR Path[1];
+} DOKAN_SECURITY_CACHE_ENTRY, *PDOKAN_SECURITY_CACHE_ENTRY;
+
+VOID DokanInitCache(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_DIRECTORY_CACHE cache = &DokanInstance->DirectoryCache;
+  PDOKAN_ATTRIBUTE_CACHE attributeCache = &DokanInstance->AttributeCache;
+  PDOKAN_SECURITY_CACHE securityCache = &DokanInstance->SecurityCache;
+  ULONG i;
+
+  InitializeCriticalSection(&cache->Lock);
+  for (i = 0; i < DOKAN_DIRECTORY_CACHE_BUCKETS; ++i)
+    InitializeListHead(&cache->Buckets[i]);
+  InitializeListHead(&cache->LruList);
+  cache->Size = 0;
+  cache->Hits = 0;
+  cache->Misses = 0;
+
+  InitializeCriticalSection(&attributeCache->Lock);
+  for (i = 0; i < DOKAN_ATTRIBUTE_CACHE_BUCKETS; ++i)
+    InitializeListHead(&attributeCache->Buckets[i]);
+  InitializeListHead(&attributeCache->LruList);
+  attributeCache->Count = 0;
+  attributeCache->Hits = 0;
+  attributeCache->Misses = 0;
+  attributeCache->NegativeHits = 0;
+  attributeCache->NegativeMisses = 0;
+
+  DokanInstance->CacheGeneration = 0;
+
+  InitializeCriticalSection(&securityCache->Lock);
+  for (i = 0; i < DOKAN_SECURITY_CACHE_BUCKETS; ++i)
+    InitializeListHead(&securityCache->Buckets[i]);
+  for (i = 0; i < DOKAN_SECURITY_CACHE_DESCRIPTOR_BUCKETS; ++i)
+    InitializeListHead(&securityCache->DescriptorBuckets[i]);
+  InitializeListHead(&securityCache->LruList);
+  securityCache->Size = 0;
+  securityCache->Hits = 0;
+  securityCache->Misses = 0;
+
+  InitializeCriticalSection(&DokanInstance->VolumeCache.Lock);
+  DokanInstance->VolumeCache.VolumeInfoValid = FALSE;
+  DokanInstance->VolumeCache.FreeSpaceValid = FALSE;
+  DokanInstance->VolumeCache.FreeSpaceRefreshing = FALSE;
+}
+
+VOID DokanDirectoryCacheRemove(PDOKAN_DIRECTORY_CACHE Cache,
+                               PDOKAN_DIRECTORY_CACHE_ENTRY Entry) {
+  RemoveEntryList(&Entry->HashListEntry);
+  RemoveEntryList(&Entry->LruListEntry);
+  Cache->Size -= Entry->Size;
+  ClearFindData(&Entry->FindDataList);
+  free(Entry);
+}
+
+VOID DokanAttributeCacheRemove(PDOKAN_ATTRIBUTE_CACHE Cache,
+                               PDOKAN_ATTRIBUTE_CACHE_ENTRY Entry) {
+  RemoveEntryList(&Entry->HashListEntry);
+  RemoveEntryList(&Entry->LruListEntry);
+  Cache->Count--;
+  ClearFindData(&Entry->Streams);
+  free(Entry);
+}
+
+VOID DokanSecurityCacheRemove(PDOKAN_SECURITY_CACHE Cache,
+                              PDOKAN_SECURITY_CACHE_ENTRY Entry) {
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB descriptor = Entry->Descriptor;
+
+  RemoveEntryList(&Entry->HashListEntry);
+  RemoveEntryList(&Entry->LruListEntry);
+  Cache->Size -= sizeof(DOKAN_SECURITY_CACHE_ENTRY) +
+                 Entry->PathLength * sizeof(WCHAR);
+  free(Entry);
+
+  if (--descriptor->RefCount == 0) {
+    RemoveEntryList(&descriptor->HashListEntry);
+    Cache->Size -= sizeof(DOKAN_SECURITY_DESCRIPTOR_BLOB) + descriptor->Length;
+    free(descriptor);
+  }
+}
+
+VOID DokanDeleteCache(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_DIRECTORY_CACHE cache = &DokanInstance->DirectoryCache;
+  PDOKAN_ATTRIBUTE_CACHE attributeCache = &DokanInstance->AttributeCache;
+  PDOKAN_SECURITY_CACHE securityCache = &DokanInstance->SecurityCache;
+
+  while (!IsListEmpty(&cache->LruList)) {
+    DokanDirectoryCacheRemove(
+        cache, CONTAINING_RECORD(cache->LruList.Flink,
+                                 DOKAN_DIRECTORY_CACHE_ENTRY, LruListEntry));
+  }
+  DeleteCriticalSection(&cache->Lock);
+
+  while (!IsListEmpty(&attributeCache->LruList)) {
+    DokanAttributeCacheRemove(
+        attributeCache,
+        CONTAINING_RECORD(attributeCache->LruList.Flink,
+                          DOKAN_ATTRIBUTE_CACHE_ENTRY, LruListEntry));
+  }
+  DeleteCriticalSection(&attributeCache->Lock);
+
+  while (!IsListEmpty(&securityCache->LruList)) {
+    DokanSecurityCacheRemove(
+        securityCache,
+        CONTAINING_RECORD(securityCache->LruList.Flink,
+                          DOKAN_SECURITY_CACHE_ENTRY, LruListEntry));
+  }
+  DeleteCriticalSection(&securityCache->Lock);
+
+  DeleteCriticalSection(&DokanInstance->VolumeCache.Lock);
+}
+
+// length of the path without its trailing backslash, except for the root
+ULONG DokanCachePathLength(LPCWSTR Path) {
+  ULONG length = (ULONG)wcslen(Path);
+  if (length > 1 && Path[length - 1] == L'\\')
+    length--;
+  return length;
+}
+
+// length of the file of which FileName is an alternate data stream, or of
+// FileName itself
+ULONG DokanCacheStreamBaseLength(LPCWSTR FileName, ULONG Length) {
+  ULONG i;
+  for (i = Length; i > 0 && FileName[i - 1] != L'\\'; --i) {
+    if (FileName[i - 1] == L':')
+      Length = i - 1;
+  }
+  return Length;
+}
+
+// length of the parent directory of FileName
+ULONG DokanCacheParentLength(LPCWSTR FileName) {
+  ULONG length = DokanCachePathLength(FileName);
+  while (length > 0 && FileName[length - 1] != L'\\')
+    length--;
+  // keep the backslash of the root only
+  if (length > 1)
+    length--;
+  return length;
+}
+
+PDOKAN_DIRECTORY_CACHE_ENTRY
+DokanDirectoryCacheFind(PDOKAN_DIRECTORY_CACHE Cache, LPCWSTR Path,
+                        ULONG PathLength, ULONG Hash, LPCWSTR Pattern,
+                        BOOL IgnoreCase) {
+  PLIST_ENTRY bucket = &Cache->Buckets[Hash % DOKAN_DIRECTORY_CACHE_BUCKETS];
+  PLIST_ENTRY listEntry;
+  ULONGLONG now = GetTickCount64();
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_DIRECTORY_CACHE_ENTRY entry = CONTAINING_RECORD(
+        listEntry, DOKAN_DIRECTORY_CACHE_ENTRY, HashListEntry);
+
+    if (entry->Hash != Hash ||
+        !DokanCachePathEqual(entry->Path, entry->PathLength, Path,
+                             PathLength, IgnoreCase) ||
+        wcscmp(entry->Pattern, Pattern) != 0)
+      continue;
+
+    if (entry->ExpirationTime <= now) {
+      DokanDirectoryCacheRemove(Cache, entry);
+      return NULL;
+    }
+    return entry;
+  }
+  return NULL;
+}
+
+// Copy the cached listing of the directory in FindDataList. A full listing
+// is used for any pattern, otherwise one made with the same pattern.
+BOOL DokanDirectoryCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                               LPCWSTR Pattern,
+                               PDOKAN_FIND_DATA_ARENA FindDataList,
+                               PBOOLEAN PatternCheck) {
+  PDOKAN_DIRECTORY_CACHE cache = &DokanInstance->DirectoryCache;
+  PDOKAN_DIRECTORY_CACHE_ENTRY entry;
+  ULONG pathLength;
+  ULONG hash;
+  BOOL found = FALSE;
+
+  if (DokanInstance->DokanOptions->DirectoryCacheTimeout == 0)
+    return FALSE;
+
+  pathLength = DokanCachePathLength(Path);
+  hash = DokanCacheHash(Path, pathLength);
+  if (Pattern == NULL || wcscmp(Pattern, L"*") == 0)
+    Pattern = L"";
+
+  EnterCriticalSection(&cache->Lock);
+
+  entry = DokanDirectoryCacheFind(cache, Path, pathLength, hash, L"",
+                                  DokanCacheIgnoreCase(DokanInstance));
+  if (entry != NULL) {
+    *PatternCheck = TRUE;
+  } else if (Pattern[0] != L'\0') {
+    entry = DokanDirectoryCacheFind(cache, Path, pathLength, hash, Pattern,
+                                    DokanCacheIgnoreCase(DokanInstance));
+    *PatternCheck = FALSE;
+  }
+
+  if (entry != NULL) {
+    ClearFindData(FindDataList);
+    FindDataList->Buffer = (PCHAR)malloc(entry->FindDataList.Size + 1);
+    if (FindDataList->Buffer != NULL) {
+      RtlCopyMemory(FindDataList->Buffer, entry->FindDataList.Buffer,
+                    entry->FindDataList.Size);
+      FindDataList->Size = entry->FindDataList.Size;
+      FindDataList->Capacity = entry->FindDataList.Size;
+      FindDataList->Count = entry->FindDataList.Count;
+      found = TRUE;
+
+      RemoveEntryList(&entry->LruListEntry);
+      InsertHeadList(&cache->LruList, &entry->LruListEntry);
+    }
+  }
+
+  if (found)
+    cache->Hits++;
+  else
+    cache->Misses++;
+
+  LeaveCriticalSection(&cache->Lock);
+
+  if (found)
+    DbgPrintW(L"  directory cache hit %s (%s)\n", Path, Pattern);
+  return found;
+}
+
+// Store a copy of the listing made for Path with Pattern, NULL or "*" for a
+// full listing. Nothing is stored if the cache was invalidated since
+// DOKAN_INSTANCE.CacheGeneration was Generation.
+VOID DokanDirectoryCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                               LPCWSTR Pattern,
+                               PDOKAN_FIND_DATA_ARENA FindDataList,
+                               ULONG Generation) {
+  PDOKAN_DIRECTORY_CACHE cache = &DokanInstance->DirectoryCache;
+  PDOKAN_DIRECTORY_CACHE_ENTRY entry, old;
+  ULONG pathLength;
+  SIZE_T patternLength;
+  SIZE_T maxSize = DokanInstance->DokanOptions->DirectoryCacheSize;
+  SIZE_T size;
+
+  if (DokanInstance->DokanOptions->DirectoryCacheTimeout == 0)
+    return;
+
+  if (maxSize == 0)
+    maxSize = DOKAN_DIRECTORY_CACHE_DEFAULT_SIZE;
+  if (Pattern == NULL || wcscmp(Pattern, L"*") == 0)
+    Pattern = L"";
+
+  pathLength = DokanCachePathLength(Path);
+  patternLength = wcslen(Pattern);
+  size = sizeof(DOKAN_DIRECTORY_CACHE_ENTRY) +
+         (pathLength + patternLength + 2) * sizeof(WCHAR) + FindDataList->Size;
+  if (size > maxSize)
+    return;
+
+  entry = (PDOKAN_DIRECTORY_CACHE_ENTRY)malloc(
+      sizeof(DOKAN_DIRECTORY_CACHE_ENTRY) +
+      (pathLength + patternLength + 2) * sizeof(WCHAR));
+  if (entry == NULL)
+    return;
+  ZeroMemory(entry, sizeof(DOKAN_DIRECTORY_CACHE_ENTRY));
+
+  entry->FindDataList.Buffer = (PCHAR)malloc(FindDataList->Size + 1);
+  if (entry->FindDataList.Buffer == NULL) {
+    free(entry);
+    return;
+  }
+  RtlCopyMemory(entry->FindDataList.Buffer, FindDataList->Buffer,
+                FindDataList->Size);
+  entry->FindDataList.Size = FindDataList->Size;
+  entry->FindDataList.Capacity = FindDataList->Size;
+  entry->FindDataList.Count = FindDataList->Count;
+
+  entry->Path = (LPWSTR)(entry + 1);
+  RtlCopyMemory(entry->Path, Path, pathLength * sizeof(WCHAR));
+  entry->Path[pathLength] = L'\0';
+  entry->PathLength = pathLength;
+  entry->Pattern = entry->Path + pathLength + 1;
+  RtlCopyMemory(entry->Pattern, Pattern, (patternLength + 1) * sizeof(WCHAR));
+  entry->Hash = DokanCacheHash(Path, pathLength);
+  entry->Size = size;
+  entry->ExpirationTime =
+      GetTickCount64() + DokanInstance->DokanOptions->DirectoryCacheTimeout;
+
+  EnterCriticalSection(&cache->Lock);
+
+  if ((ULONG)DokanInstance->CacheGeneration != Generation) {
+    LeaveCriticalSection(&cache->Lock);
+    ClearFindData(&entry->FindDataList);
+    free(entry);
+    return;
+  }
+
+  old = DokanDirectoryCacheFind(cache, entry->Path, pathLength, entry->Hash,
+                                entry->Pattern,
+                                DokanCacheIgnoreCase(DokanInstance));
+  if (old != NULL)
+    DokanDirectoryCacheRemove(cache, old);
+
+  // release the least recently used listings to stay in the budget
+  while (cache->Size + size > maxSize && !IsListEmpty(&cache->LruList)) {
+    DokanDirectoryCacheRemove(
+        cache, CONTAINING_RECORD(cache->LruList.Blink,
+                                 DOKAN_DIRECTORY_CACHE_ENTRY, LruListEntry));
+  }
+
+  InsertHeadList(&cache->Buckets[entry->Hash % DOKAN_DIRECTORY_CACHE_BUCKETS],
+                 &entry->HashListEntry);
+  InsertHeadList(&cache->LruList, &entry->LruListEntry);
+  cache->Size += size;
+
+  LeaveCriticalSection(&cache->Lock);
+}
+
+PDOKAN_ATTRIBUTE_CACHE_ENTRY
+DokanAttributeCacheFind(PDOKAN_ATTRIBUTE_CACHE Cache, LPCWSTR Path,
+                        ULONG PathLength, ULONG Hash, BOOL IgnoreCase) {
+  PLIST_ENTRY bucket = &Cache->Buckets[Hash % DOKAN_ATTRIBUTE_CACHE_BUCKETS];
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_ATTRIBUTE_CACHE_ENTRY entry = CONTAINING_RECORD(
+        listEntry, DOKAN_ATTRIBUTE_CACHE_ENTRY, HashListEntry);
+
+    if (entry->Hash == Hash &&
+        DokanCachePathEqual(entry->Path, entry->PathLength, Path, PathLength,
+                            IgnoreCase))
+      return entry;
+  }
+  return NULL;
+}
+
+// Store the informations of the file Name in the directory Path, or of Path
+// itself when Name is NULL. A NULL FileInfo records that the file does not
+// exist. Must be called with the cache lock held.
+VOID DokanAttributeCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              ULONG PathLength, LPCWSTR Name,
+                              ULONG NameLength,
+                              PBY_HANDLE_FILE_INFORMATION FileInfo,
+                              BOOLEAN HasFileId, BOOLEAN HasFullInfo,
+                              ULONGLONG ExpirationTime) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  PDOKAN_ATTRIBUTE_CACHE_ENTRY entry, old;
+  ULONG maxCount = DokanInstance->DokanOptions->AttributeCacheSize;
+  ULONG length = PathLength;
+
+  if (maxCount == 0)
+    maxCount = DOKAN_ATTRIBUTE_CACHE_DEFAULT_SIZE;
+
+  // the root is the only directory path ending with a backslash
+  if (Name != NULL)
+    length += NameLength + (PathLength > 1 ? 1 : 0);
+
+  entry = (PDOKAN_ATTRIBUTE_CACHE_ENTRY)malloc(
+      sizeof(DOKAN_ATTRIBUTE_CACHE_ENTRY) + length * sizeof(WCHAR));
+  if (entry == NULL)
+    return;
+
+  RtlCopyMemory(entry->Path, Path, PathLength * sizeof(WCHAR));
+  if (Name != NULL) {
+    if (PathLength > 1)
+      entry->Path[PathLength] = L'\\';
+    RtlCopyMemory(entry->Path + length - NameLength, Name,
+                  NameLength * sizeof(WCHAR));
+  }
+  entry->Path[length] = L'\0';
+  entry->PathLength = length;
+  entry->Hash = DokanCacheHash(entry->Path, length);
+  entry->ExpirationTime = ExpirationTime;
+  entry->HasFileId = HasFileId;
+  entry->HasFullInfo = HasFullInfo;
+  entry->Negative = FileInfo == NULL;
+  entry->HasStreams = FALSE;
+  ZeroMemory(&entry->Streams, sizeof(DOKAN_FIND_DATA_ARENA));
+  if (FileInfo != NULL)
+    entry->FileInfo = *FileInfo;
+  else
+    ZeroMemory(&entry->FileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
+
+  old = DokanAttributeCacheFind(cache, entry->Path, length, entry->Hash,
+                                DokanCacheIgnoreCase(DokanInstance));
+  if (old != NULL) {
+    // a listing does not change what GetFileInformation told of the file
+    if (FileInfo != NULL && !HasFullInfo && old->HasFullInfo &&
+        !old->Negative) {
+      entry->FileInfo.dwVolumeSerialNumber = old->FileInfo.dwVolumeSerialNumber;
+      entry->FileInfo.nNumberOfLinks = old->FileInfo.nNumberOfLinks;
+      if (!HasFileId) {
+        entry->FileInfo.nFileIndexHigh = old->FileInfo.nFileIndexHigh;
+        entry->FileInfo.nFileIndexLow = old->FileInfo.nFileIndexLow;
+      }
+      entry->HasFileId = TRUE;
+      entry->HasFullInfo = TRUE;
+    }
+    DokanAttributeCacheRemove(cache, old);
+  }
+
+  // release the least recently used files to stay in the budget
+  while (cache->Count >= maxCount && !IsListEmpty(&cache->LruList)) {
+    DokanAttributeCacheRemove(
+        cache, CONTAINING_RECORD(cache->LruList.Blink,
+                                 DOKAN_ATTRIBUTE_CACHE_ENTRY, LruListEntry));
+  }
+
+  InsertHeadList(&cache->Buckets[entry->Hash % DOKAN_ATTRIBUTE_CACHE_BUCKETS],
+                 &entry->HashListEntry);
+  InsertHeadList(&cache->LruList, &entry->LruListEntry);
+  cache->Count++;
+}
+
+// Copy the cached informations of FileName in FileInfo. An entry made from a
+// directory listing is not used when NeedFullInfo is TRUE, nor when
+// NeedFileId is TRUE and the listing had no FileId.
+BOOL DokanAttributeCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               BOOL NeedFileId, BOOL NeedFullInfo,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  PDOKAN_ATTRIBUTE_CACHE_ENTRY entry;
+  ULONG length;
+  ULONG hash;
+  BOOL found = FALSE;
+
+  if (DokanInstance->DokanOptions->AttributeCacheTimeout == 0)
+    return FALSE;
+
+  length = DokanCachePathLength(FileName);
+  hash = DokanCacheHash(FileName, length);
+
+  EnterCriticalSection(&cache->Lock);
+
+  entry = DokanAttributeCacheFind(cache, FileName, length, hash,
+                                  DokanCacheIgnoreCase(DokanInstance));
+  if (entry != NULL && entry->ExpirationTime <= GetTickCount64()) {
+    DokanAttributeCacheRemove(cache, entry);
+    entry = NULL;
+  }
+
+  if (entry != NULL && !entry->Negative &&
+      (entry->HasFileId || !NeedFileId) &&
+      (entry->HasFullInfo || !NeedFullInfo)) {
+    *FileInfo = entry->FileInfo;
+    found = TRUE;
+
+    RemoveEntryList(&entry->LruListEntry);
+    InsertHeadList(&cache->LruList, &entry->LruListEntry);
+    cache->Hits++;
+  } else {
+    cache->Misses++;
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+
+  if (found)
+    DbgPrintW(L"  attribute cache hit %s\n", FileName);
+  return found;
+}
+
+// Store the result of GetFileInformation for FileName. Nothing is stored if
+// the cache was invalidated since DOKAN_INSTANCE.CacheGeneration was
+// Generation.
+VOID DokanAttributeCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo,
+                               ULONG Generation) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  ULONG timeout = DokanInstance->DokanOptions->AttributeCacheTimeout;
+
+  if (timeout == 0)
+    return;
+
+  EnterCriticalSection(&cache->Lock);
+  if ((ULONG)DokanInstance->CacheGeneration == Generation)
+    DokanAttributeCacheStore(DokanInstance, FileName,
+                             DokanCachePathLength(FileName), NULL, 0, FileInfo,
+                             TRUE, TRUE, GetTickCount64() + timeout);
+  LeaveCriticalSection(&cache->Lock);
+}
+
+// Store the informations of the files listed in the directory Path, so that
+// opening and querying them right after the listing needs no callback
+VOID DokanAttributeCacheSeed(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             PDOKAN_FIND_DATA_ARENA FindDataList,
+                             ULONG Generation) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  ULONG timeout = DokanInstance->DokanOptions->AttributeCacheTimeout;
+  ULONG pathLength;
+  ULONGLONG expirationTime;
+  BY_HANDLE_FILE_INFORMATION fileInfo;
+  SIZE_T offset;
+
+  if (timeout == 0 || FindDataList->Count == 0)
+    return;
+
+  pathLength = DokanCachePathLength(Path);
+  expirationTime = GetTickCount64() + timeout;
+  ZeroMemory(&fileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
+  fileInfo.nNumberOfLinks = 1;
+
+  EnterCriticalSection(&cache->Lock);
+
+  if ((ULONG)DokanInstance->CacheGeneration != Generation) {
+    LeaveCriticalSection(&cache->Lock);
+    return;
+  }
+
+  for (offset = 0; offset < FindDataList->Size;) {
+    PDOKAN_FIND_DATA find = DOKAN_FIND_DATA_ENTRY(FindDataList, offset);
+    offset += find->EntrySize;
+
+    if ((find->FileNameLength == 1 && find->FileName[0] == L'.') ||
+        (find->FileNameLength == 2 && find->FileName[0] == L'.' &&
+         find->FileName[1] == L'.'))
+      continue;
+
+    fileInfo.dwFileAttributes = find->FileAttributes;
+    fileInfo.ftCreationTime = find->CreationTime;
+    fileInfo.ftLastAccessTime = find->LastAccessTime;
+    fileInfo.ftLastWriteTime = find->LastWriteTime;
+    fileInfo.nFileSizeHigh = find->FileSizeHigh;
+    fileInfo.nFileSizeLow = find->FileSizeLow;
+    fileInfo.nFileIndexHigh = (DWORD)(find->FileId >> 32);
+    fileInfo.nFileIndexLow = (DWORD)find->FileId;
+
+    DokanAttributeCacheStore(DokanInstance, Path, pathLength, find->FileName,
+                             find->FileNameLength, &fileInfo,
+                             find->FileId != 0, FALSE, expirationTime);
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+}
+
+// TRUE when an open of FileName failed with STATUS_OBJECT_NAME_NOT_FOUND less
+// than DOKAN_OPTIONS.NegativeCacheTimeout ago
+BOOL DokanNegativeCacheLookup(PDOKAN_INSTANCE DokanInstance,
+                              LPCWSTR FileName) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  PDOKAN_ATTRIBUTE_CACHE_ENTRY entry;
+  ULONG length;
+  BOOL found = FALSE;
+
+  if (DokanInstance->DokanOptions->NegativeCacheTimeout == 0)
+    return FALSE;
+
+  length = DokanCachePathLength(FileName);
+
+  EnterCriticalSection(&cache->Lock);
+
+  entry = DokanAttributeCacheFind(cache, FileName, length,
+                                  DokanCacheHash(FileName, length),
+                                  DokanCacheIgnoreCase(DokanInstance));
+  if (entry != NULL && entry->ExpirationTime <= GetTickCount64()) {
+    DokanAttributeCacheRemove(cache, entry);
+    entry = NULL;
+  }
+
+  if (entry != NULL && entry->Negative) {
+    found = TRUE;
+    RemoveEntryList(&entry->LruListEntry);
+    InsertHeadList(&cache->LruList, &entry->LruListEntry);
+    cache->NegativeHits++;
+  } else {
+    cache->NegativeMisses++;
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+
+  if (found)
+    DbgPrintW(L"  negative cache hit %s\n", FileName);
+  return found;
+}
+
+// Record that FileName does not exist. Nothing is stored if the cache was
+// invalidated since DOKAN_INSTANCE.CacheGeneration was Generation.
+VOID DokanNegativeCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                              ULONG Generation) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  ULONG timeout = DokanInstance->DokanOptions->NegativeCacheTimeout;
+
+  if (timeout == 0)
+    return;
+
+  EnterCriticalSection(&cache->Lock);
+  if ((ULONG)DokanInstance->CacheGeneration == Generation)
+    DokanAttributeCacheStore(DokanInstance, FileName,
+                             DokanCachePathLength(FileName), NULL, 0, NULL,
+                             FALSE, FALSE, GetTickCount64() + timeout);
+  LeaveCriticalSection(&cache->Lock);
+}
+
+// Copy the cached alternate data streams of FileName in StreamList
+BOOL DokanStreamCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PDOKAN_FIND_DATA_ARENA StreamList) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  PDOKAN_ATTRIBUTE_CACHE_ENTRY entry;
+  ULONG length;
+  BOOL found = FALSE;
+
+  if (DokanInstance->DokanOptions->AttributeCacheTimeout == 0)
+    return FALSE;
+
+  length = DokanCachePathLength(FileName);
+
+  EnterCriticalSection(&cache->Lock);
+
+  entry = DokanAttributeCacheFind(cache, FileName, length,
+                                  DokanCacheHash(FileName, length),
+                                  DokanCacheIgnoreCase(DokanInstance));
+  if (entry != NULL && entry->ExpirationTime <= GetTickCount64()) {
+    DokanAttributeCacheRemove(cache, entry);
+    entry = NULL;
+  }
+
+  if (entry != NULL && entry->HasStreams) {
+    ClearFindData(StreamList);
+    StreamList->Buffer = (PCHAR)malloc(entry->Streams.Size + 1);
+    if (StreamList->Buffer != NULL) {
+      RtlCopyMemory(StreamList->Buffer, entry->Streams.Buffer,
+                    entry->Streams.Size);
+      StreamList->Size = entry->Streams.Size;
+      StreamList->Capacity = entry->Streams.Size;
+      StreamList->Count = entry->Streams.Count;
+      found = TRUE;
+
+      RemoveEntryList(&entry->LruListEntry);
+      InsertHeadList(&cache->LruList, &entry->LruListEntry);
+    }
+  }
+
+  if (found)
+    cache->Hits++;
+  else
+    cache->Misses++;
+
+  LeaveCriticalSection(&cache->Lock);
+
+  if (found)
+    DbgPrintW(L"  stream cache hit %s\n", FileName);
+  return found;
+}
+
+// Keep a copy of the alternate data streams listed for FileName with its
+// informations. They are only stored when the informations are, which is
+// the case of a file queried after its open, and live as long as them.
+VOID DokanStreamCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PDOKAN_FIND_DATA_ARENA StreamList,
+                            ULONG Generation) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  PDOKAN_ATTRIBUTE_CACHE_ENTRY entry;
+  ULONG length;
+  PCHAR buffer;
+
+  if (DokanInstance->DokanOptions->AttributeCacheTimeout == 0)
+    return;
+
+  length = DokanCachePathLength(FileName);
+  buffer = (PCHAR)malloc(StreamList->Size + 1);
+  if (buffer == NULL)
+    return;
+  RtlCopyMemory(buffer, StreamList->Buffer, StreamList->Size);
+
+  EnterCriticalSection(&cache->Lock);
+
+  entry = DokanAttributeCacheFind(cache, FileName, length,
+                                  DokanCacheHash(FileName, length),
+                                  DokanCacheIgnoreCase(DokanInstance));
+  if ((ULONG)DokanInstance->CacheGeneration == Generation && entry != NULL &&
+      !entry->Negative && entry->ExpirationTime > GetTickCount64()) {
+    ClearFindData(&entry->Streams);
+    entry->Streams.Buffer = buffer;
+    entry->Streams.Size = StreamList->Size;
+    entry->Streams.Capacity = StreamList->Size;
+    entry->Streams.Count = StreamList->Count;
+    entry->HasStreams = TRUE;
+    buffer = NULL;
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+
+  if (buffer != NULL)
+    free(buffer);
+}
+
+// forget Path, in every case of its name
+VOID DokanAttributeCacheDrop(PDOKAN_ATTRIBUTE_CACHE Cache, LPCWSTR Path,
+                             ULONG PathLength) {
+  ULONG hash = DokanCacheHash(Path, PathLength);
+  PDOKAN_ATTRIBUTE_CACHE_ENTRY entry;
+
+  while ((entry = DokanAttributeCacheFind(Cache, Path, PathLength, hash,
+                                          TRUE)) != NULL)
+    DokanAttributeCacheRemove(Cache, entry);
+}
+
+// The content of FileName may change: the data read from it before is out
+// of date. Files are hashed in buckets, a change in one of them makes the
+// data read from the others be read again.
+VOID DokanDataChanged(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName) {
+  ULONG length = DokanCachePathLength(FileName);
+  InterlockedIncrement(
+      &DokanInstance->DataGeneration[DokanCacheHash(FileName, length) %
+                                     DOKAN_DATA_GENERATION_BUCKETS]);
+}
+
+// Data read from FileName is still valid if this value did not change since
+ULONG DokanDataGeneration(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName) {
+  ULONG length = DokanCachePathLength(FileName);
+  return (ULONG)DokanInstance->DataGeneration[DokanCacheHash(FileName, length) %
+                                              DOKAN_DATA_GENERATION_BUCKETS];
+}
+
+// The content of FileName was written: forget its cached informations
+VOID DokanCacheInvalidateFile(PDOKAN_INSTANCE DokanInstance,
+                              LPCWSTR FileName) {
+  PDOKAN_ATTRIBUTE_CACHE cache = &DokanInstance->AttributeCache;
+  ULONG length;
+  ULONG baseLength;
+
+  DokanDataChanged(DokanInstance, FileName);
+  DokanBlockCacheInvalidate(DokanInstance, FileName, FALSE);
+  DokanFlightInvalidate(DokanInstance, FileName, FALSE);
+
+  if (DokanInstance->DokanOptions->AttributeCacheTimeout == 0)
+    return;
+
+  InterlockedIncrement(&DokanInstance->CacheGeneration);
+
+  length = DokanCachePathLength(FileName);
+
+  EnterCriticalSection(&cache->Lock);
+  DokanAttributeCacheDrop(cache, FileName, length);
+  // the size of an alternate data stream is in the streams of its file
+  baseLength = DokanCacheStreamBaseLength(FileName, length);
+  if (baseLength != length)
+    DokanAttributeCacheDrop(cache, FileName, baseLength);
+  LeaveCriticalSection(&cache->Lock);
+}
+
+ULONG DokanSecurityDescriptorHash(PVOID Data, ULONG Length) {
+  PBYTE bytes = (PBYTE)Data;
+  ULONG hash = 2166136261;
+  ULONG i;
+  for (i = 0; i < Length; ++i) {
+    hash ^= bytes[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+// Copy the cached descriptor of FileName for SecurityInformation in Buffer if
+// it fits. LengthNeeded receives its size, as from GetFileSecurity.
+BOOL DokanSecurityCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                              SECURITY_INFORMATION SecurityInformation,
+                              PVOID Buffer, ULONG BufferLength,
+                              PULONG LengthNeeded) {
+  PDOKAN_SECURITY_CACHE cache = &DokanInstance->SecurityCache;
+  PLIST_ENTRY bucket, listEntry;
+  ULONG length;
+  ULONG hash;
+  BOOL found = FALSE;
+
+  if (DokanInstance->DokanOptions->SecurityCacheTimeout == 0)
+    return FALSE;
+
+  length = DokanCachePathLength(FileName);
+  hash = DokanCacheHash(FileName, length);
+  bucket = &cache->Buckets[hash % DOKAN_SECURITY_CACHE_BUCKETS];
+
+  EnterCriticalSection(&cache->Lock);
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_SECURITY_CACHE_ENTRY entry = CONTAINING_RECORD(
+        listEntry, DOKAN_SECURITY_CACHE_ENTRY, HashListEntry);
+
+    if (entry->Hash != hash ||
+        entry->SecurityInformation != SecurityInformation ||
+        !DokanCachePathEqual(entry->Path, entry->PathLength, FileName, length,
+                             DokanCacheIgnoreCase(DokanInstance)))
+      continue;
+
+    if (entry->ExpirationTime <= GetTickCount64()) {
+      DokanSecurityCacheRemove(cache, entry);
+      break;
+    }
+
+    *LengthNeeded = entry->Descriptor->Length;
+    if (entry->Descriptor->Length <= BufferLength)
+      RtlCopyMemory(Buffer, entry->Descriptor->Data, entry->Descriptor->Length);
+    found = TRUE;
+
+    RemoveEntryList(&entry->LruListEntry);
+    InsertHeadList(&cache->LruList, &entry->LruListEntry);
+    break;
+  }
+
+  if (found)
+    cache->Hits++;
+  else
+    cache->Misses++;
+
+  LeaveCriticalSection(&cache->Lock);
+
+  if (found)
+    DbgPrintW(L"  security cache hit %s\n", FileName);
+  return found;
+}
+
+// Store the descriptor returned by GetFileSecurity for FileName. The bytes
+// are shared with the other files having the same descriptor. Nothing is
+// stored if the cache was invalidated since DOKAN_INSTANCE.CacheGeneration
+// was Generation.
+VOID DokanSecurityCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                              SECURITY_INFORMATION SecurityInformation,
+                              PVOID SecurityDescriptor, ULONG Length,
+                              ULONG Generation) {
+  PDOKAN_SECURITY_CACHE cache = &DokanInstance->SecurityCache;
+  ULONG timeout = DokanInstance->DokanOptions->SecurityCacheTimeout;
+  SIZE_T maxSize = DokanInstance->DokanOptions->SecurityCacheSize;
+  PDOKAN_SECURITY_CACHE_ENTRY entry;
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB descriptor = NULL;
+  PLIST_ENTRY bucket, listEntry, nextEntry;
+  ULONG pathLength;
+  ULONG descriptorHash;
+
+  if (timeout == 0 || Length == 0)
+    return;
+  if (maxSize == 0)
+    maxSize = DOKAN_SECURITY_CACHE_DEFAULT_SIZE;
+
+  pathLength = DokanCachePathLength(FileName);
+  descriptorHash = DokanSecurityDescriptorHash(SecurityDescriptor, Length);
+
+  entry = (PDOKAN_SECURITY_CACHE_ENTRY)malloc(
+      sizeof(DOKAN_SECURITY_CACHE_ENTRY) + pathLength * sizeof(WCHAR));
+  if (entry == NULL)
+    return;
+  RtlCopyMemory(entry->Path, FileName, pathLength * sizeof(WCHAR));
+  entry->Path[pathLength] = L'\0';
+  entry->PathLength = pathLength;
+  entry->Hash = DokanCacheHash(FileName, pathLength);
+  entry->SecurityInformation = SecurityInformation;
+  entry->ExpirationTime = GetTickCount64() + timeout;
+
+  EnterCriticalSection(&cache->Lock);
+
+  if ((ULONG)DokanInstance->CacheGeneration != Generation) {
+    LeaveCriticalSection(&cache->Lock);
+    free(entry);
+    return;
+  }
+
+  // replace what was cached for this file and mask
+  bucket = &cache->Buckets[entry->Hash % DOKAN_SECURITY_CACHE_BUCKETS];
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = nextEntry) {
+    PDOKAN_SECURITY_CACHE_ENTRY old = CONTAINING_RECORD(
+        listEntry, DOKAN_SECURITY_CACHE_ENTRY, HashListEntry);
+    nextEntry = listEntry->Flink;
+
+    if (old->Hash == entry->Hash &&
+        old->SecurityInformation == SecurityInformation &&
+        DokanCachePathEqual(old->Path, old->PathLength, FileName, pathLength,
+                            DokanCacheIgnoreCase(DokanInstance)))
+      DokanSecurityCacheRemove(cache, old);
+  }
+
+  bucket = &cache->DescriptorBuckets[descriptorHash %
+                                     DOKAN_SECURITY_CACHE_DESCRIPTOR_BUCKETS];
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_SECURITY_DESCRIPTOR_BLOB blob = CONTAINING_RECORD(
+        listEntry, DOKAN_SECURITY_DESCRIPTOR_BLOB, HashListEntry);
+    if (blob->Hash == descriptorHash && blob->Length == Length &&
+        memcmp(blob->Data, SecurityDescriptor, Length) == 0) {
+      descriptor = blob;
+      break;
+    }
+  }
+
+  if (descriptor == NULL) {
+    descriptor = (PDOKAN_SECURITY_DESCRIPTOR_BLOB)malloc(
+        sizeof(DOKAN_SECURITY_DESCRIPTOR_BLOB) + Length);
+    if (descriptor == NULL) {
+      LeaveCriticalSection(&cache->Lock);
+      free(entry);
+      return;
+    }
+    descriptor->Hash = descriptorHash;
+    descriptor->RefCount = 0;
+    descriptor->Length = Length;
+    RtlCopyMemory(descriptor->Data, SecurityDescriptor, Length);
+    InsertHeadList(bucket, &descriptor->HashListEntry);
+    cache->Size += sizeof(DOKAN_SECURITY_DESCRIPTOR_BLOB) + Length;
+  }
+  descriptor->RefCount++;
+  entry->Descriptor = descriptor;
+
+  InsertHeadList(&cache->Buckets[entry->Hash % DOKAN_SECURITY_CACHE_BUCKETS],
+                 &entry->HashListEntry);
+  InsertHeadList(&cache->LruList, &entry->LruListEntry);
+  cache->Size += sizeof(DOKAN_SECURITY_CACHE_ENTRY) + pathLength * sizeof(WCHAR);
+
+  // release the least recently used files to stay in the budget, the new
+  // entry is the last one to go
+  while (cache->Size > maxSize && cache->LruList.Blink != &entry->LruListEntry) {
+    DokanSecurityCacheRemove(
+        cache, CONTAINING_RECORD(cache->LruList.Blink,
+                                 DOKAN_SECURITY_CACHE_ENTRY, LruListEntry));
+  }
+  if (cache->Size > maxSize)
+    DokanSecurityCacheRemove(cache, entry);
+
+  LeaveCriticalSection(&cache->Lock);
+}
+
+// The security of FileName changed or it was created, deleted or renamed:
+// forget its descriptors, and those of everything under it when Subtree is
+// TRUE, as they may inherit from it
+VOID DokanSecurityCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR FileName, BOOL Subtree) {
+  PDOKAN_SECURITY_CACHE cache = &DokanInstance->SecurityCache;
+  PLIST_ENTRY listEntry, nextEntry;
+  ULONG length;
+  ULONG hash;
+
+  if (DokanInstance->DokanOptions->SecurityCacheTimeout == 0)
+    return;
+
+  length = DokanCachePathLength(FileName);
+  hash = DokanCacheHash(FileName, length);
+
+  InterlockedIncrement(&DokanInstance->CacheGeneration);
+
+  EnterCriticalSection(&cache->Lock);
+
+  if (Subtree) {
+    for (listEntry = cache->LruList.Flink; listEntry != &cache->LruList;
+         listEntry = nextEntry) {
+      PDOKAN_SECURITY_CACHE_ENTRY entry = CONTAINING_RECORD(
+          listEntry, DOKAN_SECURITY_CACHE_ENTRY, LruListEntry);
+      nextEntry = listEntry->Flink;
+
+      if (entry->PathLength >= length &&
+          _wcsnicmp(entry->Path, FileName, length) == 0 &&
+          (entry->PathLength == length || entry->Path[length] == L'\\'))
+        DokanSecurityCacheRemove(cache, entry);
+    }
+  } else {
+    PLIST_ENTRY bucket = &cache->Buckets[hash % DOKAN_SECURITY_CACHE_BUCKETS];
+
+    for (listEntry = bucket->Flink; listEntry != bucket;
+         listEntry = nextEntry) {
+      PDOKAN_SECURITY_CACHE_ENTRY entry = CONTAINING_RECORD(
+          listEntry, DOKAN_SECURITY_CACHE_ENTRY, HashListEntry);
+      nextEntry = listEntry->Flink;
+
+      if (entry->Hash == hash &&
+          DokanCachePathEqual(entry->Path, entry->PathLength, FileName,
+                              length, TRUE))
+        DokanSecurityCacheRemove(cache, entry);
+    }
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+}
+
+// FileName was created, deleted, renamed or modified: forget what is cached
+// about its parent directory, and about FileName and everything under it
+// when Subtree is TRUE
+VOID DokanCacheInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                          BOOL Subtree) {
+  PDOKAN_DIRECTORY_CACHE cache = &DokanInstance->DirectoryCache;
+  PDOKAN_ATTRIBUTE_CACHE attributeCache = &DokanInstance->AttributeCache;
+  ULONG parentLength;
+  ULONG length;
+  ULONG baseLength;
+  ULONG hash;
+  PLIST_ENTRY bucket, listEntry, nextEntry;
+
+  DokanSecurityCacheInvalidate(DokanInstance, FileName, Subtree);
+  DokanDataChanged(DokanInstance, FileName);
+  DokanBlockCacheInvalidate(DokanInstance, FileName, Subtree);
+  DokanFlightInvalidate(DokanInstance, FileName, Subtree);
+
+  if (DokanInstance->DokanOptions->DirectoryCacheTimeout == 0 &&
+      DokanInstance->DokanOptions->AttributeCacheTimeout == 0 &&
+      DokanInstance->DokanOptions->NegativeCacheTimeout == 0)
+    return;
+
+  parentLength = DokanCacheParentLength(FileName);
+  length = DokanCachePathLength(FileName);
+  hash = DokanCacheHash(FileName, parentLength);
+
+  InterlockedIncrement(&DokanInstance->CacheGeneration);
+
+  EnterCriticalSection(&cache->Lock);
+
+  bucket = &cache->Buckets[hash % DOKAN_DIRECTORY_CACHE_BUCKETS];
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = nextEntry) {
+    PDOKAN_DIRECTORY_CACHE_ENTRY entry = CONTAINING_RECORD(
+        listEntry, DOKAN_DIRECTORY_CACHE_ENTRY, HashListEntry);
+    nextEntry = listEntry->Flink;
+
+    if (entry->Hash == hash &&
+        DokanCachePathEqual(entry->Path, entry->PathLength, FileName,
+                            parentLength, TRUE))
+      DokanDirectoryCacheRemove(cache, entry);
+  }
+
+  if (Subtree) {
+    for (listEntry = cache->LruList.Flink; listEntry != &cache->LruList;
+         listEntry = nextEntry) {
+      PDOKAN_DIRECTORY_CACHE_ENTRY entry = CONTAINING_RECORD(
+          listEntry, DOKAN_DIRECTORY_CACHE_ENTRY, LruListEntry);
+      nextEntry = listEntry->Flink;
+
+      if (entry->PathLength >= length &&
+          _wcsnicmp(entry->Path, FileName, length) == 0 &&
+          (entry->PathLength == length || entry->Path[length] == L'\\'))
+        DokanDirectoryCacheRemove(cache, entry);
+    }
+  }
+
+  LeaveCriticalSection(&cache->Lock);
+
+  // the file and the times of its parent directory, or their absence
+  EnterCriticalSection(&attributeCache->Lock);
+
+  DokanAttributeCacheDrop(attributeCache, FileName, length);
+  DokanAttributeCacheDrop(attributeCache, FileName, parentLength);
+  // and the streams of the file when FileName is one of them
+  baseLength = DokanCacheStreamBaseLength(FileName, length);
+  if (baseLength != length)
+    DokanAttributeCacheDrop(attributeCache, FileName, baseLength);
+
+  if (Subtree) {
+    for (listEntry = attributeCache->LruList.Flink;
+         listEntry != &attributeCache->LruList; listEntry = nextEntry) {
+      PDOKAN_ATTRIBUTE_CACHE_ENTRY entry = CONTAINING_RECORD(
+          listEntry, DOKAN_ATTRIBUTE_CACHE_ENTRY, LruListEntry);
+      nextEntry = listEntry->Flink;
+
+      if (entry->PathLength > length &&
+          _wcsnicmp(entry->Path, FileName, length) == 0 &&
+          entry->Path[length] == L'\\')
+        DokanAttributeCacheRemove(attributeCache, entry);
+    }
+  }
+
+  LeaveCriticalSection(&attributeCache->Lock);
+}
+
+BOOL DOKANAPI DokanGetCacheStatistics(PDOKAN_OPTIONS DokanOptions,
+                                      PDOKAN_CACHE_STATISTICS Statistics) {
+  PLIST_ENTRY listEntry;
+  BOOL found = FALSE;
+
+  ZeroMemory(Statistics, sizeof(DOKAN_CACHE_STATISTICS));
+
+  EnterCriticalSection(&g_InstanceCriticalSection);
+
+  for (listEntry = g_InstanceList.Flink; listEntry != &g_InstanceList;
+       listEntry = listEntry->Flink) {
+    PDOKAN_INSTANCE instance =
+        CONTAINING_RECORD(listEntry, DOKAN_INSTANCE, ListEntry);
+    PDOKAN_DIRECTORY_CACHE cache = &instance->DirectoryCache;
+    PDOKAN_ATTRIBUTE_CACHE attributeCache = &instance->AttributeCache;
+
+    if (instance->UserOptions != DokanOptions)
+      continue;
+
+    EnterCriticalSection(&cache->Lock);
+    Statistics->DirectoryCacheHits = cache->Hits;
+    Statistics->DirectoryCacheMisses = cache->Misses;
+    Statistics->DirectoryCacheSize = cache->Size;
+    LeaveCriticalSection(&cache->Lock);
+
+    EnterCriticalSection(&attributeCache->Lock);
+    Statistics->AttributeCacheHits = attributeCache->Hits;
+    Statistics->AttributeCacheMisses = attributeCache->Misses;
+    Statistics->AttributeCacheCount = attributeCache->Count;
+    Statistics->NegativeCacheHits = attributeCache->NegativeHits;
+    Statistics->NegativeCacheMisses = attributeCache->NegativeMisses;
+    LeaveCriticalSection(&attributeCache->Lock);
+
+    EnterCriticalSection(&instance->SecurityCache.Lock);
+    Statistics->SecurityCacheHits = instance->SecurityCache.Hits;
+    Statistics->SecurityCacheMisses = instance->SecurityCache.Misses;
+    Statistics->SecurityCacheSize = instance->SecurityCache.Size;
+    LeaveCriticalSection(&instance->SecurityCache.Lock);
+
+    EnterCriticalSection(&instance->HandlePool.Lock);
+    Statistics->HandlePoolHits = instance->HandlePool.Hits;
+    Statistics->HandlePoolMisses = instance->HandlePool.Misses;
+    Statistics->HandlePoolCount = instance->HandlePool.Count;
+    LeaveCriticalSection(&instance->HandlePool.Lock);
+
+    EnterCriticalSection(&instance->BlockCache.Lock);
+    Statistics->BlockCacheHits = instance->BlockCache.Hits;
+    Statistics->BlockCacheMisses = instance->BlockCache.Misses;
+    Statistics->BlockCacheEvictions = instance->BlockCache.Evictions;
+    Statistics->BlockCacheSize = instance->BlockCache.Size;
+    LeaveCriticalSection(&instance->BlockCache.Lock);
+
+    found = TRUE;
+    break;
+  }
+
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+
+  return found;
+}
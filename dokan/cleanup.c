@@ -37,14 +37,49 @@ VOID DispatchCleanup(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   DbgPrint("###Cleanup %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->Cleanup) {
+  // stop reading ahead before the FileSystem closes the file, and wait for
+  // the requests of other handles using it
+  if (openInfo != NULL) {
+    DokanReadAheadClose(openInfo);
+    EnterCriticalSection(&openInfo->CleanupLock);
+    openInfo->CleanedUp = TRUE;
+  }
+
+  // the status of a cleanup is not returned by CloseHandle, a failure of the
+  // buffered writes not reported to a flush or write before is lost
+  DokanWriteBehindFlushFile(DokanInstance,
+                            EventContext->Operation.Cleanup.FileName, NULL);
+  if (openInfo != NULL) {
+    NTSTATUS writeBehindStatus = DokanWriteBehindTakeError(openInfo);
+    if (writeBehindStatus != STATUS_SUCCESS)
+      DbgPrintW(L"  write behind error %lx of %s dropped at cleanup\n",
+                writeBehindStatus, EventContext->Operation.Cleanup.FileName);
+    fileInfo.Context = openInfo->UserContext;
+  }
+
+  // a handle to delete is not pooled
+  if (openInfo != NULL && openInfo->PoolSid != NULL && fileInfo.DeleteOnClose) {
+    free(openInfo->PoolSid);
+    openInfo->PoolSid = NULL;
+  }
+
+  // the Cleanup of a handle which can be pooled is called by DispatchClose
+  // or when it leaves the pool
+  if (DokanInstance->DokanOperations->Cleanup &&
+      (openInfo == NULL || openInfo->PoolSid == NULL)) {
     // ignore return value
     DokanInstance->DokanOperations->Cleanup(
         EventContext->Operation.Cleanup.FileName, &fileInfo);
   }
 
-  if (openInfo != NULL)
+  if (openInfo != NULL) {
     openInfo->UserContext = fileInfo.Context;
+    LeaveCriticalSection(&openInfo->CleanupLock);
+  }
+
+  if (fileInfo.DeleteOnClose)
+    DokanCacheInvalidate(DokanInstance, EventContext->Operation.Cleanup.FileName,
+                         fileInfo.IsDirectory);
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
 
@@ -39,10 +39,29 @@ VOID DispatchClose(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   DbgPrint("###Close %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->CloseFile) {
-    // ignore return value
-    DokanInstance->DokanOperations->CloseFile(
-        EventContext->Operation.Close.FileName, &fileInfo);
+  // flushed by the Cleanup already, unless written since
+  if (openInfo != NULL) {
+    DokanWriteBehindClose(openInfo, DokanInstance);
+    fileInfo.Context = openInfo->UserContext;
+  }
+
+  if (openInfo != NULL && openInfo->PoolSid != NULL &&
+      DokanHandlePoolAdd(DokanInstance, EventContext->Operation.Close.FileName,
+                         openInfo, &fileInfo)) {
+    DbgPrint("  handle pooled\n");
+  } else {
+    // Cleanup was deferred by DispatchCleanup
+    if (openInfo != NULL && openInfo->PoolSid != NULL &&
+        DokanInstance->DokanOperations->Cleanup) {
+      DokanInstance->DokanOperations->Cleanup(
+          EventContext->Operation.Close.FileName, &fileInfo);
+    }
+
+    if (DokanInstance->DokanOperations->CloseFile) {
+      // ignore return value
+      DokanInstance->DokanOperations->CloseFile(
+          EventContext->Operation.Close.FileName, &fileInfo);
+    }
   }
 
   // do not send it to the driver
@@ -104,6 +104,10 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
   BOOL childExisted = TRUE;
   WCHAR *origFileName = NULL;
   DWORD origOptions;
+  BOOL mustExist;
+  ULONG generation;
+  BOOL readOnly;
+  PSID poolSid = NULL;
 
   fileName = (WCHAR *)((char *)&EventContext->Operation.Create +
                        EventContext->Operation.Create.FileNameOffset);
@@ -117,7 +121,7 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
   eventInfo.SerialNumber = EventContext->SerialNumber;
 
   fileInfo.ProcessId = EventContext->ProcessId;
-  fileInfo.DokanOptions = DokanInstance->DokanOptions;
+  fileInfo.DokanOptions = DokanInstance->UserOptions;
 
   // DOKAN_OPEN_INFO is structure for a opened file
   // this will be freed by Close
@@ -128,6 +132,7 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
     return;
   }
   ZeroMemory(openInfo, sizeof(DOKAN_OPEN_INFO));
+  InitializeCriticalSection(&openInfo->CleanupLock);
   openInfo->OpenCount = 2;
   openInfo->EventContext = EventContext;
   openInfo->DokanInstance = DokanInstance;
@@ -229,9 +234,42 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
     // ERROR_ALREADY_EXISTS
     SetLastError(ERROR_SUCCESS);
 
+    // only these dispositions fail on a file that does not exist
+    mustExist = (disposition == FILE_OPEN || disposition == FILE_OVERWRITE) &&
+                !(EventContext->Flags & SL_OPEN_TARGET_DIRECTORY);
+    generation = (ULONG)DokanInstance->CacheGeneration;
+
+    readOnly = DokanHandlePoolIsReadOnly(
+        ioSecurityContext.DesiredAccess,
+        EventContext->Operation.Create.ShareAccess, disposition);
+
+    // a read-only open of a file can reuse a pooled handle, and is pooled
+    // on close, other opens may conflict with the pooled handles
+    if (DokanInstance->DokanOptions->HandlePoolTimeout != 0) {
+      if (readOnly && disposition == FILE_OPEN &&
+          !(EventContext->Flags & SL_OPEN_TARGET_DIRECTORY) &&
+          !(options & (FILE_DIRECTORY_FILE | FILE_DELETE_ON_CLOSE)))
+        poolSid = DokanGetRequestorSid(&fileInfo);
+      else if (!readOnly)
+        DokanHandlePoolEvict(DokanInstance, fileName, TRUE);
+    }
+
+    // buffered writes must not land on the truncated file
+    if (disposition == FILE_OVERWRITE || disposition == FILE_OVERWRITE_IF ||
+        disposition == FILE_SUPERSEDE)
+      DokanWriteBehindFlushFile(DokanInstance, fileName, NULL);
+
     if (options & FILE_NON_DIRECTORY_FILE && options & FILE_DIRECTORY_FILE)
       status = STATUS_INVALID_PARAMETER;
-    else
+    else if (mustExist && DokanNegativeCacheLookup(DokanInstance, fileName))
+      status = STATUS_OBJECT_NAME_NOT_FOUND;
+    else if (poolSid != NULL &&
+             DokanHandlePoolTake(DokanInstance, fileName,
+                                 ioSecurityContext.DesiredAccess,
+                                 EventContext->Operation.Create.ShareAccess,
+                                 options, poolSid, &fileInfo))
+      status = STATUS_SUCCESS;
+    else {
       // This should call SetLastError(ERROR_ALREADY_EXISTS) when appropriate
       status = DokanInstance->DokanOperations->ZwCreateFile(
           fileName, &ioSecurityContext, ioSecurityContext.DesiredAccess,
@@ -239,6 +277,19 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
           EventContext->Operation.Create.ShareAccess, disposition, options,
           &fileInfo);
 
+      if (mustExist && status == STATUS_OBJECT_NAME_NOT_FOUND)
+        DokanNegativeCacheInsert(DokanInstance, fileName, generation);
+    }
+
+    if (poolSid != NULL && status == STATUS_SUCCESS && !fileInfo.IsDirectory) {
+      openInfo->PoolSid = poolSid;
+      openInfo->PoolDesiredAccess = ioSecurityContext.DesiredAccess;
+      openInfo->PoolShareAccess = EventContext->Operation.Create.ShareAccess;
+      openInfo->PoolCreateOptions = options;
+    } else if (poolSid != NULL) {
+      free(poolSid);
+    }
+
     lastError = GetLastError();
     if (status == STATUS_SUCCESS) {
       if (!childExisted) {
@@ -251,6 +302,7 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
 
   // save the information about this access in DOKAN_OPEN_INFO
   openInfo->IsDirectory = fileInfo.IsDirectory;
+  openInfo->CreateOptions = options;
   openInfo->UserContext = fileInfo.Context;
 
   // FILE_CREATED
@@ -330,6 +382,11 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
 
     if (fileInfo.IsDirectory)
       eventInfo.Operation.Create.Flags |= DOKAN_FILE_DIRECTORY;
+
+    // the file was created or truncated, cached listings are out of date
+    if (eventInfo.Operation.Create.Information != FILE_OPENED ||
+        disposition == FILE_OVERWRITE || disposition == FILE_SUPERSEDE)
+      DokanCacheInvalidate(DokanInstance, fileName, FALSE);
   }
 
   if (origFileName)
@@ -27,194 +27,220 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 typedef ULONG ULONG_PTR;
 #endif
 
-typedef struct _DOKAN_FIND_DATA {
-  WIN32_FIND_DATAW FindData;
-  LIST_ENTRY ListEntry;
-} DOKAN_FIND_DATA, *PDOKAN_FIND_DATA;
-
 VOID DokanFillDirInfo(PFILE_DIRECTORY_INFORMATION Buffer,
-                      PWIN32_FIND_DATAW FindData, ULONG Index,
+                      PDOKAN_FIND_DATA FindData, ULONG Index,
                       PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = FindData->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.HighPart = FindData->FileSizeHigh;
+  Buffer->EndOfFile.LowPart = FindData->FileSizeLow;
+  Buffer->AllocationSize.HighPart = FindData->FileSizeHigh;
+  Buffer->AllocationSize.LowPart = FindData->FileSizeLow;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = FindData->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = FindData->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = FindData->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = FindData->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
 }
 
 VOID DokanFillFullDirInfo(PFILE_FULL_DIR_INFORMATION Buffer,
-                          PWIN32_FIND_DATAW FindData, ULONG Index,
+                          PDOKAN_FIND_DATA FindData, ULONG Index,
                           PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = FindData->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.HighPart = FindData->FileSizeHigh;
+  Buffer->EndOfFile.LowPart = FindData->FileSizeLow;
+  Buffer->AllocationSize.HighPart = FindData->FileSizeHigh;
+  Buffer->AllocationSize.LowPart = FindData->FileSizeLow;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = FindData->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = FindData->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = FindData->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = FindData->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
 }
 
 VOID DokanFillIdFullDirInfo(PFILE_ID_FULL_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
+                            PDOKAN_FIND_DATA FindData, ULONG Index,
                             PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = FindData->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.HighPart = FindData->FileSizeHigh;
+  Buffer->EndOfFile.LowPart = FindData->FileSizeLow;
+  Buffer->AllocationSize.HighPart = FindData->FileSizeHigh;
+  Buffer->AllocationSize.LowPart = FindData->FileSizeLow;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = FindData->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = FindData->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = FindData->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = FindData->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
-  Buffer->FileId.QuadPart = 0;
+  Buffer->FileId.QuadPart = FindData->FileId;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
+}
+
+VOID DokanFillIdExtdDirInfo(PFILE_ID_EXTD_DIR_INFORMATION Buffer,
+                            PDOKAN_FIND_DATA FindData, ULONG Index,
+                            PDOKAN_INSTANCE DokanInstance) {
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
+
+  Buffer->FileIndex = Index;
+  Buffer->FileAttributes = FindData->FileAttributes;
+  Buffer->FileNameLength = nameBytes;
+
+  Buffer->EndOfFile.HighPart = FindData->FileSizeHigh;
+  Buffer->EndOfFile.LowPart = FindData->FileSizeLow;
+  Buffer->AllocationSize.HighPart = FindData->FileSizeHigh;
+  Buffer->AllocationSize.LowPart = FindData->FileSizeLow;
+  ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
+
+  Buffer->CreationTime.HighPart = FindData->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = FindData->CreationTime.dwLowDateTime;
+
+  Buffer->LastAccessTime.HighPart = FindData->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = FindData->LastAccessTime.dwLowDateTime;
+
+  Buffer->LastWriteTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
+
+  Buffer->ChangeTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
+
+  Buffer->EaSize = 0;
+  Buffer->ReparsePointTag = FindData->ReparseTag;
+
+  // the 64-bit id in the low part of the 128-bit one, as NTFS does
+  ZeroMemory(Buffer->FileId.Identifier, sizeof(Buffer->FileId.Identifier));
+  RtlCopyMemory(Buffer->FileId.Identifier, &FindData->FileId,
+                sizeof(FindData->FileId));
+
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
 }
 
 VOID DokanFillIdBothDirInfo(PFILE_ID_BOTH_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
+                            PDOKAN_FIND_DATA FindData, ULONG Index,
                             PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = FindData->FileAttributes;
   Buffer->FileNameLength = nameBytes;
   Buffer->ShortNameLength = 0;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.HighPart = FindData->FileSizeHigh;
+  Buffer->EndOfFile.LowPart = FindData->FileSizeLow;
+  Buffer->AllocationSize.HighPart = FindData->FileSizeHigh;
+  Buffer->AllocationSize.LowPart = FindData->FileSizeLow;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = FindData->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = FindData->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = FindData->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = FindData->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
-  Buffer->FileId.QuadPart = 0;
+  Buffer->FileId.QuadPart = FindData->FileId;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
 }
 
 VOID DokanFillBothDirInfo(PFILE_BOTH_DIR_INFORMATION Buffer,
-                          PWIN32_FIND_DATAW FindData, ULONG Index,
+                          PDOKAN_FIND_DATA FindData, ULONG Index,
                           PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = FindData->FileAttributes;
   Buffer->FileNameLength = nameBytes;
   Buffer->ShortNameLength = 0;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.HighPart = FindData->FileSizeHigh;
+  Buffer->EndOfFile.LowPart = FindData->FileSizeLow;
+  Buffer->AllocationSize.HighPart = FindData->FileSizeHigh;
+  Buffer->AllocationSize.LowPart = FindData->FileSizeLow;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = FindData->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = FindData->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = FindData->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = FindData->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = FindData->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = FindData->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
 }
 
 VOID DokanFillNamesInfo(PFILE_NAMES_INFORMATION Buffer,
-                        PWIN32_FIND_DATAW FindData, ULONG Index) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+                        PDOKAN_FIND_DATA FindData, ULONG Index) {
+  ULONG nameBytes = FindData->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
   Buffer->FileNameLength = nameBytes;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, FindData->FileName, nameBytes);
 }
 
-ULONG
-DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
-                              PVOID Buffer, PULONG LengthRemaining,
-                              PWIN32_FIND_DATAW FindData, ULONG Index,
-                              PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes;
-  ULONG thisEntrySize;
-
-  nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  thisEntrySize = nameBytes;
+// size of the record of DirectoryInfo for a name of NameBytes
+ULONG DokanDirectoryRecordSize(FILE_INFORMATION_CLASS DirectoryInfo,
+                               ULONG NameBytes) {
+  ULONG thisEntrySize = NameBytes;
 
   switch (DirectoryInfo) {
   case FileDirectoryInformation:
@@ -232,12 +258,27 @@ DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
   case FileIdBothDirectoryInformation:
     thisEntrySize += sizeof(FILE_ID_BOTH_DIR_INFORMATION);
     break;
+  case FileIdFullDirectoryInformation:
+    thisEntrySize += sizeof(FILE_ID_FULL_DIR_INFORMATION);
+    break;
+  case FileIdExtdDirectoryInformation:
+    thisEntrySize += sizeof(FILE_ID_EXTD_DIR_INFORMATION);
+    break;
   default:
     break;
   }
 
   // Must be align on a 8-byte boundary.
-  thisEntrySize = QuadAlign(thisEntrySize);
+  return QuadAlign(thisEntrySize);
+}
+
+ULONG
+DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
+                              PVOID Buffer, PULONG LengthRemaining,
+                              PDOKAN_FIND_DATA FindData, ULONG Index,
+                              PDOKAN_INSTANCE DokanInstance) {
+  ULONG thisEntrySize = DokanDirectoryRecordSize(
+      DirectoryInfo, FindData->FileNameLength * sizeof(WCHAR));
 
   // no more memory, don't fill any more
   if (*LengthRemaining < thisEntrySize) {
@@ -263,6 +304,12 @@ DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
   case FileIdBothDirectoryInformation:
     DokanFillIdBothDirInfo(Buffer, FindData, Index, DokanInstance);
     break;
+  case FileIdFullDirectoryInformation:
+    DokanFillIdFullDirInfo(Buffer, FindData, Index, DokanInstance);
+    break;
+  case FileIdExtdDirectoryInformation:
+    DokanFillIdExtdDirInfo(Buffer, FindData, Index, DokanInstance);
+    break;
   default:
     break;
   }
@@ -272,57 +319,96 @@ DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
   return thisEntrySize;
 }
 
-int DokanFillFileDataEx(PWIN32_FIND_DATAW FindData, PDOKAN_FILE_INFO FileInfo,
-                        BOOLEAN InsertTail) {
-  PLIST_ENTRY listHead =
-      ((PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext)->DirListHead;
-  PDOKAN_FIND_DATA findData;
+int DokanFillFileDataEx(PWIN32_FIND_DATAW FindData, ULONG64 FileId,
+                        PDOKAN_FILE_INFO FileInfo, BOOLEAN InsertTail) {
+  PDOKAN_OPEN_INFO openInfo =
+      (PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext;
 
-  findData = (PDOKAN_FIND_DATA)malloc(sizeof(DOKAN_FIND_DATA));
-  if (findData == NULL) {
-    return 0;
-  }
-  ZeroMemory(findData, sizeof(DOKAN_FIND_DATA));
-  InitializeListHead(&findData->ListEntry);
+  // the list changes, so the position saved by MatchFiles is no longer valid
+  openInfo->DirListCursorValid = FALSE;
 
-  findData->FindData = *FindData;
+  if (!DokanFindDataArenaAppend(&openInfo->DirList, FindData, FileId,
+                                InsertTail))
+    return 1;
 
-  if (InsertTail)
-    InsertTailList(listHead, &findData->ListEntry);
-  else
-    InsertHeadList(listHead, &findData->ListEntry);
+  // FindFilesPaged has filled the page
+  if (openInfo->DirListPageCount != 0 &&
+      openInfo->DirList.Count >= openInfo->DirListPageCount)
+    return 1;
   return 0;
 }
 
 int WINAPI DokanFillFileData(PWIN32_FIND_DATAW FindData,
                              PDOKAN_FILE_INFO FileInfo) {
-  return DokanFillFileDataEx(FindData, FileInfo, TRUE);
+  return DokanFillFileDataEx(FindData, 0, FileInfo, TRUE);
+}
+
+int DOKANAPI DokanFillFileDataWithId(PWIN32_FIND_DATAW FindData,
+                                     ULONG64 FileId,
+                                     PDOKAN_FILE_INFO DokanFileInfo) {
+  return DokanFillFileDataEx(FindData, FileId, DokanFileInfo, TRUE);
 }
 
-VOID ClearFindData(PLIST_ENTRY ListHead) {
-  // free all list entries
-  while (!IsListEmpty(ListHead)) {
-    PLIST_ENTRY entry = RemoveHeadList(ListHead);
-    PDOKAN_FIND_DATA find =
-        CONTAINING_RECORD(entry, DOKAN_FIND_DATA, ListEntry);
-    free(find);
+int DOKANAPI DokanFillFileDataArray(PWIN32_FIND_DATAW FindData, ULONG Count,
+                                    PDOKAN_FILE_INFO DokanFileInfo) {
+  PDOKAN_OPEN_INFO openInfo =
+      (PDOKAN_OPEN_INFO)(UINT_PTR)DokanFileInfo->DokanContext;
+  PDOKAN_FIND_DATA_ARENA arena = &openInfo->DirList;
+  ULONG i;
+
+  openInfo->DirListCursorValid = FALSE;
+
+  // most names are short, reserve room for them at once
+  if (!DokanFindDataArenaReserve(
+          arena, (SIZE_T)Count * QuadAlign(sizeof(DOKAN_FIND_DATA) +
+                                           32 * sizeof(WCHAR))))
+    return 1;
+
+  for (i = 0; i < Count; ++i) {
+    if (!DokanFindDataArenaAppend(arena, &FindData[i], 0, TRUE))
+      return 1;
   }
+
+  if (openInfo->DirListPageCount != 0 &&
+      arena->Count >= openInfo->DirListPageCount)
+    return 1;
+  return 0;
+}
+
+// forget the listing of the handle, the next query will start a new one
+VOID ResetFindData(PDOKAN_OPEN_INFO OpenInfo) {
+  ClearFindData(&OpenInfo->DirList);
+  OpenInfo->DirListCursorValid = FALSE;
+  OpenInfo->DirListPaged = FALSE;
+  OpenInfo->DirListEnd = FALSE;
+  OpenInfo->DirListBaseIndex = 0;
+  OpenInfo->DirListPageCount = 0;
+  OpenInfo->DirListCookie = 0;
 }
 
 // add entry which matches the pattern specifed in EventContext
 // to the buffer specifed in EventInfo
 //
+// The position reached is saved in DokanOpenInfo so that the next sequential
+// query resumes from there instead of matching the list from its head again.
+//
 LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
-                PLIST_ENTRY FindDataList, BOOLEAN PatternCheck,
+                PDOKAN_OPEN_INFO DokanOpenInfo, BOOLEAN PatternCheck,
                 PDOKAN_INSTANCE DokanInstance) {
-  PLIST_ENTRY thisEntry, listHead, nextEntry;
+  PDOKAN_FIND_DATA_ARENA findDataList = &DokanOpenInfo->DirList;
+  PDOKAN_FIND_DATA find;
+  DOKAN_FIND_DATA_CURSOR cursor;
 
   ULONG lengthRemaining = EventInfo->BufferLength;
   PVOID currentBuffer = EventInfo->Buffer;
   PVOID lastBuffer = currentBuffer;
-  ULONG index = 0;
 
   PWCHAR pattern = NULL;
+  DOKAN_EXPRESSION compiled;
+  PDOKAN_EXPRESSION expression = &compiled;
+
+  cursor.Offset = 0;
+  cursor.Index = DokanOpenInfo->DirListBaseIndex;
 
   // search patten is specified
   if (PatternCheck &&
@@ -330,59 +416,76 @@ LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
     pattern = (PWCHAR)(
         (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
         (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
-  }
-
-  listHead = FindDataList;
 
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
+    // the pattern of a handle does not change, compile it once
+    if (DokanOpenInfo->DirListPattern == NULL ||
+        wcscmp(DokanOpenInfo->DirListPattern, pattern) != 0) {
+      if (DokanOpenInfo->DirListPattern != NULL)
+        free(DokanOpenInfo->DirListPattern);
+      DokanOpenInfo->DirListPattern = _wcsdup(pattern);
+      if (DokanOpenInfo->DirListPattern != NULL)
+        DokanCompileExpression(&DokanOpenInfo->DirListExpression,
+                               DokanOpenInfo->DirListPattern, TRUE);
+    }
+    if (DokanOpenInfo->DirListPattern != NULL)
+      expression = &DokanOpenInfo->DirListExpression;
+    else
+      DokanCompileExpression(&compiled, pattern, TRUE);
+  }
 
-    PDOKAN_FIND_DATA find;
-    nextEntry = thisEntry->Flink;
+  // continue where the previous query stopped
+  if (DokanOpenInfo->DirListCursorValid &&
+      !(EventContext->Flags & (SL_INDEX_SPECIFIED | SL_RESTART_SCAN)) &&
+      DokanOpenInfo->DirListCursor.Index ==
+          EventContext->Operation.Directory.FileIndex) {
+    DbgPrint("  resume from index %d\n", DokanOpenInfo->DirListCursor.Index);
+    cursor = DokanOpenInfo->DirListCursor;
+  }
 
-    find = CONTAINING_RECORD(thisEntry, DOKAN_FIND_DATA, ListEntry);
+  // pattern is not specified or pattern match is ignore cases
+  while ((find = DokanFindDataSeek(findDataList, &cursor,
+                                   pattern ? expression : NULL)) != NULL) {
 
-    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", find->FindData.cFileName,
+    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", find->FileName,
               (pattern ? pattern : L"null"),
-              EventContext->Operation.Directory.FileIndex, index);
+              EventContext->Operation.Directory.FileIndex, cursor.Index);
+
+    if (EventContext->Operation.Directory.FileIndex <= cursor.Index) {
+      // index+1 is very important, should use next entry index
+      ULONG entrySize = DokanFillDirectoryInformation(
+          EventContext->Operation.Directory.FileInformationClass,
+          currentBuffer, &lengthRemaining, find, cursor.Index + 1,
+          DokanInstance);
+      // buffer is full
+      if (entrySize == 0)
+        break;
+
+      // pointer of the current last entry
+      lastBuffer = currentBuffer;
+
+      // end if needs to return single entry
+      if (EventContext->Flags & SL_RETURN_SINGLE_ENTRY) {
+        DbgPrint("  =>return single entry\n");
+        DokanFindDataSkip(findDataList, &cursor);
+        break;
+      }
 
-    // pattern is not specified or pattern match is ignore cases
-    if (!pattern ||
-        DokanIsNameInExpression(pattern, find->FindData.cFileName, TRUE)) {
+      DbgPrint("  =>return\n");
 
-      if (EventContext->Operation.Directory.FileIndex <= index) {
-        // index+1 is very important, should use next entry index
-        ULONG entrySize = DokanFillDirectoryInformation(
-            EventContext->Operation.Directory.FileInformationClass,
-            currentBuffer, &lengthRemaining, &find->FindData, index + 1,
-            DokanInstance);
-        // buffer is full
-        if (entrySize == 0)
-          break;
-
-        // pointer of the current last entry
-        lastBuffer = currentBuffer;
-
-        // end if needs to return single entry
-        if (EventContext->Flags & SL_RETURN_SINGLE_ENTRY) {
-          DbgPrint("  =>return single entry\n");
-          index++;
-          break;
-        }
-
-        DbgPrint("  =>return\n");
-
-        // the offset of next entry
-        ((PFILE_BOTH_DIR_INFORMATION)currentBuffer)->NextEntryOffset =
-            entrySize;
-
-        // next buffer position
-        currentBuffer = (PCHAR)currentBuffer + entrySize;
-      }
-      index++;
+      // the offset of next entry
+      ((PFILE_BOTH_DIR_INFORMATION)currentBuffer)->NextEntryOffset =
+          entrySize;
+
+      // next buffer position
+      currentBuffer = (PCHAR)currentBuffer + entrySize;
     }
+    DokanFindDataSkip(findDataList, &cursor);
   }
 
+  // the cursor is on the first entry that has not been returned yet
+  DokanOpenInfo->DirListCursor = cursor;
+  DokanOpenInfo->DirListCursorValid = TRUE;
+
   // Since next of the last entry doesn't exist, clear next offset
   ((PFILE_BOTH_DIR_INFORMATION)lastBuffer)->NextEntryOffset = 0;
 
@@ -391,16 +494,55 @@ LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
       EventContext->Operation.Directory.BufferLength - lengthRemaining;
 
   // NO_MORE_FILES
-  if (index <= EventContext->Operation.Directory.FileIndex)
+  if (cursor.Index <= EventContext->Operation.Directory.FileIndex)
     return -1;
 
-  return index;
+  return cursor.Index;
+}
+
+// answer a query whose pattern is a file name with FindFileByName,
+// STATUS_NOT_IMPLEMENTED is returned when the directory has to be listed
+NTSTATUS DokanFindFileByName(PEVENT_CONTEXT EventContext,
+                             PDOKAN_FILE_INFO DokanFileInfo,
+                             PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_EXPRESSION compiled;
+  WIN32_FIND_DATAW findData;
+  PWCHAR pattern;
+  NTSTATUS status;
+
+  if (EventContext->Operation.Directory.SearchPatternLength == 0)
+    return STATUS_NOT_IMPLEMENTED;
+
+  pattern = (PWCHAR)(
+      (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
+      (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
+
+  DokanCompileExpression(&compiled, pattern, TRUE);
+  if (compiled.Type != DOKAN_EXPRESSION_LITERAL ||
+      compiled.LiteralLength >= MAX_PATH || wcscmp(pattern, L".") == 0 ||
+      wcscmp(pattern, L"..") == 0)
+    return STATUS_NOT_IMPLEMENTED;
+
+  DbgPrint("###FindFileByName %04d\n",
+           ((PDOKAN_OPEN_INFO)(UINT_PTR)DokanFileInfo->DokanContext)->EventId);
+
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  status = DokanInstance->DokanOperations->FindFileByName(
+      EventContext->Operation.Directory.DirectoryName, pattern, &findData,
+      DokanFileInfo);
+
+  if (status == STATUS_SUCCESS) {
+    if (findData.cFileName[0] == L'\0')
+      wcscpy_s(findData.cFileName, MAX_PATH, pattern);
+    DokanFillFileData(&findData, DokanFileInfo);
+  }
+  return status;
 }
 
 VOID AddMissingCurrentAndParentFolder(PEVENT_CONTEXT EventContext,
-                                      PLIST_ENTRY FindDataList,
+                                      PDOKAN_FIND_DATA_ARENA FindDataList,
                                       PDOKAN_FILE_INFO fileInfo) {
-  PLIST_ENTRY thisEntry, listHead, nextEntry;
+  SIZE_T offset;
   PWCHAR pattern = NULL;
   BOOLEAN currentFolder = FALSE, parentFolder = FALSE;
   WIN32_FIND_DATAW findData;
@@ -416,21 +558,17 @@ VOID AddMissingCurrentAndParentFolder(PEVENT_CONTEXT EventContext,
       (pattern != NULL && wcscmp(pattern, L"*") != 0))
     return;
 
-  listHead = FindDataList;
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    PDOKAN_FIND_DATA find;
-    nextEntry = thisEntry->Flink;
+  for (offset = 0; offset < FindDataList->Size;
+       offset += DOKAN_FIND_DATA_ENTRY(FindDataList, offset)->EntrySize) {
 
-    find = CONTAINING_RECORD(thisEntry, DOKAN_FIND_DATA, ListEntry);
+    PDOKAN_FIND_DATA find = DOKAN_FIND_DATA_ENTRY(FindDataList, offset);
 
-    if (wcscmp(find->FindData.cFileName, L".") == 0)
+    if (wcscmp(find->FileName, L".") == 0)
       currentFolder = TRUE;
-    if (wcscmp(find->FindData.cFileName, L"..") == 0)
+    if (wcscmp(find->FileName, L"..") == 0)
       parentFolder = TRUE;
-	if (currentFolder == TRUE && parentFolder == TRUE)
-		return; // folders are already there
+    if (currentFolder == TRUE && parentFolder == TRUE)
+      return; // folders are already there
   }
 
   GetSystemTimeAsFileTime(&systime);
@@ -443,14 +581,89 @@ VOID AddMissingCurrentAndParentFolder(PEVENT_CONTEXT EventContext,
   if (!parentFolder) {
     findData.cFileName[0] = '.';
     findData.cFileName[1] = '.';
-    DokanFillFileDataEx(&findData, fileInfo, FALSE);
+    DokanFillFileDataEx(&findData, 0, fileInfo, FALSE);
   }
 
   if (!currentFolder) {
     findData.cFileName[0] = '.';
     findData.cFileName[1] = '\0';
-    DokanFillFileDataEx(&findData, fileInfo, FALSE);
+    DokanFillFileDataEx(&findData, 0, fileInfo, FALSE);
+  }
+}
+
+// get from FindFilesPaged the page of the listing that holds the entry
+// requested by EventContext, the previous page is released first
+NTSTATUS DokanFindFilesPage(PEVENT_CONTEXT EventContext,
+                            PDOKAN_OPEN_INFO DokanOpenInfo,
+                            PDOKAN_FILE_INFO DokanFileInfo,
+                            PDOKAN_INSTANCE DokanInstance) {
+  ULONG fileIndex = EventContext->Operation.Directory.FileIndex;
+  LPCWSTR pattern = L"*";
+  NTSTATUS status = STATUS_SUCCESS;
+
+  // if search pattern is specified
+  if (EventContext->Operation.Directory.SearchPatternLength != 0) {
+    pattern = (PWCHAR)(
+        (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
+        (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
+  }
+
+  // entry is before the current page, the listing has to start again
+  if (fileIndex < DokanOpenInfo->DirListBaseIndex) {
+    DbgPrint("  restart paged listing for index %d\n", fileIndex);
+    ClearFindData(&DokanOpenInfo->DirList);
+    DokanOpenInfo->DirListCursorValid = FALSE;
+    DokanOpenInfo->DirListEnd = FALSE;
+    DokanOpenInfo->DirListBaseIndex = 0;
+    DokanOpenInfo->DirListCookie = 0;
   }
+
+  while (!DokanOpenInfo->DirListEnd &&
+         fileIndex >=
+             DokanOpenInfo->DirListBaseIndex + DokanOpenInfo->DirList.Count) {
+
+    DbgPrint("###FindFilesPaged %04d from %d\n", DokanOpenInfo->EventId,
+             DokanOpenInfo->DirListBaseIndex + DokanOpenInfo->DirList.Count);
+
+    DokanOpenInfo->DirListBaseIndex += DokanOpenInfo->DirList.Count;
+    ClearFindData(&DokanOpenInfo->DirList);
+    DokanOpenInfo->DirListCursorValid = FALSE;
+
+    // as many entries as the buffer of the kernel can hold, with names of
+    // one character, so that a page is always enough to fill it
+    DokanOpenInfo->DirListPageCount =
+        EventContext->Operation.Directory.BufferLength /
+        DokanDirectoryRecordSize(
+            EventContext->Operation.Directory.FileInformationClass,
+            sizeof(WCHAR));
+    if (DokanOpenInfo->DirListPageCount == 0)
+      DokanOpenInfo->DirListPageCount = 1;
+
+    status = DokanInstance->DokanOperations->FindFilesPaged(
+        EventContext->Operation.Directory.DirectoryName, pattern,
+        &DokanOpenInfo->DirListCookie, DokanFillFileData, DokanFileInfo);
+
+    DokanOpenInfo->DirListPageCount = 0;
+
+    if (status == STATUS_NO_MORE_FILES) {
+      DokanOpenInfo->DirListEnd = TRUE;
+      status = STATUS_SUCCESS;
+    }
+    if (status != STATUS_SUCCESS)
+      break;
+
+    // the first page gets them each time it is fetched, so that the
+    // indexes of the entries do not change when the listing restarts
+    if (DokanOpenInfo->DirListBaseIndex == 0)
+      AddMissingCurrentAndParentFolder(EventContext, &DokanOpenInfo->DirList,
+                                       DokanFileInfo);
+
+    // an empty page would never end the loop
+    if (DokanOpenInfo->DirList.Count == 0)
+      DokanOpenInfo->DirListEnd = TRUE;
+  }
+
+  return status;
 }
 
 VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
@@ -464,6 +677,9 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
                           EventContext->Operation.Directory.BufferLength;
 
   BOOLEAN patternCheck = TRUE;
+  LPCWSTR pattern = L"*";
+  ULONG generation;
+  BOOLEAN listed = FALSE;
 
   CheckFileName(EventContext->Operation.Directory.DirectoryName);
 
@@ -475,7 +691,9 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
       fileInfoClass != FileFullDirectoryInformation &&
       fileInfoClass != FileNamesInformation &&
       fileInfoClass != FileIdBothDirectoryInformation &&
-      fileInfoClass != FileBothDirectoryInformation) {
+      fileInfoClass != FileBothDirectoryInformation &&
+      fileInfoClass != FileIdFullDirectoryInformation &&
+      fileInfoClass != FileIdExtdDirectoryInformation) {
 
     DbgPrint("not suported type %d\n", fileInfoClass);
 
@@ -491,46 +709,74 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   // this buffer length is fixed in MatchFiles funciton
   eventInfo->BufferLength = EventContext->Operation.Directory.BufferLength;
 
-  if (openInfo->DirListHead == NULL) {
-    openInfo->DirListHead = malloc(sizeof(LIST_ENTRY));
-    if (openInfo->DirListHead != NULL) {
-      InitializeListHead(openInfo->DirListHead);
-    } else {
-      eventInfo->BufferLength = 0;
-      eventInfo->Status = STATUS_NO_MEMORY;
-      SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-      free(eventInfo);
-      return;
-    }
-  }
-
   if (EventContext->Operation.Directory.FileIndex == 0) {
-    ClearFindData(openInfo->DirListHead);
+    ResetFindData(openInfo);
   }
 
-  if (IsListEmpty(openInfo->DirListHead)) {
+  // read before calling the FileSystem, see DokanDirectoryCacheInsert
+  generation = (ULONG)DokanInstance->CacheGeneration;
+
+  if (openInfo->DirListPaged) {
+    // fetch the page holding the requested entry
+    status = DokanFindFilesPage(EventContext, openInfo, &fileInfo,
+                                DokanInstance);
+    listed = TRUE;
+
+  } else if (openInfo->DirList.Count == 0) {
 
     DbgPrint("###FindFiles %04d\n", openInfo->EventId);
 
+    status = STATUS_NOT_IMPLEMENTED;
+
+    // a pattern without wildcard only needs the entry of that file
+    if (DokanInstance->DokanOperations->FindFileByName) {
+      status = DokanFindFileByName(EventContext, &fileInfo, DokanInstance);
+      if (status != STATUS_NOT_IMPLEMENTED)
+        patternCheck = FALSE;
+    }
+
+    // if user defined FindFilesPaged
+    if (status == STATUS_NOT_IMPLEMENTED &&
+        DokanInstance->DokanOperations->FindFilesPaged) {
+      openInfo->DirListPaged = TRUE;
+      patternCheck = FALSE; // pattern is handled by FindFilesPaged
+
+      status = DokanFindFilesPage(EventContext, openInfo, &fileInfo,
+                                  DokanInstance);
+      if (status == STATUS_NOT_IMPLEMENTED)
+        ResetFindData(openInfo);
+    }
+
+    // if search pattern is specified
+    if (EventContext->Operation.Directory.SearchPatternLength != 0) {
+      pattern = (PWCHAR)(
+          (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
+          (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
+    }
+
+    // a listing of this directory may already be cached by another handle
+    if (status == STATUS_NOT_IMPLEMENTED &&
+        DokanDirectoryCacheLookup(
+            DokanInstance, EventContext->Operation.Directory.DirectoryName,
+            pattern, &openInfo->DirList, &patternCheck)) {
+      status = STATUS_SUCCESS;
+    } else {
+      listed = TRUE;
+    }
+
     // if user defined FindFilesWithPattern
-    if (DokanInstance->DokanOperations->FindFilesWithPattern) {
-      LPCWSTR pattern = L"*";
-
-      // if search pattern is specified
-      if (EventContext->Operation.Directory.SearchPatternLength != 0) {
-        pattern = (PWCHAR)(
-            (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
-            (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
-      }
+    if (status == STATUS_NOT_IMPLEMENTED &&
+        DokanInstance->DokanOperations->FindFilesWithPattern) {
 
       patternCheck = FALSE; // do not recheck pattern later in MatchFiles
 
       status = DokanInstance->DokanOperations->FindFilesWithPattern(
           EventContext->Operation.Directory.DirectoryName, pattern,
           DokanFillFileData, &fileInfo);
-
-    } else {
-      status = STATUS_NOT_IMPLEMENTED;
+      if (status == STATUS_SUCCESS)
+        DokanDirectoryCacheInsert(
+            DokanInstance, EventContext->Operation.Directory.DirectoryName,
+            pattern, &openInfo->DirList, generation);
     }
 
     if (status == STATUS_NOT_IMPLEMENTED &&
@@ -542,9 +788,28 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
       status = DokanInstance->DokanOperations->FindFiles(
           EventContext->Operation.Directory.DirectoryName, DokanFillFileData,
           &fileInfo);
+      if (status == STATUS_SUCCESS)
+        DokanDirectoryCacheInsert(
+            DokanInstance, EventContext->Operation.Directory.DirectoryName,
+            NULL, &openInfo->DirList, generation);
     }
+
+    openInfo->DirListPatternCheck = patternCheck;
+
+    // entries are only added here, so check for "." and ".." once per listing
+    // (a paged listing adds them to its first page in DokanFindFilesPage)
+    if (status == STATUS_SUCCESS && !openInfo->DirListPaged)
+      AddMissingCurrentAndParentFolder(EventContext, &openInfo->DirList,
+                                       &fileInfo);
   }
 
+  // the entries just returned by the FileSystem can answer the file
+  // information queries that usually follow a listing
+  if (status == STATUS_SUCCESS && listed)
+    DokanAttributeCacheSeed(DokanInstance,
+                            EventContext->Operation.Directory.DirectoryName,
+                            &openInfo->DirList, generation);
+
   if (status != STATUS_SUCCESS) {
 
     if (EventContext->Operation.Directory.FileIndex == 0) {
@@ -559,18 +824,15 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
     eventInfo->Operation.Directory.Index =
         EventContext->Operation.Directory.FileIndex;
     // free all of list entries
-    ClearFindData(openInfo->DirListHead);
+    ResetFindData(openInfo);
   } else {
     LONG index;
     eventInfo->Status = STATUS_SUCCESS;
 
-    AddMissingCurrentAndParentFolder(EventContext, openInfo->DirListHead,
-                                     &fileInfo);
-
     DbgPrint("index from %d\n", EventContext->Operation.Directory.FileIndex);
     // extract entries that match search pattern from FindFiles result
-    index = MatchFiles(EventContext, eventInfo, openInfo->DirListHead,
-                       patternCheck, DokanInstance);
+    index = MatchFiles(EventContext, eventInfo, openInfo,
+                       openInfo->DirListPatternCheck, DokanInstance);
 
     // there is no matched file
     if (index < 0) {
@@ -585,7 +847,7 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
       eventInfo->Operation.Directory.Index =
           EventContext->Operation.Directory.FileIndex;
 
-      ClearFindData(openInfo->DirListHead);
+      ResetFindData(openInfo);
 
     } else {
       DbgPrint("index to %d\n", index);
@@ -602,10 +864,6 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   return;
 }
 
-#define DOS_STAR (L'<')
-#define DOS_QM (L'>')
-#define DOS_DOT (L'"')
-
 // check whether Name matches Expression
 // Expression can contain "?"(any one character) and "*" (any string)
 // when IgnoreCase is TRUE, do case insenstive matching
@@ -622,89 +880,8 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
                                       LPCWSTR Name,       // file name
                                       BOOL IgnoreCase) {
-  ULONG ei = 0;
-  ULONG ni = 0;
-
-  while (Expression[ei] != '\0') {
-
-    if (Expression[ei] == L'*') {
-      ei++;
-      if (Expression[ei] == '\0')
-        return TRUE;
-
-      while (Name[ni] != '\0') {
-        if (DokanIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
-          return TRUE;
-        ni++;
-      }
-
-    } else if (Expression[ei] == DOS_STAR) {
-
-      ULONG p = ni;
-      ULONG lastDot = 0;
-      ei++;
-
-      while (Name[p] != '\0') {
-        if (Name[p] == L'.')
-          lastDot = p;
-        p++;
-      }
-
-      BOOL endReached = FALSE;
-      while (!endReached) {
-
-        endReached = (Name[ni] == '\0' || ni == lastDot);
-
-        if (!endReached) {
-          if (DokanIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
-            return TRUE;
-
-          ni++;
-        }
-      }
-
-    } else if (Expression[ei] == DOS_QM) {
-
-      ei++;
-      if (Name[ni] != L'.') {
-        ni++;
-      } else {
-
-        ULONG p = ni + 1;
-        while (Name[p] != '\0') {
-          if (Name[p] == L'.')
-            break;
-          p++;
-        }
-
-        if (Name[p] == L'.')
-          ni++;
-      }
-
-    } else if (Expression[ei] == DOS_DOT) {
-      ei++;
-
-      if (Name[ni] == L'.')
-        ni++;
-
-    } else {
-      if (Expression[ei] == L'?') {
-        ei++;
-        ni++;
-      } else if (IgnoreCase && towupper(Expression[ei]) == towupper(Name[ni])) {
-        ei++;
-        ni++;
-      } else if (!IgnoreCase && Expression[ei] == Name[ni]) {
-        ei++;
-        ni++;
-      } else {
-        return FALSE;
-      }
-    }
-  }
-
-  if (ei == wcslen(Expression) && ni == wcslen(Name))
-    return TRUE;
+  DOKAN_EXPRESSION compiled;
 
-  return FALSE;
+  DokanCompileExpression(&compiled, Expression, IgnoreCase);
+  return DokanMatchExpression(&compiled, Name, (ULONG)wcslen(Name));
 }
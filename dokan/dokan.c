@@ -58,6 +58,14 @@ NewDokanInstance() {
   InitializeCriticalSectionAndSpinCount(&instance->CriticalSection, 0x80000400);
 #endif
 
+  DokanInitCache(instance);
+  DokanInitHandlePool(instance);
+  DokanInitWriteBehind(instance);
+  DokanInitBlockCache(instance);
+  DokanInitReadQueue(instance);
+  DokanInitProcessTable(instance);
+  DokanInitFlights(instance);
+
   InitializeListHead(&instance->ListEntry);
 
   EnterCriticalSection(&g_InstanceCriticalSection);
@@ -69,6 +77,13 @@ NewDokanInstance() {
 
 VOID DeleteDokanInstance(PDOKAN_INSTANCE Instance) {
   DeleteCriticalSection(&Instance->CriticalSection);
+  DokanDeleteCache(Instance);
+  DokanDeleteHandlePool(Instance);
+  DokanDeleteWriteBehind(Instance);
+  DokanDeleteBlockCache(Instance);
+  DokanDeleteReadQueue(Instance);
+  DokanDeleteProcessTable(Instance);
+  DokanDeleteFlights(Instance);
 
   EnterCriticalSection(&g_InstanceCriticalSection);
   RemoveEntryList(&Instance->ListEntry);
@@ -232,8 +247,20 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
 
   DbgPrint("device opened\n");
   instance = NewDokanInstance();
-  instance->DokanOptions = DokanOptions;
-  instance->DokanOperations = DokanOperations;
+  instance->UserOptions = DokanOptions;
+  // an older caller's DOKAN_OPTIONS ends after SectorSize and its
+  // DOKAN_OPERATIONS after FindStreams
+  if (DokanOptions->Version < DOKAN_VERSION_EXTENDED) {
+    RtlCopyMemory(&instance->Options, DokanOptions,
+                  FIELD_OFFSET(DOKAN_OPTIONS, DirectoryCacheTimeout));
+    RtlCopyMemory(&instance->Operations, DokanOperations,
+                  FIELD_OFFSET(DOKAN_OPERATIONS, FindFilesPaged));
+  } else {
+    instance->Options = *DokanOptions;
+    instance->Operations = *DokanOperations;
+  }
+  instance->DokanOptions = &instance->Options;
+  instance->DokanOperations = &instance->Operations;
 
   if (DokanOptions->MountPoint != NULL) {
     wcscpy_s(instance->MountPoint, sizeof(instance->MountPoint) / sizeof(WCHAR),
@@ -261,6 +288,11 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     return DOKAN_START_ERROR;
   }
 
+  if ((DokanOptions->Options & DOKAN_OPTION_PROCESS_ACCOUNTING) &&
+      !DokanStartThrottle(instance)) {
+    DokanDbgPrint("Dokan Error: throttle thread failed to start\n");
+  }
+
   // Start Keep Alive thread
   threadIds[threadNum++] = (HANDLE)_beginthreadex(NULL, // Security Attributes
                                                   0,    // stack size
@@ -304,8 +336,13 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     CloseHandle(threadIds[i]);
   }
 
+  DokanStopThrottle(instance);
+
   CloseHandle(device);
 
+  // the FileSystem gets the Cleanup and CloseFile it was not given yet
+  DokanHandlePoolSweep(instance, TRUE);
+
   if (DokanOperations->Unmounted) {
     DOKAN_FILE_INFO fileInfo;
     RtlZeroMemory(&fileInfo, sizeof(DOKAN_FILE_INFO));
@@ -340,22 +377,75 @@ void ALIGN_ALLOCATION_SIZE(PLARGE_INTEGER size, PDOKAN_OPTIONS DokanOptions) {
       (size->QuadPart + (r > 0 ? DokanOptions->AllocationUnitSize - r : 0));
 }
 
+VOID DokanDispatchEvent(HANDLE Device, PEVENT_CONTEXT EventContext,
+                        PDOKAN_INSTANCE DokanInstance) {
+  switch (EventContext->MajorFunction) {
+  case IRP_MJ_CREATE:
+    DispatchCreate(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_CLEANUP:
+    DispatchCleanup(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_CLOSE:
+    DispatchClose(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_DIRECTORY_CONTROL:
+    DispatchDirectoryInformation(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_READ:
+    DispatchRead(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_WRITE:
+    DispatchWrite(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_INFORMATION:
+    DispatchQueryInformation(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_VOLUME_INFORMATION:
+    DispatchQueryVolumeInformation(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_LOCK_CONTROL:
+    DispatchLock(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_SET_INFORMATION:
+    DispatchSetInformation(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_FLUSH_BUFFERS:
+    DispatchFlush(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_SECURITY:
+    DispatchQuerySecurity(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_SET_SECURITY:
+    DispatchSetSecurity(Device, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_FILE_SYSTEM_CONTROL:
+    DispatchFsControl(Device, EventContext, DokanInstance);
+    break;
+  default:
+    break;
+  }
+}
+
 UINT WINAPI DokanLoop(PDOKAN_INSTANCE DokanInstance) {
   HANDLE device = INVALID_HANDLE_VALUE;
   char *buffer = NULL;
+  ULONG bufferLength;
   BOOL status;
   ULONG returnedLength;
   DWORD result = 0;
   DWORD lastError = 0;
   WCHAR rawDeviceName[MAX_PATH];
 
-  buffer = malloc(sizeof(char) * EVENT_CONTEXT_MAX_SIZE);
+  // sized as negotiated by DokanStart
+  bufferLength = sizeof(char) * DokanInstance->EventContextMaxSize;
+  buffer = malloc(bufferLength);
   if (buffer == NULL) {
     result = (DWORD)-1;
     _endthreadex(result);
     return result;
   }
-  RtlZeroMemory(buffer, sizeof(char) * EVENT_CONTEXT_MAX_SIZE);
+  RtlZeroMemory(buffer, bufferLength);
 
   status = TRUE;
   while (status) {
@@ -388,10 +478,9 @@ UINT WINAPI DokanLoop(PDOKAN_INSTANCE DokanInstance) {
         NULL,             // Input Buffer to driver.
         0,                // Length of input buffer in bytes.
         buffer,           // Output Buffer from driver.
-        sizeof(char) *
-            EVENT_CONTEXT_MAX_SIZE, // Length of output buffer in bytes.
-        &returnedLength,            // Bytes placed in buffer.
-        NULL                        // synchronous call
+        bufferLength,     // Length of output buffer in bytes.
+        &returnedLength,  // Bytes placed in buffer.
+        NULL              // synchronous call
         );
 
     if (!status) {
@@ -419,48 +508,14 @@ UINT WINAPI DokanLoop(PDOKAN_INSTANCE DokanInstance) {
         continue;
       }
 
-      switch (context->MajorFunction) {
-      case IRP_MJ_CREATE:
-        DispatchCreate(device, context, DokanInstance);
-        break;
-      case IRP_MJ_CLEANUP:
-        DispatchCleanup(device, context, DokanInstance);
-        break;
-      case IRP_MJ_CLOSE:
-        DispatchClose(device, context, DokanInstance);
-        break;
-      case IRP_MJ_DIRECTORY_CONTROL:
-        DispatchDirectoryInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_READ:
-        DispatchRead(device, context, DokanInstance);
-        break;
-      case IRP_MJ_WRITE:
-        DispatchWrite(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_INFORMATION:
-        DispatchQueryInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_VOLUME_INFORMATION:
-        DispatchQueryVolumeInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_LOCK_CONTROL:
-        DispatchLock(device, context, DokanInstance);
-        break;
-      case IRP_MJ_SET_INFORMATION:
-        DispatchSetInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_FLUSH_BUFFERS:
-        DispatchFlush(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_SECURITY:
-        DispatchQuerySecurity(device, context, DokanInstance);
-        break;
-      case IRP_MJ_SET_SECURITY:
-        DispatchSetSecurity(device, context, DokanInstance);
-        break;
-      default:
-        break;
+      if (DokanInstance->DokanOptions->Options &
+          DOKAN_OPTION_PROCESS_ACCOUNTING) {
+        // a deferred event keeps the device to reply on
+        if (!DokanProcessEvent(device, context, returnedLength,
+                               DokanInstance))
+          continue;
+      } else {
+        DokanDispatchEvent(device, context, DokanInstance);
       }
 
     } else {
@@ -538,7 +593,7 @@ DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
   eventInfo->SerialNumber = EventContext->SerialNumber;
 
   DokanFileInfo->ProcessId = EventContext->ProcessId;
-  DokanFileInfo->DokanOptions = DokanInstance->DokanOptions;
+  DokanFileInfo->DokanOptions = DokanInstance->UserOptions;
   if (EventContext->FileFlags & DOKAN_DELETE_ON_CLOSE) {
     DokanFileInfo->DeleteOnClose = 1;
   }
@@ -564,6 +619,8 @@ DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
   DokanFileInfo->Context = (ULONG64)(*DokanOpenInfo)->UserContext;
   DokanFileInfo->IsDirectory = (UCHAR)(*DokanOpenInfo)->IsDirectory;
   DokanFileInfo->DokanContext = (ULONG64)(*DokanOpenInfo);
+  if ((*DokanOpenInfo)->ReadAhead != NULL)
+    DokanFileInfo->AccessPattern = (*DokanOpenInfo)->ReadAhead->AccessPattern;
 
   eventInfo->Context = (ULONG64)(*DokanOpenInfo);
 
@@ -594,16 +651,15 @@ VOID ReleaseDokanOpenInfo(PEVENT_INFORMATION EventInformation,
   if (openInfo != NULL) {
     openInfo->OpenCount--;
     if (openInfo->OpenCount < 1) {
-      if (openInfo->DirListHead != NULL) {
-        ClearFindData(openInfo->DirListHead);
-        free(openInfo->DirListHead);
-        openInfo->DirListHead = NULL;
-      }
-      if (openInfo->StreamListHead != NULL) {
-        ClearFindStreamData(openInfo->StreamListHead);
-        free(openInfo->StreamListHead);
-        openInfo->StreamListHead = NULL;
-      }
+      ClearFindData(&openInfo->DirList);
+      if (openInfo->DirListPattern != NULL)
+        free(openInfo->DirListPattern);
+      ClearFindData(&openInfo->StreamList);
+      if (openInfo->PoolSid != NULL)
+        free(openInfo->PoolSid);
+      DokanReadAheadDelete(openInfo);
+      DokanWriteBehindFree(openInfo);
+      DeleteCriticalSection(&openInfo->CleanupLock);
       free(openInfo);
       EventInformation->Context = 0;
     }
@@ -701,6 +757,14 @@ BOOL DokanStart(PDOKAN_INSTANCE Instance) {
 
   eventStart.IrpTimeout = Instance->DokanOptions->Timeout;
 
+  // room for the header of the write and a file name like in WRITE_MAX_SIZE
+  if (Instance->DokanOptions->MaxTransferSize > WRITE_MAX_SIZE) {
+    ULONG64 eventSize = (ULONG64)Instance->DokanOptions->MaxTransferSize +
+                        EVENT_CONTEXT_MAX_SIZE - WRITE_MAX_SIZE;
+    eventStart.EventContextMaxSize =
+        (ULONG)min(eventSize, EVENT_CONTEXT_MAX_SIZE_LIMIT);
+  }
+
   SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_EVENT_START, &eventStart,
                sizeof(EVENT_START), &driverInfo, sizeof(EVENT_DRIVER_INFO),
                &returnedLength);
@@ -716,6 +780,11 @@ BOOL DokanStart(PDOKAN_INSTANCE Instance) {
   } else if (driverInfo.Status == DOKAN_MOUNTED) {
     Instance->MountId = driverInfo.MountId;
     Instance->DeviceNumber = driverInfo.DeviceNumber;
+    Instance->EventContextMaxSize = driverInfo.EventContextMaxSize;
+    if (Instance->EventContextMaxSize < EVENT_CONTEXT_MAX_SIZE)
+      Instance->EventContextMaxSize = EVENT_CONTEXT_MAX_SIZE;
+    DbgPrint("Dokan: events of up to %lu bytes\n",
+             Instance->EventContextMaxSize);
     wcscpy_s(Instance->DeviceName, sizeof(Instance->DeviceName) / sizeof(WCHAR),
              driverInfo.DeviceName);
     return TRUE;
@@ -814,6 +883,7 @@ BOOL WINAPI DllMain(HINSTANCE Instance, DWORD Reason, LPVOID Reserved) {
 #endif
 
     InitializeListHead(&g_InstanceList);
+    DokanInitUpcaseTable();
   } break;
   case DLL_PROCESS_DETACH: {
     EnterCriticalSection(&g_InstanceCriticalSection);
@@ -54,8 +54,8 @@ extern "C" {
  */
 /** @{ */
 
-/** The current Dokan version (ver 1.0.0). \ref DOKAN_OPTIONS.Version */
-#define DOKAN_VERSION 100
+/** The current Dokan version (ver 1.1.0). \ref DOKAN_OPTIONS.Version */
+#define DOKAN_VERSION 110
 /** Minimum Dokan version (ver 1.0.0) accepted. */
 #define DOKAN_MINIMUM_COMPATIBLE_VERSION 100
 /** Maximum number of dokan instances.*/
@@ -88,6 +88,53 @@ extern "C" {
 #define DOKAN_OPTION_CURRENT_SESSION 128
 /** Enable Lockfile/Unlockfile operations. Otherwise Dokan will take care of it */
 #define DOKAN_OPTION_FILELOCK_USER_MODE 256
+/**
+ * Call GetVolumeInformation once and reuse its result for the lifetime of the
+ * mount, for volume information that never changes
+ */
+#define DOKAN_OPTION_CACHE_VOLUME_INFO 512
+/**
+ * Queue the reads of a file arriving while it is read, then read them by
+ * offset, with one DOKAN_OPERATIONS.ReadFile call for reads which overlap or
+ * follow each other, \see DOKAN_OPTIONS.ReadMergeWindow
+ */
+#define DOKAN_OPTION_MERGE_READS 1024
+/**
+ * Account the operations of each process, and hold back those of a process
+ * over its limit, \see DokanSetProcessLimit and DokanGetProcessStatistics
+ */
+#define DOKAN_OPTION_PROCESS_ACCOUNTING 2048
+/**
+ * Share the result of a DOKAN_OPERATIONS.GetFileInformation,
+ * GetFileSecurity, GetVolumeInformation or GetDiskFreeSpace call with the
+ * identical requests arriving while it runs, instead of calling the
+ * FileSystem again. A request arriving after a change of the file is not
+ * shared with the calls started before. Independent of the caches.
+ */
+#define DOKAN_OPTION_COALESCE_QUERIES 4096
+/**
+ * Use the cached informations, listings, security, blocks and handles of a
+ * file for any case of its name. Only for a FileSystem which is case
+ * insensitive: without it, \\a and \\A are cached apart, as the volume is
+ * FILE_CASE_SENSITIVE_SEARCH. A change of a file always invalidates every
+ * case of its name.
+ */
+#define DOKAN_OPTION_CASE_INSENSITIVE_CACHE 8192
+
+/** @} */
+
+/**
+ * \defgroup DOKAN_ACCESS_PATTERN DOKAN_ACCESS_PATTERN
+ * \brief Values of DOKAN_FILE_INFO.AccessPattern
+ */
+/** @{ */
+
+/** Not enough reads yet to tell */
+#define DOKAN_ACCESS_PATTERN_UNKNOWN 0
+/** Each read starts where the previous one ended */
+#define DOKAN_ACCESS_PATTERN_SEQUENTIAL 1
+/** Reads jump around the file, or it was opened with FILE_RANDOM_ACCESS */
+#define DOKAN_ACCESS_PATTERN_RANDOM 2
 
 /** @} */
 
@@ -96,7 +143,11 @@ extern "C" {
  * \brief Dokan mount options used to describe dokan device behaviour.
  */
 typedef struct _DOKAN_OPTIONS {
-  /** Version of the dokan features requested (Version "123" is equal to Dokan version 1.2.3) */
+  /**
+   * Version of the dokan features requested (Version "123" is equal to Dokan
+   * version 1.2.3). The fields after SectorSize are supported since 1.1.0 and
+   * read as 0 with an older Version.
+   */
   USHORT Version;
   /** Number of threads to be used internally by Dokan library. More thread will handle more event at the same time */
   USHORT ThreadCount;
@@ -114,8 +165,212 @@ typedef struct _DOKAN_OPTIONS {
   ULONG AllocationUnitSize;
   /** Sector Size of the volume. This will behave on the file size */
   ULONG SectorSize;
+  /**
+   * Time in milliseconds a directory listing is reused by the library for the
+   * following queries on the same directory, from any handle. 0 disables it.
+   * Listings are dropped when a create, delete, rename or set information on
+   * their files goes through the library. \see DokanGetCacheStatistics
+   */
+  ULONG DirectoryCacheTimeout;
+  /** Memory in bytes the cached directory listings can use, 0 for 16 MB */
+  ULONG DirectoryCacheSize;
+  /**
+   * Time in milliseconds the library answers file information queries without
+   * calling GetFileInformation, with the result of a previous call or with
+   * the entry returned for the file by a directory listing. 0 disables it.
+   * The alternate data streams returned by FindStreams for a cached file are
+   * kept with its informations. Entries are dropped on write, create,
+   * delete, rename and set information going through the library.
+   * \see DokanGetCacheStatistics
+   */
+  ULONG AttributeCacheTimeout;
+  /**
+   * Maximum number of files in the attribute cache, including the files known
+   * not to exist, 0 for 65536
+   */
+  ULONG AttributeCacheSize;
+  /**
+   * Time in milliseconds the library fails opens requiring an existing file with
+   * STATUS_OBJECT_NAME_NOT_FOUND without calling ZwCreateFile, after the
+   * FileSystem returned that status for the same name. 0 disables it.
+   * Entries are dropped when a create or rename going through the library
+   * targets the name or its parent. \see DokanGetCacheStatistics
+   */
+  ULONG NegativeCacheTimeout;
+  /**
+   * Maximum age in milliseconds of a GetDiskFreeSpace result returned by the
+   * library, 0 to call GetDiskFreeSpace for every query. Once half of it has
+   * elapsed, a query is still answered with the cached result and
+   * GetDiskFreeSpace is called after replying to refresh it.
+   */
+  ULONG DiskFreeSpaceCacheTimeout;
+  /**
+   * Time in milliseconds a GetFileSecurity result is reused for queries of the
+   * same file and SECURITY_INFORMATION, including the queries made to learn
+   * the size of the descriptor. 0 disables it. Identical descriptors are
+   * stored once. Entries are dropped by SetFileSecurity on the file or a
+   * parent directory, and by create, delete and rename going through the
+   * library. \see DokanGetCacheStatistics
+   */
+  ULONG SecurityCacheTimeout;
+  /** Memory in bytes the cached security descriptors can use, 0 for 4 MB */
+  ULONG SecurityCacheSize;
+  /**
+   * Time in milliseconds the library keeps the \ref DOKAN_FILE_INFO.Context of
+   * a closed read-only file handle before calling DOKAN_OPERATIONS.Cleanup and
+   * DOKAN_OPERATIONS.CloseFile on it. An open of the same file by the same
+   * user with the same share access and options, and no more rights, reuses
+   * it without calling DOKAN_OPERATIONS.ZwCreateFile. 0 disables it.
+   * Pooled handles are closed before an open which can change the file or
+   * its directory, and before a rename over it. \see DokanGetCacheStatistics
+   */
+  ULONG HandlePoolTimeout;
+  /** Maximum number of pooled handles, 0 for 64 */
+  ULONG HandlePoolSize;
+  /**
+   * Largest amount in bytes the library reads ahead of a file handle read
+   * sequentially, 0 disables read-ahead. Once a handle is read sequentially,
+   * or from its first read when opened with FILE_SEQUENTIAL_ONLY, the data
+   * that follows is read with DOKAN_OPERATIONS.ReadFile after replying to a
+   * read, in a window doubling up to this size, and the next reads are
+   * answered from it. A read elsewhere in the file collapses the window, a
+   * handle opened with FILE_RANDOM_ACCESS is never read ahead. The data is
+   * dropped when the file is written, truncated, renamed or deleted through
+   * the library.
+   */
+  ULONG ReadAheadMaxSize;
+  /**
+   * Size in bytes of the buffer in which the library gathers the contiguous
+   * writes of a file handle before calling DOKAN_OPERATIONS.WriteFile once
+   * for all of them, 0 disables it. Paging writes, writes to the end of file
+   * and writes of half this size or more are not buffered. The buffer is
+   * written before a write elsewhere in the file, a read, information query,
+   * set information, flush or cleanup of the file, an open overwriting it,
+   * and when WriteBehindTotalSize is reached. When it fails, the error is
+   * returned to the next write, flush or set information of the handle. An
+   * error left when the handle is closed is lost, CloseHandle does not
+   * return it: call FlushFileBuffers before closing to get it.
+   */
+  ULONG WriteBehindSize;
+  /** Memory in bytes all the write buffers can use, 0 for 64 MB */
+  ULONG WriteBehindTotalSize;
+  /**
+   * Memory in bytes the library can use to keep the data returned by
+   * DOKAN_OPERATIONS.ReadFile, 0 disables it. Files are read by aligned
+   * blocks of BlockCacheBlockSize bytes, which answer the following reads of
+   * any handle of the file. Blocks read once are evicted before blocks read
+   * again, so that scanning a large file does not evict the data which is
+   * used the most. Blocks of a file are dropped when it is written,
+   * truncated, renamed or deleted through the library. Reads of handles
+   * opened with FILE_NO_INTERMEDIATE_BUFFERING do not use it.
+   * \see DokanGetCacheStatistics
+   */
+  ULONG64 BlockCacheSize;
+  /**
+   * Largest write in bytes the driver sends in one request to each worker
+   * thread, which receives requests in a buffer of about this size. A bigger
+   * write needs another exchange with the driver. 0 for about 32 KB, the
+   * driver accepts up to 16 MB.
+   */
+  ULONG MaxTransferSize;
+  /**
+   * Size in bytes of the blocks in which the FileSystem stores the data of
+   * its files. The reads and writes given to DOKAN_OPERATIONS.ReadFileV and
+   * DOKAN_OPERATIONS.WriteFileV are split in segments which do not cross a
+   * block boundary. 0 gives them a single segment.
+   */
+  ULONG IoSegmentSize;
+  /** Size in bytes of the blocks of the block cache, 0 for 64 KB */
+  ULONG BlockCacheBlockSize;
+  /**
+   * Time in milliseconds the first read of a file waits for other reads to
+   * merge with, when DOKAN_OPTION_MERGE_READS is set. With 0, only the reads
+   * arriving while the file is read are merged. Merged reads are made with
+   * the \ref DOKAN_FILE_INFO of the first of them.
+   */
+  ULONG ReadMergeWindow;
 } DOKAN_OPTIONS, *PDOKAN_OPTIONS;
 
+/**
+ * \struct DOKAN_CACHE_STATISTICS
+ * \brief Usage of the caches of the library, \see DokanGetCacheStatistics
+ */
+typedef struct _DOKAN_CACHE_STATISTICS {
+  /** Directory queries answered with a cached listing */
+  ULONG64 DirectoryCacheHits;
+  /** Directory listings requested to the FileSystem while the cache is enabled */
+  ULONG64 DirectoryCacheMisses;
+  /** Memory in bytes used by the cached directory listings */
+  ULONG64 DirectoryCacheSize;
+  /** File information queries answered without calling GetFileInformation */
+  ULONG64 AttributeCacheHits;
+  /** GetFileInformation calls made while the attribute cache is enabled */
+  ULONG64 AttributeCacheMisses;
+  /** Number of files in the attribute cache */
+  ULONG64 AttributeCacheCount;
+  /** Opens failed without calling ZwCreateFile */
+  ULONG64 NegativeCacheHits;
+  /** Opens of existing files sent to ZwCreateFile with the negative cache enabled */
+  ULONG64 NegativeCacheMisses;
+  /** Security queries answered without calling GetFileSecurity */
+  ULONG64 SecurityCacheHits;
+  /** GetFileSecurity calls made while the security cache is enabled */
+  ULONG64 SecurityCacheMisses;
+  /** Memory in bytes used by the cached security descriptors */
+  ULONG64 SecurityCacheSize;
+  /** Read-only opens which reused a pooled handle */
+  ULONG64 HandlePoolHits;
+  /** Read-only opens sent to ZwCreateFile with the handle pool enabled */
+  ULONG64 HandlePoolMisses;
+  /** Number of handles in the pool */
+  ULONG64 HandlePoolCount;
+  /** Blocks of reads found in the block cache */
+  ULONG64 BlockCacheHits;
+  /** Blocks read with ReadFile while the block cache is enabled */
+  ULONG64 BlockCacheMisses;
+  /** Blocks removed from the block cache to stay within its memory budget */
+  ULONG64 BlockCacheEvictions;
+  /** Memory in bytes used by the cached blocks */
+  ULONG64 BlockCacheSize;
+} DOKAN_CACHE_STATISTICS, *PDOKAN_CACHE_STATISTICS;
+
+/**
+ * \struct DOKAN_PROCESS_STATISTICS
+ * \brief Operations of a process on the device, when
+ * DOKAN_OPTION_PROCESS_ACCOUNTING is set, \see DokanGetProcessStatistics
+ */
+typedef struct _DOKAN_PROCESS_STATISTICS {
+  /** Process issuing the operations */
+  ULONG ProcessId;
+  /** Operations dispatched to the FileSystem */
+  ULONG64 Operations;
+  /** Bytes requested by the reads */
+  ULONG64 ReadBytes;
+  /** Bytes given by the writes */
+  ULONG64 WriteBytes;
+  /** Time spent dispatching the operations, in microseconds */
+  ULONG64 TotalLatency;
+  /** Longest time spent dispatching an operation, in microseconds */
+  ULONG64 MaxLatency;
+  /** Operations held back by the limit of the process */
+  ULONG64 ThrottledOperations;
+  /** Time the operations were held back, in milliseconds */
+  ULONG64 ThrottledTime;
+} DOKAN_PROCESS_STATISTICS, *PDOKAN_PROCESS_STATISTICS;
+
+/**
+ * \struct DOKAN_PROCESS_LIMIT
+ * \brief Rate allowed to a process, \see DokanSetProcessLimit
+ *
+ * A process can use up to one second of its rate at once after being idle.
+ */
+typedef struct _DOKAN_PROCESS_LIMIT {
+  /** Operations per second, 0 for no limit */
+  ULONG OperationsPerSecond;
+  /** Bytes read or written per second, 0 for no limit */
+  ULONG64 BytesPerSecond;
+} DOKAN_PROCESS_LIMIT, *PDOKAN_PROCESS_LIMIT;
+
 /**
  * \struct DOKAN_FILE_INFO
  * \brief Dokan file information on the current operation.
@@ -150,21 +405,43 @@ typedef struct _DOKAN_FILE_INFO {
   UCHAR Nocache;
   /**  If true, write to the current end of file instead of Offset parameter. */
   UCHAR WriteToEndOfFile;
+  /**
+   * How the handle is read, one of \ref DOKAN_ACCESS_PATTERN. Only detected
+   * when DOKAN_OPTIONS.ReadAheadMaxSize is not 0, so never with a
+   * DOKAN_OPTIONS.Version older than 1.1.0.
+   */
+  UCHAR AccessPattern;
 } DOKAN_FILE_INFO, *PDOKAN_FILE_INFO;
 
 /**
  * \brief FillFindData Used to add an entry in FindFiles operation
- * \return 1 if buffer is full, otherwise 0 (currently it never returns 1)
+ * \return 1 if buffer is full (no more memory is available, or the page
+ * requested by FindFilesPaged is complete), otherwise 0
+ * \see DokanFillFileDataArray to add many entries at once
+ * \see DokanFillFileDataWithId to give the id of the file
  */
 typedef int(WINAPI *PFillFindData)(PWIN32_FIND_DATAW, PDOKAN_FILE_INFO);
 
 /**
  * \brief FillFindStreamData Used to add an entry in FindStreams
- * \return 1 if buffer is full, otherwise 0 (currently it never returns 1)
+ * \return 1 if no more memory is available, otherwise 0
  */
 typedef int(WINAPI *PFillFindStreamData)(PWIN32_FIND_STREAM_DATA,
                                          PDOKAN_FILE_INFO);
 
+/**
+ * \struct DOKAN_IO_SEGMENT
+ * \brief Part of a read or write, \see DOKAN_OPERATIONS.ReadFileV
+ */
+typedef struct _DOKAN_IO_SEGMENT {
+  /** Offset of the segment in the file */
+  LONGLONG Offset;
+  /** Bytes to read or write */
+  ULONG Length;
+  /** Data of the segment, in the buffer of the request */
+  PVOID Buffer;
+} DOKAN_IO_SEGMENT, *PDOKAN_IO_SEGMENT;
+
 // clang-format off
 
 /**
@@ -643,6 +920,193 @@ typedef struct _DOKAN_OPERATIONS {
     PFillFindStreamData FillFindStreamData,
     PDOKAN_FILE_INFO DokanFileInfo);
 
+  /**
+  * \brief FindFilesPaged Dokan API callback
+  *
+  * Same as FindFilesWithPattern but only one page of the listing is requested
+  * per call, so that entries are returned to the application without waiting
+  * for the whole directory to be listed. It is checked before
+  * FindFilesWithPattern and FindFiles. If it returns STATUS_NOT_IMPLEMENTED,
+  * they are used instead.
+  *
+  * Cookie is 0 on the first call of a listing. Entries must be added with
+  * FillFindData until it returns 1 (the page is full, the entry is kept) or
+  * the listing ends, and Cookie must be set to a value that allows to continue
+  * after the last added entry on the next call.
+  * "." and ".." must be in the first page if they are returned.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param PathName Path requested by the Kernel on the FileSystem.
+  * \param SearchPattern Search pattern.
+  * \param Cookie Position to continue the listing from, set by the previous call.
+  * \param FillFindData Callback that has to be called with PWIN32_FIND_DATAW that contain file information.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return STATUS_SUCCESS if the listing has more entries, STATUS_NO_MORE_FILES when
+  * the entries added by this call are the last ones or NTSTATUS appropriate to the request result.
+  */
+  NTSTATUS(DOKAN_CALLBACK *FindFilesPaged)(LPCWSTR PathName,
+    LPCWSTR SearchPattern,
+    PULONG64 Cookie,
+    PFillFindData FillFindData,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief FindFileByName Dokan API callback
+  *
+  * Get the directory entry of a single file. It is called instead of listing
+  * the directory when the search pattern has no wildcard, like FindFirstFile
+  * does when it is given the path of a file. If it returns
+  * STATUS_NOT_IMPLEMENTED, the directory is listed instead.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param PathName Path of the directory requested by the Kernel on the FileSystem.
+  * \param FileName Name of the file in the directory (case insensitive).
+  * \param FindData Entry to fill as FindFiles would fill it for this file.
+  * \param DokanFileInfo Information about the directory.
+  * \return STATUS_SUCCESS on success, STATUS_OBJECT_NAME_NOT_FOUND if there is no such file or NTSTATUS appropriate to the request result.
+  */
+  NTSTATUS(DOKAN_CALLBACK *FindFileByName)(LPCWSTR PathName,
+    LPCWSTR FileName,
+    PWIN32_FIND_DATAW FindData,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief ReadFileV Dokan API callback
+  *
+  * Same as ReadFile, with the read split in segments which each stay within
+  * one block of DOKAN_OPTIONS.IoSegmentSize bytes, the first and last ones
+  * possibly partial. The segments follow each other in the file and in the
+  * buffer of the request. It is called instead of ReadFile when it is set.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param FileName File path requested by the Kernel on the FileSystem.
+  * \param Segments Segments to fill, by increasing offset.
+  * \param SegmentCount Number of segments.
+  * \param ReadLength Total data size that has been read, from the first segment.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see ReadFile
+  */
+  NTSTATUS(DOKAN_CALLBACK *ReadFileV)(LPCWSTR FileName,
+    PDOKAN_IO_SEGMENT Segments,
+    ULONG SegmentCount,
+    LPDWORD ReadLength,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief WriteFileV Dokan API callback
+  *
+  * Same as WriteFile, with the write split in segments as for ReadFileV. It
+  * is called instead of WriteFile when it is set. A write to the end of file
+  * (DOKAN_FILE_INFO.WriteToEndOfFile) is given in a single segment.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param FileName File path requested by the Kernel on the FileSystem.
+  * \param Segments Segments to write, by increasing offset.
+  * \param SegmentCount Number of segments.
+  * \param NumberOfBytesWritten Total data size that has been written, from the first segment.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see WriteFile
+  */
+  NTSTATUS(DOKAN_CALLBACK *WriteFileV)(LPCWSTR FileName,
+    PDOKAN_IO_SEGMENT Segments,
+    ULONG SegmentCount,
+    LPDWORD NumberOfBytesWritten,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief QueryAllocatedRanges Dokan API callback
+  *
+  * Return the ranges of a file which hold data, for FSCTL_QUERY_ALLOCATED_RANGES,
+  * so that sparse-aware callers skip the holes. The ranges are sorted, within the
+  * requested range and do not overlap.
+  * If it is not implemented, the whole requested range is reported as allocated.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param FileName File path requested by the Kernel on the FileSystem.
+  * \param Offset Offset of the requested range.
+  * \param Length Length of the requested range.
+  * \param Ranges Buffer that receive the allocated ranges.
+  * \param RangeCount Number of ranges Ranges can hold.
+  * \param RangesReturned Number of ranges written to Ranges.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return STATUS_SUCCESS on success, STATUS_BUFFER_OVERFLOW if Ranges is full before the
+  * end of the requested range, or NTSTATUS appropriate to the request result.
+  * \see <a href="https://msdn.microsoft.com/en-us/library/windows/desktop/aa364582(v=vs.85).aspx">FSCTL_QUERY_ALLOCATED_RANGES (MSDN)</a>
+  */
+  NTSTATUS(DOKAN_CALLBACK *QueryAllocatedRanges)(LPCWSTR FileName,
+    LONGLONG Offset,
+    LONGLONG Length,
+    PFILE_ALLOCATED_RANGE_BUFFER Ranges,
+    ULONG RangeCount,
+    PULONG RangesReturned,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief SetZeroData Dokan API callback
+  *
+  * Zero a range of a file for FSCTL_SET_ZERO_DATA, releasing its storage when the
+  * file is sparse. The file is not extended: the part of the range beyond the end
+  * of file is left alone.
+  * If it is not implemented, the range is zeroed with WriteFile.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param FileName File path requested by the Kernel on the FileSystem.
+  * \param Offset Offset of the first byte to zero.
+  * \param BeyondFinalZero Offset of the first byte after the range.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see <a href="https://msdn.microsoft.com/en-us/library/windows/desktop/aa364597(v=vs.85).aspx">FSCTL_SET_ZERO_DATA (MSDN)</a>
+  */
+  NTSTATUS(DOKAN_CALLBACK *SetZeroData)(LPCWSTR FileName,
+    LONGLONG Offset,
+    LONGLONG BeyondFinalZero,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief CopyRange Dokan API callback
+  *
+  * Copy a range of a file to another file of the volume, or to another place of the same
+  * file, without the data going through the Kernel, for FSCTL_DUPLICATE_EXTENTS_TO_FILE.
+  * Both files are open, the source with read access and the target with write access.
+  * If it is not implemented, the range is copied with ReadFile and WriteFile.
+  * Callers look for FILE_SUPPORTS_BLOCK_REFCOUNTING in the flags returned by
+  * GetVolumeInformation before using it.
+  *
+  * Supported since 1.1.0. You must specify the version at
+  * DOKAN_OPTIONS.Version.
+  *
+  * \param SourceFileName Path of the file to copy from.
+  * \param SourceOffset Offset of the range in the source.
+  * \param SourceFileInfo Information about the handle of the source.
+  * \param FileName Path of the file to copy to.
+  * \param Offset Offset of the range in the target.
+  * \param Length Length of the range.
+  * \param DokanFileInfo Information about the handle of the target.
+  * \return STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see <a href="https://msdn.microsoft.com/en-us/library/windows/desktop/mt590821(v=vs.85).aspx">FSCTL_DUPLICATE_EXTENTS_TO_FILE (MSDN)</a>
+  */
+  NTSTATUS(DOKAN_CALLBACK *CopyRange)(LPCWSTR SourceFileName,
+    LONGLONG SourceOffset,
+    PDOKAN_FILE_INFO SourceFileInfo,
+    LPCWSTR FileName,
+    LONGLONG Offset,
+    LONGLONG Length,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
 } DOKAN_OPERATIONS, *PDOKAN_OPERATIONS;
 
 // clang-format on
@@ -749,6 +1213,86 @@ BOOL DOKANAPI DokanRemoveMountPointEx(LPCWSTR MountPoint, BOOL Safe);
 BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, LPCWSTR Name,
                                       BOOL IgnoreCase);
 
+/**
+ * \brief Add many entries at once in FindFiles operation
+ *
+ * Bulk version of the \ref PFillFindData callback, it can be called from
+ * DOKAN_OPERATIONS.FindFiles and DOKAN_OPERATIONS.FindFilesWithPattern with the
+ * \ref DOKAN_FILE_INFO they receive, alone or mixed with FillFindData calls.
+ *
+ * \param FindData Array of entries to add.
+ * \param Count Number of entries in FindData.
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO of the FindFiles operation.
+ * \return 1 if buffer is full (no more memory is available), otherwise 0
+ */
+int DOKANAPI DokanFillFileDataArray(PWIN32_FIND_DATAW FindData, ULONG Count,
+                                    PDOKAN_FILE_INFO DokanFileInfo);
+
+/**
+ * \brief Add an entry with its file id in FindFiles operation
+ *
+ * Same as the \ref PFillFindData callback, FileId is returned to queries of
+ * FileIdBothDirectoryInformation, FileIdFullDirectoryInformation and
+ * FileIdExtdDirectoryInformation so that the caller does not have to open
+ * each file to get it. Entries added with FillFindData have a FileId of 0.
+ * The reparse tag of a reparse point is read from FindData->dwReserved0.
+ *
+ * \param FindData Entry to add.
+ * \param FileId Same value as nFileIndexHigh and nFileIndexLow returned by
+ * DOKAN_OPERATIONS.GetFileInformation for this file.
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO of the FindFiles operation.
+ * \return 1 if buffer is full (no more memory is available, or the page
+ * requested by FindFilesPaged is complete), otherwise 0
+ */
+int DOKANAPI DokanFillFileDataWithId(PWIN32_FIND_DATAW FindData,
+                                     ULONG64 FileId,
+                                     PDOKAN_FILE_INFO DokanFileInfo);
+
+/**
+ * \brief Get the usage of the caches of a mounted device
+ *
+ * \param DokanOptions \ref DOKAN_OPTIONS given to \ref DokanMain for the device.
+ * \param Statistics Receives the statistics.
+ * \return False if no device was mounted with these options.
+ */
+BOOL DOKANAPI DokanGetCacheStatistics(PDOKAN_OPTIONS DokanOptions,
+                                      PDOKAN_CACHE_STATISTICS Statistics);
+
+/**
+ * \brief Get the operations of the processes using a mounted device
+ *
+ * Only filled when DOKAN_OPTION_PROCESS_ACCOUNTING is set. The processes
+ * least recently active may be forgotten.
+ *
+ * \param DokanOptions \ref DOKAN_OPTIONS given to \ref DokanMain for the device.
+ * \param Statistics Receives the statistics, most recently active first.
+ * \param Count Number of elements of Statistics.
+ * \return Number of processes known, which can be more than Count.
+ */
+ULONG DOKANAPI DokanGetProcessStatistics(PDOKAN_OPTIONS DokanOptions,
+                                         PDOKAN_PROCESS_STATISTICS Statistics,
+                                         ULONG Count);
+
+/**
+ * \brief Limit the rate of the operations of a process on a mounted device
+ *
+ * Applies when DOKAN_OPTION_PROCESS_ACCOUNTING is set. The operations over the
+ * limit are held back then dispatched one at a time, while the other
+ * processes keep being served. Cleanup and CloseFile are not limited, they
+ * only wait for the operations of their handle held back before them.
+ * An operation held back longer than DOKAN_OPTIONS.Timeout is canceled by the
+ * driver.
+ *
+ * \param DokanOptions \ref DOKAN_OPTIONS given to \ref DokanMain for the device.
+ * \param ProcessId Process to limit, or 0 to set the limit of the processes
+ * without one of their own, which never applies to the System process.
+ * \param Limit Limit to apply, NULL to remove it.
+ * \return False if no device was mounted with these options.
+ */
+BOOL DOKANAPI DokanSetProcessLimit(PDOKAN_OPTIONS DokanOptions,
+                                   ULONG ProcessId,
+                                   PDOKAN_PROCESS_LIMIT Limit);
+
 /**
  * \brief Get Dokan Version
  * \return Dokan version
@@ -30,11 +30,183 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "dokan.h"
 #include "dokanc.h"
 #include "list.h"
+#include "names.h"
+#include "finddata.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define DOKAN_DIRECTORY_CACHE_BUCKETS 256
+#define DOKAN_ATTRIBUTE_CACHE_BUCKETS 1024
+#define DOKAN_SECURITY_CACHE_BUCKETS 256
+#define DOKAN_SECURITY_CACHE_DESCRIPTOR_BUCKETS 64
+#define DOKAN_DATA_GENERATION_BUCKETS 64
+#define DOKAN_BLOCK_CACHE_FILE_BUCKETS 256
+#define DOKAN_BLOCK_CACHE_BUCKETS 1024
+#define DOKAN_PROCESS_BUCKETS 64
+
+// first DOKAN_OPTIONS.Version with the DOKAN_OPERATIONS after FindStreams
+// and the DOKAN_OPTIONS after SectorSize
+#define DOKAN_VERSION_EXTENDED 110
+
+// listings of directories kept for DOKAN_OPTIONS.DirectoryCacheTimeout
+typedef struct _DOKAN_DIRECTORY_CACHE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_DIRECTORY_CACHE_ENTRY by hash of the directory path
+  LIST_ENTRY Buckets[DOKAN_DIRECTORY_CACHE_BUCKETS];
+  // most recently used entry first
+  LIST_ENTRY LruList;
+  // bytes used by the entries
+  SIZE_T Size;
+  ULONG64 Hits;
+  ULONG64 Misses;
+} DOKAN_DIRECTORY_CACHE, *PDOKAN_DIRECTORY_CACHE;
+
+// file informations kept for DOKAN_OPTIONS.AttributeCacheTimeout, and files
+// known not to exist for DOKAN_OPTIONS.NegativeCacheTimeout
+typedef struct _DOKAN_ATTRIBUTE_CACHE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_ATTRIBUTE_CACHE_ENTRY by hash of the file path
+  LIST_ENTRY Buckets[DOKAN_ATTRIBUTE_CACHE_BUCKETS];
+  // most recently used entry first
+  LIST_ENTRY LruList;
+  ULONG Count;
+  ULONG64 Hits;
+  ULONG64 Misses;
+  ULONG64 NegativeHits;
+  ULONG64 NegativeMisses;
+} DOKAN_ATTRIBUTE_CACHE, *PDOKAN_ATTRIBUTE_CACHE;
+
+// security descriptors kept for DOKAN_OPTIONS.SecurityCacheTimeout
+typedef struct _DOKAN_SECURITY_CACHE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_SECURITY_CACHE_ENTRY by hash of the file path
+  LIST_ENTRY Buckets[DOKAN_SECURITY_CACHE_BUCKETS];
+  // DOKAN_SECURITY_DESCRIPTOR_BLOB by hash of their content
+  LIST_ENTRY DescriptorBuckets[DOKAN_SECURITY_CACHE_DESCRIPTOR_BUCKETS];
+  // most recently used entry first
+  LIST_ENTRY LruList;
+  // bytes used by the entries and the descriptors
+  SIZE_T Size;
+  ULONG64 Hits;
+  ULONG64 Misses;
+} DOKAN_SECURITY_CACHE, *PDOKAN_SECURITY_CACHE;
+
+// result of DOKAN_OPERATIONS.GetVolumeInformation
+typedef struct _DOKAN_VOLUME_INFORMATION {
+  WCHAR VolumeName[MAX_PATH];
+  DWORD VolumeSerialNumber;
+  DWORD MaximumComponentLength;
+  DWORD FileSystemFlags;
+  WCHAR FileSystemName[MAX_PATH];
+} DOKAN_VOLUME_INFORMATION, *PDOKAN_VOLUME_INFORMATION;
+
+// result of DOKAN_OPERATIONS.GetDiskFreeSpace
+typedef struct _DOKAN_DISK_FREE_SPACE {
+  ULONGLONG FreeBytesAvailable;
+  ULONGLONG TotalNumberOfBytes;
+  ULONGLONG TotalNumberOfFreeBytes;
+} DOKAN_DISK_FREE_SPACE, *PDOKAN_DISK_FREE_SPACE;
+
+// volume informations kept with DOKAN_OPTION_CACHE_VOLUME_INFO and
+// DOKAN_OPTIONS.DiskFreeSpaceCacheTimeout
+typedef struct _DOKAN_VOLUME_CACHE {
+  CRITICAL_SECTION Lock;
+  BOOLEAN VolumeInfoValid;
+  DOKAN_VOLUME_INFORMATION VolumeInfo;
+  BOOLEAN FreeSpaceValid;
+  // a worker is calling GetDiskFreeSpace to update FreeSpace
+  BOOLEAN FreeSpaceRefreshing;
+  ULONGLONG FreeSpaceTime;
+  DOKAN_DISK_FREE_SPACE FreeSpace;
+} DOKAN_VOLUME_CACHE, *PDOKAN_VOLUME_CACHE;
+
+// requests to the FileSystem shared with DokanFlightBegin when
+// DOKAN_OPTION_COALESCE_QUERIES is set
+#define DOKAN_FLIGHT_FILE_INFORMATION 1
+#define DOKAN_FLIGHT_FILE_SECURITY 2
+#define DOKAN_FLIGHT_VOLUME_INFORMATION 3
+#define DOKAN_FLIGHT_DISK_FREE_SPACE 4
+
+typedef struct _DOKAN_FLIGHT DOKAN_FLIGHT, *PDOKAN_FLIGHT;
+
+// requests being made to the FileSystem, see flight.c
+typedef struct _DOKAN_FLIGHT_TABLE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_FLIGHT, at most one per worker
+  LIST_ENTRY Flights;
+} DOKAN_FLIGHT_TABLE, *PDOKAN_FLIGHT_TABLE;
+
+// closed read-only handles whose Cleanup and CloseFile are deferred so that
+// a following open of the file reuses them, see handlepool.c
+typedef struct _DOKAN_HANDLE_POOL {
+  CRITICAL_SECTION Lock;
+  // DOKAN_POOLED_HANDLE, most recently closed first
+  LIST_ENTRY List;
+  ULONG Count;
+  ULONG64 Hits;
+  ULONG64 Misses;
+} DOKAN_HANDLE_POOL, *PDOKAN_HANDLE_POOL;
+
+// data read by DOKAN_OPERATIONS.ReadFile kept within
+// DOKAN_OPTIONS.BlockCacheSize, with the 2Q policy, see blockcache.c
+typedef struct _DOKAN_BLOCK_CACHE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_BLOCK_CACHE_FILE by hash of the path, without stream name
+  LIST_ENTRY FileBuckets[DOKAN_BLOCK_CACHE_FILE_BUCKETS];
+  // DOKAN_BLOCK_CACHE_BLOCK by file and index
+  LIST_ENTRY Buckets[DOKAN_BLOCK_CACHE_BUCKETS];
+  // blocks read once, most recent first
+  LIST_ENTRY InQueue;
+  // blocks read again, most recently used first
+  LIST_ENTRY MainQueue;
+  // blocks evicted from InQueue, without their data, most recent first
+  LIST_ENTRY OutQueue;
+  // bytes of data of the blocks of InQueue, and of all blocks
+  SIZE_T InSize;
+  SIZE_T Size;
+  ULONG OutCount;
+  ULONG64 Hits;
+  ULONG64 Misses;
+  ULONG64 Evictions;
+} DOKAN_BLOCK_CACHE, *PDOKAN_BLOCK_CACHE;
+
+// files being read when DOKAN_OPTION_MERGE_READS is set, see readqueue.c
+typedef struct _DOKAN_READ_QUEUE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_READ_QUEUE_FILE
+  LIST_ENTRY Files;
+} DOKAN_READ_QUEUE, *PDOKAN_READ_QUEUE;
+
+// processes using the device when DOKAN_OPTION_PROCESS_ACCOUNTING is set,
+// see process.c
+typedef struct _DOKAN_PROCESS_TABLE {
+  CRITICAL_SECTION Lock;
+  // DOKAN_PROCESS by ProcessId
+  LIST_ENTRY Buckets[DOKAN_PROCESS_BUCKETS];
+  // DOKAN_PROCESS, least recently active first
+  LIST_ENTRY Lru;
+  // DOKAN_PROCESS with deferred events, next to be served first
+  LIST_ENTRY Throttled;
+  ULONG Count;
+  // limit of the processes without one of their own
+  DOKAN_PROCESS_LIMIT DefaultLimit;
+  // dispatching the deferred events, woken by Wake
+  HANDLE Thread;
+  HANDLE Wake;
+  BOOL Stop;
+} DOKAN_PROCESS_TABLE, *PDOKAN_PROCESS_TABLE;
+
+// handles which have buffered writes, see write.c
+typedef struct _DOKAN_WRITE_BEHIND_LIST {
+  CRITICAL_SECTION Lock;
+  // DOKAN_WRITE_BEHIND with data
+  LIST_ENTRY List;
+  // bytes buffered by all of them
+  ULONG64 Size;
+} DOKAN_WRITE_BEHIND_LIST, *PDOKAN_WRITE_BEHIND_LIST;
+
 typedef struct _DOKAN_INSTANCE {
   // to ensure that unmount dispatch is called at once
   CRITICAL_SECTION CriticalSection;
@@ -47,13 +219,102 @@ typedef struct _DOKAN_INSTANCE {
 
   ULONG DeviceNumber;
   ULONG MountId;
+  // size of the buffers of DokanLoop, negotiated with the driver
+  ULONG EventContextMaxSize;
 
+  // points to Options
   PDOKAN_OPTIONS DokanOptions;
+  // DOKAN_OPTIONS given to DokanMain, given to the FileSystem in
+  // DOKAN_FILE_INFO and identifying the instance in the APIs taking it
+  PDOKAN_OPTIONS UserOptions;
+  // UserOptions with 0 in the fields its Version does not have
+  DOKAN_OPTIONS Options;
+  // points to Operations
   PDOKAN_OPERATIONS DokanOperations;
+  // DOKAN_OPERATIONS given to DokanMain, without the callbacks its
+  // DOKAN_OPTIONS.Version does not have
+  DOKAN_OPERATIONS Operations;
+
+  DOKAN_DIRECTORY_CACHE DirectoryCache;
+  DOKAN_ATTRIBUTE_CACHE AttributeCache;
+  DOKAN_SECURITY_CACHE SecurityCache;
+  DOKAN_VOLUME_CACHE VolumeCache;
+  DOKAN_FLIGHT_TABLE Flights;
+  DOKAN_HANDLE_POOL HandlePool;
+  DOKAN_WRITE_BEHIND_LIST WriteBehindList;
+  DOKAN_BLOCK_CACHE BlockCache;
+  DOKAN_READ_QUEUE ReadQueue;
+  DOKAN_PROCESS_TABLE ProcessTable;
+  // incremented by each cache invalidation, what was read from the FileSystem
+  // while it changed is not stored
+  volatile LONG CacheGeneration;
+  // incremented when the content of a file hashed in the bucket may change,
+  // see DokanDataChanged
+  volatile LONG DataGeneration[DOKAN_DATA_GENERATION_BUCKETS];
 
   LIST_ENTRY ListEntry;
 } DOKAN_INSTANCE, *PDOKAN_INSTANCE;
 
+// alternate data stream packed in a DOKAN_FIND_DATA_ARENA by
+// DokanFillFindStreamData
+typedef struct _DOKAN_FIND_STREAM_DATA {
+  // size of the whole entry including the name, 8-byte aligned
+  ULONG EntrySize;
+  LARGE_INTEGER StreamSize;
+  // in characters, without the terminating null
+  USHORT StreamNameLength;
+  WCHAR StreamName[1];
+} DOKAN_FIND_STREAM_DATA, *PDOKAN_FIND_STREAM_DATA;
+
+#define DOKAN_FIND_STREAM_DATA_ENTRY(Arena, Offset)                            \
+  ((PDOKAN_FIND_STREAM_DATA)((Arena)->Buffer + (Offset)))
+
+// read-ahead state of a handle, see read.c
+typedef struct _DOKAN_READ_AHEAD {
+  CRITICAL_SECTION Lock;
+  // one of DOKAN_ACCESS_PATTERN
+  UCHAR AccessPattern;
+  // opened with FILE_RANDOM_ACCESS, never read ahead
+  BOOLEAN RandomAccess;
+  // set by DispatchCleanup, the FileSystem may have closed the file
+  BOOLEAN Closed;
+  // no data after the buffer, the last read ahead reached the end of file
+  BOOLEAN Eof;
+  ULONG SequentialCount;
+  // offset following the last read and its length
+  LONGLONG NextOffset;
+  ULONG LastLength;
+  // bytes read ahead each time, 0 until the handle is read sequentially
+  ULONG Window;
+  // data from BufferOffset read ahead while the generation of the file was
+  // BufferGeneration
+  PCHAR Buffer;
+  ULONG BufferCapacity;
+  ULONG BufferLength;
+  LONGLONG BufferOffset;
+  ULONG BufferGeneration;
+} DOKAN_READ_AHEAD, *PDOKAN_READ_AHEAD;
+
+// writes of a handle not given to the FileSystem yet, see write.c
+typedef struct _DOKAN_WRITE_BEHIND {
+  CRITICAL_SECTION Lock;
+  // in DOKAN_WRITE_BEHIND_LIST.List while Length is not 0
+  LIST_ENTRY ListEntry;
+  struct _DOKAN_OPEN_INFO *OpenInfo;
+  // contiguous data to write at Offset
+  PCHAR Buffer;
+  ULONG Capacity;
+  ULONG Length;
+  LONGLONG Offset;
+  // name of the file and process of the first buffered write
+  LPWSTR FileName;
+  ULONG Hash;
+  ULONG ProcessId;
+  // error of a write of the buffer done for another operation, returned by
+  // the next write, flush, set information or cleanup of the handle
+  NTSTATUS DeferredStatus;
+} DOKAN_WRITE_BEHIND, *PDOKAN_WRITE_BEHIND;
+
 typedef struct _DOKAN_OPEN_INFO {
   BOOL IsDirectory;
   ULONG OpenCount;
@@ -61,8 +322,45 @@ typedef struct _DOKAN_OPEN_INFO {
   PDOKAN_INSTANCE DokanInstance;
   ULONG64 UserContext;
   ULONG EventId;
-  PLIST_ENTRY DirListHead;
-  PLIST_ENTRY StreamListHead;
+  DOKAN_FIND_DATA_ARENA DirList;
+  // entry following the last one returned by MatchFiles, so that a
+  // sequential directory query does not rescan the whole list
+  DOKAN_FIND_DATA_CURSOR DirListCursor;
+  BOOLEAN DirListCursorValid;
+  // whether DirList entries have to be matched against the pattern
+  BOOLEAN DirListPatternCheck;
+  // listing done with FindFilesPaged, DirList only holds the current page
+  BOOLEAN DirListPaged;
+  BOOLEAN DirListEnd;
+  // match index of the first DirList entry
+  ULONG DirListBaseIndex;
+  // DirList count after which FillFindData asks for the page to end
+  ULONG DirListPageCount;
+  ULONG64 DirListCookie;
+  // copy of the search pattern and its compiled form
+  PWCHAR DirListPattern;
+  DOKAN_EXPRESSION DirListExpression;
+  // streams of the file, kept while a query does not fit in its buffer so
+  // that the retry with a larger one does not list them again
+  DOKAN_FIND_DATA_ARENA StreamList;
+  // set when the handle is read-only and DOKAN_OPTIONS.HandlePoolTimeout is
+  // not 0: its user and what ZwCreateFile was called with, so that it can be
+  // pooled on close
+  PSID PoolSid;
+  ACCESS_MASK PoolDesiredAccess;
+  ULONG PoolShareAccess;
+  ULONG PoolCreateOptions;
+  // options of ZwCreateFile
+  ULONG CreateOptions;
+  // allocated by the first read when DOKAN_OPTIONS.ReadAheadMaxSize is set
+  PDOKAN_READ_AHEAD ReadAhead;
+  // allocated by the first write when DOKAN_OPTIONS.WriteBehindSize is set
+  PDOKAN_WRITE_BEHIND WriteBehind;
+  // held by DispatchCleanup, and while the FileSystem uses the handle for a
+  // request on another one, so that it does not close the file meanwhile
+  CRITICAL_SECTION CleanupLock;
+  // set by DispatchCleanup, the FileSystem may have closed the file
+  BOOL CleanedUp;
 } DOKAN_OPEN_INFO, *PDOKAN_OPEN_INFO;
 
 BOOL DokanStart(PDOKAN_INSTANCE Instance);
@@ -131,6 +429,12 @@ VOID DispatchQuerySecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
 VOID DispatchSetSecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
                          PDOKAN_INSTANCE DokanInstance);
 
+VOID DispatchFsControl(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                       PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDispatchEvent(HANDLE Device, PEVENT_CONTEXT EventContext,
+                        PDOKAN_INSTANCE DokanInstance);
+
 BOOLEAN
 InstallDriver(SC_HANDLE SchSCManager, LPCWSTR DriverName, LPCWSTR ServiceExe);
 
@@ -152,9 +456,180 @@ BOOL SendGlobalReleaseIRP(LPCWSTR MountPoint);
 
 VOID CheckFileName(LPWSTR FileName);
 
-VOID ClearFindData(PLIST_ENTRY ListHead);
+VOID DokanInitCache(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteCache(PDOKAN_INSTANCE DokanInstance);
+
+// the cache keys are compared without their case, see
+// DOKAN_OPTION_CASE_INSENSITIVE_CACHE
+#define DokanCacheIgnoreCase(DokanInstance)                                    \
+  (((DokanInstance)->DokanOptions->Options &                                   \
+    DOKAN_OPTION_CASE_INSENSITIVE_CACHE) != 0)
+
+ULONG DokanCachePathLength(LPCWSTR Path);
+
+ULONG DokanCacheStreamBaseLength(LPCWSTR FileName, ULONG Length);
+
+ULONG DokanCacheParentLength(LPCWSTR FileName);
+
+VOID DokanCacheInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                          BOOL Subtree);
+
+VOID DokanCacheInvalidateFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName);
+
+VOID DokanDataChanged(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName);
+
+ULONG DokanDataGeneration(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName);
+
+BOOL DokanDirectoryCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                               LPCWSTR Pattern,
+                               PDOKAN_FIND_DATA_ARENA FindDataList,
+                               PBOOLEAN PatternCheck);
+
+VOID DokanDirectoryCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                               LPCWSTR Pattern,
+                               PDOKAN_FIND_DATA_ARENA FindDataList,
+                               ULONG Generation);
+
+BOOL DokanAttributeCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               BOOL NeedFileId, BOOL NeedFullInfo,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo);
+
+VOID DokanAttributeCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo,
+                               ULONG Generation);
+
+BOOL DokanNegativeCacheLookup(PDOKAN_INSTANCE DokanInstance,
+                              LPCWSTR FileName);
+
+VOID DokanNegativeCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                              ULONG Generation);
+
+BOOL DokanSecurityCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                              SECURITY_INFORMATION SecurityInformation,
+                              PVOID Buffer, ULONG BufferLength,
+                              PULONG LengthNeeded);
+
+VOID DokanSecurityCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                              SECURITY_INFORMATION SecurityInformation,
+                              PVOID SecurityDescriptor, ULONG Length,
+                              ULONG Generation);
+
+VOID DokanSecurityCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR FileName, BOOL Subtree);
+
+VOID DokanAttributeCacheSeed(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             PDOKAN_FIND_DATA_ARENA FindDataList,
+                             ULONG Generation);
+
+BOOL DokanStreamCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PDOKAN_FIND_DATA_ARENA StreamList);
+
+VOID DokanStreamCacheInsert(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PDOKAN_FIND_DATA_ARENA StreamList,
+                            ULONG Generation);
+
+VOID DokanInitHandlePool(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteHandlePool(PDOKAN_INSTANCE DokanInstance);
+
+BOOL DokanHandlePoolIsReadOnly(ACCESS_MASK DesiredAccess, ULONG ShareAccess,
+                               ULONG Disposition);
+
+PSID DokanGetRequestorSid(PDOKAN_FILE_INFO FileInfo);
+
+BOOL DokanHandlePoolTake(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                         ACCESS_MASK DesiredAccess, ULONG ShareAccess,
+                         ULONG CreateOptions, PSID Sid,
+                         PDOKAN_FILE_INFO FileInfo);
+
+BOOL DokanHandlePoolAdd(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                        PDOKAN_OPEN_INFO OpenInfo, PDOKAN_FILE_INFO FileInfo);
+
+VOID DokanHandlePoolEvict(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                          BOOL Subtree);
+
+VOID DokanHandlePoolSweep(PDOKAN_INSTANCE DokanInstance, BOOL All);
+
+VOID DokanReadAheadClose(PDOKAN_OPEN_INFO OpenInfo);
+
+VOID DokanReadAheadDelete(PDOKAN_OPEN_INFO OpenInfo);
+
+VOID DokanInitBlockCache(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteBlockCache(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanBlockCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                               LPCWSTR FileName, BOOL Subtree);
+
+NTSTATUS DokanBlockCacheRead(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                             PCHAR Buffer, ULONG Length, LONGLONG Offset,
+                             PULONG ReadLength, PDOKAN_FILE_INFO FileInfo);
+
+PDOKAN_IO_SEGMENT DokanSplitIo(PDOKAN_INSTANCE DokanInstance, PVOID Buffer,
+                               ULONG Length, LONGLONG Offset, PULONG Count);
+
+NTSTATUS DokanCallReadFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                           PVOID Buffer, ULONG Length, PULONG ReadLength,
+                           LONGLONG Offset, PDOKAN_FILE_INFO FileInfo);
+
+NTSTATUS DokanCallWriteFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PVOID Buffer, ULONG Length, PULONG WrittenLength,
+                            LONGLONG Offset, PDOKAN_FILE_INFO FileInfo);
+
+NTSTATUS DokanReadFileData(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                           PCHAR Buffer, ULONG Length, LONGLONG Offset,
+                           PULONG ReadLength, PDOKAN_FILE_INFO FileInfo,
+                           BOOL Cached);
+
+VOID DokanInitFlights(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteFlights(PDOKAN_INSTANCE DokanInstance);
+
+BOOL DokanFlightBegin(PDOKAN_INSTANCE DokanInstance, ULONG Operation,
+                      ULONG Parameter, LPCWSTR FileName, PVOID Buffer,
+                      ULONG BufferLength, NTSTATUS *Status, PULONG Length,
+                      PDOKAN_FLIGHT *Flight);
+
+VOID DokanFlightEnd(PDOKAN_INSTANCE DokanInstance, PDOKAN_FLIGHT Flight,
+                    NTSTATUS Status, PVOID Buffer, ULONG Length);
+
+VOID DokanFlightInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                           BOOL Subtree);
+
+VOID DokanInitReadQueue(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteReadQueue(PDOKAN_INSTANCE DokanInstance);
+
+NTSTATUS DokanReadQueueRead(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PCHAR Buffer, ULONG Length, LONGLONG Offset,
+                            PULONG ReadLength, PDOKAN_FILE_INFO FileInfo,
+                            BOOL Cached);
+
+VOID DokanInitProcessTable(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteProcessTable(PDOKAN_INSTANCE DokanInstance);
+
+BOOL DokanStartThrottle(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanStopThrottle(PDOKAN_INSTANCE DokanInstance);
+
+BOOL DokanProcessEvent(HANDLE Device, PEVENT_CONTEXT EventContext,
+                       ULONG Length, PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanInitWriteBehind(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDeleteWriteBehind(PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanWriteBehindFlushFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               PDOKAN_OPEN_INFO Except);
+
+NTSTATUS DokanWriteBehindTakeError(PDOKAN_OPEN_INFO OpenInfo);
+
+VOID DokanWriteBehindClose(PDOKAN_OPEN_INFO OpenInfo,
+                           PDOKAN_INSTANCE DokanInstance);
 
-VOID ClearFindStreamData(PLIST_ENTRY ListHead);
+VOID DokanWriteBehindFree(PDOKAN_OPEN_INFO OpenInfo);
 
 UINT WINAPI DokanKeepAlive(PVOID Param);
 
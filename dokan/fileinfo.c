@@ -283,117 +283,103 @@ DokanFillIdInfo(PFILE_ID_INFORMATION IdInfo,
   return STATUS_SUCCESS;
 }
 
-typedef struct _DOKAN_FIND_STREAM_DATA {
-  WIN32_FIND_STREAM_DATA FindStreamData;
-  LIST_ENTRY ListEntry;
-} DOKAN_FIND_STREAM_DATA, *PDOKAN_FIND_STREAM_DATA;
-
 int WINAPI DokanFillFindStreamData(PWIN32_FIND_STREAM_DATA FindStreamData,
                                    PDOKAN_FILE_INFO FileInfo) {
-  PLIST_ENTRY listHead =
-      ((PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext)->StreamListHead;
-  PDOKAN_FIND_STREAM_DATA findStreamData;
-
-  findStreamData =
-      (PDOKAN_FIND_STREAM_DATA)malloc(sizeof(DOKAN_FIND_STREAM_DATA));
-  if (findStreamData == NULL) {
-    return 0;
-  }
-  ZeroMemory(findStreamData, sizeof(DOKAN_FIND_STREAM_DATA));
-  InitializeListHead(&findStreamData->ListEntry);
-
-  findStreamData->FindStreamData = *FindStreamData;
-
-  InsertTailList(listHead, &findStreamData->ListEntry);
+  PDOKAN_FIND_DATA_ARENA streamList =
+      &((PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext)->StreamList;
+  PDOKAN_FIND_STREAM_DATA find;
+  SIZE_T nameLength = wcsnlen(FindStreamData->cStreamName, MAX_PATH + 36);
+  ULONG entrySize =
+      (ULONG)QuadAlign(FIELD_OFFSET(DOKAN_FIND_STREAM_DATA, StreamName) +
+                       (nameLength + 1) * sizeof(WCHAR));
+
+  if (!DokanFindDataArenaReserve(streamList, entrySize))
+    return 1;
+
+  find = DOKAN_FIND_STREAM_DATA_ENTRY(streamList, streamList->Size);
+  find->EntrySize = entrySize;
+  find->StreamSize = FindStreamData->StreamSize;
+  find->StreamNameLength = (USHORT)nameLength;
+  RtlCopyMemory(find->StreamName, FindStreamData->cStreamName,
+                nameLength * sizeof(WCHAR));
+  find->StreamName[nameLength] = L'\0';
+
+  streamList->Size += entrySize;
+  streamList->Count++;
   return 0;
 }
 
-VOID ClearFindStreamData(PLIST_ENTRY ListHead) {
-  // free all list entries
-  while (!IsListEmpty(ListHead)) {
-    PLIST_ENTRY entry = RemoveHeadList(ListHead);
-    PDOKAN_FIND_STREAM_DATA find =
-        CONTAINING_RECORD(entry, DOKAN_FIND_STREAM_DATA, ListEntry);
-    free(find);
-  }
-}
-
 NTSTATUS
 DokanFindStreams(PFILE_STREAM_INFORMATION StreamInfo, PDOKAN_FILE_INFO FileInfo,
                  PEVENT_CONTEXT EventContext, PDOKAN_INSTANCE DokanInstance,
                  PULONG RemainingLength) {
   PDOKAN_OPEN_INFO openInfo =
       (PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext;
+  PDOKAN_FIND_DATA_ARENA streamList = &openInfo->StreamList;
+  LPCWSTR fileName = EventContext->Operation.File.FileName;
   NTSTATUS status = STATUS_SUCCESS;
+  ULONG generation;
+  ULONG entrySize;
+  SIZE_T offset;
 
   if (!DokanInstance->DokanOperations->FindStreams) {
     return STATUS_NOT_IMPLEMENTED;
   }
 
-  if (openInfo->StreamListHead == NULL) {
-    openInfo->StreamListHead = malloc(sizeof(LIST_ENTRY));
-    if (openInfo->StreamListHead != NULL) {
-      InitializeListHead(openInfo->StreamListHead);
-    } else {
-      status = STATUS_NO_MEMORY;
-    }
+  // the list is kept by a previous query which did not fit in its buffer
+  if (streamList->Count == 0 &&
+      !DokanStreamCacheLookup(DokanInstance, fileName, streamList)) {
+    generation = (ULONG)DokanInstance->CacheGeneration;
+    status = DokanInstance->DokanOperations->FindStreams(
+        fileName, DokanFillFindStreamData, FileInfo);
+    if (status == STATUS_SUCCESS)
+      DokanStreamCacheInsert(DokanInstance, fileName, streamList, generation);
   }
 
-  if (status == STATUS_SUCCESS && IsListEmpty(openInfo->StreamListHead)) {
-    status = DokanInstance->DokanOperations->FindStreams(
-        EventContext->Operation.File.FileName, DokanFillFindStreamData,
-        FileInfo);
+  if (status != STATUS_SUCCESS) {
+    ClearFindData(streamList);
+    return status;
   }
 
-  if (status == STATUS_SUCCESS) {
-    PLIST_ENTRY listHead, entry;
-    ULONG entrySize;
-
-    listHead = openInfo->StreamListHead;
-    entrySize = 0;
-
-    for (entry = listHead->Flink; entry != listHead; entry = entry->Flink) {
-      PDOKAN_FIND_STREAM_DATA find =
-          CONTAINING_RECORD(entry, DOKAN_FIND_STREAM_DATA, ListEntry);
-
-      ULONG nextEntryOffset = entrySize;
-
-      ULONG streamNameLength =
-          (ULONG)wcslen(find->FindStreamData.cStreamName) * sizeof(WCHAR);
-      entrySize = sizeof(FILE_STREAM_INFORMATION) + streamNameLength;
-      // Must be align on a 8-byte boundary.
-      entrySize = QuadAlign(entrySize);
-      if (*RemainingLength < entrySize) {
-        status = STATUS_BUFFER_OVERFLOW;
-        break;
-      }
-
-      // Not the first entry, set the offset before filling the new entry
-      if (nextEntryOffset > 0) {
-        StreamInfo->NextEntryOffset = nextEntryOffset;
-        StreamInfo = (PFILE_STREAM_INFORMATION)((LPBYTE)StreamInfo +
-                                                StreamInfo->NextEntryOffset);
-      }
-
-      // Fill the new entry
-      StreamInfo->StreamNameLength = streamNameLength;
-      memcpy(StreamInfo->StreamName, find->FindStreamData.cStreamName,
-             streamNameLength);
-      StreamInfo->StreamSize = find->FindStreamData.StreamSize;
-      StreamInfo->StreamAllocationSize = find->FindStreamData.StreamSize;
-      StreamInfo->NextEntryOffset = 0;
-      ALIGN_ALLOCATION_SIZE(&StreamInfo->StreamAllocationSize,
-                            DokanInstance->DokanOptions);
-
-      *RemainingLength -= entrySize;
+  entrySize = 0;
+  for (offset = 0; offset < streamList->Size;) {
+    PDOKAN_FIND_STREAM_DATA find =
+        DOKAN_FIND_STREAM_DATA_ENTRY(streamList, offset);
+    ULONG nextEntryOffset = entrySize;
+    ULONG streamNameLength = find->StreamNameLength * sizeof(WCHAR);
+
+    offset += find->EntrySize;
+
+    entrySize = sizeof(FILE_STREAM_INFORMATION) + streamNameLength;
+    // Must be align on a 8-byte boundary.
+    entrySize = QuadAlign(entrySize);
+    if (*RemainingLength < entrySize) {
+      // the entries which fit are returned, as NTFS does
+      status = STATUS_BUFFER_OVERFLOW;
+      break;
     }
 
-    if (status != STATUS_BUFFER_OVERFLOW) {
-      ClearFindStreamData(openInfo->StreamListHead);
+    // Not the first entry, set the offset before filling the new entry
+    if (nextEntryOffset > 0) {
+      StreamInfo->NextEntryOffset = nextEntryOffset;
+      StreamInfo = (PFILE_STREAM_INFORMATION)((LPBYTE)StreamInfo +
+                                              StreamInfo->NextEntryOffset);
     }
 
-  } else {
-    ClearFindStreamData(openInfo->StreamListHead);
+    // Fill the new entry
+    StreamInfo->StreamNameLength = streamNameLength;
+    memcpy(StreamInfo->StreamName, find->StreamName, streamNameLength);
+    StreamInfo->StreamSize = find->StreamSize;
+    StreamInfo->StreamAllocationSize = find->StreamSize;
+    StreamInfo->NextEntryOffset = 0;
+    ALIGN_ALLOCATION_SIZE(&StreamInfo->StreamAllocationSize,
+                          DokanInstance->DokanOptions);
+
+    *RemainingLength -= entrySize;
+  }
+
+  if (status != STATUS_BUFFER_OVERFLOW) {
+    ClearFindData(streamList);
   }
 
   return status;
@@ -408,6 +394,10 @@ VOID DispatchQueryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   NTSTATUS status = STATUS_INVALID_PARAMETER;
   PDOKAN_OPEN_INFO openInfo;
   ULONG sizeOfEventInfo;
+  ULONG fileInfoClass = EventContext->Operation.File.FileInformationClass;
+  ULONG generation;
+  PDOKAN_FLIGHT flight;
+  ULONG flightLength;
 
   sizeOfEventInfo =
       sizeof(EVENT_INFORMATION) - 8 + EventContext->Operation.File.BufferLength;
@@ -423,9 +413,40 @@ VOID DispatchQueryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   DbgPrint("###GetFileInfo %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->GetFileInformation) {
+  // the size has to include the buffered writes
+  DokanWriteBehindFlushFile(DokanInstance,
+                            EventContext->Operation.File.FileName, NULL);
+  if (openInfo != NULL)
+    fileInfo.Context = openInfo->UserContext;
+
+  // read before calling the FileSystem, see DokanAttributeCacheInsert
+  generation = (ULONG)DokanInstance->CacheGeneration;
+
+  // a directory listing has no volume serial number nor number of links, and
+  // maybe no file index
+  if (DokanAttributeCacheLookup(DokanInstance,
+                                EventContext->Operation.File.FileName,
+                                fileInfoClass == FileInternalInformation,
+                                fileInfoClass == FileIdInformation ||
+                                    fileInfoClass == FileStandardInformation ||
+                                    fileInfoClass == FileAllInformation,
+                                &byHandleFileInfo)) {
+    status = STATUS_SUCCESS;
+
+  } else if (DokanInstance->DokanOperations->GetFileInformation &&
+             !DokanFlightBegin(DokanInstance, DOKAN_FLIGHT_FILE_INFORMATION,
+                               0, EventContext->Operation.File.FileName,
+                               &byHandleFileInfo,
+                               sizeof(BY_HANDLE_FILE_INFORMATION), &status,
+                               &flightLength, &flight)) {
     status = DokanInstance->DokanOperations->GetFileInformation(
         EventContext->Operation.File.FileName, &byHandleFileInfo, &fileInfo);
+    DokanFlightEnd(DokanInstance, flight, status, &byHandleFileInfo,
+                   sizeof(BY_HANDLE_FILE_INFORMATION));
+    if (status == STATUS_SUCCESS)
+      DokanAttributeCacheInsert(DokanInstance,
+                                EventContext->Operation.File.FileName,
+                                &byHandleFileInfo, generation);
   }
 
   remainingLength = eventInfo->BufferLength;
@@ -0,0 +1,124 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <windows.h>
+#include <stdlib.h>
+
+#include "finddata.h"
+
+// QuadAlign of fileinfo.h
+#define DokanQuadAlign(Size) (((Size) + 7) & ~(SIZE_T)7)
+
+// initial size of a DOKAN_FIND_DATA_ARENA buffer, doubled when it is full
+#define DOKAN_FIND_DATA_ARENA_INITIAL_SIZE (16 * 1024)
+
+BOOL DokanFindDataArenaReserve(PDOKAN_FIND_DATA_ARENA Arena, SIZE_T Length) {
+  SIZE_T capacity;
+  PCHAR buffer;
+
+  if (Arena->Size + Length <= Arena->Capacity)
+    return TRUE;
+
+  capacity = Arena->Capacity;
+  if (capacity == 0)
+    capacity = DOKAN_FIND_DATA_ARENA_INITIAL_SIZE;
+  while (capacity < Arena->Size + Length)
+    capacity *= 2;
+
+  buffer = (PCHAR)realloc(Arena->Buffer, capacity);
+  if (buffer == NULL)
+    return FALSE;
+  Arena->Buffer = buffer;
+  Arena->Capacity = capacity;
+  return TRUE;
+}
+
+BOOL DokanFindDataArenaAppend(PDOKAN_FIND_DATA_ARENA Arena,
+                              PWIN32_FIND_DATAW FindData, ULONG64 FileId,
+                              BOOLEAN InsertTail) {
+  PDOKAN_FIND_DATA find;
+  SIZE_T nameLength = wcsnlen(FindData->cFileName, MAX_PATH);
+  ULONG entrySize =
+      (ULONG)DokanQuadAlign(FIELD_OFFSET(DOKAN_FIND_DATA, FileName) +
+                            (nameLength + 1) * sizeof(WCHAR));
+
+  if (!DokanFindDataArenaReserve(Arena, entrySize))
+    return FALSE;
+
+  if (InsertTail) {
+    find = DOKAN_FIND_DATA_ENTRY(Arena, Arena->Size);
+  } else {
+    RtlMoveMemory(Arena->Buffer + entrySize, Arena->Buffer, Arena->Size);
+    find = DOKAN_FIND_DATA_ENTRY(Arena, 0);
+  }
+
+  find->EntrySize = entrySize;
+  find->FileAttributes = FindData->dwFileAttributes;
+  find->CreationTime = FindData->ftCreationTime;
+  find->LastAccessTime = FindData->ftLastAccessTime;
+  find->LastWriteTime = FindData->ftLastWriteTime;
+  find->FileSizeHigh = FindData->nFileSizeHigh;
+  find->FileSizeLow = FindData->nFileSizeLow;
+  find->FileId = FileId;
+  find->ReparseTag =
+      (FindData->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+          ? FindData->dwReserved0
+          : 0;
+  find->FileNameLength = (USHORT)nameLength;
+  RtlCopyMemory(find->FileName, FindData->cFileName,
+                nameLength * sizeof(WCHAR));
+  find->FileName[nameLength] = L'\0';
+
+  Arena->Size += entrySize;
+  Arena->Count++;
+  return TRUE;
+}
+
+VOID ClearFindData(PDOKAN_FIND_DATA_ARENA FindDataList) {
+  // the whole listing is in a single buffer
+  if (FindDataList->Buffer != NULL)
+    free(FindDataList->Buffer);
+  ZeroMemory(FindDataList, sizeof(DOKAN_FIND_DATA_ARENA));
+}
+
+// Entry at Cursor, or the first one after it whose name matches Expression,
+// any name when it is NULL. Cursor is moved to it, its match index does not
+// change. NULL at the end of the listing.
+PDOKAN_FIND_DATA DokanFindDataSeek(PDOKAN_FIND_DATA_ARENA Arena,
+                                   PDOKAN_FIND_DATA_CURSOR Cursor,
+                                   PDOKAN_EXPRESSION Expression) {
+  while (Cursor->Offset < Arena->Size) {
+    PDOKAN_FIND_DATA find = DOKAN_FIND_DATA_ENTRY(Arena, Cursor->Offset);
+    if (Expression == NULL ||
+        DokanMatchExpression(Expression, find->FileName,
+                             find->FileNameLength))
+      return find;
+    Cursor->Offset += find->EntrySize;
+  }
+  return NULL;
+}
+
+// move Cursor past the entry returned by DokanFindDataSeek
+VOID DokanFindDataSkip(PDOKAN_FIND_DATA_ARENA Arena,
+                       PDOKAN_FIND_DATA_CURSOR Cursor) {
+  Cursor->Offset += DOKAN_FIND_DATA_ENTRY(Arena, Cursor->Offset)->EntrySize;
+  Cursor->Index++;
+}
@@ -0,0 +1,94 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FINDDATA_H_
+#define FINDDATA_H_
+
+// Listings of directories kept for the directory queries. Only the base
+// Windows types are used, so that finddata.c also builds out of Windows and
+// can be tested and benchmarked there, see sys/tests/finddata_test.c.
+
+#include "names.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// directory entry packed in a DOKAN_FIND_DATA_ARENA, only the fields used
+// to answer directory queries are kept and the name is stored with its length
+typedef struct _DOKAN_FIND_DATA {
+  // size of the whole entry including the name, 8-byte aligned
+  ULONG EntrySize;
+  DWORD FileAttributes;
+  FILETIME CreationTime;
+  FILETIME LastAccessTime;
+  FILETIME LastWriteTime;
+  DWORD FileSizeHigh;
+  DWORD FileSizeLow;
+  // 0 when not given by the FileSystem
+  ULONG64 FileId;
+  // WIN32_FIND_DATAW.dwReserved0 of a reparse point
+  DWORD ReparseTag;
+  // in characters, without the terminating null
+  USHORT FileNameLength;
+  WCHAR FileName[1];
+} DOKAN_FIND_DATA, *PDOKAN_FIND_DATA;
+
+// contiguous growable buffer holding the DOKAN_FIND_DATA entries of a listing
+typedef struct _DOKAN_FIND_DATA_ARENA {
+  PCHAR Buffer;
+  // bytes used by the entries
+  SIZE_T Size;
+  // bytes allocated for Buffer
+  SIZE_T Capacity;
+  ULONG Count;
+} DOKAN_FIND_DATA_ARENA, *PDOKAN_FIND_DATA_ARENA;
+
+#define DOKAN_FIND_DATA_ENTRY(Arena, Offset)                                   \
+  ((PDOKAN_FIND_DATA)((Arena)->Buffer + (Offset)))
+
+// position in a DOKAN_FIND_DATA_ARENA, see DokanFindDataSeek
+typedef struct _DOKAN_FIND_DATA_CURSOR {
+  SIZE_T Offset;
+  // match index of the entry at Offset
+  ULONG Index;
+} DOKAN_FIND_DATA_CURSOR, *PDOKAN_FIND_DATA_CURSOR;
+
+VOID ClearFindData(PDOKAN_FIND_DATA_ARENA FindDataList);
+
+BOOL DokanFindDataArenaReserve(PDOKAN_FIND_DATA_ARENA Arena, SIZE_T Length);
+
+BOOL DokanFindDataArenaAppend(PDOKAN_FIND_DATA_ARENA Arena,
+                              PWIN32_FIND_DATAW FindData, ULONG64 FileId,
+                              BOOLEAN InsertTail);
+
+PDOKAN_FIND_DATA DokanFindDataSeek(PDOKAN_FIND_DATA_ARENA Arena,
+                                   PDOKAN_FIND_DATA_CURSOR Cursor,
+                                   PDOKAN_EXPRESSION Expression);
+
+VOID DokanFindDataSkip(PDOKAN_FIND_DATA_ARENA Arena,
+                       PDOKAN_FIND_DATA_CURSOR Cursor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FINDDATA_H_
@@ -0,0 +1,234 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// worker waiting for the result of the same request made by another one
+typedef struct _DOKAN_FLIGHT_WAITER {
+  // in DOKAN_FLIGHT.Waiters
+  LIST_ENTRY ListEntry;
+  PVOID Buffer;
+  ULONG BufferLength;
+  // set when the request is done, Done is FALSE if its result does not fit
+  // the buffer of the waiter
+  HANDLE Event;
+  BOOL Done;
+  NTSTATUS Status;
+  ULONG Length;
+} DOKAN_FLIGHT_WAITER, *PDOKAN_FLIGHT_WAITER;
+
+// request to the FileSystem made by a worker, the leader, for itself and the
+// workers making the same request meanwhile
+struct _DOKAN_FLIGHT {
+  // in DOKAN_FLIGHT_TABLE.Flights, linked to itself once the request may
+  // have started before a change of the file
+  LIST_ENTRY ListEntry;
+  LIST_ENTRY Waiters;
+  ULONG Operation;
+  ULONG Parameter;
+  ULONG Hash;
+  // empty for a request on the volume
+  ULONG PathLength;
+  WCHAR Path[1];
+};
+
+VOID DokanInitFlights(PDOKAN_INSTANCE DokanInstance) {
+  InitializeCriticalSection(&DokanInstance->Flights.Lock);
+  InitializeListHead(&DokanInstance->Flights.Flights);
+}
+
+VOID DokanDeleteFlights(PDOKAN_INSTANCE DokanInstance) {
+  // a flight is removed by its leader
+  DeleteCriticalSection(&DokanInstance->Flights.Lock);
+}
+
+PDOKAN_FLIGHT DokanFlightFind(PDOKAN_FLIGHT_TABLE Table, ULONG Operation,
+                              ULONG Parameter, LPCWSTR FileName,
+                              ULONG Length, ULONG Hash, BOOL IgnoreCase) {
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = Table->Flights.Flink; listEntry != &Table->Flights;
+       listEntry = listEntry->Flink) {
+    PDOKAN_FLIGHT flight =
+        CONTAINING_RECORD(listEntry, DOKAN_FLIGHT, ListEntry);
+    if (flight->Operation == Operation && flight->Parameter == Parameter &&
+        flight->Hash == Hash &&
+        DokanCachePathEqual(flight->Path, flight->PathLength, FileName,
+                            Length, IgnoreCase))
+      return flight;
+  }
+  return NULL;
+}
+
+// Wait for the same request if another worker is making it. Returns TRUE when
+// its result was received in Buffer, with its Status and Length. Otherwise
+// the caller makes the request then gives its result to DokanFlightEnd with
+// Flight, which is NULL when the request is not shared.
+BOOL DokanFlightBegin(PDOKAN_INSTANCE DokanInstance, ULONG Operation,
+                      ULONG Parameter, LPCWSTR FileName, PVOID Buffer,
+                      ULONG BufferLength, NTSTATUS *Status, PULONG Length,
+                      PDOKAN_FLIGHT *Flight) {
+  PDOKAN_FLIGHT_TABLE table = &DokanInstance->Flights;
+  ULONG pathLength;
+  ULONG hash;
+  PDOKAN_FLIGHT flight;
+  DOKAN_FLIGHT_WAITER waiter;
+
+  *Flight = NULL;
+
+  if (!(DokanInstance->DokanOptions->Options &
+        DOKAN_OPTION_COALESCE_QUERIES))
+    return FALSE;
+
+  if (FileName == NULL)
+    FileName = L"";
+  pathLength = DokanCachePathLength(FileName);
+  hash = DokanCacheHash(FileName, pathLength);
+
+  EnterCriticalSection(&table->Lock);
+
+  flight = DokanFlightFind(table, Operation, Parameter, FileName, pathLength,
+                           hash, DokanCacheIgnoreCase(DokanInstance));
+  if (flight != NULL) {
+    ZeroMemory(&waiter, sizeof(DOKAN_FLIGHT_WAITER));
+    waiter.Buffer = Buffer;
+    waiter.BufferLength = BufferLength;
+    waiter.Event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (waiter.Event == NULL) {
+      // request alone
+      LeaveCriticalSection(&table->Lock);
+      return FALSE;
+    }
+    InsertTailList(&flight->Waiters, &waiter.ListEntry);
+    LeaveCriticalSection(&table->Lock);
+
+    WaitForSingleObject(waiter.Event, INFINITE);
+    CloseHandle(waiter.Event);
+
+    if (!waiter.Done)
+      return FALSE;
+    *Status = waiter.Status;
+    *Length = waiter.Length;
+    return TRUE;
+  }
+
+  flight = (PDOKAN_FLIGHT)malloc(sizeof(DOKAN_FLIGHT) +
+                                 pathLength * sizeof(WCHAR));
+  if (flight != NULL) {
+    InitializeListHead(&flight->Waiters);
+    flight->Operation = Operation;
+    flight->Parameter = Parameter;
+    flight->Hash = hash;
+    flight->PathLength = pathLength;
+    RtlCopyMemory(flight->Path, FileName, pathLength * sizeof(WCHAR));
+    flight->Path[pathLength] = L'\0';
+    InsertTailList(&table->Flights, &flight->ListEntry);
+    *Flight = flight;
+  }
+
+  LeaveCriticalSection(&table->Lock);
+  return FALSE;
+}
+
+// Give the result of the request to the workers waiting for it. Buffer holds
+// Length bytes on success, Length is the size needed on
+// STATUS_BUFFER_OVERFLOW.
+VOID DokanFlightEnd(PDOKAN_INSTANCE DokanInstance, PDOKAN_FLIGHT Flight,
+                    NTSTATUS Status, PVOID Buffer, ULONG Length) {
+  PDOKAN_FLIGHT_TABLE table = &DokanInstance->Flights;
+
+  if (Flight == NULL)
+    return;
+
+  EnterCriticalSection(&table->Lock);
+  RemoveEntryList(&Flight->ListEntry);
+  LeaveCriticalSection(&table->Lock);
+
+  // no waiter can join anymore
+  while (!IsListEmpty(&Flight->Waiters)) {
+    PDOKAN_FLIGHT_WAITER waiter = CONTAINING_RECORD(
+        RemoveHeadList(&Flight->Waiters), DOKAN_FLIGHT_WAITER, ListEntry);
+
+    if (Status == STATUS_SUCCESS) {
+      waiter->Done = Length <= waiter->BufferLength;
+      if (waiter->Done)
+        RtlCopyMemory(waiter->Buffer, Buffer, Length);
+    } else if (Status == STATUS_BUFFER_OVERFLOW) {
+      // only the size needed is returned, a waiter with a buffer large
+      // enough makes its own request
+      waiter->Done = Length > waiter->BufferLength;
+    } else {
+      waiter->Done = TRUE;
+    }
+    waiter->Status = Status;
+    waiter->Length = Length;
+    SetEvent(waiter->Event);
+  }
+
+  free(Flight);
+}
+
+// FileName changed: the requests on it or its parent directory, or under it
+// when Subtree is TRUE, are not shared with the workers arriving from now on
+VOID DokanFlightInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                           BOOL Subtree) {
+  PDOKAN_FLIGHT_TABLE table = &DokanInstance->Flights;
+  PLIST_ENTRY listEntry, nextEntry;
+  ULONG length;
+  ULONG baseLength;
+  ULONG parentLength;
+
+  if (!(DokanInstance->DokanOptions->Options &
+        DOKAN_OPTION_COALESCE_QUERIES))
+    return;
+
+  length = DokanCachePathLength(FileName);
+  baseLength = DokanCacheStreamBaseLength(FileName, length);
+  parentLength = DokanCacheParentLength(FileName);
+
+  EnterCriticalSection(&table->Lock);
+
+  for (listEntry = table->Flights.Flink; listEntry != &table->Flights;
+       listEntry = nextEntry) {
+    PDOKAN_FLIGHT flight =
+        CONTAINING_RECORD(listEntry, DOKAN_FLIGHT, ListEntry);
+    ULONG flightBaseLength =
+        DokanCacheStreamBaseLength(flight->Path, flight->PathLength);
+    nextEntry = listEntry->Flink;
+
+    if (flight->PathLength == 0)
+      continue;
+
+    // the file and its streams, and its parent directory
+    if ((flightBaseLength == baseLength &&
+         _wcsnicmp(flight->Path, FileName, baseLength) == 0) ||
+        (flight->PathLength == parentLength &&
+         _wcsnicmp(flight->Path, FileName, parentLength) == 0) ||
+        (Subtree && flight->PathLength > length &&
+         flight->Path[length] == L'\\' &&
+         _wcsnicmp(flight->Path, FileName, length) == 0)) {
+      RemoveEntryList(&flight->ListEntry);
+      InitializeListHead(&flight->ListEntry);
+    }
+  }
+
+  LeaveCriticalSection(&table->Lock);
+}
@@ -36,7 +36,18 @@ VOID DispatchFlush(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   DbgPrint("###Flush %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->FlushFileBuffers) {
+  // the buffered writes go to the FileSystem first
+  DokanWriteBehindFlushFile(DokanInstance,
+                            EventContext->Operation.Flush.FileName, NULL);
+  status = STATUS_SUCCESS;
+  if (openInfo != NULL) {
+    fileInfo.Context = openInfo->UserContext;
+    status = DokanWriteBehindTakeError(openInfo);
+  }
+
+  if (status != STATUS_SUCCESS) {
+    DbgPrint("  write behind error %lx\n", status);
+  } else if (DokanInstance->DokanOperations->FlushFileBuffers) {
 
     status = DokanInstance->DokanOperations->FlushFileBuffers(
         EventContext->Operation.Flush.FileName, &fileInfo);
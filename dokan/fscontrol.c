@@ -0,0 +1,398 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// size of the writes zeroing a range when SetZeroData is not implemented
+#define DOKAN_ZERO_WRITE_SIZE (64 * 1024)
+
+// size of the reads and writes copying a range when CopyRange is not
+// implemented
+#define DOKAN_COPY_RANGE_BUFFER_SIZE (1024 * 1024)
+
+NTSTATUS DokanQueryAllocatedRanges(PDOKAN_INSTANCE DokanInstance,
+                                   PEVENT_CONTEXT EventContext,
+                                   PEVENT_INFORMATION EventInfo,
+                                   PDOKAN_FILE_INFO FileInfo) {
+  FILE_ALLOCATED_RANGE_BUFFER query;
+  PFILE_ALLOCATED_RANGE_BUFFER ranges;
+  ULONG rangeCount = EventContext->Operation.FsControl.OutputLength /
+                     sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+  ULONG rangesReturned = 0;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  RtlCopyMemory(&query,
+                (PCHAR)EventContext +
+                    EventContext->Operation.FsControl.InputOffset,
+                sizeof(FILE_ALLOCATED_RANGE_BUFFER));
+
+  DbgPrint("  QueryAllocatedRanges %I64d bytes at %I64d\n",
+           query.Length.QuadPart, query.FileOffset.QuadPart);
+
+  if (query.FileOffset.QuadPart < 0 || query.Length.QuadPart < 0 ||
+      query.FileOffset.QuadPart > MAXLONGLONG - query.Length.QuadPart) {
+    return STATUS_INVALID_PARAMETER;
+  }
+  if (query.Length.QuadPart == 0 || rangeCount == 0) {
+    return STATUS_SUCCESS;
+  }
+
+  // EventInfo->Buffer is not aligned for the ranges
+  ranges = (PFILE_ALLOCATED_RANGE_BUFFER)malloc(
+      rangeCount * sizeof(FILE_ALLOCATED_RANGE_BUFFER));
+  if (ranges == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  if (DokanInstance->DokanOperations->QueryAllocatedRanges) {
+    status = DokanInstance->DokanOperations->QueryAllocatedRanges(
+        EventContext->Operation.FsControl.FileName, query.FileOffset.QuadPart,
+        query.Length.QuadPart, ranges, rangeCount, &rangesReturned, FileInfo);
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    // a FileSystem without holes has all of the range allocated
+    ranges[0] = query;
+    rangesReturned = 1;
+    status = STATUS_SUCCESS;
+  }
+
+  if (status == STATUS_SUCCESS || status == STATUS_BUFFER_OVERFLOW) {
+    if (rangesReturned > rangeCount) {
+      rangesReturned = rangeCount;
+    }
+    EventInfo->BufferLength =
+        rangesReturned * sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+    RtlCopyMemory(EventInfo->Buffer, ranges, EventInfo->BufferLength);
+  }
+
+  free(ranges);
+  return status;
+}
+
+// Zero the range with writes, without extending the file
+NTSTATUS DokanWriteZeroData(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            LONGLONG Offset, LONGLONG BeyondFinalZero,
+                            PDOKAN_FILE_INFO FileInfo) {
+  BY_HANDLE_FILE_INFORMATION byHandleFileInfo;
+  LONGLONG fileSize;
+  PVOID zeros;
+  NTSTATUS status;
+
+  if (!DokanInstance->DokanOperations->GetFileInformation ||
+      (!DokanInstance->DokanOperations->WriteFile &&
+       !DokanInstance->DokanOperations->WriteFileV)) {
+    return STATUS_NOT_IMPLEMENTED;
+  }
+
+  ZeroMemory(&byHandleFileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
+  status = DokanInstance->DokanOperations->GetFileInformation(
+      FileName, &byHandleFileInfo, FileInfo);
+  if (status != STATUS_SUCCESS) {
+    return status;
+  }
+
+  fileSize = ((LONGLONG)byHandleFileInfo.nFileSizeHigh << 32) |
+             byHandleFileInfo.nFileSizeLow;
+  if (BeyondFinalZero > fileSize) {
+    BeyondFinalZero = fileSize;
+  }
+  if (Offset >= BeyondFinalZero) {
+    return STATUS_SUCCESS;
+  }
+
+  zeros = calloc(1, DOKAN_ZERO_WRITE_SIZE);
+  if (zeros == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  FileInfo->WriteToEndOfFile = 0;
+  while (Offset < BeyondFinalZero) {
+    ULONG length = DOKAN_ZERO_WRITE_SIZE;
+    ULONG writtenLength = 0;
+
+    if (BeyondFinalZero - Offset < length) {
+      length = (ULONG)(BeyondFinalZero - Offset);
+    }
+    status = DokanCallWriteFile(DokanInstance, FileName, zeros, length,
+                                &writtenLength, Offset, FileInfo);
+    if (status != STATUS_SUCCESS) {
+      break;
+    }
+    if (writtenLength == 0) {
+      status = STATUS_DISK_FULL;
+      break;
+    }
+    Offset += writtenLength;
+  }
+
+  free(zeros);
+  return status;
+}
+
+NTSTATUS DokanSetZeroData(PDOKAN_INSTANCE DokanInstance,
+                          PEVENT_CONTEXT EventContext,
+                          PDOKAN_FILE_INFO FileInfo) {
+  FILE_ZERO_DATA_INFORMATION zeroData;
+  LPCWSTR fileName = EventContext->Operation.FsControl.FileName;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  RtlCopyMemory(&zeroData,
+                (PCHAR)EventContext +
+                    EventContext->Operation.FsControl.InputOffset,
+                sizeof(FILE_ZERO_DATA_INFORMATION));
+
+  DbgPrint("  SetZeroData from %I64d to %I64d\n",
+           zeroData.FileOffset.QuadPart, zeroData.BeyondFinalZero.QuadPart);
+
+  if (zeroData.FileOffset.QuadPart < 0 ||
+      zeroData.BeyondFinalZero.QuadPart < zeroData.FileOffset.QuadPart) {
+    return STATUS_INVALID_PARAMETER;
+  }
+  if (zeroData.BeyondFinalZero.QuadPart == zeroData.FileOffset.QuadPart) {
+    return STATUS_SUCCESS;
+  }
+
+  if (DokanInstance->DokanOperations->SetZeroData) {
+    status = DokanInstance->DokanOperations->SetZeroData(
+        fileName, zeroData.FileOffset.QuadPart,
+        zeroData.BeyondFinalZero.QuadPart, FileInfo);
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    status = DokanWriteZeroData(DokanInstance, fileName,
+                                zeroData.FileOffset.QuadPart,
+                                zeroData.BeyondFinalZero.QuadPart, FileInfo);
+  }
+
+  DokanCacheInvalidateFile(DokanInstance, fileName);
+  return status;
+}
+
+// Copy the range with reads and writes. When the ranges overlap in the same
+// file and the target is after the source, it is copied from its end so that
+// the source is read before it is overwritten.
+NTSTATUS DokanCopyRangeData(PDOKAN_INSTANCE DokanInstance,
+                            LPCWSTR SourceFileName, LONGLONG SourceOffset,
+                            PDOKAN_FILE_INFO SourceFileInfo, LPCWSTR FileName,
+                            LONGLONG Offset, LONGLONG Length,
+                            PDOKAN_FILE_INFO FileInfo) {
+  PCHAR buffer;
+  BOOL backward;
+  LONGLONG copied = 0;
+  NTSTATUS status = STATUS_SUCCESS;
+
+  if ((!DokanInstance->DokanOperations->ReadFile &&
+       !DokanInstance->DokanOperations->ReadFileV) ||
+      (!DokanInstance->DokanOperations->WriteFile &&
+       !DokanInstance->DokanOperations->WriteFileV)) {
+    return STATUS_NOT_IMPLEMENTED;
+  }
+
+  backward = Offset > SourceOffset && Offset < SourceOffset + Length &&
+             _wcsicmp(SourceFileName, FileName) == 0;
+
+  buffer = (PCHAR)malloc(Length < DOKAN_COPY_RANGE_BUFFER_SIZE
+                             ? (SIZE_T)Length
+                             : DOKAN_COPY_RANGE_BUFFER_SIZE);
+  if (buffer == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  FileInfo->WriteToEndOfFile = 0;
+  while (copied < Length) {
+    ULONG length = DOKAN_COPY_RANGE_BUFFER_SIZE;
+    ULONG readLength = 0;
+    ULONG writtenLength = 0;
+    LONGLONG position;
+
+    if (Length - copied < length) {
+      length = (ULONG)(Length - copied);
+    }
+    position = backward ? Length - copied - length : copied;
+
+    status = DokanCallReadFile(DokanInstance, SourceFileName, buffer, length,
+                               &readLength, SourceOffset + position,
+                               SourceFileInfo);
+    if (status == STATUS_SUCCESS && readLength < length) {
+      // the range goes beyond the end of the source
+      status = STATUS_END_OF_FILE;
+    }
+    if (status != STATUS_SUCCESS) {
+      break;
+    }
+
+    while (writtenLength < length) {
+      ULONG written = 0;
+
+      status = DokanCallWriteFile(
+          DokanInstance, FileName, buffer + writtenLength,
+          length - writtenLength, &written,
+          Offset + position + writtenLength, FileInfo);
+      if (status == STATUS_SUCCESS && written == 0) {
+        status = STATUS_DISK_FULL;
+      }
+      if (status != STATUS_SUCCESS) {
+        break;
+      }
+      writtenLength += written;
+    }
+    if (status != STATUS_SUCCESS) {
+      break;
+    }
+    copied += length;
+  }
+
+  free(buffer);
+  return status;
+}
+
+NTSTATUS DokanDuplicateExtents(PDOKAN_INSTANCE DokanInstance,
+                               PEVENT_CONTEXT EventContext,
+                               PDOKAN_FILE_INFO FileInfo) {
+  // aligned by the driver
+  PDUPLICATE_EXTENTS_CONTEXT input = (PDUPLICATE_EXTENTS_CONTEXT)(
+      (PCHAR)EventContext + EventContext->Operation.FsControl.InputOffset);
+  LPCWSTR fileName = EventContext->Operation.FsControl.FileName;
+  PDOKAN_OPEN_INFO sourceOpenInfo =
+      (PDOKAN_OPEN_INFO)(UINT_PTR)input->SourceContext;
+  DOKAN_FILE_INFO sourceFileInfo;
+  EVENT_INFORMATION releaseInfo;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  CheckFileName(input->SourceFileName);
+
+  DbgPrint("  DuplicateExtents %I64d bytes from %ws at %I64d to %I64d\n",
+           input->ByteCount, input->SourceFileName, input->SourceOffset,
+           input->TargetOffset);
+
+  if (input->ByteCount == 0) {
+    return STATUS_SUCCESS;
+  }
+  if (sourceOpenInfo == NULL) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  // the driver keeps the source from being closed until the request is
+  // completed, but not from being cleaned up
+  EnterCriticalSection(&DokanInstance->CriticalSection);
+  sourceOpenInfo->OpenCount++;
+  LeaveCriticalSection(&DokanInstance->CriticalSection);
+  RtlZeroMemory(&releaseInfo, sizeof(EVENT_INFORMATION));
+  releaseInfo.Context = (ULONG64)sourceOpenInfo;
+
+  EnterCriticalSection(&sourceOpenInfo->CleanupLock);
+  if (sourceOpenInfo->CleanedUp) {
+    LeaveCriticalSection(&sourceOpenInfo->CleanupLock);
+    ReleaseDokanOpenInfo(&releaseInfo, DokanInstance);
+    return STATUS_FILE_CLOSED;
+  }
+
+  ZeroMemory(&sourceFileInfo, sizeof(DOKAN_FILE_INFO));
+  sourceFileInfo.ProcessId = EventContext->ProcessId;
+  sourceFileInfo.DokanOptions = DokanInstance->UserOptions;
+  sourceFileInfo.Context = sourceOpenInfo->UserContext;
+  sourceFileInfo.IsDirectory = (UCHAR)sourceOpenInfo->IsDirectory;
+  sourceFileInfo.DokanContext = (ULONG64)sourceOpenInfo;
+
+  // the buffered writes of the source go to the FileSystem first
+  DokanWriteBehindFlushFile(DokanInstance, input->SourceFileName, NULL);
+
+  if (DokanInstance->DokanOperations->CopyRange) {
+    status = DokanInstance->DokanOperations->CopyRange(
+        input->SourceFileName, input->SourceOffset, &sourceFileInfo, fileName,
+        input->TargetOffset, input->ByteCount, FileInfo);
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    status = DokanCopyRangeData(DokanInstance, input->SourceFileName,
+                                input->SourceOffset, &sourceFileInfo,
+                                fileName, input->TargetOffset,
+                                input->ByteCount, FileInfo);
+  }
+
+  if (sourceOpenInfo != (PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext)
+    sourceOpenInfo->UserContext = sourceFileInfo.Context;
+
+  LeaveCriticalSection(&sourceOpenInfo->CleanupLock);
+  ReleaseDokanOpenInfo(&releaseInfo, DokanInstance);
+
+  DokanCacheInvalidateFile(DokanInstance, fileName);
+  return status;
+}
+
+VOID DispatchFsControl(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                       PDOKAN_INSTANCE DokanInstance) {
+  PEVENT_INFORMATION eventInfo;
+  DOKAN_FILE_INFO fileInfo;
+  PDOKAN_OPEN_INFO openInfo;
+  ULONG eventInfoLength;
+  NTSTATUS status;
+
+  eventInfoLength = sizeof(EVENT_INFORMATION) - 8 +
+                    EventContext->Operation.FsControl.OutputLength;
+  CheckFileName(EventContext->Operation.FsControl.FileName);
+
+  eventInfo = DispatchCommon(EventContext, eventInfoLength, DokanInstance,
+                             &fileInfo, &openInfo);
+
+  DbgPrint("###FsControl %04d\n", openInfo != NULL ? openInfo->EventId : -1);
+
+  // the buffered writes go to the FileSystem first
+  DokanWriteBehindFlushFile(DokanInstance,
+                            EventContext->Operation.FsControl.FileName, NULL);
+  status = STATUS_SUCCESS;
+  if (openInfo != NULL) {
+    fileInfo.Context = openInfo->UserContext;
+    status = DokanWriteBehindTakeError(openInfo);
+  }
+
+  if (status != STATUS_SUCCESS) {
+    DbgPrint("  write behind error %lx\n", status);
+  } else {
+    switch (EventContext->Operation.FsControl.FsControlCode) {
+    case FSCTL_QUERY_ALLOCATED_RANGES:
+      status = DokanQueryAllocatedRanges(DokanInstance, EventContext,
+                                         eventInfo, &fileInfo);
+      break;
+    case FSCTL_SET_ZERO_DATA:
+      status = DokanSetZeroData(DokanInstance, EventContext, &fileInfo);
+      break;
+    case FSCTL_DUPLICATE_EXTENTS_TO_FILE:
+      status = DokanDuplicateExtents(DokanInstance, EventContext, &fileInfo);
+      break;
+    default:
+      status = STATUS_INVALID_DEVICE_REQUEST;
+      break;
+    }
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    status = STATUS_INVALID_DEVICE_REQUEST;
+  }
+  eventInfo->Status = status;
+
+  if (openInfo != NULL)
+    openInfo->UserContext = fileInfo.Context;
+
+  SendEventInformation(Handle, eventInfo, eventInfoLength, DokanInstance);
+  free(eventInfo);
+}
@@ -0,0 +1,329 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// used when DOKAN_OPTIONS.HandlePoolSize is 0
+#define DOKAN_HANDLE_POOL_DEFAULT_SIZE 64
+
+// rights which let a handle change the file, such a handle is never pooled
+// and its open closes the pooled handles of the file
+#define DOKAN_HANDLE_POOL_WRITE_ACCESS                                         \
+  (FILE_WRITE_DATA | FILE_APPEND_DATA | FILE_WRITE_EA |                        \
+   FILE_WRITE_ATTRIBUTES | DELETE | WRITE_DAC | WRITE_OWNER |                  \
+   ACCESS_SYSTEM_SECURITY | MAXIMUM_ALLOWED | GENERIC_WRITE | GENERIC_ALL)
+
+// user context of a closed handle on which Cleanup and CloseFile are not
+// called yet
+typedef struct _DOKAN_POOLED_HANDLE {
+  LIST_ENTRY ListEntry;
+  ULONGLONG ExpirationTime;
+  ULONG64 UserContext;
+  ULONG ProcessId;
+  // what ZwCreateFile was called with
+  ACCESS_MASK DesiredAccess;
+  ULONG ShareAccess;
+  ULONG CreateOptions;
+  // user of the process which opened it
+  PSID Sid;
+  ULONG Hash;
+  ULONG PathLength;
+  WCHAR Path[1];
+} DOKAN_POOLED_HANDLE, *PDOKAN_POOLED_HANDLE;
+
+VOID DokanInitHandlePool(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_HANDLE_POOL pool = &DokanInstance->HandlePool;
+
+  InitializeCriticalSection(&pool->Lock);
+  InitializeListHead(&pool->List);
+  pool->Count = 0;
+  pool->Hits = 0;
+  pool->Misses = 0;
+}
+
+VOID DokanFreePooledHandle(PDOKAN_POOLED_HANDLE Handle) {
+  free(Handle->Sid);
+  free(Handle);
+}
+
+VOID DokanDeleteHandlePool(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_HANDLE_POOL pool = &DokanInstance->HandlePool;
+
+  // DokanHandlePoolSweep closed them before the unmount
+  while (!IsListEmpty(&pool->List)) {
+    DokanFreePooledHandle(CONTAINING_RECORD(
+        RemoveHeadList(&pool->List), DOKAN_POOLED_HANDLE, ListEntry));
+  }
+  DeleteCriticalSection(&pool->Lock);
+}
+
+// Call the Cleanup and CloseFile deferred for the handles removed from the
+// pool on List, then free them
+VOID DokanClosePooledHandles(PDOKAN_INSTANCE DokanInstance, PLIST_ENTRY List) {
+  PDOKAN_OPERATIONS operations = DokanInstance->DokanOperations;
+  DOKAN_FILE_INFO fileInfo;
+
+  while (!IsListEmpty(List)) {
+    PDOKAN_POOLED_HANDLE handle = CONTAINING_RECORD(
+        RemoveHeadList(List), DOKAN_POOLED_HANDLE, ListEntry);
+
+    DbgPrintW(L"  close pooled handle %s\n", handle->Path);
+
+    RtlZeroMemory(&fileInfo, sizeof(DOKAN_FILE_INFO));
+    fileInfo.Context = handle->UserContext;
+    fileInfo.DokanOptions = DokanInstance->UserOptions;
+    fileInfo.ProcessId = handle->ProcessId;
+
+    if (operations->Cleanup)
+      operations->Cleanup(handle->Path, &fileInfo);
+    if (operations->CloseFile)
+      operations->CloseFile(handle->Path, &fileInfo);
+
+    DokanFreePooledHandle(handle);
+  }
+}
+
+// TRUE when an open with these parameters cannot change the file nor prevent
+// a pooled handle from reading it
+BOOL DokanHandlePoolIsReadOnly(ACCESS_MASK DesiredAccess, ULONG ShareAccess,
+                               ULONG Disposition) {
+  return !(DesiredAccess & DOKAN_HANDLE_POOL_WRITE_ACCESS) &&
+         (ShareAccess & FILE_SHARE_READ) &&
+         (Disposition == FILE_OPEN || Disposition == FILE_OPEN_IF);
+}
+
+// The user of the process which sent the create being dispatched, to be freed
+// by the caller. NULL when it can't be read.
+PSID DokanGetRequestorSid(PDOKAN_FILE_INFO FileInfo) {
+  HANDLE token;
+  DWORD buffer[(sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE) / sizeof(DWORD) +
+               1];
+  PTOKEN_USER tokenUser = (PTOKEN_USER)buffer;
+  DWORD length;
+  PSID sid = NULL;
+
+  token = DokanOpenRequestorToken(FileInfo);
+  if (token == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  if (GetTokenInformation(token, TokenUser, tokenUser, sizeof(buffer),
+                          &length)) {
+    length = GetLengthSid(tokenUser->User.Sid);
+    sid = malloc(length);
+    if (sid != NULL && !CopySid(length, sid, tokenUser->User.Sid)) {
+      free(sid);
+      sid = NULL;
+    }
+  } else {
+    DbgPrint("  GetTokenInformation failed: %d\n", GetLastError());
+  }
+
+  CloseHandle(token);
+  return sid;
+}
+
+// TRUE when Path is FileName, or is under it when Subtree is TRUE. The case
+// of the names matters for the first only, when IgnoreCase is FALSE.
+BOOL DokanHandlePoolPathMatch(PDOKAN_POOLED_HANDLE Handle, LPCWSTR FileName,
+                              ULONG Length, BOOL Subtree, BOOL IgnoreCase) {
+  if (Handle->PathLength == Length)
+    return DokanMatchLiteral(Handle->Path, FileName, Length, IgnoreCase);
+  return Subtree && Handle->PathLength > Length &&
+         _wcsnicmp(Handle->Path, FileName, Length) == 0 &&
+         (Handle->Path[Length] == L'\\' || Length == 1);
+}
+
+// Give FileInfo the user context of a pooled handle of FileName opened by the
+// same user with the same share access and options, and at least the
+// requested rights. The other pooled handles of the file are closed, as they
+// may conflict with the open which follows a miss.
+BOOL DokanHandlePoolTake(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                         ACCESS_MASK DesiredAccess, ULONG ShareAccess,
+                         ULONG CreateOptions, PSID Sid,
+                         PDOKAN_FILE_INFO FileInfo) {
+  PDOKAN_HANDLE_POOL pool = &DokanInstance->HandlePool;
+  PLIST_ENTRY listEntry, nextEntry;
+  PDOKAN_POOLED_HANDLE found = NULL;
+  LIST_ENTRY closeList;
+  ULONG length = DokanCachePathLength(FileName);
+  ULONG hash = DokanCacheHash(FileName, length);
+
+  InitializeListHead(&closeList);
+
+  EnterCriticalSection(&pool->Lock);
+
+  for (listEntry = pool->List.Flink; listEntry != &pool->List;
+       listEntry = nextEntry) {
+    PDOKAN_POOLED_HANDLE handle =
+        CONTAINING_RECORD(listEntry, DOKAN_POOLED_HANDLE, ListEntry);
+    nextEntry = listEntry->Flink;
+
+    if (handle->Hash != hash ||
+        !DokanHandlePoolPathMatch(handle, FileName, length, FALSE,
+                                  DokanCacheIgnoreCase(DokanInstance)))
+      continue;
+
+    RemoveEntryList(&handle->ListEntry);
+    pool->Count--;
+
+    if (found == NULL && handle->ShareAccess == ShareAccess &&
+        handle->CreateOptions == CreateOptions &&
+        (handle->DesiredAccess & DesiredAccess) == DesiredAccess &&
+        EqualSid(handle->Sid, Sid)) {
+      found = handle;
+    } else {
+      InsertTailList(&closeList, &handle->ListEntry);
+    }
+  }
+
+  if (found != NULL)
+    pool->Hits++;
+  else
+    pool->Misses++;
+
+  LeaveCriticalSection(&pool->Lock);
+
+  DokanClosePooledHandles(DokanInstance, &closeList);
+
+  if (found == NULL)
+    return FALSE;
+
+  DbgPrintW(L"  pooled handle reused %s\n", FileName);
+  FileInfo->Context = found->UserContext;
+  DokanFreePooledHandle(found);
+  return TRUE;
+}
+
+// Keep the user context of the closed handle OpenInfo for
+// DOKAN_OPTIONS.HandlePoolTimeout instead of calling CloseFile. FALSE when it
+// is not kept, the caller closes it.
+BOOL DokanHandlePoolAdd(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                        PDOKAN_OPEN_INFO OpenInfo, PDOKAN_FILE_INFO FileInfo) {
+  PDOKAN_HANDLE_POOL pool = &DokanInstance->HandlePool;
+  PDOKAN_POOLED_HANDLE handle;
+  LIST_ENTRY closeList;
+  ULONG maxCount = DokanInstance->DokanOptions->HandlePoolSize;
+  ULONG length = DokanCachePathLength(FileName);
+
+  if (DokanInstance->DokanOptions->HandlePoolTimeout == 0)
+    return FALSE;
+  if (maxCount == 0)
+    maxCount = DOKAN_HANDLE_POOL_DEFAULT_SIZE;
+
+  handle = (PDOKAN_POOLED_HANDLE)malloc(sizeof(DOKAN_POOLED_HANDLE) +
+                                        length * sizeof(WCHAR));
+  if (handle == NULL)
+    return FALSE;
+
+  RtlCopyMemory(handle->Path, FileName, length * sizeof(WCHAR));
+  handle->Path[length] = L'\0';
+  handle->PathLength = length;
+  handle->Hash = DokanCacheHash(FileName, length);
+  handle->ExpirationTime =
+      GetTickCount64() + DokanInstance->DokanOptions->HandlePoolTimeout;
+  handle->UserContext = FileInfo->Context;
+  handle->ProcessId = FileInfo->ProcessId;
+  handle->DesiredAccess = OpenInfo->PoolDesiredAccess;
+  handle->ShareAccess = OpenInfo->PoolShareAccess;
+  handle->CreateOptions = OpenInfo->PoolCreateOptions;
+  handle->Sid = OpenInfo->PoolSid;
+  OpenInfo->PoolSid = NULL;
+
+  InitializeListHead(&closeList);
+
+  EnterCriticalSection(&pool->Lock);
+
+  // close the least recently pooled handles to stay in the budget
+  while (pool->Count >= maxCount && !IsListEmpty(&pool->List)) {
+    InsertTailList(&closeList, RemoveTailList(&pool->List));
+    pool->Count--;
+  }
+
+  InsertHeadList(&pool->List, &handle->ListEntry);
+  pool->Count++;
+
+  LeaveCriticalSection(&pool->Lock);
+
+  DokanClosePooledHandles(DokanInstance, &closeList);
+  return TRUE;
+}
+
+// Close the pooled handles of FileName, and of the files under it when
+// Subtree is TRUE, before an operation they could make fail
+VOID DokanHandlePoolEvict(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                          BOOL Subtree) {
+  PDOKAN_HANDLE_POOL pool = &DokanInstance->HandlePool;
+  PLIST_ENTRY listEntry, nextEntry;
+  LIST_ENTRY closeList;
+  ULONG length;
+
+  if (DokanInstance->DokanOptions->HandlePoolTimeout == 0)
+    return;
+
+  length = DokanCachePathLength(FileName);
+  InitializeListHead(&closeList);
+
+  EnterCriticalSection(&pool->Lock);
+
+  for (listEntry = pool->List.Flink; listEntry != &pool->List;
+       listEntry = nextEntry) {
+    PDOKAN_POOLED_HANDLE handle =
+        CONTAINING_RECORD(listEntry, DOKAN_POOLED_HANDLE, ListEntry);
+    nextEntry = listEntry->Flink;
+
+    if (DokanHandlePoolPathMatch(handle, FileName, length, Subtree, TRUE)) {
+      RemoveEntryList(&handle->ListEntry);
+      InsertTailList(&closeList, &handle->ListEntry);
+      pool->Count--;
+    }
+  }
+
+  LeaveCriticalSection(&pool->Lock);
+
+  DokanClosePooledHandles(DokanInstance, &closeList);
+}
+
+// Close the handles pooled for longer than DOKAN_OPTIONS.HandlePoolTimeout,
+// or all of them when All is TRUE
+VOID DokanHandlePoolSweep(PDOKAN_INSTANCE DokanInstance, BOOL All) {
+  PDOKAN_HANDLE_POOL pool = &DokanInstance->HandlePool;
+  LIST_ENTRY closeList;
+  ULONGLONG now = GetTickCount64();
+
+  InitializeListHead(&closeList);
+
+  EnterCriticalSection(&pool->Lock);
+
+  // the oldest handles are at the tail
+  while (!IsListEmpty(&pool->List)) {
+    PDOKAN_POOLED_HANDLE handle =
+        CONTAINING_RECORD(pool->List.Blink, DOKAN_POOLED_HANDLE, ListEntry);
+    if (!All && handle->ExpirationTime > now)
+      break;
+    RemoveEntryList(&handle->ListEntry);
+    InsertTailList(&closeList, &handle->ListEntry);
+    pool->Count--;
+  }
+
+  LeaveCriticalSection(&pool->Lock);
+
+  DokanClosePooledHandles(DokanInstance, &closeList);
+}
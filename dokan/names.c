@@ -0,0 +1,315 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <windows.h>
+#include <stdlib.h>
+#include <wctype.h>
+
+#include "names.h"
+
+#define DOS_STAR (L'<')
+#define DOS_QM (L'>')
+#define DOS_DOT (L'"')
+
+// towupper of every character, filled when the dll is loaded
+WCHAR DokanUpcaseTable[0x10000];
+
+VOID DokanInitUpcaseTable() {
+  ULONG c;
+  for (c = 0; c < 0x10000; ++c)
+    DokanUpcaseTable[c] = towupper((WCHAR)c);
+}
+
+#define DOKAN_CHAR_EQUAL(IgnoreCase, A, B)                                     \
+  ((A) == (B) || ((IgnoreCase) && DokanUpcaseTable[(WCHAR)(A)] ==               \
+                                      DokanUpcaseTable[(WCHAR)(B)]))
+
+// check the expression once so that the common forms are matched without
+// the general algorithm
+VOID DokanCompileExpression(PDOKAN_EXPRESSION Compiled, LPCWSTR Expression,
+                            BOOL IgnoreCase) {
+  ULONG i;
+  ULONG leadingStars = 0;
+  ULONG trailingStars = 0;
+  ULONG wildcards = 0;
+
+  Compiled->Expression = Expression;
+  Compiled->Length = (ULONG)wcslen(Expression);
+  Compiled->IgnoreCase = IgnoreCase;
+
+  for (i = 0; i < Compiled->Length; ++i) {
+    WCHAR c = Expression[i];
+    if (c == L'*' || c == L'?' || c == DOS_STAR || c == DOS_QM ||
+        c == DOS_DOT)
+      wildcards++;
+  }
+  while (leadingStars < Compiled->Length && Expression[leadingStars] == L'*')
+    leadingStars++;
+  while (trailingStars < Compiled->Length - leadingStars &&
+         Expression[Compiled->Length - trailingStars - 1] == L'*')
+    trailingStars++;
+
+  Compiled->Literal = Expression + leadingStars;
+  Compiled->LiteralLength = Compiled->Length - leadingStars - trailingStars;
+
+  if (leadingStars == Compiled->Length && leadingStars != 0) {
+    Compiled->Type = DOKAN_EXPRESSION_ALL;
+  } else if (wildcards == 0) {
+    Compiled->Type = DOKAN_EXPRESSION_LITERAL;
+  } else if (wildcards == trailingStars && leadingStars == 0) {
+    Compiled->Type = DOKAN_EXPRESSION_PREFIX;
+  } else if (wildcards == leadingStars && trailingStars == 0) {
+    Compiled->Type = DOKAN_EXPRESSION_SUFFIX;
+  } else {
+    Compiled->Type = DOKAN_EXPRESSION_GENERAL;
+  }
+}
+
+BOOL DokanMatchLiteral(LPCWSTR Literal, LPCWSTR Name, ULONG Length,
+                       BOOL IgnoreCase) {
+  ULONG i;
+  for (i = 0; i < Length; ++i) {
+    if (!DOKAN_CHAR_EQUAL(IgnoreCase, Literal[i], Name[i]))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+// number of 64 expression positions kept on the stack by DokanMatchGeneral
+#define DOKAN_EXPRESSION_STACK_WORDS 4
+
+#define DOKAN_STATE_SET(States, Index)                                         \
+  ((States)[(Index) / 64] |= (ULONG64)1 << ((Index) % 64))
+#define DOKAN_STATE_TEST(States, Index)                                        \
+  ((States)[(Index) / 64] & ((ULONG64)1 << ((Index) % 64)))
+// move forward without consuming, keeping whether the position is fresh
+#define DOKAN_STATE_COPY(Stale, Fresh, From, To)                               \
+  do {                                                                         \
+    if (DOKAN_STATE_TEST(Stale, From))                                         \
+      DOKAN_STATE_SET(Stale, To);                                              \
+    if (DOKAN_STATE_TEST(Fresh, From))                                         \
+      DOKAN_STATE_SET(Fresh, To);                                              \
+  } while (0)
+
+// ? and DOS_QM consume a character even at the end of the name. The rest of
+// the expression then matched only if it ends with a * and has no character
+// to compare before it.
+BOOL DokanMatchPastEnd(LPCWSTR Expression, ULONG From, ULONG Length) {
+  ULONG i;
+
+  if (From == Length || Expression[Length - 1] != L'*')
+    return FALSE;
+  for (i = From; i < Length; ++i) {
+    WCHAR c = Expression[i];
+    if (c != L'*' && c != L'?' && c != DOS_STAR && c != DOS_QM &&
+        c != DOS_DOT)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+// Match the name against any expression by following all the expression
+// positions that can be reached at the same time, one name character after
+// the other, instead of backtracking at every name position for each *.
+//
+// The transitions reproduce the recursive matcher used before:
+// - * and DOS_STAR try the rest of the expression at each position they can
+//   consume, which is a new match starting there.
+// - DOS_STAR consumes until the last dot of the name if it is not before it,
+//   or until the end of the name otherwise. When there is no dot left and it
+//   is at the position where the current match started, it matches nothing.
+//   Positions are therefore "fresh" (no character consumed since the start of
+//   the match) or not.
+// - ? and DOS_QM at the end of the name go past it, see DokanMatchPastEnd.
+BOOL DokanMatchGeneral(PDOKAN_EXPRESSION Compiled, LPCWSTR Name,
+                       ULONG NameLength) {
+  LPCWSTR expression = Compiled->Expression;
+  ULONG length = Compiled->Length;
+  ULONG words = length / 64 + 1;
+  ULONG64 stackStates[3 * DOKAN_EXPRESSION_STACK_WORDS];
+  PULONG64 states = stackStates;
+  PULONG64 fresh, current, next, swap;
+  LONG lastDot = -1;
+  BOOL match = FALSE;
+  ULONG ni, ei;
+
+  if (words > DOKAN_EXPRESSION_STACK_WORDS) {
+    states = (PULONG64)malloc(3 * words * sizeof(ULONG64));
+    if (states == NULL)
+      return FALSE;
+  }
+  fresh = states;
+  current = states + words;
+  next = states + 2 * words;
+
+  for (ni = 0; ni < NameLength; ++ni) {
+    if (Name[ni] == L'.')
+      lastDot = ni;
+  }
+
+  // nothing is consumed yet, the first position is fresh
+  ZeroMemory(states, 2 * words * sizeof(ULONG64));
+  DOKAN_STATE_SET(fresh, 0);
+
+  for (ni = 0;; ++ni) {
+    BOOL endOfName = ni == NameLength;
+    BOOL alive = FALSE;
+    WCHAR c = endOfName ? L'\0' : Name[ni];
+
+    ZeroMemory(next, words * sizeof(ULONG64));
+
+    // positions only move forward without consuming a character, so a
+    // single pass in order also handles them
+    for (ei = 0; ei <= length && !match; ++ei) {
+      BOOL isStale = DOKAN_STATE_TEST(current, ei) != 0;
+      BOOL isFresh = DOKAN_STATE_TEST(fresh, ei) != 0;
+      BOOL consume;
+
+      if (!isStale && !isFresh)
+        continue;
+
+      if (ei == length) {
+        match = endOfName;
+        continue;
+      }
+
+      switch (expression[ei]) {
+      case L'*':
+      case DOS_STAR:
+        if (endOfName)
+          consume = FALSE;
+        else if (expression[ei] == L'*')
+          consume = TRUE;
+        else if (lastDot >= (LONG)ni)
+          consume = (LONG)ni < lastDot;
+        else
+          consume = isStale;
+
+        if (consume) {
+          // the rest of the expression is a new match from here
+          DOKAN_STATE_SET(next, ei);
+          DOKAN_STATE_SET(fresh, ei + 1);
+        } else {
+          DOKAN_STATE_COPY(current, fresh, ei, ei + 1);
+        }
+        break;
+
+      case DOS_QM:
+        if (c == L'.' && lastDot == (LONG)ni) {
+          // a dot is only consumed if another one follows
+          DOKAN_STATE_COPY(current, fresh, ei, ei + 1);
+        } else if (!endOfName) {
+          DOKAN_STATE_SET(next, ei + 1);
+        } else if (DokanMatchPastEnd(expression, ei + 1, length)) {
+          match = TRUE;
+        }
+        break;
+
+      case DOS_DOT:
+        if (c == L'.')
+          DOKAN_STATE_SET(next, ei + 1);
+        else
+          DOKAN_STATE_COPY(current, fresh, ei, ei + 1);
+        break;
+
+      case L'?':
+        if (!endOfName)
+          DOKAN_STATE_SET(next, ei + 1);
+        else if (DokanMatchPastEnd(expression, ei + 1, length))
+          match = TRUE;
+        break;
+
+      default:
+        if (!endOfName &&
+            DOKAN_CHAR_EQUAL(Compiled->IgnoreCase, expression[ei], c))
+          DOKAN_STATE_SET(next, ei + 1);
+        break;
+      }
+    }
+
+    if (match || endOfName)
+      break;
+
+    for (ei = 0; ei < words; ++ei) {
+      if (next[ei] != 0) {
+        alive = TRUE;
+        break;
+      }
+    }
+    if (!alive)
+      break;
+
+    // consuming a character never leaves a position fresh
+    ZeroMemory(fresh, words * sizeof(ULONG64));
+    swap = current;
+    current = next;
+    next = swap;
+  }
+
+  if (states != stackStates)
+    free(states);
+
+  return match;
+}
+
+BOOL DokanMatchExpression(PDOKAN_EXPRESSION Compiled, LPCWSTR Name,
+                          ULONG NameLength) {
+  switch (Compiled->Type) {
+  case DOKAN_EXPRESSION_ALL:
+    return TRUE;
+  case DOKAN_EXPRESSION_LITERAL:
+    return NameLength == Compiled->LiteralLength &&
+           DokanMatchLiteral(Compiled->Literal, Name, NameLength,
+                             Compiled->IgnoreCase);
+  case DOKAN_EXPRESSION_PREFIX:
+    return NameLength >= Compiled->LiteralLength &&
+           DokanMatchLiteral(Compiled->Literal, Name, Compiled->LiteralLength,
+                             Compiled->IgnoreCase);
+  case DOKAN_EXPRESSION_SUFFIX:
+    return NameLength >= Compiled->LiteralLength &&
+           DokanMatchLiteral(Compiled->Literal,
+                             Name + NameLength - Compiled->LiteralLength,
+                             Compiled->LiteralLength, Compiled->IgnoreCase);
+  default:
+    return DokanMatchGeneral(Compiled, Name, NameLength);
+  }
+}
+
+// case insensitive hash of the path, every case of a name is in the same
+// bucket of the caches
+ULONG DokanCacheHash(LPCWSTR Path, ULONG Length) {
+  ULONG hash = 2166136261;
+  ULONG i;
+  for (i = 0; i < Length; ++i) {
+    hash ^= DokanUpcaseTable[Path[i]];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+// TRUE when Path1 and Path2 are the same key of a cache. The case of the
+// names matters unless IgnoreCase is TRUE, see
+// DOKAN_OPTION_CASE_INSENSITIVE_CACHE.
+BOOL DokanCachePathEqual(LPCWSTR Path1, ULONG Length1, LPCWSTR Path2,
+                         ULONG Length2, BOOL IgnoreCase) {
+  return Length1 == Length2 &&
+         DokanMatchLiteral(Path1, Path2, Length1, IgnoreCase);
+}
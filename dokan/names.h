@@ -0,0 +1,76 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NAMES_H_
+#define NAMES_H_
+
+// File names: upcase table, search expressions and keys of the caches. Only
+// the base Windows types are used, so that names.c also builds out of
+// Windows and can be tested and benchmarked there, see
+// sys/tests/names_test.c.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// towupper of every character, see DokanInitUpcaseTable
+extern WCHAR DokanUpcaseTable[0x10000];
+
+// kinds of DOKAN_EXPRESSION, the common ones are matched without the
+// general algorithm
+#define DOKAN_EXPRESSION_ALL 0     // "*"
+#define DOKAN_EXPRESSION_LITERAL 1 // no wildcard
+#define DOKAN_EXPRESSION_PREFIX 2  // "abc*"
+#define DOKAN_EXPRESSION_SUFFIX 3  // "*.abc"
+#define DOKAN_EXPRESSION_GENERAL 4
+
+// expression checked by DokanCompileExpression, Expression is not copied
+typedef struct _DOKAN_EXPRESSION {
+  ULONG Type;
+  BOOL IgnoreCase;
+  LPCWSTR Expression;
+  ULONG Length;
+  // part without the leading and trailing * for LITERAL, PREFIX and SUFFIX
+  LPCWSTR Literal;
+  ULONG LiteralLength;
+} DOKAN_EXPRESSION, *PDOKAN_EXPRESSION;
+
+VOID DokanInitUpcaseTable();
+
+BOOL DokanMatchLiteral(LPCWSTR Literal, LPCWSTR Name, ULONG Length,
+                       BOOL IgnoreCase);
+
+VOID DokanCompileExpression(PDOKAN_EXPRESSION Compiled, LPCWSTR Expression,
+                            BOOL IgnoreCase);
+
+BOOL DokanMatchExpression(PDOKAN_EXPRESSION Compiled, LPCWSTR Name,
+                          ULONG NameLength);
+
+ULONG DokanCacheHash(LPCWSTR Path, ULONG Length);
+
+BOOL DokanCachePathEqual(LPCWSTR Path1, ULONG Length1, LPCWSTR Path2,
+                         ULONG Length2, BOOL IgnoreCase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NAMES_H_
@@ -0,0 +1,539 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include <process.h>
+
+extern LIST_ENTRY g_InstanceList;
+extern CRITICAL_SECTION g_InstanceCriticalSection;
+
+// processes tracked, the least recently active one without a limit of its
+// own is forgotten beyond
+#define DOKAN_PROCESS_MAX_COUNT 1024
+
+// the default limit does not apply to it, it makes the paging I/O of all
+// the processes
+#define DOKAN_SYSTEM_PROCESS_ID 4
+
+// event of a process over its limit, dispatched by DokanThrottleLoop
+typedef struct _DOKAN_DEFERRED_EVENT {
+  LIST_ENTRY ListEntry;
+  // device the event was received on, to reply on
+  HANDLE Device;
+  ULONGLONG QueueTime;
+  // the cleanup or close of a handle waiting for its deferred events, it is
+  // dispatched after them without tokens
+  BOOLEAN Closing;
+  EVENT_CONTEXT EventContext;
+} DOKAN_DEFERRED_EVENT, *PDOKAN_DEFERRED_EVENT;
+
+typedef struct _DOKAN_PROCESS {
+  // in DOKAN_PROCESS_TABLE.Buckets, by ProcessId
+  LIST_ENTRY BucketEntry;
+  // in DOKAN_PROCESS_TABLE.Lru, least recently active first
+  LIST_ENTRY LruEntry;
+  // in DOKAN_PROCESS_TABLE.Throttled while Deferred is not empty
+  LIST_ENTRY ThrottledEntry;
+  // DOKAN_DEFERRED_EVENT, in the order they were received
+  LIST_ENTRY Deferred;
+  DOKAN_PROCESS_STATISTICS Statistics;
+  // limit set for the process, otherwise the default one applies
+  BOOL HasLimit;
+  DOKAN_PROCESS_LIMIT Limit;
+  // token buckets holding up to one second of the limit, in thousandths of
+  // an operation and in bytes. The bytes can go below 0 for a request larger
+  // than the limit.
+  LONGLONG OperationTokens;
+  LONGLONG ByteTokens;
+  ULONGLONG RefillTime;
+  // events being dispatched, the process is not forgotten meanwhile
+  ULONG Active;
+} DOKAN_PROCESS, *PDOKAN_PROCESS;
+
+VOID DokanInitProcessTable(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+  ULONG i;
+
+  ZeroMemory(table, sizeof(DOKAN_PROCESS_TABLE));
+  InitializeCriticalSection(&table->Lock);
+  for (i = 0; i < DOKAN_PROCESS_BUCKETS; ++i)
+    InitializeListHead(&table->Buckets[i]);
+  InitializeListHead(&table->Lru);
+  InitializeListHead(&table->Throttled);
+}
+
+VOID DokanFreeDeferredEvents(PDOKAN_PROCESS Process) {
+  while (!IsListEmpty(&Process->Deferred)) {
+    PDOKAN_DEFERRED_EVENT deferred = CONTAINING_RECORD(
+        RemoveHeadList(&Process->Deferred), DOKAN_DEFERRED_EVENT, ListEntry);
+    CloseHandle(deferred->Device);
+    free(deferred);
+  }
+}
+
+VOID DokanDeleteProcessTable(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+
+  while (!IsListEmpty(&table->Lru)) {
+    PDOKAN_PROCESS process = CONTAINING_RECORD(RemoveHeadList(&table->Lru),
+                                               DOKAN_PROCESS, LruEntry);
+    DokanFreeDeferredEvents(process);
+    free(process);
+  }
+  DeleteCriticalSection(&table->Lock);
+}
+
+PDOKAN_PROCESS DokanFindProcess(PDOKAN_PROCESS_TABLE Table, ULONG ProcessId) {
+  PLIST_ENTRY bucket = &Table->Buckets[ProcessId % DOKAN_PROCESS_BUCKETS];
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_PROCESS process =
+        CONTAINING_RECORD(listEntry, DOKAN_PROCESS, BucketEntry);
+    if (process->Statistics.ProcessId == ProcessId)
+      return process;
+  }
+  return NULL;
+}
+
+// Forget the least recently active process which has nothing to keep
+VOID DokanForgetProcess(PDOKAN_PROCESS_TABLE Table) {
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = Table->Lru.Flink; listEntry != &Table->Lru;
+       listEntry = listEntry->Flink) {
+    PDOKAN_PROCESS process =
+        CONTAINING_RECORD(listEntry, DOKAN_PROCESS, LruEntry);
+    if (process->HasLimit || process->Active != 0 ||
+        !IsListEmpty(&process->Deferred))
+      continue;
+    RemoveEntryList(&process->BucketEntry);
+    RemoveEntryList(&process->LruEntry);
+    free(process);
+    Table->Count--;
+    return;
+  }
+}
+
+// Find the process or start tracking it, NULL on allocation failure
+PDOKAN_PROCESS DokanGetProcess(PDOKAN_PROCESS_TABLE Table, ULONG ProcessId) {
+  PDOKAN_PROCESS process = DokanFindProcess(Table, ProcessId);
+
+  if (process != NULL) {
+    RemoveEntryList(&process->LruEntry);
+    InsertTailList(&Table->Lru, &process->LruEntry);
+    return process;
+  }
+
+  if (Table->Count >= DOKAN_PROCESS_MAX_COUNT)
+    DokanForgetProcess(Table);
+
+  process = (PDOKAN_PROCESS)malloc(sizeof(DOKAN_PROCESS));
+  if (process == NULL)
+    return NULL;
+  ZeroMemory(process, sizeof(DOKAN_PROCESS));
+  process->Statistics.ProcessId = ProcessId;
+  InitializeListHead(&process->ThrottledEntry);
+  InitializeListHead(&process->Deferred);
+  process->RefillTime = GetTickCount64();
+  InsertTailList(&Table->Buckets[ProcessId % DOKAN_PROCESS_BUCKETS],
+                 &process->BucketEntry);
+  InsertTailList(&Table->Lru, &process->LruEntry);
+  Table->Count++;
+  return process;
+}
+
+// Limit applying to the process, NULL when it has none
+PDOKAN_PROCESS_LIMIT DokanProcessLimit(PDOKAN_PROCESS_TABLE Table,
+                                       PDOKAN_PROCESS Process) {
+  PDOKAN_PROCESS_LIMIT limit;
+
+  if (Process->HasLimit)
+    limit = &Process->Limit;
+  else if (Process->Statistics.ProcessId != DOKAN_SYSTEM_PROCESS_ID)
+    limit = &Table->DefaultLimit;
+  else
+    return NULL;
+
+  if (limit->OperationsPerSecond == 0 && limit->BytesPerSecond == 0)
+    return NULL;
+  return limit;
+}
+
+VOID DokanRefillProcess(PDOKAN_PROCESS Process, PDOKAN_PROCESS_LIMIT Limit) {
+  ULONGLONG now = GetTickCount64();
+  LONGLONG elapsed = (LONGLONG)(now - Process->RefillTime);
+
+  Process->RefillTime = now;
+
+  Process->OperationTokens += elapsed * Limit->OperationsPerSecond;
+  if (Process->OperationTokens > (LONGLONG)Limit->OperationsPerSecond * 1000)
+    Process->OperationTokens = (LONGLONG)Limit->OperationsPerSecond * 1000;
+
+  Process->ByteTokens += elapsed * (LONGLONG)Limit->BytesPerSecond / 1000;
+  if (Process->ByteTokens > (LONGLONG)Limit->BytesPerSecond)
+    Process->ByteTokens = (LONGLONG)Limit->BytesPerSecond;
+}
+
+// Bytes the event transfers, as counted by the byte limit
+ULONG DokanEventBytes(PEVENT_CONTEXT EventContext) {
+  switch (EventContext->MajorFunction) {
+  case IRP_MJ_READ:
+    return EventContext->Operation.Read.BufferLength;
+  case IRP_MJ_WRITE:
+    return EventContext->Operation.Write.BufferLength;
+  default:
+    return 0;
+  }
+}
+
+// Take the tokens of the event. Returns 0 when they were taken, otherwise
+// the time in milliseconds until they are available.
+ULONG DokanTakeTokens(PDOKAN_PROCESS_TABLE Table, PDOKAN_PROCESS Process,
+                      PEVENT_CONTEXT EventContext) {
+  PDOKAN_PROCESS_LIMIT limit = DokanProcessLimit(Table, Process);
+  ULONGLONG wait = 0;
+
+  if (limit == NULL)
+    return 0;
+
+  DokanRefillProcess(Process, limit);
+
+  if (limit->OperationsPerSecond != 0 && Process->OperationTokens < 1000) {
+    wait = (1000 - Process->OperationTokens + limit->OperationsPerSecond - 1) /
+           limit->OperationsPerSecond;
+  }
+  if (limit->BytesPerSecond != 0 && Process->ByteTokens < 0) {
+    ULONGLONG byteWait =
+        ((ULONGLONG)-Process->ByteTokens * 1000 + limit->BytesPerSecond - 1) /
+        limit->BytesPerSecond;
+    if (byteWait > wait)
+      wait = byteWait;
+  }
+  if (wait != 0)
+    return wait > MAXULONG ? MAXULONG : (ULONG)wait;
+
+  if (limit->OperationsPerSecond != 0)
+    Process->OperationTokens -= 1000;
+  if (limit->BytesPerSecond != 0)
+    Process->ByteTokens -= DokanEventBytes(EventContext);
+  return 0;
+}
+
+// TRUE when an event of the handle of EventContext is deferred
+BOOL DokanHandleDeferred(PDOKAN_PROCESS Process, PEVENT_CONTEXT EventContext) {
+  PLIST_ENTRY listEntry;
+
+  if (EventContext->Context == 0)
+    return FALSE;
+
+  for (listEntry = Process->Deferred.Flink; listEntry != &Process->Deferred;
+       listEntry = listEntry->Flink) {
+    PDOKAN_DEFERRED_EVENT deferred =
+        CONTAINING_RECORD(listEntry, DOKAN_DEFERRED_EVENT, ListEntry);
+    if (deferred->EventContext.Context == EventContext->Context)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+// Dispatch the event and add it to the statistics of Process, which is kept
+// by its Active count
+VOID DokanDispatchAccounted(HANDLE Device, PEVENT_CONTEXT EventContext,
+                            PDOKAN_INSTANCE DokanInstance,
+                            PDOKAN_PROCESS Process) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+  LARGE_INTEGER frequency, start, end;
+  ULONG64 latency;
+
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&start);
+
+  DokanDispatchEvent(Device, EventContext, DokanInstance);
+
+  QueryPerformanceCounter(&end);
+  latency = (ULONG64)(end.QuadPart - start.QuadPart) * 1000000 /
+            frequency.QuadPart;
+
+  EnterCriticalSection(&table->Lock);
+  Process->Active--;
+  Process->Statistics.Operations++;
+  if (EventContext->MajorFunction == IRP_MJ_READ)
+    Process->Statistics.ReadBytes += EventContext->Operation.Read.BufferLength;
+  else if (EventContext->MajorFunction == IRP_MJ_WRITE)
+    Process->Statistics.WriteBytes +=
+        EventContext->Operation.Write.BufferLength;
+  Process->Statistics.TotalLatency += latency;
+  if (latency > Process->Statistics.MaxLatency)
+    Process->Statistics.MaxLatency = latency;
+  LeaveCriticalSection(&table->Lock);
+}
+
+BOOL DokanProcessEvent(HANDLE Device, PEVENT_CONTEXT EventContext,
+                       ULONG Length, PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+  PDOKAN_PROCESS process;
+  PDOKAN_DEFERRED_EVENT deferred;
+  BOOLEAN closing = EventContext->MajorFunction == IRP_MJ_CLEANUP ||
+                    EventContext->MajorFunction == IRP_MJ_CLOSE;
+
+  EnterCriticalSection(&table->Lock);
+
+  process = DokanGetProcess(table, EventContext->ProcessId);
+  if (process == NULL) {
+    LeaveCriticalSection(&table->Lock);
+    DokanDispatchEvent(Device, EventContext, DokanInstance);
+    return TRUE;
+  }
+
+  // closing a file is never delayed, nor anything without the throttle
+  // thread, but it waits for the reads and writes of the handle deferred
+  // before it
+  if (table->Stop || table->Thread == NULL ||
+      (closing && !DokanHandleDeferred(process, EventContext)) ||
+      (!closing && IsListEmpty(&process->Deferred) &&
+       DokanTakeTokens(table, process, EventContext) == 0)) {
+    process->Active++;
+    LeaveCriticalSection(&table->Lock);
+    DokanDispatchAccounted(Device, EventContext, DokanInstance, process);
+    return TRUE;
+  }
+
+  // the event buffer is reused by the loop
+  deferred = (PDOKAN_DEFERRED_EVENT)malloc(
+      FIELD_OFFSET(DOKAN_DEFERRED_EVENT, EventContext) + Length);
+  if (deferred == NULL) {
+    process->Active++;
+    LeaveCriticalSection(&table->Lock);
+    DokanDispatchAccounted(Device, EventContext, DokanInstance, process);
+    return TRUE;
+  }
+  deferred->Device = Device;
+  deferred->QueueTime = GetTickCount64();
+  deferred->Closing = closing;
+  RtlCopyMemory(&deferred->EventContext, EventContext, Length);
+
+  if (IsListEmpty(&process->Deferred))
+    InsertTailList(&table->Throttled, &process->ThrottledEntry);
+  InsertTailList(&process->Deferred, &deferred->ListEntry);
+  process->Statistics.ThrottledOperations++;
+
+  LeaveCriticalSection(&table->Lock);
+
+  SetEvent(table->Wake);
+  return FALSE;
+}
+
+// Dispatch the deferred events once their process has the tokens, one
+// process after the other. Running on one thread, the throttled processes
+// never hold the workers serving the others.
+UINT WINAPI DokanThrottleLoop(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+
+  while (TRUE) {
+    PDOKAN_DEFERRED_EVENT deferred = NULL;
+    PDOKAN_PROCESS process = NULL;
+    PLIST_ENTRY listEntry;
+    DWORD wait = INFINITE;
+
+    EnterCriticalSection(&table->Lock);
+
+    if (table->Stop) {
+      LeaveCriticalSection(&table->Lock);
+      break;
+    }
+
+    for (listEntry = table->Throttled.Flink; listEntry != &table->Throttled;
+         listEntry = listEntry->Flink) {
+      ULONG tokenWait;
+
+      process = CONTAINING_RECORD(listEntry, DOKAN_PROCESS, ThrottledEntry);
+      deferred = CONTAINING_RECORD(process->Deferred.Flink,
+                                   DOKAN_DEFERRED_EVENT, ListEntry);
+      tokenWait = 0;
+      if (!deferred->Closing)
+        tokenWait = DokanTakeTokens(table, process, &deferred->EventContext);
+      if (tokenWait == 0)
+        break;
+      if (tokenWait < wait)
+        wait = tokenWait;
+      deferred = NULL;
+    }
+
+    if (deferred != NULL) {
+      RemoveEntryList(&deferred->ListEntry);
+      // the next process goes first next time
+      RemoveEntryList(&process->ThrottledEntry);
+      if (!IsListEmpty(&process->Deferred))
+        InsertTailList(&table->Throttled, &process->ThrottledEntry);
+      else
+        InitializeListHead(&process->ThrottledEntry);
+      process->Statistics.ThrottledTime +=
+          GetTickCount64() - deferred->QueueTime;
+      process->Active++;
+    }
+
+    LeaveCriticalSection(&table->Lock);
+
+    if (deferred == NULL) {
+      WaitForSingleObject(table->Wake, wait);
+      continue;
+    }
+
+    DokanDispatchAccounted(deferred->Device, &deferred->EventContext,
+                           DokanInstance, process);
+    CloseHandle(deferred->Device);
+    free(deferred);
+  }
+
+  _endthreadex(0);
+  return 0;
+}
+
+BOOL DokanStartThrottle(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+
+  table->Wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (table->Wake == NULL)
+    return FALSE;
+
+  table->Thread = (HANDLE)_beginthreadex(NULL, 0, DokanThrottleLoop,
+                                         (PVOID)DokanInstance, 0, NULL);
+  if (table->Thread == NULL) {
+    CloseHandle(table->Wake);
+    table->Wake = NULL;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+VOID DokanStopThrottle(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PROCESS_TABLE table = &DokanInstance->ProcessTable;
+  PLIST_ENTRY listEntry;
+
+  EnterCriticalSection(&table->Lock);
+  table->Stop = TRUE;
+  LeaveCriticalSection(&table->Lock);
+
+  if (table->Thread == NULL)
+    return;
+
+  SetEvent(table->Wake);
+  WaitForSingleObject(table->Thread, INFINITE);
+  CloseHandle(table->Thread);
+  CloseHandle(table->Wake);
+  table->Thread = NULL;
+  table->Wake = NULL;
+
+  // the driver already gave up the requests left
+  for (listEntry = table->Lru.Flink; listEntry != &table->Lru;
+       listEntry = listEntry->Flink) {
+    DokanFreeDeferredEvents(
+        CONTAINING_RECORD(listEntry, DOKAN_PROCESS, LruEntry));
+  }
+  InitializeListHead(&table->Throttled);
+}
+
+PDOKAN_INSTANCE DokanFindInstance(PDOKAN_OPTIONS DokanOptions) {
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = g_InstanceList.Flink; listEntry != &g_InstanceList;
+       listEntry = listEntry->Flink) {
+    PDOKAN_INSTANCE instance =
+        CONTAINING_RECORD(listEntry, DOKAN_INSTANCE, ListEntry);
+    if (instance->UserOptions == DokanOptions)
+      return instance;
+  }
+  return NULL;
+}
+
+ULONG DOKANAPI DokanGetProcessStatistics(PDOKAN_OPTIONS DokanOptions,
+                                         PDOKAN_PROCESS_STATISTICS Statistics,
+                                         ULONG Count) {
+  PDOKAN_INSTANCE instance;
+  PLIST_ENTRY listEntry;
+  ULONG processCount = 0;
+
+  EnterCriticalSection(&g_InstanceCriticalSection);
+
+  instance = DokanFindInstance(DokanOptions);
+  if (instance != NULL) {
+    PDOKAN_PROCESS_TABLE table = &instance->ProcessTable;
+
+    EnterCriticalSection(&table->Lock);
+    // most recently active first
+    for (listEntry = table->Lru.Blink; listEntry != &table->Lru;
+         listEntry = listEntry->Blink) {
+      if (processCount < Count)
+        Statistics[processCount] =
+            CONTAINING_RECORD(listEntry, DOKAN_PROCESS, LruEntry)->Statistics;
+      processCount++;
+    }
+    LeaveCriticalSection(&table->Lock);
+  }
+
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+  return processCount;
+}
+
+BOOL DOKANAPI DokanSetProcessLimit(PDOKAN_OPTIONS DokanOptions,
+                                   ULONG ProcessId,
+                                   PDOKAN_PROCESS_LIMIT Limit) {
+  PDOKAN_INSTANCE instance;
+  BOOL found = FALSE;
+
+  EnterCriticalSection(&g_InstanceCriticalSection);
+
+  instance = DokanFindInstance(DokanOptions);
+  if (instance != NULL) {
+    PDOKAN_PROCESS_TABLE table = &instance->ProcessTable;
+
+    EnterCriticalSection(&table->Lock);
+    if (ProcessId == 0) {
+      if (Limit != NULL)
+        table->DefaultLimit = *Limit;
+      else
+        ZeroMemory(&table->DefaultLimit, sizeof(DOKAN_PROCESS_LIMIT));
+      found = TRUE;
+    } else {
+      PDOKAN_PROCESS process = Limit != NULL
+                                   ? DokanGetProcess(table, ProcessId)
+                                   : DokanFindProcess(table, ProcessId);
+      if (process != NULL) {
+        process->HasLimit = Limit != NULL;
+        if (Limit != NULL)
+          process->Limit = *Limit;
+        found = TRUE;
+      } else {
+        found = Limit == NULL;
+      }
+    }
+    LeaveCriticalSection(&table->Lock);
+
+    // the deferred events may go sooner
+    if (table->Wake != NULL)
+      SetEvent(table->Wake);
+  }
+
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+  return found;
+}
@@ -21,14 +21,306 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 
+// used when the window is first opened for reads smaller than half of it
+#define DOKAN_READ_AHEAD_MIN_WINDOW (64 * 1024)
+
+// Split the Length bytes of Buffer at Offset in segments which do not cross
+// a boundary of the DOKAN_OPTIONS.IoSegmentSize blocks. Returns the
+// allocated segments, NULL on allocation failure.
+PDOKAN_IO_SEGMENT DokanSplitIo(PDOKAN_INSTANCE DokanInstance, PVOID Buffer,
+                               ULONG Length, LONGLONG Offset, PULONG Count) {
+  ULONG segmentSize = DokanInstance->DokanOptions->IoSegmentSize;
+  PDOKAN_IO_SEGMENT segments;
+  ULONG done = 0;
+  ULONG i;
+
+  *Count = 1;
+  if (segmentSize != 0 && Length > 0)
+    *Count = (ULONG)((Offset + Length - 1) / segmentSize -
+                     Offset / segmentSize + 1);
+
+  segments = (PDOKAN_IO_SEGMENT)malloc(*Count * sizeof(DOKAN_IO_SEGMENT));
+  if (segments == NULL)
+    return NULL;
+
+  for (i = 0; i < *Count; ++i) {
+    ULONG length = Length - done;
+    if (segmentSize != 0 &&
+        length > segmentSize - (ULONG)((Offset + done) % segmentSize))
+      length = segmentSize - (ULONG)((Offset + done) % segmentSize);
+    segments[i].Offset = Offset + done;
+    segments[i].Length = length;
+    segments[i].Buffer = (PCHAR)Buffer + done;
+    done += length;
+  }
+  return segments;
+}
+
+// ReadFile, or ReadFileV with the read split in segments
+NTSTATUS DokanCallReadFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                           PVOID Buffer, ULONG Length, PULONG ReadLength,
+                           LONGLONG Offset, PDOKAN_FILE_INFO FileInfo) {
+  PDOKAN_IO_SEGMENT segments;
+  ULONG count;
+  NTSTATUS status;
+
+  if (DokanInstance->DokanOperations->ReadFileV == NULL)
+    return DokanInstance->DokanOperations->ReadFile(
+        FileName, Buffer, Length, ReadLength, Offset, FileInfo);
+
+  segments = DokanSplitIo(DokanInstance, Buffer, Length, Offset, &count);
+  if (segments == NULL)
+    return STATUS_INSUFFICIENT_RESOURCES;
+  status = DokanInstance->DokanOperations->ReadFileV(FileName, segments, count,
+                                                     ReadLength, FileInfo);
+  free(segments);
+  return status;
+}
+
+// Read-ahead state of the handle, allocated by its first read. NULL when
+// read-ahead is disabled or on allocation failure.
+PDOKAN_READ_AHEAD DokanGetReadAhead(PDOKAN_OPEN_INFO OpenInfo,
+                                    PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_READ_AHEAD readAhead;
+
+  if (DokanInstance->DokanOptions->ReadAheadMaxSize == 0)
+    return NULL;
+  if (OpenInfo->ReadAhead != NULL)
+    return OpenInfo->ReadAhead;
+
+  readAhead = (PDOKAN_READ_AHEAD)malloc(sizeof(DOKAN_READ_AHEAD));
+  if (readAhead == NULL)
+    return NULL;
+  ZeroMemory(readAhead, sizeof(DOKAN_READ_AHEAD));
+  InitializeCriticalSection(&readAhead->Lock);
+  readAhead->RandomAccess =
+      (OpenInfo->CreateOptions & FILE_RANDOM_ACCESS) != 0;
+  if (readAhead->RandomAccess)
+    readAhead->AccessPattern = DOKAN_ACCESS_PATTERN_RANDOM;
+  else if (OpenInfo->CreateOptions & FILE_SEQUENTIAL_ONLY)
+    readAhead->AccessPattern = DOKAN_ACCESS_PATTERN_SEQUENTIAL;
+
+  // another read of the handle may have done it meanwhile
+  EnterCriticalSection(&DokanInstance->CriticalSection);
+  if (OpenInfo->ReadAhead == NULL) {
+    OpenInfo->ReadAhead = readAhead;
+    readAhead = NULL;
+  }
+  LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+  if (readAhead != NULL) {
+    DeleteCriticalSection(&readAhead->Lock);
+    free(readAhead);
+  }
+  return OpenInfo->ReadAhead;
+}
+
+// The FileSystem is about to close the file, nothing must be read ahead from
+// it anymore
+VOID DokanReadAheadClose(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_READ_AHEAD readAhead = OpenInfo->ReadAhead;
+
+  if (readAhead == NULL)
+    return;
+
+  // waits for a read ahead in progress
+  EnterCriticalSection(&readAhead->Lock);
+  readAhead->Closed = TRUE;
+  if (readAhead->Buffer != NULL)
+    free(readAhead->Buffer);
+  readAhead->Buffer = NULL;
+  readAhead->BufferCapacity = 0;
+  readAhead->BufferLength = 0;
+  LeaveCriticalSection(&readAhead->Lock);
+}
+
+VOID DokanReadAheadDelete(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_READ_AHEAD readAhead = OpenInfo->ReadAhead;
+
+  if (readAhead == NULL)
+    return;
+
+  if (readAhead->Buffer != NULL)
+    free(readAhead->Buffer);
+  DeleteCriticalSection(&readAhead->Lock);
+  free(readAhead);
+  OpenInfo->ReadAhead = NULL;
+}
+
+// Classify the read of Length bytes at Offset and copy in Buffer what was
+// read ahead of it. Returns the number of bytes copied, from Offset. Eof is
+// set when the copied bytes end at the end of the file. Called with the
+// lock held.
+ULONG DokanReadAheadLookup(PDOKAN_READ_AHEAD ReadAhead, ULONG Generation,
+                           LONGLONG Offset, ULONG Length, PCHAR Buffer,
+                           PBOOLEAN Eof) {
+  BOOL sequential = Offset == ReadAhead->NextOffset;
+  LONGLONG bufferEnd = ReadAhead->BufferOffset + ReadAhead->BufferLength;
+  ULONG copied = 0;
+
+  *Eof = FALSE;
+
+  // the file was changed since it was read ahead
+  if (ReadAhead->BufferGeneration != Generation) {
+    ReadAhead->BufferLength = 0;
+    ReadAhead->Eof = FALSE;
+    bufferEnd = ReadAhead->BufferOffset;
+  }
+
+  if (sequential) {
+    ReadAhead->SequentialCount++;
+  } else {
+    // collapse the window, and the data which is not going to be used
+    ReadAhead->SequentialCount = 0;
+    ReadAhead->Window = 0;
+    if (Offset < ReadAhead->BufferOffset || Offset >= bufferEnd) {
+      ReadAhead->BufferLength = 0;
+      ReadAhead->Eof = FALSE;
+    }
+  }
+
+  // FILE_SEQUENTIAL_ONLY makes it sequential until a read proves otherwise
+  if (ReadAhead->RandomAccess || !sequential)
+    ReadAhead->AccessPattern = DOKAN_ACCESS_PATTERN_RANDOM;
+  else if (ReadAhead->SequentialCount >= 2)
+    ReadAhead->AccessPattern = DOKAN_ACCESS_PATTERN_SEQUENTIAL;
+
+  if (ReadAhead->BufferLength > 0 && Offset >= ReadAhead->BufferOffset &&
+      Offset < bufferEnd) {
+    ULONG start = (ULONG)(Offset - ReadAhead->BufferOffset);
+    copied = ReadAhead->BufferLength - start;
+    if (copied > Length)
+      copied = Length;
+    RtlCopyMemory(Buffer, ReadAhead->Buffer + start, copied);
+    *Eof = ReadAhead->Eof && Offset + copied == bufferEnd;
+  }
+
+  ReadAhead->NextOffset = Offset + Length;
+  ReadAhead->LastLength = Length;
+  return copied;
+}
+
+// Called after replying to a read of a handle read sequentially: read the
+// data following it unless enough of it is already buffered
+VOID DokanReadAhead(PDOKAN_READ_AHEAD ReadAhead, PEVENT_CONTEXT EventContext,
+                    PDOKAN_FILE_INFO FileInfo, PDOKAN_OPEN_INFO OpenInfo,
+                    PDOKAN_INSTANCE DokanInstance) {
+  ULONG maxSize = DokanInstance->DokanOptions->ReadAheadMaxSize;
+  LPCWSTR fileName = EventContext->Operation.Read.FileName;
+  LONGLONG offset;
+  ULONG keep = 0;
+  ULONG length;
+  ULONG readLength = 0;
+  ULONG generation;
+  NTSTATUS status;
+
+  EnterCriticalSection(&ReadAhead->Lock);
+
+  if (ReadAhead->Closed ||
+      ReadAhead->AccessPattern != DOKAN_ACCESS_PATTERN_SEQUENTIAL ||
+      (!DokanInstance->DokanOperations->ReadFile &&
+       !DokanInstance->DokanOperations->ReadFileV)) {
+    LeaveCriticalSection(&ReadAhead->Lock);
+    return;
+  }
+
+  offset = ReadAhead->NextOffset;
+
+  // keep what the application did not read yet
+  if (offset >= ReadAhead->BufferOffset &&
+      offset < ReadAhead->BufferOffset + ReadAhead->BufferLength) {
+    ULONG start = (ULONG)(offset - ReadAhead->BufferOffset);
+    keep = ReadAhead->BufferLength - start;
+    RtlMoveMemory(ReadAhead->Buffer, ReadAhead->Buffer + start, keep);
+  } else {
+    ReadAhead->Eof = FALSE;
+  }
+  ReadAhead->BufferOffset = offset;
+  ReadAhead->BufferLength = keep;
+
+  // the window doubles with each read ahead while the handle is read
+  // sequentially
+  if (ReadAhead->Window == 0) {
+    ReadAhead->Window = ReadAhead->LastLength * 2;
+    if (ReadAhead->Window < DOKAN_READ_AHEAD_MIN_WINDOW)
+      ReadAhead->Window = DOKAN_READ_AHEAD_MIN_WINDOW;
+  } else if (keep < ReadAhead->Window / 2 && ReadAhead->Window < maxSize) {
+    ReadAhead->Window *= 2;
+  }
+  if (ReadAhead->Window > maxSize)
+    ReadAhead->Window = maxSize;
+
+  // half of the window is still to be read
+  if (ReadAhead->Eof || keep >= ReadAhead->Window / 2) {
+    LeaveCriticalSection(&ReadAhead->Lock);
+    return;
+  }
+
+  if (ReadAhead->BufferCapacity < ReadAhead->Window) {
+    PCHAR buffer = (PCHAR)realloc(ReadAhead->Buffer, ReadAhead->Window);
+    if (buffer == NULL) {
+      LeaveCriticalSection(&ReadAhead->Lock);
+      return;
+    }
+    ReadAhead->Buffer = buffer;
+    ReadAhead->BufferCapacity = ReadAhead->Window;
+  }
+
+  length = ReadAhead->Window - keep;
+  generation = DokanDataGeneration(DokanInstance, fileName);
+  if (keep == 0)
+    ReadAhead->BufferGeneration = generation;
+
+  DbgPrint("  read ahead %lu bytes at %I64d\n", length, offset + keep);
+
+  // with the lock held, a read of the handle waits for the data it most
+  // likely asks for
+  FileInfo->Context = OpenInfo->UserContext;
+  FileInfo->AccessPattern = ReadAhead->AccessPattern;
+  status = DokanCallReadFile(DokanInstance, fileName, ReadAhead->Buffer + keep,
+                             length, &readLength, offset + keep, FileInfo);
+
+  // the reply is sent, other requests of the handle may run meanwhile
+  EnterCriticalSection(&DokanInstance->CriticalSection);
+  OpenInfo->UserContext = FileInfo->Context;
+  LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+  if (status == STATUS_SUCCESS && ReadAhead->BufferGeneration == generation) {
+    if (readLength > length)
+      readLength = length;
+    ReadAhead->BufferLength = keep + readLength;
+    ReadAhead->Eof = readLength < length;
+  }
+
+  LeaveCriticalSection(&ReadAhead->Lock);
+}
+
+// Read from the FileSystem, through the block cache when Cached is set
+NTSTATUS DokanReadFileData(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                           PCHAR Buffer, ULONG Length, LONGLONG Offset,
+                           PULONG ReadLength, PDOKAN_FILE_INFO FileInfo,
+                           BOOL Cached) {
+  if (Cached)
+    return DokanBlockCacheRead(DokanInstance, FileName, Buffer, Length, Offset,
+                               ReadLength, FileInfo);
+  return DokanCallReadFile(DokanInstance, FileName, Buffer, Length, ReadLength,
+                           Offset, FileInfo);
+}
+
 VOID DispatchRead(HANDLE Handle, PEVENT_CONTEXT EventContext,
                   PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_READ_AHEAD readAhead = NULL;
   ULONG readLength = 0;
+  ULONG copied = 0;
+  BOOLEAN eof = FALSE;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
   DOKAN_FILE_INFO fileInfo;
   ULONG sizeOfEventInfo;
+  LONGLONG offset = EventContext->Operation.Read.ByteOffset.QuadPart;
+  ULONG length = EventContext->Operation.Read.BufferLength;
+  EVENT_INFORMATION releaseInfo;
 
   sizeOfEventInfo =
       sizeof(EVENT_INFORMATION) - 8 + EventContext->Operation.Read.BufferLength;
@@ -40,11 +332,49 @@ VOID DispatchRead(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   DbgPrint("###Read %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->ReadFile) {
-    status = DokanInstance->DokanOperations->ReadFile(
-        EventContext->Operation.Read.FileName, eventInfo->Buffer,
-        EventContext->Operation.Read.BufferLength, &readLength,
-        EventContext->Operation.Read.ByteOffset.QuadPart, &fileInfo);
+  // the writes buffered for the file come before
+  DokanWriteBehindFlushFile(DokanInstance,
+                            EventContext->Operation.Read.FileName, NULL);
+  if (openInfo != NULL)
+    fileInfo.Context = openInfo->UserContext;
+
+  if (openInfo != NULL && !openInfo->IsDirectory)
+    readAhead = DokanGetReadAhead(openInfo, DokanInstance);
+
+  if (readAhead != NULL) {
+    ULONG generation = DokanDataGeneration(
+        DokanInstance, EventContext->Operation.Read.FileName);
+
+    EnterCriticalSection(&readAhead->Lock);
+    copied = DokanReadAheadLookup(readAhead, generation, offset, length,
+                                  (PCHAR)eventInfo->Buffer, &eof);
+    fileInfo.AccessPattern = readAhead->AccessPattern;
+    LeaveCriticalSection(&readAhead->Lock);
+  }
+
+  if (copied > 0 && (copied == length || eof)) {
+    DbgPrint("  %lu bytes read ahead\n", copied);
+    status = STATUS_SUCCESS;
+    readLength = copied;
+  } else if (DokanInstance->DokanOperations->ReadFile ||
+             DokanInstance->DokanOperations->ReadFileV) {
+    BOOL cached =
+        DokanInstance->DokanOptions->BlockCacheSize != 0 &&
+        (openInfo == NULL ||
+         !(openInfo->CreateOptions & FILE_NO_INTERMEDIATE_BUFFERING));
+
+    // what was not read ahead
+    if (DokanInstance->DokanOptions->Options & DOKAN_OPTION_MERGE_READS)
+      status = DokanReadQueueRead(
+          DokanInstance, EventContext->Operation.Read.FileName,
+          (PCHAR)eventInfo->Buffer + copied, length - copied, offset + copied,
+          &readLength, &fileInfo, cached);
+    else
+      status = DokanReadFileData(
+          DokanInstance, EventContext->Operation.Read.FileName,
+          (PCHAR)eventInfo->Buffer + copied, length - copied, offset + copied,
+          &readLength, &fileInfo, cached);
+    readLength += copied;
   }
 
   if (openInfo != NULL)
@@ -62,7 +392,23 @@ VOID DispatchRead(HANDLE Handle, PEVENT_CONTEXT EventContext,
     }
   }
 
+  // the handle is kept open until the read ahead is done
+  if (readAhead != NULL) {
+    EnterCriticalSection(&DokanInstance->CriticalSection);
+    openInfo->OpenCount++;
+    LeaveCriticalSection(&DokanInstance->CriticalSection);
+  }
+
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
   free(eventInfo);
+
+  if (readAhead != NULL) {
+    DokanReadAhead(readAhead, EventContext, &fileInfo, openInfo,
+                   DokanInstance);
+
+    RtlZeroMemory(&releaseInfo, sizeof(EVENT_INFORMATION));
+    releaseInfo.Context = (ULONG64)openInfo;
+    ReleaseDokanOpenInfo(&releaseInfo, DokanInstance);
+  }
   return;
 }
@@ -0,0 +1,297 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// largest read made of merged reads
+#define DOKAN_READ_QUEUE_MAX_MERGE (1024 * 1024)
+
+// read of a worker waiting for the reads of the file in progress
+typedef struct _DOKAN_PENDING_READ {
+  // in DOKAN_READ_QUEUE_FILE.Pending, by offset
+  LIST_ENTRY ListEntry;
+  LONGLONG Offset;
+  ULONG Length;
+  PCHAR Buffer;
+  PDOKAN_FILE_INFO FileInfo;
+  // read through the block cache
+  BOOL Cached;
+  // set when the read is done, or when its worker has to do the next reads
+  // of the file
+  HANDLE Event;
+  BOOL Done;
+  NTSTATUS Status;
+  ULONG ReadLength;
+} DOKAN_PENDING_READ, *PDOKAN_PENDING_READ;
+
+// file with a worker reading it, the leader, which reads what the other
+// workers queue meanwhile
+typedef struct _DOKAN_READ_QUEUE_FILE {
+  LIST_ENTRY ListEntry;
+  LIST_ENTRY Pending;
+  // where the last read ended, the next reads start from there
+  LONGLONG Position;
+  ULONG Hash;
+  ULONG PathLength;
+  WCHAR Path[1];
+} DOKAN_READ_QUEUE_FILE, *PDOKAN_READ_QUEUE_FILE;
+
+VOID DokanInitReadQueue(PDOKAN_INSTANCE DokanInstance) {
+  InitializeCriticalSection(&DokanInstance->ReadQueue.Lock);
+  InitializeListHead(&DokanInstance->ReadQueue.Files);
+}
+
+VOID DokanDeleteReadQueue(PDOKAN_INSTANCE DokanInstance) {
+  // a file is removed by its last reader
+  DeleteCriticalSection(&DokanInstance->ReadQueue.Lock);
+}
+
+PDOKAN_READ_QUEUE_FILE DokanReadQueueFindFile(PDOKAN_READ_QUEUE Queue,
+                                              LPCWSTR FileName, ULONG Length,
+                                              ULONG Hash, BOOL IgnoreCase) {
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = Queue->Files.Flink; listEntry != &Queue->Files;
+       listEntry = listEntry->Flink) {
+    PDOKAN_READ_QUEUE_FILE file =
+        CONTAINING_RECORD(listEntry, DOKAN_READ_QUEUE_FILE, ListEntry);
+    if (file->Hash == Hash &&
+        DokanCachePathEqual(file->Path, file->PathLength, FileName, Length,
+                            IgnoreCase))
+      return file;
+  }
+  return NULL;
+}
+
+VOID DokanReadQueueInsert(PDOKAN_READ_QUEUE_FILE File,
+                          PDOKAN_PENDING_READ Read) {
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = File->Pending.Flink; listEntry != &File->Pending;
+       listEntry = listEntry->Flink) {
+    if (CONTAINING_RECORD(listEntry, DOKAN_PENDING_READ, ListEntry)->Offset >
+        Read->Offset)
+      break;
+  }
+  InsertTailList(listEntry, &Read->ListEntry);
+}
+
+// Read the reads of Batch from First, by offset, with one call for reads
+// which overlap or follow each other. Returns where the last read ended.
+LONGLONG DokanReadQueueReadBatch(PDOKAN_INSTANCE DokanInstance,
+                                 LPCWSTR FileName, PLIST_ENTRY Batch,
+                                 PLIST_ENTRY First, PLIST_ENTRY Last) {
+  PLIST_ENTRY listEntry = First;
+  LONGLONG position = 0;
+
+  while (listEntry != Last) {
+    PDOKAN_PENDING_READ first =
+        CONTAINING_RECORD(listEntry, DOKAN_PENDING_READ, ListEntry);
+    PLIST_ENTRY end = listEntry->Flink;
+    LONGLONG runOffset = first->Offset;
+    LONGLONG runEnd = first->Offset + first->Length;
+    ULONG runRead = 0;
+    PCHAR runBuffer;
+    NTSTATUS status;
+
+    while (end != Last && end != Batch) {
+      PDOKAN_PENDING_READ next =
+          CONTAINING_RECORD(end, DOKAN_PENDING_READ, ListEntry);
+      LONGLONG nextEnd = next->Offset + next->Length;
+      if (next->Offset > runEnd || next->Cached != first->Cached ||
+          (nextEnd > runEnd &&
+           nextEnd - runOffset > DOKAN_READ_QUEUE_MAX_MERGE))
+        break;
+      if (nextEnd > runEnd)
+        runEnd = nextEnd;
+      end = end->Flink;
+    }
+
+    // a read alone is made in its own buffer
+    if (end == listEntry->Flink) {
+      first->Status = DokanReadFileData(
+          DokanInstance, FileName, first->Buffer, first->Length,
+          first->Offset, &first->ReadLength, first->FileInfo, first->Cached);
+      position = first->Offset + first->ReadLength;
+      listEntry = end;
+      continue;
+    }
+
+    DbgPrint("  merged reads of %I64d bytes at %I64d\n", runEnd - runOffset,
+             runOffset);
+
+    runBuffer = (PCHAR)malloc((SIZE_T)(runEnd - runOffset));
+    if (runBuffer != NULL) {
+      status = DokanReadFileData(DokanInstance, FileName, runBuffer,
+                                 (ULONG)(runEnd - runOffset), runOffset,
+                                 &runRead, first->FileInfo, first->Cached);
+      if (runRead > runEnd - runOffset)
+        runRead = (ULONG)(runEnd - runOffset);
+    } else {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (; listEntry != end; listEntry = listEntry->Flink) {
+      PDOKAN_PENDING_READ read =
+          CONTAINING_RECORD(listEntry, DOKAN_PENDING_READ, ListEntry);
+      ULONG start = (ULONG)(read->Offset - runOffset);
+
+      read->Status = status;
+      read->ReadLength = 0;
+      if (status == STATUS_SUCCESS && start < runRead) {
+        read->ReadLength = runRead - start;
+        if (read->ReadLength > read->Length)
+          read->ReadLength = read->Length;
+        RtlCopyMemory(read->Buffer, runBuffer + start, read->ReadLength);
+      }
+    }
+
+    if (runBuffer != NULL)
+      free(runBuffer);
+    position = runOffset + runRead;
+  }
+  return position;
+}
+
+// Read Length bytes of FileName at Offset with DokanReadFileData. While a
+// worker reads the file, the reads of the other workers are queued, then
+// read by one of them in one pass over the file, starting where the
+// previous pass ended, with one call for reads which follow each other.
+NTSTATUS DokanReadQueueRead(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PCHAR Buffer, ULONG Length, LONGLONG Offset,
+                            PULONG ReadLength, PDOKAN_FILE_INFO FileInfo,
+                            BOOL Cached) {
+  PDOKAN_READ_QUEUE queue = &DokanInstance->ReadQueue;
+  ULONG pathLength = DokanCachePathLength(FileName);
+  ULONG hash = DokanCacheHash(FileName, pathLength);
+  PDOKAN_READ_QUEUE_FILE file;
+  DOKAN_PENDING_READ read;
+  PDOKAN_PENDING_READ next = NULL;
+  LIST_ENTRY batch;
+  PLIST_ENTRY listEntry, nextEntry, start;
+  BOOL first = FALSE;
+
+  ZeroMemory(&read, sizeof(DOKAN_PENDING_READ));
+  read.Offset = Offset;
+  read.Length = Length;
+  read.Buffer = Buffer;
+  read.FileInfo = FileInfo;
+  read.Cached = Cached;
+
+  EnterCriticalSection(&queue->Lock);
+
+  file = DokanReadQueueFindFile(queue, FileName, pathLength, hash,
+                                DokanCacheIgnoreCase(DokanInstance));
+  if (file != NULL) {
+    read.Event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (read.Event == NULL) {
+      // read alone
+      LeaveCriticalSection(&queue->Lock);
+      return DokanReadFileData(DokanInstance, FileName, Buffer, Length,
+                               Offset, ReadLength, FileInfo, Cached);
+    }
+    DokanReadQueueInsert(file, &read);
+    LeaveCriticalSection(&queue->Lock);
+
+    WaitForSingleObject(read.Event, INFINITE);
+    CloseHandle(read.Event);
+    read.Event = NULL;
+
+    if (read.Done) {
+      *ReadLength = read.ReadLength;
+      return read.Status;
+    }
+    // the leader left the reads queued meanwhile to this worker
+  } else {
+    file = (PDOKAN_READ_QUEUE_FILE)malloc(sizeof(DOKAN_READ_QUEUE_FILE) +
+                                          pathLength * sizeof(WCHAR));
+    if (file == NULL) {
+      LeaveCriticalSection(&queue->Lock);
+      return DokanReadFileData(DokanInstance, FileName, Buffer, Length,
+                               Offset, ReadLength, FileInfo, Cached);
+    }
+    InitializeListHead(&file->Pending);
+    file->Position = Offset;
+    file->Hash = hash;
+    file->PathLength = pathLength;
+    RtlCopyMemory(file->Path, FileName, pathLength * sizeof(WCHAR));
+    file->Path[pathLength] = L'\0';
+    InsertTailList(&queue->Files, &file->ListEntry);
+    DokanReadQueueInsert(file, &read);
+    LeaveCriticalSection(&queue->Lock);
+    first = TRUE;
+  }
+
+  // leave time for the reads which come along to be queued
+  if (first && DokanInstance->DokanOptions->ReadMergeWindow != 0)
+    Sleep(DokanInstance->DokanOptions->ReadMergeWindow);
+
+  EnterCriticalSection(&queue->Lock);
+  InitializeListHead(&batch);
+  if (!IsListEmpty(&file->Pending)) {
+    batch.Flink = file->Pending.Flink;
+    batch.Blink = file->Pending.Blink;
+    batch.Flink->Blink = &batch;
+    batch.Blink->Flink = &batch;
+    InitializeListHead(&file->Pending);
+  }
+  LeaveCriticalSection(&queue->Lock);
+
+  // the reads after the position, then from the start of the file
+  for (start = batch.Flink; start != &batch; start = start->Flink) {
+    if (CONTAINING_RECORD(start, DOKAN_PENDING_READ, ListEntry)->Offset >=
+        file->Position)
+      break;
+  }
+  file->Position = DokanReadQueueReadBatch(DokanInstance, FileName, &batch,
+                                           start, &batch);
+  if (start != batch.Flink)
+    file->Position = DokanReadQueueReadBatch(DokanInstance, FileName,
+                                             &batch, batch.Flink, start);
+
+  EnterCriticalSection(&queue->Lock);
+
+  if (IsListEmpty(&file->Pending)) {
+    RemoveEntryList(&file->ListEntry);
+    free(file);
+  } else {
+    next = CONTAINING_RECORD(file->Pending.Flink, DOKAN_PENDING_READ,
+                             ListEntry);
+  }
+
+  for (listEntry = batch.Flink; listEntry != &batch; listEntry = nextEntry) {
+    PDOKAN_PENDING_READ done =
+        CONTAINING_RECORD(listEntry, DOKAN_PENDING_READ, ListEntry);
+    nextEntry = listEntry->Flink;
+    // its worker returns once woken
+    done->Done = TRUE;
+    if (done != &read)
+      SetEvent(done->Event);
+  }
+
+  LeaveCriticalSection(&queue->Lock);
+
+  if (next != NULL)
+    SetEvent(next->Event);
+
+  *ReadLength = read.ReadLength;
+  return read.Status;
+}
@@ -21,6 +21,9 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 
+// a larger size returned by GetFileSecurity is not read ahead for the cache
+#define DOKAN_SECURITY_DESCRIPTOR_MAX_LENGTH (64 * 1024)
+
 VOID DispatchQuerySecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
                            PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
@@ -29,6 +32,11 @@ VOID DispatchQuerySecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
   ULONG eventInfoLength;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
   ULONG lengthNeeded = 0;
+  SECURITY_INFORMATION securityInformation =
+      EventContext->Operation.Security.SecurityInformation;
+  ULONG generation;
+  PDOKAN_FLIGHT flight;
+  NTSTATUS flightStatus;
 
   eventInfoLength = sizeof(EVENT_INFORMATION) - 8 +
                     EventContext->Operation.Security.BufferLength;
@@ -40,12 +48,65 @@ VOID DispatchQuerySecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
   DbgPrint("###GetFileSecurity %04d\n",
            openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->GetFileSecurity) {
+  // read before calling the FileSystem, see DokanSecurityCacheInsert
+  generation = (ULONG)DokanInstance->CacheGeneration;
+
+  if (DokanSecurityCacheLookup(
+          DokanInstance, EventContext->Operation.Security.FileName,
+          securityInformation, &eventInfo->Buffer,
+          EventContext->Operation.Security.BufferLength, &lengthNeeded)) {
+    status = STATUS_SUCCESS;
+
+  } else if (DokanInstance->DokanOperations->GetFileSecurity &&
+             !DokanFlightBegin(
+                 DokanInstance, DOKAN_FLIGHT_FILE_SECURITY, securityInformation,
+                 EventContext->Operation.Security.FileName, &eventInfo->Buffer,
+                 EventContext->Operation.Security.BufferLength, &status,
+                 &lengthNeeded, &flight)) {
     status = DokanInstance->DokanOperations->GetFileSecurity(
         EventContext->Operation.Security.FileName,
         &EventContext->Operation.Security.SecurityInformation,
         &eventInfo->Buffer, EventContext->Operation.Security.BufferLength,
         &lengthNeeded, &fileInfo);
+
+    // a descriptor larger than the buffer is not in it
+    flightStatus = status;
+    if (status == STATUS_SUCCESS &&
+        lengthNeeded > EventContext->Operation.Security.BufferLength)
+      flightStatus = STATUS_BUFFER_OVERFLOW;
+    DokanFlightEnd(DokanInstance, flight, flightStatus, &eventInfo->Buffer,
+                   lengthNeeded);
+
+    if (status == STATUS_SUCCESS &&
+        lengthNeeded <= EventContext->Operation.Security.BufferLength) {
+      DokanSecurityCacheInsert(DokanInstance,
+                               EventContext->Operation.Security.FileName,
+                               securityInformation, &eventInfo->Buffer,
+                               lengthNeeded, generation);
+
+    } else if (status == STATUS_BUFFER_OVERFLOW &&
+               DokanInstance->DokanOptions->SecurityCacheTimeout != 0 &&
+               lengthNeeded > EventContext->Operation.Security.BufferLength &&
+               lengthNeeded <= DOKAN_SECURITY_DESCRIPTOR_MAX_LENGTH) {
+      // the caller only asked for the size and will come back with a buffer
+      // large enough, read the descriptor now so that it is in the cache
+      PVOID descriptor = malloc(lengthNeeded);
+      ULONG descriptorLength = 0;
+
+      if (descriptor != NULL) {
+        SECURITY_INFORMATION requested = securityInformation;
+
+        if (DokanInstance->DokanOperations->GetFileSecurity(
+                EventContext->Operation.Security.FileName, &requested,
+                descriptor, lengthNeeded, &descriptorLength,
+                &fileInfo) == STATUS_SUCCESS &&
+            descriptorLength <= lengthNeeded)
+          DokanSecurityCacheInsert(
+              DokanInstance, EventContext->Operation.Security.FileName,
+              securityInformation, descriptor, descriptorLength, generation);
+        free(descriptor);
+      }
+    }
   }
 
   eventInfo->Status = status;
@@ -94,6 +155,15 @@ VOID DispatchSetSecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
         &fileInfo);
   }
 
+  // even a failed call may have changed part of the descriptor, and what is
+  // inherited by the children of a directory
+  DokanSecurityCacheInvalidate(DokanInstance,
+                               EventContext->Operation.SetSecurity.FileName,
+                               fileInfo.IsDirectory);
+  DokanFlightInvalidate(DokanInstance,
+                        EventContext->Operation.SetSecurity.FileName,
+                        fileInfo.IsDirectory);
+
   if (status != STATUS_SUCCESS) {
     eventInfo->Status = STATUS_INVALID_PARAMETER;
     eventInfo->BufferLength = 0;
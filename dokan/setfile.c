@@ -149,15 +149,13 @@ DokanSetLinkInformation(PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
   return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS
-DokanSetRenameInformation(PEVENT_CONTEXT EventContext,
-                          PDOKAN_FILE_INFO FileInfo,
-                          PDOKAN_OPERATIONS DokanOperations) {
+// NewName receives the full name of the target of the rename, MAX_PATH
+// characters long, a relative name is in the directory of the renamed file
+VOID DokanGetRenameTargetName(PEVENT_CONTEXT EventContext, PWCHAR NewName) {
   PDOKAN_RENAME_INFORMATION renameInfo = (PDOKAN_RENAME_INFORMATION)(
       (PCHAR)EventContext + EventContext->Operation.SetFile.BufferOffset);
 
-  WCHAR newName[MAX_PATH];
-  ZeroMemory(newName, sizeof(newName));
+  ZeroMemory(NewName, MAX_PATH * sizeof(WCHAR));
 
   if (renameInfo->FileName[0] != L'\\') {
     ULONG pos;
@@ -166,13 +164,24 @@ DokanSetRenameInformation(PEVENT_CONTEXT EventContext,
       if (EventContext->Operation.SetFile.FileName[pos] == '\\')
         break;
     }
-    RtlCopyMemory(newName, EventContext->Operation.SetFile.FileName,
+    RtlCopyMemory(NewName, EventContext->Operation.SetFile.FileName,
                   (pos + 1) * sizeof(WCHAR));
-    RtlCopyMemory((PCHAR)newName + (pos + 1) * sizeof(WCHAR),
+    RtlCopyMemory((PCHAR)NewName + (pos + 1) * sizeof(WCHAR),
                   renameInfo->FileName, renameInfo->FileNameLength);
   } else {
-    RtlCopyMemory(newName, renameInfo->FileName, renameInfo->FileNameLength);
+    RtlCopyMemory(NewName, renameInfo->FileName, renameInfo->FileNameLength);
   }
+}
+
+NTSTATUS
+DokanSetRenameInformation(PEVENT_CONTEXT EventContext,
+                          PDOKAN_FILE_INFO FileInfo,
+                          PDOKAN_OPERATIONS DokanOperations) {
+  PDOKAN_RENAME_INFORMATION renameInfo = (PDOKAN_RENAME_INFORMATION)(
+      (PCHAR)EventContext + EventContext->Operation.SetFile.BufferOffset);
+
+  WCHAR newName[MAX_PATH];
+  DokanGetRenameTargetName(EventContext, newName);
 
   if (!DokanOperations->MoveFile)
     return STATUS_NOT_IMPLEMENTED;
@@ -198,53 +207,34 @@ DokanSetValidDataLengthInformation(PEVENT_CONTEXT EventContext,
                                        FileInfo);
 }
 
-VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
-                            PDOKAN_INSTANCE DokanInstance) {
-  PEVENT_INFORMATION eventInfo;
-  PDOKAN_OPEN_INFO openInfo;
-  DOKAN_FILE_INFO fileInfo;
+NTSTATUS DokanSetInformation(PDOKAN_INSTANCE DokanInstance,
+                             PEVENT_CONTEXT EventContext,
+                             PDOKAN_FILE_INFO FileInfo) {
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
-  ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
-
-  if (EventContext->Operation.SetFile.FileInformationClass ==
-      FileRenameInformation) {
-    PDOKAN_RENAME_INFORMATION renameInfo = (PDOKAN_RENAME_INFORMATION)(
-        (PCHAR)EventContext + EventContext->Operation.SetFile.BufferOffset);
-    sizeOfEventInfo += renameInfo->FileNameLength;
-  }
-
-  CheckFileName(EventContext->Operation.SetFile.FileName);
-
-  eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
-
-  DbgPrint("###SetFileInfo %04d  %d\n",
-           openInfo != NULL ? openInfo->EventId : -1,
-           EventContext->Operation.SetFile.FileInformationClass);
 
   switch (EventContext->Operation.SetFile.FileInformationClass) {
   case FileAllocationInformation:
-    status = DokanSetAllocationInformation(EventContext, &fileInfo,
+    status = DokanSetAllocationInformation(EventContext, FileInfo,
                                            DokanInstance->DokanOperations);
     break;
 
   case FileBasicInformation:
-    status = DokanSetBasicInformation(EventContext, &fileInfo,
+    status = DokanSetBasicInformation(EventContext, FileInfo,
                                       DokanInstance->DokanOperations);
     break;
 
   case FileDispositionInformation:
-    status = DokanSetDispositionInformation(EventContext, &fileInfo,
+    status = DokanSetDispositionInformation(EventContext, FileInfo,
                                             DokanInstance->DokanOperations);
     break;
 
   case FileEndOfFileInformation:
-    status = DokanSetEndOfFileInformation(EventContext, &fileInfo,
+    status = DokanSetEndOfFileInformation(EventContext, FileInfo,
                                           DokanInstance->DokanOperations);
     break;
 
   case FileLinkInformation:
-    status = DokanSetLinkInformation(EventContext, &fileInfo,
+    status = DokanSetLinkInformation(EventContext, FileInfo,
                                      DokanInstance->DokanOperations);
     break;
 
@@ -253,22 +243,88 @@ VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
     status = STATUS_NOT_IMPLEMENTED;
     break;
 
-  case FileRenameInformation:
-    status = DokanSetRenameInformation(EventContext, &fileInfo,
+  case FileRenameInformation: {
+    WCHAR newName[MAX_PATH];
+    DokanGetRenameTargetName(EventContext, newName);
+    // buffered writes of the target must not land on the renamed file
+    DokanWriteBehindFlushFile(DokanInstance, newName, NULL);
+    // a pooled handle of the target would make the rename fail
+    if (DokanInstance->DokanOptions->HandlePoolTimeout != 0)
+      DokanHandlePoolEvict(DokanInstance, newName, TRUE);
+    status = DokanSetRenameInformation(EventContext, FileInfo,
                                        DokanInstance->DokanOperations);
-    break;
+  } break;
 
   case FileValidDataLengthInformation:
-    status = DokanSetValidDataLengthInformation(EventContext, &fileInfo,
+    status = DokanSetValidDataLengthInformation(EventContext, FileInfo,
                                                 DokanInstance->DokanOperations);
     break;
   }
 
+  return status;
+}
+
+VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                            PDOKAN_INSTANCE DokanInstance) {
+  PEVENT_INFORMATION eventInfo;
+  PDOKAN_OPEN_INFO openInfo;
+  DOKAN_FILE_INFO fileInfo;
+  NTSTATUS status;
+  NTSTATUS writeBehindStatus = STATUS_SUCCESS;
+  ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
+
+  if (EventContext->Operation.SetFile.FileInformationClass ==
+      FileRenameInformation) {
+    PDOKAN_RENAME_INFORMATION renameInfo = (PDOKAN_RENAME_INFORMATION)(
+        (PCHAR)EventContext + EventContext->Operation.SetFile.BufferOffset);
+    sizeOfEventInfo += renameInfo->FileNameLength;
+  }
+
+  CheckFileName(EventContext->Operation.SetFile.FileName);
+
+  eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
+                             &fileInfo, &openInfo);
+
+  DbgPrint("###SetFileInfo %04d  %d\n",
+           openInfo != NULL ? openInfo->EventId : -1,
+           EventContext->Operation.SetFile.FileInformationClass);
+
+  // the buffered writes come before, a failure of them is reported here
+  DokanWriteBehindFlushFile(DokanInstance,
+                            EventContext->Operation.SetFile.FileName, NULL);
+  if (openInfo != NULL) {
+    fileInfo.Context = openInfo->UserContext;
+    writeBehindStatus = DokanWriteBehindTakeError(openInfo);
+  }
+
+  if (writeBehindStatus != STATUS_SUCCESS) {
+    DbgPrint("  write behind error %lx\n", writeBehindStatus);
+    status = writeBehindStatus;
+  } else {
+    status = DokanSetInformation(DokanInstance, EventContext, &fileInfo);
+  }
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
   eventInfo->BufferLength = 0;
   eventInfo->Status = status;
 
+  if (status == STATUS_SUCCESS) {
+    BOOL rename = EventContext->Operation.SetFile.FileInformationClass ==
+                  FileRenameInformation;
+
+    DokanCacheInvalidate(DokanInstance,
+                         EventContext->Operation.SetFile.FileName,
+                         rename && fileInfo.IsDirectory);
+
+    // the target name now exists, and may have replaced a directory
+    if (rename) {
+      WCHAR newName[MAX_PATH];
+      DokanGetRenameTargetName(EventContext, newName);
+      DokanCacheInvalidate(DokanInstance, newName, fileInfo.IsDirectory);
+    }
+  }
+
   if (EventContext->Operation.SetFile.FileInformationClass ==
       FileDispositionInformation) {
     if (status == STATUS_SUCCESS) {
@@ -105,6 +105,8 @@ UINT WINAPI DokanKeepAlive(PDOKAN_INSTANCE DokanInstance) {
       break;
     }
 
+    DokanHandlePoolSweep(DokanInstance, FALSE);
+
     Sleep(DOKAN_KEEPALIVE_TIME);
   }
 
@@ -53,18 +53,170 @@ NTSTATUS DOKAN_CALLBACK DokanGetVolumeInformation(
   return STATUS_SUCCESS;
 }
 
+// GetVolumeInformation of the FileSystem, or the first result it returned
+// when DOKAN_OPTION_CACHE_VOLUME_INFO is set
+NTSTATUS DokanQueryVolumeInformation(PDOKAN_INSTANCE DokanInstance,
+                                     PDOKAN_FILE_INFO FileInfo,
+                                     PDOKAN_VOLUME_INFORMATION VolumeInfo) {
+  PDOKAN_VOLUME_CACHE cache = &DokanInstance->VolumeCache;
+  BOOL useCache =
+      DokanInstance->DokanOptions->Options & DOKAN_OPTION_CACHE_VOLUME_INFO;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  PDOKAN_FLIGHT flight;
+  ULONG flightLength;
+
+  if (useCache) {
+    EnterCriticalSection(&cache->Lock);
+    if (cache->VolumeInfoValid) {
+      *VolumeInfo = cache->VolumeInfo;
+      LeaveCriticalSection(&cache->Lock);
+      return STATUS_SUCCESS;
+    }
+    LeaveCriticalSection(&cache->Lock);
+  }
+
+  RtlZeroMemory(VolumeInfo, sizeof(DOKAN_VOLUME_INFORMATION));
+
+  if (DokanFlightBegin(DokanInstance, DOKAN_FLIGHT_VOLUME_INFORMATION, 0, NULL,
+                       VolumeInfo, sizeof(DOKAN_VOLUME_INFORMATION), &status,
+                       &flightLength, &flight))
+    return status;
+
+  if (DokanInstance->DokanOperations->GetVolumeInformation) {
+    status = DokanInstance->DokanOperations->GetVolumeInformation(
+        VolumeInfo->VolumeName, sizeof(VolumeInfo->VolumeName) / sizeof(WCHAR),
+        &VolumeInfo->VolumeSerialNumber, &VolumeInfo->MaximumComponentLength,
+        &VolumeInfo->FileSystemFlags, VolumeInfo->FileSystemName,
+        sizeof(VolumeInfo->FileSystemName) / sizeof(WCHAR), FileInfo);
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    status = DokanGetVolumeInformation(
+        VolumeInfo->VolumeName, sizeof(VolumeInfo->VolumeName) / sizeof(WCHAR),
+        &VolumeInfo->VolumeSerialNumber, &VolumeInfo->MaximumComponentLength,
+        &VolumeInfo->FileSystemFlags, VolumeInfo->FileSystemName,
+        sizeof(VolumeInfo->FileSystemName) / sizeof(WCHAR), FileInfo);
+  }
+
+  DokanFlightEnd(DokanInstance, flight, status, VolumeInfo,
+                 sizeof(DOKAN_VOLUME_INFORMATION));
+
+  if (status == STATUS_SUCCESS && useCache) {
+    EnterCriticalSection(&cache->Lock);
+    cache->VolumeInfo = *VolumeInfo;
+    cache->VolumeInfoValid = TRUE;
+    LeaveCriticalSection(&cache->Lock);
+  }
+
+  return status;
+}
+
+NTSTATUS DokanCallGetDiskFreeSpace(PDOKAN_INSTANCE DokanInstance,
+                                   PDOKAN_FILE_INFO FileInfo,
+                                   PDOKAN_DISK_FREE_SPACE FreeSpace) {
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  PDOKAN_FLIGHT flight;
+  ULONG flightLength;
+
+  RtlZeroMemory(FreeSpace, sizeof(DOKAN_DISK_FREE_SPACE));
+
+  if (DokanFlightBegin(DokanInstance, DOKAN_FLIGHT_DISK_FREE_SPACE, 0, NULL,
+                       FreeSpace, sizeof(DOKAN_DISK_FREE_SPACE), &status,
+                       &flightLength, &flight))
+    return status;
+
+  if (DokanInstance->DokanOperations->GetDiskFreeSpace) {
+    status = DokanInstance->DokanOperations->GetDiskFreeSpace(
+        &FreeSpace->FreeBytesAvailable,     // FreeBytesAvailable
+        &FreeSpace->TotalNumberOfBytes,     // TotalNumberOfBytes
+        &FreeSpace->TotalNumberOfFreeBytes, // TotalNumberOfFreeBytes
+        FileInfo);
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    status = DokanGetDiskFreeSpace(
+        &FreeSpace->FreeBytesAvailable,     // FreeBytesAvailable
+        &FreeSpace->TotalNumberOfBytes,     // TotalNumberOfBytes
+        &FreeSpace->TotalNumberOfFreeBytes, // TotalNumberOfFreeBytes
+        FileInfo);
+  }
+
+  DokanFlightEnd(DokanInstance, flight, status, FreeSpace,
+                 sizeof(DOKAN_DISK_FREE_SPACE));
+
+  return status;
+}
+
+// GetDiskFreeSpace of the FileSystem, or its last result if it is younger
+// than DOKAN_OPTIONS.DiskFreeSpaceCacheTimeout. Refresh is set to TRUE when
+// the result is old enough to be refreshed with DokanRefreshDiskFreeSpace
+// once the request is answered.
+NTSTATUS DokanQueryDiskFreeSpace(PDOKAN_INSTANCE DokanInstance,
+                                 PDOKAN_FILE_INFO FileInfo,
+                                 PDOKAN_DISK_FREE_SPACE FreeSpace,
+                                 PBOOLEAN Refresh) {
+  PDOKAN_VOLUME_CACHE cache = &DokanInstance->VolumeCache;
+  ULONG timeout = DokanInstance->DokanOptions->DiskFreeSpaceCacheTimeout;
+  NTSTATUS status;
+
+  if (timeout != 0) {
+    EnterCriticalSection(&cache->Lock);
+    if (cache->FreeSpaceValid) {
+      ULONGLONG age = GetTickCount64() - cache->FreeSpaceTime;
+      if (age < timeout) {
+        *FreeSpace = cache->FreeSpace;
+        // only one worker refreshes it at a time
+        if (age >= timeout / 2 && !cache->FreeSpaceRefreshing) {
+          cache->FreeSpaceRefreshing = TRUE;
+          *Refresh = TRUE;
+        }
+        LeaveCriticalSection(&cache->Lock);
+        return STATUS_SUCCESS;
+      }
+    }
+    LeaveCriticalSection(&cache->Lock);
+  }
+
+  status = DokanCallGetDiskFreeSpace(DokanInstance, FileInfo, FreeSpace);
+
+  if (status == STATUS_SUCCESS && timeout != 0) {
+    EnterCriticalSection(&cache->Lock);
+    cache->FreeSpace = *FreeSpace;
+    cache->FreeSpaceTime = GetTickCount64();
+    cache->FreeSpaceValid = TRUE;
+    LeaveCriticalSection(&cache->Lock);
+  }
+
+  return status;
+}
+
+// called after answering a request with a cached free space that is getting
+// old, so that the next requests do not wait for GetDiskFreeSpace
+VOID DokanRefreshDiskFreeSpace(PDOKAN_INSTANCE DokanInstance,
+                               PDOKAN_FILE_INFO FileInfo) {
+  PDOKAN_VOLUME_CACHE cache = &DokanInstance->VolumeCache;
+  DOKAN_DISK_FREE_SPACE freeSpace;
+  NTSTATUS status;
+
+  status = DokanCallGetDiskFreeSpace(DokanInstance, FileInfo, &freeSpace);
+
+  EnterCriticalSection(&cache->Lock);
+  if (status == STATUS_SUCCESS) {
+    cache->FreeSpace = freeSpace;
+    cache->FreeSpaceTime = GetTickCount64();
+  }
+  cache->FreeSpaceRefreshing = FALSE;
+  LeaveCriticalSection(&cache->Lock);
+}
+
 NTSTATUS
 DokanFsVolumeInformation(PEVENT_INFORMATION EventInfo,
                          PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
-                         PDOKAN_OPERATIONS DokanOperations) {
-  WCHAR volumeName[MAX_PATH];
-  DWORD volumeSerial = 0;
-  DWORD maxComLength = 0;
-  DWORD fsFlags = 0;
-  WCHAR fsName[MAX_PATH];
+                         PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_VOLUME_INFORMATION volume;
   ULONG remainingLength;
   ULONG bytesToCopy;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  NTSTATUS status;
 
   PFILE_FS_VOLUME_INFORMATION volumeInfo =
       (PFILE_FS_VOLUME_INFORMATION)EventInfo->Buffer;
@@ -75,50 +227,25 @@ DokanFsVolumeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  RtlZeroMemory(volumeName, sizeof(volumeName));
-  RtlZeroMemory(fsName, sizeof(fsName));
-
-  if (DokanOperations->GetVolumeInformation) {
-    status = DokanOperations->GetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
-        FileInfo);
-  }
+  status = DokanQueryVolumeInformation(DokanInstance, FileInfo, &volume);
 
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
   volumeInfo->VolumeCreationTime.QuadPart = 0;
-  volumeInfo->VolumeSerialNumber = volumeSerial;
+  volumeInfo->VolumeSerialNumber = volume.VolumeSerialNumber;
   volumeInfo->SupportsObjects = FALSE;
 
   remainingLength -= FIELD_OFFSET(FILE_FS_VOLUME_INFORMATION, VolumeLabel[0]);
 
-  bytesToCopy = (ULONG)wcslen(volumeName) * sizeof(WCHAR);
+  bytesToCopy = (ULONG)wcslen(volume.VolumeName) * sizeof(WCHAR);
   if (remainingLength < bytesToCopy) {
     bytesToCopy = remainingLength;
   }
 
   volumeInfo->VolumeLabelLength = bytesToCopy;
-  RtlCopyMemory(volumeInfo->VolumeLabel, volumeName, bytesToCopy);
+  RtlCopyMemory(volumeInfo->VolumeLabel, volume.VolumeName, bytesToCopy);
   remainingLength -= bytesToCopy;
 
   EventInfo->BufferLength =
@@ -130,11 +257,9 @@ DokanFsVolumeInformation(PEVENT_INFORMATION EventInfo,
 NTSTATUS
 DokanFsSizeInformation(PEVENT_INFORMATION EventInfo,
                        PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
-                       PDOKAN_OPERATIONS DokanOperations) {
-  ULONGLONG freeBytesAvailable = 0;
-  ULONGLONG totalBytes = 0;
-  ULONGLONG freeBytes = 0;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+                       PDOKAN_INSTANCE DokanInstance, PBOOLEAN Refresh) {
+  DOKAN_DISK_FREE_SPACE freeSpace;
+  NTSTATUS status;
 
   ULONG allocationUnitSize = FileInfo->DokanOptions->AllocationUnitSize;
   ULONG sectorSize = FileInfo->DokanOptions->SectorSize;
@@ -147,29 +272,17 @@ DokanFsSizeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  if (DokanOperations->GetDiskFreeSpace) {
-    status = DokanOperations->GetDiskFreeSpace(
-        &freeBytesAvailable, // FreeBytesAvailable
-        &totalBytes,         // TotalNumberOfBytes
-        &freeBytes,          // TotalNumberOfFreeBytes
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetDiskFreeSpace(&freeBytesAvailable, // FreeBytesAvailable
-                                   &totalBytes,         // TotalNumberOfBytes
-                                   &freeBytes, // TotalNumberOfFreeBytes
-                                   FileInfo);
-  }
+  status =
+      DokanQueryDiskFreeSpace(DokanInstance, FileInfo, &freeSpace, Refresh);
 
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
   sizeInfo->TotalAllocationUnits.QuadPart =
-      totalBytes / allocationUnitSize;
+      freeSpace.TotalNumberOfBytes / allocationUnitSize;
   sizeInfo->AvailableAllocationUnits.QuadPart =
-      freeBytesAvailable / allocationUnitSize;
+      freeSpace.FreeBytesAvailable / allocationUnitSize;
   sizeInfo->SectorsPerAllocationUnit =
 	  allocationUnitSize / sectorSize;
   sizeInfo->BytesPerSector = sectorSize;
@@ -183,15 +296,11 @@ NTSTATUS
 DokanFsAttributeInformation(PEVENT_INFORMATION EventInfo,
                             PEVENT_CONTEXT EventContext,
                             PDOKAN_FILE_INFO FileInfo,
-                            PDOKAN_OPERATIONS DokanOperations) {
-  WCHAR volumeName[MAX_PATH];
-  DWORD volumeSerial;
-  DWORD maxComLength = 0;
-  DWORD fsFlags = 0;
-  WCHAR fsName[MAX_PATH];
+                            PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_VOLUME_INFORMATION volume;
   ULONG remainingLength;
   ULONG bytesToCopy;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  NTSTATUS status;
 
   PFILE_FS_ATTRIBUTE_INFORMATION attrInfo =
       (PFILE_FS_ATTRIBUTE_INFORMATION)EventInfo->Buffer;
@@ -202,50 +311,25 @@ DokanFsAttributeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  RtlZeroMemory(volumeName, sizeof(volumeName));
-  RtlZeroMemory(fsName, sizeof(fsName));
-
-  if (DokanOperations->GetVolumeInformation) {
-    status = DokanOperations->GetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
-        FileInfo);
-  }
+  status = DokanQueryVolumeInformation(DokanInstance, FileInfo, &volume);
 
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
-  attrInfo->FileSystemAttributes = fsFlags;
-  attrInfo->MaximumComponentNameLength = maxComLength;
+  attrInfo->FileSystemAttributes = volume.FileSystemFlags;
+  attrInfo->MaximumComponentNameLength = volume.MaximumComponentLength;
 
   remainingLength -=
       FIELD_OFFSET(FILE_FS_ATTRIBUTE_INFORMATION, FileSystemName[0]);
 
-  bytesToCopy = (ULONG)wcslen(fsName) * sizeof(WCHAR);
+  bytesToCopy = (ULONG)wcslen(volume.FileSystemName) * sizeof(WCHAR);
   if (remainingLength < bytesToCopy) {
     bytesToCopy = remainingLength;
   }
 
   attrInfo->FileSystemNameLength = bytesToCopy;
-  RtlCopyMemory(attrInfo->FileSystemName, fsName, bytesToCopy);
+  RtlCopyMemory(attrInfo->FileSystemName, volume.FileSystemName, bytesToCopy);
   remainingLength -= bytesToCopy;
 
   EventInfo->BufferLength =
@@ -258,11 +342,9 @@ NTSTATUS
 DokanFsFullSizeInformation(PEVENT_INFORMATION EventInfo,
                            PEVENT_CONTEXT EventContext,
                            PDOKAN_FILE_INFO FileInfo,
-                           PDOKAN_OPERATIONS DokanOperations) {
-  ULONGLONG freeBytesAvailable = 0;
-  ULONGLONG totalBytes = 0;
-  ULONGLONG freeBytes = 0;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+                           PDOKAN_INSTANCE DokanInstance, PBOOLEAN Refresh) {
+  DOKAN_DISK_FREE_SPACE freeSpace;
+  NTSTATUS status;
 
   ULONG allocationUnitSize = FileInfo->DokanOptions->AllocationUnitSize;
   ULONG sectorSize = FileInfo->DokanOptions->SectorSize;
@@ -275,31 +357,19 @@ DokanFsFullSizeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  if (DokanOperations->GetDiskFreeSpace) {
-    status = DokanOperations->GetDiskFreeSpace(
-        &freeBytesAvailable, // FreeBytesAvailable
-        &totalBytes,         // TotalNumberOfBytes
-        &freeBytes,          // TotalNumberOfFreeBytes
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetDiskFreeSpace(&freeBytesAvailable, // FreeBytesAvailable
-                                   &totalBytes,         // TotalNumberOfBytes
-                                   &freeBytes, // TotalNumberOfFreeBytes
-                                   FileInfo);
-  }
+  status =
+      DokanQueryDiskFreeSpace(DokanInstance, FileInfo, &freeSpace, Refresh);
 
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
   sizeInfo->TotalAllocationUnits.QuadPart =
-      totalBytes / allocationUnitSize;
+      freeSpace.TotalNumberOfBytes / allocationUnitSize;
   sizeInfo->ActualAvailableAllocationUnits.QuadPart =
-      freeBytes / allocationUnitSize;
+      freeSpace.TotalNumberOfFreeBytes / allocationUnitSize;
   sizeInfo->CallerAvailableAllocationUnits.QuadPart =
-      freeBytesAvailable / allocationUnitSize;
+      freeSpace.FreeBytesAvailable / allocationUnitSize;
   sizeInfo->SectorsPerAllocationUnit =
 	  allocationUnitSize / sectorSize;
   sizeInfo->BytesPerSector = sectorSize;
@@ -316,6 +386,7 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   PDOKAN_OPEN_INFO openInfo;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION) - 8 +
                           EventContext->Operation.Volume.BufferLength;
+  BOOLEAN refreshFreeSpace = FALSE;
 
   eventInfo = (PEVENT_INFORMATION)malloc(sizeOfEventInfo);
   if (eventInfo == NULL) {
@@ -333,7 +404,7 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   eventInfo->SerialNumber = EventContext->SerialNumber;
 
   fileInfo.ProcessId = EventContext->ProcessId;
-  fileInfo.DokanOptions = DokanInstance->DokanOptions;
+  fileInfo.DokanOptions = DokanInstance->UserOptions;
 
   eventInfo->Status = STATUS_NOT_IMPLEMENTED;
   eventInfo->BufferLength = 0;
@@ -343,20 +414,20 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   switch (EventContext->Operation.Volume.FsInformationClass) {
   case FileFsVolumeInformation:
-    eventInfo->Status = DokanFsVolumeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+    eventInfo->Status = DokanFsVolumeInformation(eventInfo, EventContext,
+                                                 &fileInfo, DokanInstance);
     break;
   case FileFsSizeInformation:
     eventInfo->Status = DokanFsSizeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+        eventInfo, EventContext, &fileInfo, DokanInstance, &refreshFreeSpace);
     break;
   case FileFsAttributeInformation:
-    eventInfo->Status = DokanFsAttributeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+    eventInfo->Status = DokanFsAttributeInformation(eventInfo, EventContext,
+                                                    &fileInfo, DokanInstance);
     break;
   case FileFsFullSizeInformation:
     eventInfo->Status = DokanFsFullSizeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+        eventInfo, EventContext, &fileInfo, DokanInstance, &refreshFreeSpace);
     break;
   default:
     DbgPrint("error unknown volume info %d\n",
@@ -365,5 +436,9 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, NULL);
   free(eventInfo);
+
+  // the request was answered with the cached value, refresh it now
+  if (refreshFreeSpace)
+    DokanRefreshDiskFreeSpace(DokanInstance, &fileInfo);
   return;
 }
@@ -46,10 +46,333 @@ VOID SendWriteRequest(HANDLE Handle, PEVENT_INFORMATION EventInfo,
   DbgPrint("SendWriteRequest got %d bytes\n", returnedLength);
 }
 
+// WriteFile, or WriteFileV with the write split in segments
+NTSTATUS DokanCallWriteFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                            PVOID Buffer, ULONG Length, PULONG WrittenLength,
+                            LONGLONG Offset, PDOKAN_FILE_INFO FileInfo) {
+  DOKAN_IO_SEGMENT segment;
+  PDOKAN_IO_SEGMENT segments = &segment;
+  ULONG count = 1;
+  NTSTATUS status;
+
+  if (DokanInstance->DokanOperations->WriteFileV == NULL)
+    return DokanInstance->DokanOperations->WriteFile(
+        FileName, Buffer, Length, WrittenLength, Offset, FileInfo);
+
+  // the offset is not known yet
+  if (FileInfo->WriteToEndOfFile) {
+    segment.Offset = Offset;
+    segment.Length = Length;
+    segment.Buffer = Buffer;
+  } else {
+    segments = DokanSplitIo(DokanInstance, Buffer, Length, Offset, &count);
+    if (segments == NULL)
+      return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  status = DokanInstance->DokanOperations->WriteFileV(
+      FileName, segments, count, WrittenLength, FileInfo);
+  if (segments != &segment)
+    free(segments);
+  return status;
+}
+
+// used when DOKAN_OPTIONS.WriteBehindTotalSize is 0
+#define DOKAN_WRITE_BEHIND_DEFAULT_TOTAL_SIZE (64 * 1024 * 1024)
+
+VOID DokanInitWriteBehind(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_WRITE_BEHIND_LIST list = &DokanInstance->WriteBehindList;
+
+  InitializeCriticalSection(&list->Lock);
+  InitializeListHead(&list->List);
+  list->Size = 0;
+}
+
+VOID DokanDeleteWriteBehind(PDOKAN_INSTANCE DokanInstance) {
+  // DokanWriteBehindClose emptied it
+  DeleteCriticalSection(&DokanInstance->WriteBehindList.Lock);
+}
+
+// Write buffer of the handle, allocated by its first write. NULL when write
+// behind is disabled or on allocation failure.
+PDOKAN_WRITE_BEHIND DokanGetWriteBehind(PDOKAN_OPEN_INFO OpenInfo,
+                                        PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_WRITE_BEHIND writeBehind;
+
+  if (DokanInstance->DokanOptions->WriteBehindSize == 0)
+    return NULL;
+  if (OpenInfo->WriteBehind != NULL)
+    return OpenInfo->WriteBehind;
+
+  writeBehind = (PDOKAN_WRITE_BEHIND)malloc(sizeof(DOKAN_WRITE_BEHIND));
+  if (writeBehind == NULL)
+    return NULL;
+  ZeroMemory(writeBehind, sizeof(DOKAN_WRITE_BEHIND));
+  InitializeCriticalSection(&writeBehind->Lock);
+  InitializeListHead(&writeBehind->ListEntry);
+  writeBehind->OpenInfo = OpenInfo;
+  writeBehind->DeferredStatus = STATUS_SUCCESS;
+
+  // another write of the handle may have done it meanwhile
+  EnterCriticalSection(&DokanInstance->CriticalSection);
+  if (OpenInfo->WriteBehind == NULL) {
+    OpenInfo->WriteBehind = writeBehind;
+    writeBehind = NULL;
+  }
+  LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+  if (writeBehind != NULL) {
+    DeleteCriticalSection(&writeBehind->Lock);
+    free(writeBehind);
+  }
+  return OpenInfo->WriteBehind;
+}
+
+// Give the buffered data to WriteFile. A failure is kept in DeferredStatus,
+// the data is dropped in any case. Called with the lock of the buffer held.
+NTSTATUS DokanWriteBehindFlush(PDOKAN_WRITE_BEHIND WriteBehind,
+                               PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_WRITE_BEHIND_LIST list = &DokanInstance->WriteBehindList;
+  PDOKAN_OPEN_INFO openInfo = WriteBehind->OpenInfo;
+  DOKAN_FILE_INFO fileInfo;
+  ULONG writtenLength = 0;
+  NTSTATUS status;
+
+  if (WriteBehind->Length == 0)
+    return STATUS_SUCCESS;
+
+  DbgPrint("  write behind %lu bytes at %I64d\n", WriteBehind->Length,
+           WriteBehind->Offset);
+
+  RtlZeroMemory(&fileInfo, sizeof(DOKAN_FILE_INFO));
+  fileInfo.Context = openInfo->UserContext;
+  fileInfo.DokanContext = (ULONG64)openInfo;
+  fileInfo.DokanOptions = DokanInstance->UserOptions;
+  fileInfo.ProcessId = WriteBehind->ProcessId;
+
+  status = DokanCallWriteFile(DokanInstance, WriteBehind->FileName,
+                              WriteBehind->Buffer, WriteBehind->Length,
+                              &writtenLength, WriteBehind->Offset, &fileInfo);
+  if (status == STATUS_SUCCESS && writtenLength != WriteBehind->Length)
+    status = STATUS_UNEXPECTED_IO_ERROR;
+
+  openInfo->UserContext = fileInfo.Context;
+  DokanCacheInvalidateFile(DokanInstance, WriteBehind->FileName);
+
+  if (status != STATUS_SUCCESS) {
+    DbgPrint("  write behind failed %lx\n", status);
+    if (WriteBehind->DeferredStatus == STATUS_SUCCESS)
+      WriteBehind->DeferredStatus = status;
+  }
+
+  EnterCriticalSection(&list->Lock);
+  RemoveEntryList(&WriteBehind->ListEntry);
+  InitializeListHead(&WriteBehind->ListEntry);
+  list->Size -= WriteBehind->Length;
+  LeaveCriticalSection(&list->Lock);
+
+  WriteBehind->Length = 0;
+  return status;
+}
+
+// Write what the handles of FileName, but Except, have buffered. Errors are
+// returned to the handle which buffered the data.
+VOID DokanWriteBehindFlushFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               PDOKAN_OPEN_INFO Except) {
+  PDOKAN_WRITE_BEHIND_LIST list = &DokanInstance->WriteBehindList;
+  ULONG length;
+  ULONG hash;
+  EVENT_INFORMATION releaseInfo;
+
+  if (DokanInstance->DokanOptions->WriteBehindSize == 0)
+    return;
+
+  length = DokanCachePathLength(FileName);
+  hash = DokanCacheHash(FileName, length);
+
+  while (TRUE) {
+    PDOKAN_WRITE_BEHIND found = NULL;
+    PLIST_ENTRY listEntry;
+
+    EnterCriticalSection(&list->Lock);
+    for (listEntry = list->List.Flink; listEntry != &list->List;
+         listEntry = listEntry->Flink) {
+      PDOKAN_WRITE_BEHIND writeBehind =
+          CONTAINING_RECORD(listEntry, DOKAN_WRITE_BEHIND, ListEntry);
+      if (writeBehind->OpenInfo != Except && writeBehind->Hash == hash &&
+          DokanCachePathLength(writeBehind->FileName) == length &&
+          _wcsnicmp(writeBehind->FileName, FileName, length) == 0) {
+        found = writeBehind;
+        break;
+      }
+    }
+    // the handle must not be freed while its buffer is written
+    if (found != NULL) {
+      EnterCriticalSection(&DokanInstance->CriticalSection);
+      found->OpenInfo->OpenCount++;
+      LeaveCriticalSection(&DokanInstance->CriticalSection);
+    }
+    LeaveCriticalSection(&list->Lock);
+
+    if (found == NULL)
+      break;
+
+    EnterCriticalSection(&found->Lock);
+    DokanWriteBehindFlush(found, DokanInstance);
+    LeaveCriticalSection(&found->Lock);
+
+    RtlZeroMemory(&releaseInfo, sizeof(EVENT_INFORMATION));
+    releaseInfo.Context = (ULONG64)found->OpenInfo;
+    ReleaseDokanOpenInfo(&releaseInfo, DokanInstance);
+  }
+}
+
+// Error of a buffered write of the handle not reported yet
+NTSTATUS DokanWriteBehindTakeError(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BEHIND writeBehind = OpenInfo->WriteBehind;
+  NTSTATUS status;
+
+  if (writeBehind == NULL)
+    return STATUS_SUCCESS;
+
+  EnterCriticalSection(&writeBehind->Lock);
+  status = writeBehind->DeferredStatus;
+  writeBehind->DeferredStatus = STATUS_SUCCESS;
+  LeaveCriticalSection(&writeBehind->Lock);
+  return status;
+}
+
+// Buffer the write of Length bytes of Data at Offset. FALSE when the caller
+// has to call WriteFile, after what was buffered before was written.
+BOOL DokanWriteBehindWrite(PDOKAN_WRITE_BEHIND WriteBehind,
+                           PDOKAN_INSTANCE DokanInstance,
+                           PEVENT_CONTEXT EventContext,
+                           PDOKAN_FILE_INFO FileInfo, NTSTATUS *Status) {
+  PDOKAN_WRITE_BEHIND_LIST list = &DokanInstance->WriteBehindList;
+  ULONG maxSize = DokanInstance->DokanOptions->WriteBehindSize;
+  ULONG64 maxTotalSize = DokanInstance->DokanOptions->WriteBehindTotalSize;
+  LPCWSTR fileName = EventContext->Operation.Write.FileName;
+  ULONG length = EventContext->Operation.Write.BufferLength;
+  LONGLONG offset = EventContext->Operation.Write.ByteOffset.QuadPart;
+  BOOL canBuffer;
+
+  if (maxTotalSize == 0)
+    maxTotalSize = DOKAN_WRITE_BEHIND_DEFAULT_TOTAL_SIZE;
+
+  EnterCriticalSection(&list->Lock);
+  canBuffer = list->Size + length <= maxTotalSize;
+  LeaveCriticalSection(&list->Lock);
+
+  canBuffer = canBuffer && !FileInfo->PagingIo &&
+              !FileInfo->WriteToEndOfFile && length > 0 &&
+              length < maxSize / 2;
+
+  EnterCriticalSection(&WriteBehind->Lock);
+
+  *Status = WriteBehind->DeferredStatus;
+  WriteBehind->DeferredStatus = STATUS_SUCCESS;
+
+  // a write elsewhere, or which does not fit, goes after the buffered ones
+  if (*Status == STATUS_SUCCESS && WriteBehind->Length > 0 &&
+      (!canBuffer || offset != WriteBehind->Offset + WriteBehind->Length ||
+       WriteBehind->Length + length > maxSize)) {
+    *Status = DokanWriteBehindFlush(WriteBehind, DokanInstance);
+    WriteBehind->DeferredStatus = STATUS_SUCCESS;
+    FileInfo->Context = WriteBehind->OpenInfo->UserContext;
+  }
+
+  if (*Status != STATUS_SUCCESS) {
+    LeaveCriticalSection(&WriteBehind->Lock);
+    return TRUE;
+  }
+
+  if (canBuffer && WriteBehind->Capacity < maxSize) {
+    PCHAR buffer = (PCHAR)realloc(WriteBehind->Buffer, maxSize);
+    if (buffer != NULL) {
+      WriteBehind->Buffer = buffer;
+      WriteBehind->Capacity = maxSize;
+    } else {
+      canBuffer = FALSE;
+    }
+  }
+
+  // the name changes when the file is renamed, it was flushed before
+  if (canBuffer && WriteBehind->Length == 0 &&
+      (WriteBehind->FileName == NULL ||
+       wcscmp(WriteBehind->FileName, fileName) != 0)) {
+    LPWSTR name = _wcsdup(fileName);
+    if (name != NULL) {
+      free(WriteBehind->FileName);
+      WriteBehind->FileName = name;
+      WriteBehind->Hash = DokanCacheHash(name, DokanCachePathLength(name));
+    } else {
+      canBuffer = FALSE;
+    }
+  }
+
+  if (!canBuffer) {
+    LeaveCriticalSection(&WriteBehind->Lock);
+    return FALSE;
+  }
+
+  if (WriteBehind->Length == 0) {
+    WriteBehind->Offset = offset;
+    WriteBehind->ProcessId = FileInfo->ProcessId;
+  }
+  RtlCopyMemory(WriteBehind->Buffer + WriteBehind->Length,
+                (PCHAR)EventContext +
+                    EventContext->Operation.Write.BufferOffset,
+                length);
+
+  EnterCriticalSection(&list->Lock);
+  if (WriteBehind->Length == 0)
+    InsertTailList(&list->List, &WriteBehind->ListEntry);
+  list->Size += length;
+  LeaveCriticalSection(&list->Lock);
+
+  WriteBehind->Length += length;
+
+  LeaveCriticalSection(&WriteBehind->Lock);
+  return TRUE;
+}
+
+// The handle is closed: write what is left and release the buffer
+VOID DokanWriteBehindClose(PDOKAN_OPEN_INFO OpenInfo,
+                           PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_WRITE_BEHIND writeBehind = OpenInfo->WriteBehind;
+
+  if (writeBehind == NULL)
+    return;
+
+  EnterCriticalSection(&writeBehind->Lock);
+  DokanWriteBehindFlush(writeBehind, DokanInstance);
+  if (writeBehind->Buffer != NULL)
+    free(writeBehind->Buffer);
+  writeBehind->Buffer = NULL;
+  writeBehind->Capacity = 0;
+  LeaveCriticalSection(&writeBehind->Lock);
+}
+
+VOID DokanWriteBehindFree(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BEHIND writeBehind = OpenInfo->WriteBehind;
+
+  if (writeBehind == NULL)
+    return;
+
+  if (writeBehind->Buffer != NULL)
+    free(writeBehind->Buffer);
+  if (writeBehind->FileName != NULL)
+    free(writeBehind->FileName);
+  DeleteCriticalSection(&writeBehind->Lock);
+  free(writeBehind);
+  OpenInfo->WriteBehind = NULL;
+}
+
 VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
                    PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_WRITE_BEHIND writeBehind = NULL;
   ULONG writtenLength = 0;
   NTSTATUS status;
   DOKAN_FILE_INFO fileInfo;
@@ -78,9 +401,24 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   DbgPrint("###WriteFile %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->WriteFile) {
-    status = DokanInstance->DokanOperations->WriteFile(
-        EventContext->Operation.Write.FileName,
+  if (openInfo != NULL && (DokanInstance->DokanOperations->WriteFile ||
+                           DokanInstance->DokanOperations->WriteFileV))
+    writeBehind = DokanGetWriteBehind(openInfo, DokanInstance);
+
+  // the writes buffered by other handles of the file come first
+  if (writeBehind != NULL)
+    DokanWriteBehindFlushFile(DokanInstance,
+                              EventContext->Operation.Write.FileName, openInfo);
+
+  if (writeBehind != NULL && DokanWriteBehindWrite(writeBehind, DokanInstance,
+                                                   EventContext, &fileInfo,
+                                                   &status)) {
+    if (status == STATUS_SUCCESS)
+      writtenLength = EventContext->Operation.Write.BufferLength;
+  } else if (DokanInstance->DokanOperations->WriteFile ||
+             DokanInstance->DokanOperations->WriteFileV) {
+    status = DokanCallWriteFile(
+        DokanInstance, EventContext->Operation.Write.FileName,
         (PCHAR)EventContext + EventContext->Operation.Write.BufferOffset,
         EventContext->Operation.Write.BufferLength, &writtenLength,
         EventContext->Operation.Write.ByteOffset.QuadPart, &fileInfo);
@@ -88,6 +426,10 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
     status = STATUS_NOT_IMPLEMENTED;
   }
 
+  // size and times of the file may have changed, even on a failed write
+  DokanCacheInvalidateFile(DokanInstance,
+                           EventContext->Operation.Write.FileName);
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
   eventInfo->BufferLength = 0;
@@ -24,7 +24,6 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 NTSTATUS
 DokanGetAccessToken(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KIRQL oldIrql = 0;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PDokanVCB vcb;
   PEVENT_INFORMATION eventInfo;
@@ -71,25 +70,14 @@ DokanGetAccessToken(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
     hasLock = TRUE;
 
     // search corresponding IRP through pending IRP list
-    listHead = &vcb->Dcb->PendingIrp.ListHead;
-
-    for (thisEntry = listHead->Flink; thisEntry != listHead;
-         thisEntry = nextEntry) {
-
-      nextEntry = thisEntry->Flink;
-
-      irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-      if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-        continue;
-      }
-
-      // this irp must be IRP_MJ_CREATE
-      if (irpEntry->IrpSp->Parameters.Create.SecurityContext) {
-        accessState =
-            irpEntry->IrpSp->Parameters.Create.SecurityContext->AccessState;
-      }
-      break;
+    irpEntry =
+        DokanFindIrpEntry(&vcb->Dcb->PendingIrp, eventInfo->SerialNumber);
+
+    // this irp must be IRP_MJ_CREATE
+    if (irpEntry != NULL &&
+        irpEntry->IrpSp->Parameters.Create.SecurityContext) {
+      accessState =
+          irpEntry->IrpSp->Parameters.Create.SecurityContext->AccessState;
     }
     KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
     hasLock = FALSE;
@@ -72,6 +72,7 @@ PDokanFCB DokanAllocateFCB(__in PDokanVCB Vcb) {
   ExInitializeResourceLite(&fcb->Resource);
 
   InitializeListHead(&fcb->NextCCB);
+  DokanHashEntryInit(&fcb->HashEntry);
   InsertTailList(&Vcb->NextFCB, &fcb->NextFCB);
 
   InterlockedIncrement(&Vcb->FcbAllocated);
@@ -79,10 +80,50 @@ PDokanFCB DokanAllocateFCB(__in PDokanVCB Vcb) {
   return fcb;
 }
 
+// We must NOT call without VCB lock, exclusive
+VOID DokanHashFCB(__in PDokanVCB Vcb, __in PDokanFCB Fcb) {
+  // upcased, so that a case sensitive and an insensitive lookup land in the
+  // same bucket
+  DokanHashTableInsert(&Vcb->FcbTable, &Fcb->HashEntry,
+                       DokanHashName(Fcb->FileName.Buffer,
+                                     Fcb->FileName.Length / sizeof(WCHAR)));
+  DokanHashTableGrow(&Vcb->FcbTable, DOKAN_FCB_MAX_BUCKETS);
+}
+
+// free the buckets allocated by DokanHashFCB, once the volume has no FCB
+VOID DokanDeleteFcbTable(__in PDokanVCB Vcb) {
+  DokanHashTableDelete(&Vcb->FcbTable);
+  DokanHashTableInit(&Vcb->FcbTable, Vcb->FcbBuckets, DOKAN_FCB_BUCKETS);
+}
+
+// We must NOT call without VCB lock, shared is enough
+PDokanFCB DokanFindFCB(__in PDokanVCB Vcb, __in PUNICODE_STRING FileName,
+                       __in ULONG Hash, BOOLEAN CaseSensitive) {
+  PDOKAN_HASH_ENTRY entry = NULL;
+  PDokanFCB fcb;
+
+  while ((entry = DokanHashTableFind(&Vcb->FcbTable, Hash, entry)) != NULL) {
+
+    fcb = CONTAINING_RECORD(entry, DokanFCB, HashEntry);
+    DDbgPrint("  DokanGetFCB has entry FileName: %wZ FileCount: %lu. Looking "
+              "for %wZ\n",
+              &fcb->FileName, fcb->FileCount, FileName);
+    // FileNameLength in bytes
+    if (fcb->FileName.Length == FileName->Length &&
+        RtlEqualUnicodeString(FileName, &fcb->FileName, !CaseSensitive)) {
+      // we have the FCB which is already allocated and used
+      DDbgPrint("  Found existing FCB for %wZ\n", FileName);
+      return fcb;
+    }
+  }
+
+  return NULL;
+}
+
 PDokanFCB DokanGetFCB(__in PDokanVCB Vcb, __in PWCHAR FileName,
                       __in ULONG FileNameLength, BOOLEAN CaseSensitive) {
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PDokanFCB fcb = NULL;
+  ULONG hash;
 
   UNICODE_STRING fn;
 
@@ -90,34 +131,27 @@ PDokanFCB DokanGetFCB(__in PDokanVCB Vcb, __in PWCHAR FileName,
   fn.MaximumLength = fn.Length + sizeof(WCHAR);
   fn.Buffer = FileName;
 
-  KeEnterCriticalRegion();
-  ExAcquireResourceExclusiveLite(&Vcb->Resource, TRUE);
-
-  // search the FCB which is already allocated
-  // (being used now)
-  listHead = &Vcb->NextFCB;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    nextEntry = thisEntry->Flink;
-
-    fcb = CONTAINING_RECORD(thisEntry, DokanFCB, NextFCB);
-    DDbgPrint("  DokanGetFCB has entry FileName: %wZ FileCount: %lu. Looking "
-              "for %ls\n",
-              fcb->FileName, fcb->FileCount, FileName);
-    if (fcb->FileName.Length == FileNameLength) {
-      // FileNameLength in bytes
+  hash = DokanHashName(FileName, FileNameLength / sizeof(WCHAR));
 
-      // we have the FCB which is already allocated and used
-      if (RtlEqualUnicodeString(&fn, &fcb->FileName, !CaseSensitive)) {
-        DDbgPrint("  Found existing FCB for %ls\n", FileName);
-        break;
-      }
-    }
+  KeEnterCriticalRegion();
 
-    fcb = NULL;
+  // search the FCB which is already allocated (being used now); it is not
+  // freed while we hold the VCB lock since DokanFreeFCB takes it exclusive
+  ExAcquireResourceSharedLite(&Vcb->Resource, TRUE);
+  fcb = DokanFindFCB(Vcb, &fn, hash, CaseSensitive);
+  if (fcb != NULL) {
+    InterlockedIncrement(&fcb->FileCount);
+    ExReleaseResourceLite(&Vcb->Resource);
+    KeLeaveCriticalRegion();
+    // FileName (argument) is never used and must be freed
+    ExFreePool(FileName);
+    return fcb;
   }
+  ExReleaseResourceLite(&Vcb->Resource);
+
+  // another thread may have allocated it meanwhile
+  ExAcquireResourceExclusiveLite(&Vcb->Resource, TRUE);
+  fcb = DokanFindFCB(Vcb, &fn, hash, CaseSensitive);
 
   // we don't have FCB
   if (fcb == NULL) {
@@ -140,6 +174,8 @@ PDokanFCB DokanGetFCB(__in PDokanVCB Vcb, __in PWCHAR FileName,
     fcb->FileName.Length = (USHORT)FileNameLength;
     fcb->FileName.MaximumLength = (USHORT)FileNameLength;
 
+    DokanHashFCB(Vcb, fcb);
+
     // we already have FCB
   } else {
     // FileName (argument) is never used and must be freed
@@ -171,6 +207,7 @@ DokanFreeFCB(__in PDokanFCB Fcb) {
   if (Fcb->FileCount == 0) {
 
     RemoveEntryList(&Fcb->NextFCB);
+    DokanHashTableRemove(&vcb->FcbTable, &Fcb->HashEntry);
     InitializeListHead(&Fcb->NextCCB);
 
     DDbgPrint("  Free FCB:%p\n", Fcb);
@@ -137,6 +137,12 @@ DokanQueryDirectory(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   case FileIdBothDirectoryInformation:
     DDbgPrint("  FileIdBothDirectoryInformation\n");
     break;
+  case FileIdFullDirectoryInformation:
+    DDbgPrint("  FileIdFullDirectoryInformation\n");
+    break;
+  case FileIdExtdDirectoryInformation:
+    DDbgPrint("  FileIdExtdDirectoryInformation\n");
+    break;
   default:
     DDbgPrint("  unknown FileInfoClass %d\n",
               irpSp->Parameters.QueryDirectory.FileInformationClass);
@@ -69,6 +69,10 @@ DokanDispatchRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
   irpSp = IoGetCurrentIrpStackLocation(Irp);
 
+  if (irpSp->MajorFunction == IRP_MJ_FILE_SYSTEM_CONTROL) {
+    Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_FILE_OBJECT] = NULL;
+  }
+
   if (irpSp->MajorFunction != IRP_MJ_FILE_SYSTEM_CONTROL &&
       irpSp->MajorFunction != IRP_MJ_SHUTDOWN &&
       irpSp->MajorFunction != IRP_MJ_CLEANUP &&
@@ -93,8 +97,12 @@ DokanDispatchRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
         (irpSp->MajorFunction == IRP_MJ_SET_VOLUME_INFORMATION) ||
         (irpSp->MajorFunction == IRP_MJ_FILE_SYSTEM_CONTROL &&
          irpSp->MinorFunction == IRP_MN_USER_FS_REQUEST &&
-         irpSp->Parameters.FileSystemControl.FsControlCode ==
-             FSCTL_MARK_VOLUME_DIRTY)) {
+         (irpSp->Parameters.FileSystemControl.FsControlCode ==
+              FSCTL_MARK_VOLUME_DIRTY ||
+          irpSp->Parameters.FileSystemControl.FsControlCode ==
+              FSCTL_SET_ZERO_DATA ||
+          irpSp->Parameters.FileSystemControl.FsControlCode ==
+              FSCTL_DUPLICATE_EXTENTS_TO_FILE))) {
 
       DDbgPrint("    Media is write protected\n");
       DokanCompleteIrpRequest(Irp, STATUS_MEDIA_WRITE_PROTECTED, 0);
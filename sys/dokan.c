@@ -434,6 +434,13 @@ VOID DokanCompleteIrpRequest(__in PIRP Irp, __in NTSTATUS Status,
     Status = STATUS_INVALID_PARAMETER;
   }
   if (Status != STATUS_PENDING) {
+    if (IoGetCurrentIrpStackLocation(Irp)->MajorFunction ==
+            IRP_MJ_FILE_SYSTEM_CONTROL &&
+        Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_FILE_OBJECT] != NULL) {
+      ObDereferenceObject(
+          Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_FILE_OBJECT]);
+      Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_FILE_OBJECT] = NULL;
+    }
     Irp->IoStatus.Status = Status;
     Irp->IoStatus.Information = Info;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
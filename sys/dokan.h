@@ -81,6 +81,9 @@ extern LOOKASIDE_LIST_EX g_DokanFCBLookasideList;
 #define ExAllocatePool(size) ExAllocatePoolWithTag(NonPagedPool, size, TAG)
 #endif
 
+// allocates its buckets with the ExAllocatePool above
+#include "hashtable.h"
+
 #if _WIN32_WINNT >= _WIN32_WINNT_WIN8
 #define MmGetSystemAddressForMdlNormalSafe(mdl)                                \
   MmGetSystemAddressForMdlSafe(mdl, NormalPagePriority | MdlMappingNoExecute)
@@ -89,6 +92,8 @@ extern LOOKASIDE_LIST_EX g_DokanFCBLookasideList;
   MmGetSystemAddressForMdlSafe(mdl, NormalPagePriority)
 #endif
 
+// file object referenced for a pending FSCTL, see DokanCompleteIrpRequest
+#define DRIVER_CONTEXT_FILE_OBJECT 1
 #define DRIVER_CONTEXT_EVENT 2
 #define DRIVER_CONTEXT_IRP_ENTRY 3
 
@@ -98,6 +103,16 @@ extern LOOKASIDE_LIST_EX g_DokanFCBLookasideList;
 
 #define DOKAN_KEEPALIVE_TIMEOUT (1000 * 15) // in millisecond
 
+// buckets of the pending IRPs by serial number, see DokanFindIrpEntry, which
+// double while there are more pending IRPs, see DokanGrowIrpList
+#define DOKAN_PENDING_IRP_BUCKETS 256
+#define DOKAN_PENDING_IRP_MAX_BUCKETS (1 << 17)
+
+// buckets of the FCBs of a volume by file name, see DokanGetFCB, which
+// double while there are more FCBs, see DokanHashFCB
+#define DOKAN_FCB_BUCKETS 1024
+#define DOKAN_FCB_MAX_BUCKETS (1 << 17)
+
 #if _WIN32_WINNT > 0x501
 
 #define DDbgPrint(...)                                                         \
@@ -176,6 +191,9 @@ typedef struct _IRP_LIST {
   LIST_ENTRY ListHead;
   KEVENT NotEmpty;
   KSPIN_LOCK ListLock;
+  // IRP_ENTRY by SerialNumber, without buckets when the list is not searched
+  // by serial number
+  DOKAN_HASH_TABLE SerialTable;
 } IRP_LIST, *PIRP_LIST;
 
 typedef struct _DOKAN_CONTROL {
@@ -226,6 +244,8 @@ typedef struct _DokanDiskControlBlock {
   IRP_LIST PendingIrp;
   IRP_LIST PendingEvent;
   IRP_LIST NotifyEvent;
+  // initial buckets of PendingIrp.SerialTable
+  LIST_ENTRY PendingIrpBuckets[DOKAN_PENDING_IRP_BUCKETS];
 
   PUNICODE_STRING DiskDeviceName;
   PUNICODE_STRING SymbolicLinkName;
@@ -255,6 +275,9 @@ typedef struct _DokanDiskControlBlock {
   USHORT MountGlobally;
   USHORT FileLockInUserMode;
 
+  // largest event sent whole to the user-mode, negotiated by EVENT_START
+  ULONG EventContextMaxSize;
+
   // to make a unique id for pending IRP
   ULONG SerialNumber;
 
@@ -282,10 +305,18 @@ typedef struct _DokanVolumeControlBlock {
   SECTION_OBJECT_POINTERS SectionObjectPointers;
   FAST_MUTEX AdvancedFCBHeaderMutex;
 
+  // Guards NextFCB and FcbTable. The resources are taken in the order CCB,
+  // VCB, FCB: the rename of DokanCompleteSetInformation holds the CCB then
+  // takes this one and the FCB, as DokanFreeFCB, DokanOplockRequest and
+  // DokanEventRelease take the VCB then the FCB.
   ERESOURCE Resource;
   PDEVICE_OBJECT DeviceObject;
   PDokanDCB Dcb;
   LIST_ENTRY NextFCB;
+  // DokanFCB by the hash of their upcased FileName
+  DOKAN_HASH_TABLE FcbTable;
+  // initial buckets of FcbTable
+  LIST_ENTRY FcbBuckets[DOKAN_FCB_BUCKETS];
 
   // NotifySync is used by notify directory change
   PNOTIFY_SYNC NotifySync;
@@ -320,6 +351,8 @@ typedef struct _DokanFileControlBlock {
 
   PDokanVCB Vcb;
   LIST_ENTRY NextFCB;
+  // in DokanVCB.FcbTable, by the hash of FileName
+  DOKAN_HASH_ENTRY HashEntry;
   ERESOURCE Resource;
   LIST_ENTRY NextCCB;
 
@@ -376,6 +409,8 @@ typedef struct _DokanContextControlBlock {
 // this structure is also used to store event notification IRP
 typedef struct _IRP_ENTRY {
   LIST_ENTRY ListEntry;
+  // in IRP_LIST.SerialTable, linked to itself when the list has no buckets
+  DOKAN_HASH_ENTRY SerialEntry;
   ULONG SerialNumber;
   PIRP Irp;
   PIO_STACK_LOCATION IrpSp;
@@ -575,6 +610,9 @@ VOID DokanCompleteQuerySecurity(__in PIRP_ENTRY IrpEntry,
 VOID DokanCompleteSetSecurity(__in PIRP_ENTRY IrpEntry,
                               __in PEVENT_INFORMATION EventInfo);
 
+VOID DokanCompleteFsControl(__in PIRP_ENTRY IrpEntry,
+                            __in PEVENT_INFORMATION EventInfo);
+
 VOID DokanNoOpRelease(__in PVOID Fcb);
 
 BOOLEAN
@@ -611,6 +649,10 @@ VOID DokanNotifyReportChange(__in PDokanFCB Fcb, __in ULONG FilterMatch,
 
 PDokanFCB DokanAllocateFCB(__in PDokanVCB Vcb);
 
+VOID DokanHashFCB(__in PDokanVCB Vcb, __in PDokanFCB Fcb);
+
+VOID DokanDeleteFcbTable(__in PDokanVCB Vcb);
+
 NTSTATUS
 DokanFreeFCB(__in PDokanFCB Fcb);
 
@@ -629,6 +671,18 @@ DokanCheckCCB(__in PDokanDCB Dcb, __in_opt PDokanCCB Ccb);
 
 VOID DokanInitIrpList(__in PIRP_LIST IrpList);
 
+VOID DokanInitIrpListBuckets(__in PIRP_LIST IrpList,
+                             __in PLIST_ENTRY SerialBuckets);
+
+VOID DokanDeleteIrpListBuckets(__in PIRP_LIST IrpList);
+
+VOID DokanGrowIrpList(__in PIRP_LIST IrpList);
+
+PIRP_ENTRY
+DokanFindIrpEntry(__in PIRP_LIST IrpList, __in ULONG SerialNumber);
+
+VOID DokanRemoveIrpEntry(__in PIRP_ENTRY IrpEntry);
+
 NTSTATUS
 DokanStartEventNotificationThread(__in PDokanDCB Dcb);
 
@@ -21,6 +21,70 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokan.h"
 
+// Pending IRP of IrpList with SerialNumber, under the list lock. The lists
+// with a SerialTable are searched in the bucket of the serial number only,
+// their other IRPs are not walked. Serial numbers are given in sequence, so
+// that the pending ones are spread evenly over the buckets.
+PIRP_ENTRY
+DokanFindIrpEntry(__in PIRP_LIST IrpList, __in ULONG SerialNumber) {
+  PLIST_ENTRY thisEntry, listHead;
+  PIRP_ENTRY irpEntry;
+  PDOKAN_HASH_ENTRY entry;
+
+  if (IrpList->SerialTable.Buckets == NULL) {
+    listHead = &IrpList->ListHead;
+    for (thisEntry = listHead->Flink; thisEntry != listHead;
+         thisEntry = thisEntry->Flink) {
+      irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
+      if (irpEntry->SerialNumber == SerialNumber) {
+        return irpEntry;
+      }
+    }
+    return NULL;
+  }
+
+  // the serial number is the hash
+  entry = DokanHashTableFind(&IrpList->SerialTable, SerialNumber, NULL);
+  if (entry == NULL) {
+    return NULL;
+  }
+  return CONTAINING_RECORD(entry, IRP_ENTRY, SerialEntry);
+}
+
+// Remove IrpEntry from its IRP list, under the list lock
+VOID DokanRemoveIrpEntry(__in PIRP_ENTRY IrpEntry) {
+  RemoveEntryList(&IrpEntry->ListEntry);
+  InitializeListHead(&IrpEntry->ListEntry);
+  DokanHashTableRemove(&IrpEntry->IrpList->SerialTable,
+                       &IrpEntry->SerialEntry);
+}
+
+// Double the buckets of the serial numbers of IrpList once it has more
+// pending IRPs than buckets, so that DokanFindIrpEntry stays O(1). They are
+// allocated and freed out of the spin lock.
+VOID DokanGrowIrpList(__in PIRP_LIST IrpList) {
+  PDOKAN_HASH_TABLE table = &IrpList->SerialTable;
+  PLIST_ENTRY buckets;
+  ULONG bucketCount;
+  KIRQL oldIrql;
+
+  // read without the lock, checked again with it
+  buckets = DokanHashTableAllocateGrowth(table, DOKAN_PENDING_IRP_MAX_BUCKETS,
+                                         &bucketCount);
+  if (buckets == NULL) {
+    return;
+  }
+
+  KeAcquireSpinLock(&IrpList->ListLock, &oldIrql);
+  if (table->BucketCount < bucketCount) {
+    buckets = DokanHashTableResize(table, buckets, bucketCount);
+  }
+  KeReleaseSpinLock(&IrpList->ListLock, oldIrql);
+
+  // the previous buckets, or ours when another thread grew the table first
+  DokanHashTableFreeBuckets(buckets);
+}
+
 VOID DokanIrpCancelRoutine(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KIRQL oldIrql;
   PIRP_ENTRY irpEntry;
@@ -48,8 +112,7 @@ VOID DokanIrpCancelRoutine(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
     serialNumber = irpEntry->SerialNumber;
 
-    RemoveEntryList(&irpEntry->ListEntry);
-    InitializeListHead(&irpEntry->ListEntry);
+    DokanRemoveIrpEntry(irpEntry);
 
     // If Write is canceld before completion and buffer that saves writing
     // content is not freed, free it here
@@ -177,6 +240,7 @@ RegisterPendingIrpMain(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
   RtlZeroMemory(irpEntry, sizeof(IRP_ENTRY));
 
   InitializeListHead(&irpEntry->ListEntry);
+  DokanHashEntryInit(&irpEntry->SerialEntry);
 
   irpEntry->SerialNumber = SerialNumber;
   irpEntry->FileObject = irpSp->FileObject;
@@ -214,6 +278,10 @@ RegisterPendingIrpMain(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
   IoMarkIrpPending(Irp);
 
   InsertTailList(&IrpList->ListHead, &irpEntry->ListEntry);
+  if (IrpList->SerialTable.Buckets != NULL) {
+    DokanHashTableInsert(&IrpList->SerialTable, &irpEntry->SerialEntry,
+                         SerialNumber);
+  }
 
   irpEntry->CancelRoutineFreeMemory = FALSE;
 
@@ -225,6 +293,8 @@ RegisterPendingIrpMain(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
   // DDbgPrint("  Release IrpList.ListLock\n");
   KeReleaseSpinLock(&IrpList->ListLock, oldIrql);
 
+  DokanGrowIrpList(IrpList);
+
   DDbgPrint("<== DokanRegisterPendingIrpMain\n");
   return STATUS_PENDING;
 }
@@ -303,8 +373,9 @@ DokanRegisterPendingIrpForService(__in PDEVICE_OBJECT DeviceObject,
 NTSTATUS
 DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KIRQL oldIrql;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
+  PIRP irp;
+  PIO_STACK_LOCATION irpSp;
   PDokanVCB vcb;
   PEVENT_INFORMATION eventInfo;
 
@@ -329,29 +400,12 @@ DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KeAcquireSpinLock(&vcb->Dcb->PendingIrp.ListLock, &oldIrql);
 
   // search corresponding IRP through pending IRP list
-  listHead = &vcb->Dcb->PendingIrp.ListHead;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    PIRP irp;
-    PIO_STACK_LOCATION irpSp;
-
-    nextEntry = thisEntry->Flink;
-
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-    // check whether this is corresponding IRP
-
-    // DDbgPrint("SerialNumber irpEntry %X eventInfo %X\n",
-    // irpEntry->SerialNumber, eventInfo->SerialNumber);
+  irpEntry =
+      DokanFindIrpEntry(&vcb->Dcb->PendingIrp, eventInfo->SerialNumber);
 
-    // this irpEntry must be freed in this if statement
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-      continue;
-    }
-
-    RemoveEntryList(thisEntry);
+  // this irpEntry must be freed in this if statement
+  if (irpEntry != NULL) {
+    DokanRemoveIrpEntry(irpEntry);
 
     irp = irpEntry->Irp;
 
@@ -360,14 +414,15 @@ DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
       ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
       DokanFreeIrpEntry(irpEntry);
       irpEntry = NULL;
-      break;
+      KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
+      return STATUS_SUCCESS;
     }
 
     if (IoSetCancelRoutine(irp, NULL) == NULL) {
       // Cancel routine will run as soon as we release the lock
-      InitializeListHead(&irpEntry->ListEntry);
       irpEntry->CancelRoutineFreeMemory = TRUE;
-      break;
+      KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
+      return STATUS_SUCCESS;
     }
 
     // IRP is not canceled yet
@@ -427,6 +482,9 @@ DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
     case IRP_MJ_SET_SECURITY:
       DokanCompleteSetSecurity(irpEntry, eventInfo);
       break;
+    case IRP_MJ_FILE_SYSTEM_CONTROL:
+      DokanCompleteFsControl(irpEntry, eventInfo);
+      break;
     default:
       DDbgPrint("Unknown IRP %d\n", irpSp->MajorFunction);
       // TODO: in this case, should complete this IRP
@@ -624,6 +682,15 @@ DokanEventStart(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
     dcb->IrpTimeout = eventStart.IrpTimeout;
   }
 
+  // the user-mode receives events in buffers of this size
+  dcb->EventContextMaxSize = EVENT_CONTEXT_MAX_SIZE;
+  if (eventStart.EventContextMaxSize > EVENT_CONTEXT_MAX_SIZE) {
+    dcb->EventContextMaxSize =
+        min(eventStart.EventContextMaxSize, EVENT_CONTEXT_MAX_SIZE_LIMIT);
+  }
+  driverInfo->EventContextMaxSize = dcb->EventContextMaxSize;
+  DDbgPrint("  EventContextMaxSize:%lu\n", dcb->EventContextMaxSize);
+
   DDbgPrint("  DeviceName:%ws\n", driverInfo->DeviceName);
 
   dcb->UseAltStream = 0;
@@ -651,11 +718,14 @@ DokanEventStart(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 NTSTATUS
 DokanEventWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KIRQL oldIrql;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PDokanVCB vcb;
   PEVENT_INFORMATION eventInfo;
   PIRP writeIrp;
+  PIO_STACK_LOCATION writeIrpSp, eventIrpSp;
+  PEVENT_CONTEXT eventContext;
+  ULONG info = 0;
+  NTSTATUS status;
 
   eventInfo = (PEVENT_INFORMATION)Irp->AssociatedIrp.SystemBuffer;
   ASSERT(eventInfo != NULL);
@@ -672,91 +742,73 @@ DokanEventWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KeAcquireSpinLock(&vcb->Dcb->PendingIrp.ListLock, &oldIrql);
 
   // search corresponding write IRP through pending IRP list
-  listHead = &vcb->Dcb->PendingIrp.ListHead;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    PIO_STACK_LOCATION writeIrpSp, eventIrpSp;
-    PEVENT_CONTEXT eventContext;
-    ULONG info = 0;
-    NTSTATUS status;
-
-    nextEntry = thisEntry->Flink;
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-    // check whehter this is corresponding IRP
-
-    // DDbgPrint("SerialNumber irpEntry %X eventInfo %X\n",
-    // irpEntry->SerialNumber, eventInfo->SerialNumber);
-
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-      continue;
-    }
-
-    // do NOT free irpEntry here
-    writeIrp = irpEntry->Irp;
-    if (writeIrp == NULL) {
-      // this IRP has already been canceled
-      ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
-      DokanFreeIrpEntry(irpEntry);
-      continue;
-    }
-
-    if (IoSetCancelRoutine(writeIrp, DokanIrpCancelRoutine) == NULL) {
-      // if (IoSetCancelRoutine(writeIrp, NULL) != NULL) {
-      // Cancel routine will run as soon as we release the lock
-      InitializeListHead(&irpEntry->ListEntry);
-      irpEntry->CancelRoutineFreeMemory = TRUE;
-      continue;
-    }
-
-    writeIrpSp = irpEntry->IrpSp;
-    eventIrpSp = IoGetCurrentIrpStackLocation(Irp);
-
-    ASSERT(writeIrpSp != NULL);
-    ASSERT(eventIrpSp != NULL);
+  irpEntry =
+      DokanFindIrpEntry(&vcb->Dcb->PendingIrp, eventInfo->SerialNumber);
+  if (irpEntry == NULL) {
+    KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
+    return STATUS_SUCCESS;
+  }
 
-    eventContext =
-        (PEVENT_CONTEXT)
-            writeIrp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_EVENT];
-    ASSERT(eventContext != NULL);
+  // do NOT free irpEntry here
+  writeIrp = irpEntry->Irp;
+  if (writeIrp == NULL) {
+    // this IRP has already been canceled
+    ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
+    DokanRemoveIrpEntry(irpEntry);
+    DokanFreeIrpEntry(irpEntry);
+    KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
+    return STATUS_SUCCESS;
+  }
 
-    // short of buffer length
-    if (eventIrpSp->Parameters.DeviceIoControl.OutputBufferLength <
-        eventContext->Length) {
-      DDbgPrint("  EventWrite: STATUS_INSUFFICIENT_RESOURCE\n");
-      status = STATUS_INSUFFICIENT_RESOURCES;
-    } else {
-      PVOID buffer;
-      // DDbgPrint("  EventWrite CopyMemory\n");
-      // DDbgPrint("  EventLength %d, BufLength %d\n", eventContext->Length,
-      //			eventIrpSp->Parameters.DeviceIoControl.OutputBufferLength);
-      if (Irp->MdlAddress)
-        buffer = MmGetSystemAddressForMdlNormalSafe(Irp->MdlAddress);
-      else
-        buffer = Irp->AssociatedIrp.SystemBuffer;
-
-      ASSERT(buffer != NULL);
-      RtlCopyMemory(buffer, eventContext, eventContext->Length);
-
-      info = eventContext->Length;
-      status = STATUS_SUCCESS;
-    }
+  if (IoSetCancelRoutine(writeIrp, DokanIrpCancelRoutine) == NULL) {
+    // if (IoSetCancelRoutine(writeIrp, NULL) != NULL) {
+    // Cancel routine will run as soon as we release the lock
+    DokanRemoveIrpEntry(irpEntry);
+    irpEntry->CancelRoutineFreeMemory = TRUE;
+    KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
+    return STATUS_SUCCESS;
+  }
 
-    DokanFreeEventContext(eventContext);
-    writeIrp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_EVENT] = 0;
+  writeIrpSp = irpEntry->IrpSp;
+  eventIrpSp = IoGetCurrentIrpStackLocation(Irp);
 
-    KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
+  ASSERT(writeIrpSp != NULL);
+  ASSERT(eventIrpSp != NULL);
 
-    Irp->IoStatus.Status = status;
-    Irp->IoStatus.Information = info;
+  eventContext = (PEVENT_CONTEXT)
+                     writeIrp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_EVENT];
+  ASSERT(eventContext != NULL);
 
-    // this IRP will be completed by caller function
-    return Irp->IoStatus.Status;
+  // short of buffer length
+  if (eventIrpSp->Parameters.DeviceIoControl.OutputBufferLength <
+      eventContext->Length) {
+    DDbgPrint("  EventWrite: STATUS_INSUFFICIENT_RESOURCE\n");
+    status = STATUS_INSUFFICIENT_RESOURCES;
+  } else {
+    PVOID buffer;
+    // DDbgPrint("  EventWrite CopyMemory\n");
+    // DDbgPrint("  EventLength %d, BufLength %d\n", eventContext->Length,
+    //			eventIrpSp->Parameters.DeviceIoControl.OutputBufferLength);
+    if (Irp->MdlAddress)
+      buffer = MmGetSystemAddressForMdlNormalSafe(Irp->MdlAddress);
+    else
+      buffer = Irp->AssociatedIrp.SystemBuffer;
+
+    ASSERT(buffer != NULL);
+    RtlCopyMemory(buffer, eventContext, eventContext->Length);
+
+    info = eventContext->Length;
+    status = STATUS_SUCCESS;
   }
 
+  DokanFreeEventContext(eventContext);
+  writeIrp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_EVENT] = 0;
+
   KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
 
-  return STATUS_SUCCESS;
+  Irp->IoStatus.Status = status;
+  Irp->IoStatus.Information = info;
+
+  // this IRP will be completed by caller function
+  return Irp->IoStatus.Status;
 }
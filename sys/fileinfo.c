@@ -583,6 +583,10 @@ VOID DokanCompleteSetInformation(__in PIRP_ENTRY IrpEntry,
       if (infoClass == FileRenameInformation) {
         PVOID buffer = NULL;
 
+        // the FCB moves to the bucket of its new name, see DokanGetFCB. The
+        // CCB is held, then the VCB and FCB are taken in the order of
+        // DokanVCB.Resource.
+        ExAcquireResourceExclusiveLite(&fcb->Vcb->Resource, TRUE);
         ExAcquireResourceExclusiveLite(&fcb->Resource, TRUE);
 
         // this is used to inform rename in the bellow switch case
@@ -596,6 +600,7 @@ VOID DokanCompleteSetInformation(__in PIRP_ENTRY IrpEntry,
         if (buffer == NULL) {
           status = STATUS_INSUFFICIENT_RESOURCES;
           ExReleaseResourceLite(&fcb->Resource);
+          ExReleaseResourceLite(&fcb->Vcb->Resource);
           ExReleaseResourceLite(&ccb->Resource);
           KeLeaveCriticalRegion();
           __leave;
@@ -613,7 +618,11 @@ VOID DokanCompleteSetInformation(__in PIRP_ENTRY IrpEntry,
         fcb->FileName.Length = (USHORT)EventInfo->BufferLength;
         fcb->FileName.MaximumLength = (USHORT)EventInfo->BufferLength;
 
+        DokanHashTableRemove(&fcb->Vcb->FcbTable, &fcb->HashEntry);
+        DokanHashFCB(fcb->Vcb, fcb);
+
         ExReleaseResourceLite(&fcb->Resource);
+        ExReleaseResourceLite(&fcb->Vcb->Resource);
       }
     }
 
@@ -22,6 +22,23 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "dokan.h"
 #include <wdmsec.h>
 
+// input of FSCTL_DUPLICATE_EXTENTS_TO_FILE, which older headers lack
+typedef struct _DOKAN_DUPLICATE_EXTENTS_DATA {
+  HANDLE FileHandle;
+  LARGE_INTEGER SourceFileOffset;
+  LARGE_INTEGER TargetFileOffset;
+  LARGE_INTEGER ByteCount;
+} DOKAN_DUPLICATE_EXTENTS_DATA, *PDOKAN_DUPLICATE_EXTENTS_DATA;
+
+#if defined(_WIN64)
+typedef struct _DOKAN_DUPLICATE_EXTENTS_DATA32 {
+  UINT32 FileHandle;
+  LARGE_INTEGER SourceFileOffset;
+  LARGE_INTEGER TargetFileOffset;
+  LARGE_INTEGER ByteCount;
+} DOKAN_DUPLICATE_EXTENTS_DATA32, *PDOKAN_DUPLICATE_EXTENTS_DATA32;
+#endif
+
 NTSTATUS DokanOplockRequest(__in PIRP *pIrp) {
   NTSTATUS Status = STATUS_SUCCESS;
   ULONG FsControlCode;
@@ -238,13 +255,372 @@ NTSTATUS DokanOplockRequest(__in PIRP *pIrp) {
   return Status;
 }
 
+// Build the input of FSCTL_DUPLICATE_EXTENTS_TO_FILE given to the
+// FileSystem, with the source file, which has to be a file of the same
+// volume, resolved from its handle. The source file object stays referenced
+// until the IRP is completed, so that it is not closed meanwhile. The user
+// mode keeps its cleanup from running during the copy.
+NTSTATUS DokanDuplicateExtentsInput(__in PDokanVCB Vcb, __in PIRP Irp,
+                                    __out PDUPLICATE_EXTENTS_CONTEXT *Input,
+                                    __out PULONG InputLength) {
+  PIO_STACK_LOCATION irpSp;
+  PVOID buffer;
+  ULONG bufferLength;
+  HANDLE handle;
+  LARGE_INTEGER sourceOffset;
+  LARGE_INTEGER targetOffset;
+  LARGE_INTEGER byteCount;
+  PFILE_OBJECT sourceObject;
+  PDokanCCB sourceCcb;
+  PDokanFCB sourceFcb;
+  PDUPLICATE_EXTENTS_CONTEXT input;
+  ULONG inputLength;
+  NTSTATUS status;
+
+  irpSp = IoGetCurrentIrpStackLocation(Irp);
+  buffer = Irp->AssociatedIrp.SystemBuffer;
+  bufferLength = irpSp->Parameters.FileSystemControl.InputBufferLength;
+
+  if (buffer == NULL) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+#if defined(_WIN64)
+  if (IoIs32bitProcess(Irp)) {
+    PDOKAN_DUPLICATE_EXTENTS_DATA32 data = buffer;
+    if (bufferLength < sizeof(DOKAN_DUPLICATE_EXTENTS_DATA32)) {
+      return STATUS_INVALID_PARAMETER;
+    }
+    handle = LongToHandle((LONG)data->FileHandle);
+    sourceOffset = data->SourceFileOffset;
+    targetOffset = data->TargetFileOffset;
+    byteCount = data->ByteCount;
+  } else
+#endif
+  {
+    PDOKAN_DUPLICATE_EXTENTS_DATA data = buffer;
+    if (bufferLength < sizeof(DOKAN_DUPLICATE_EXTENTS_DATA)) {
+      return STATUS_INVALID_PARAMETER;
+    }
+    handle = data->FileHandle;
+    sourceOffset = data->SourceFileOffset;
+    targetOffset = data->TargetFileOffset;
+    byteCount = data->ByteCount;
+  }
+
+  if (sourceOffset.QuadPart < 0 || targetOffset.QuadPart < 0 ||
+      byteCount.QuadPart < 0 ||
+      sourceOffset.QuadPart > MAXLONGLONG - byteCount.QuadPart ||
+      targetOffset.QuadPart > MAXLONGLONG - byteCount.QuadPart) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  status = ObReferenceObjectByHandle(handle, FILE_READ_DATA,
+                                     *IoFileObjectType, Irp->RequestorMode,
+                                     (PVOID *)&sourceObject, NULL);
+  if (!NT_SUCCESS(status)) {
+    DDbgPrint("    ObReferenceObjectByHandle failed: 0x%x\n", status);
+    return status;
+  }
+  // released by DokanCompleteIrpRequest
+  Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_FILE_OBJECT] = sourceObject;
+
+  if (IoGetRelatedDeviceObject(sourceObject) !=
+      IoGetRelatedDeviceObject(irpSp->FileObject)) {
+    return STATUS_NOT_SAME_DEVICE;
+  }
+  if (!DokanCheckCCB(Vcb->Dcb, sourceObject->FsContext2)) {
+    return STATUS_INVALID_PARAMETER;
+  }
+  if (FlagOn(sourceObject->Flags, FO_CLEANUP_COMPLETE)) {
+    return STATUS_FILE_CLOSED;
+  }
+
+  sourceCcb = sourceObject->FsContext2;
+  sourceFcb = sourceCcb->Fcb;
+  ASSERT(sourceFcb != NULL);
+
+  if (FlagOn(sourceFcb->Flags, DOKAN_FILE_DIRECTORY)) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  // the FileSystem reads the data written to the cache of the source
+  if (sourceObject->SectionObjectPointer != NULL &&
+      sourceObject->SectionObjectPointer->DataSectionObject != NULL) {
+    CcFlushCache(&sourceFcb->SectionObjectPointers, NULL, 0, NULL);
+  }
+
+  inputLength = FIELD_OFFSET(DUPLICATE_EXTENTS_CONTEXT, SourceFileName[0]) +
+                sourceFcb->FileName.Length + sizeof(WCHAR);
+  input = ExAllocatePool(inputLength);
+  if (input == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  RtlZeroMemory(input, inputLength);
+
+  input->SourceContext = sourceCcb->UserContext;
+  input->SourceOffset = sourceOffset.QuadPart;
+  input->TargetOffset = targetOffset.QuadPart;
+  input->ByteCount = byteCount.QuadPart;
+  input->SourceFileNameLength = sourceFcb->FileName.Length;
+  RtlCopyMemory(input->SourceFileName, sourceFcb->FileName.Buffer,
+                sourceFcb->FileName.Length);
+
+  *Input = input;
+  *InputLength = inputLength;
+  return STATUS_SUCCESS;
+}
+
+// Forward an FSCTL on a file to the FileSystem. Its input buffer is copied
+// after the file name, the output is returned by DokanCompleteFsControl.
+NTSTATUS DokanForwardFsControl(__in PDEVICE_OBJECT DeviceObject,
+                               __in PIRP Irp) {
+  PIO_STACK_LOCATION irpSp;
+  PFILE_OBJECT fileObject;
+  PDokanVCB vcb;
+  PDokanCCB ccb;
+  PDokanFCB fcb;
+  PEVENT_CONTEXT eventContext;
+  ULONG eventLength;
+  ULONG fsControlCode;
+  ULONG inputLength;
+  ULONG outputLength;
+  ULONG inputOffset;
+  PVOID inputBuffer = NULL;
+  PDUPLICATE_EXTENTS_CONTEXT duplicateInput = NULL;
+  ULONG flags = 0;
+  NTSTATUS status;
+
+  irpSp = IoGetCurrentIrpStackLocation(Irp);
+  fileObject = irpSp->FileObject;
+  fsControlCode = irpSp->Parameters.FileSystemControl.FsControlCode;
+  inputLength = irpSp->Parameters.FileSystemControl.InputBufferLength;
+  outputLength = irpSp->Parameters.FileSystemControl.OutputBufferLength;
+
+  vcb = DeviceObject->DeviceExtension;
+  if (fileObject == NULL || GetIdentifierType(vcb) != VCB ||
+      !DokanCheckCCB(vcb->Dcb, fileObject->FsContext2)) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  ccb = fileObject->FsContext2;
+  ASSERT(ccb != NULL);
+
+  fcb = ccb->Fcb;
+  ASSERT(fcb != NULL);
+
+  if (FlagOn(fcb->Flags, DOKAN_FILE_DIRECTORY)) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  switch (fsControlCode) {
+  case FSCTL_QUERY_ALLOCATED_RANGES:
+    if (inputLength < sizeof(FILE_ALLOCATED_RANGE_BUFFER)) {
+      return STATUS_INVALID_PARAMETER;
+    }
+    if (outputLength < sizeof(FILE_ALLOCATED_RANGE_BUFFER)) {
+      return STATUS_BUFFER_TOO_SMALL;
+    }
+    inputLength = sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+    break;
+
+  case FSCTL_SET_ZERO_DATA:
+    if (inputLength < sizeof(FILE_ZERO_DATA_INFORMATION)) {
+      return STATUS_INVALID_PARAMETER;
+    }
+    inputLength = sizeof(FILE_ZERO_DATA_INFORMATION);
+    outputLength = 0;
+    break;
+
+  case FSCTL_DUPLICATE_EXTENTS_TO_FILE:
+    status = DokanDuplicateExtentsInput(vcb, Irp, &duplicateInput,
+                                        &inputLength);
+    if (!NT_SUCCESS(status)) {
+      return status;
+    }
+    inputBuffer = duplicateInput;
+    outputLength = 0;
+    break;
+
+  default:
+    return STATUS_INVALID_DEVICE_REQUEST;
+  }
+
+  if (inputBuffer != NULL) {
+    // built by the driver
+  } else if (METHOD_FROM_CTL_CODE(fsControlCode) == METHOD_NEITHER) {
+    inputBuffer = irpSp->Parameters.FileSystemControl.Type3InputBuffer;
+  } else {
+    inputBuffer = Irp->AssociatedIrp.SystemBuffer;
+  }
+  if (inputBuffer == NULL) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  // aligned for the user mode to read the input in place
+  inputOffset = FIELD_OFFSET(EVENT_CONTEXT, Operation.FsControl.FileName[0]) +
+                fcb->FileName.Length + sizeof(WCHAR);
+  inputOffset = (inputOffset + 7) & ~7;
+  eventLength = inputOffset + inputLength;
+  eventContext = AllocateEventContext(vcb->Dcb, Irp, eventLength, ccb);
+
+  if (eventContext == NULL) {
+    if (duplicateInput != NULL) {
+      ExFreePool(duplicateInput);
+    }
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  status = STATUS_SUCCESS;
+  __try {
+    if (METHOD_FROM_CTL_CODE(fsControlCode) == METHOD_NEITHER &&
+        Irp->RequestorMode != KernelMode) {
+      ProbeForRead(inputBuffer, inputLength, sizeof(UCHAR));
+    }
+    RtlCopyMemory((PCHAR)eventContext + inputOffset, inputBuffer,
+                  inputLength);
+  } __except (EXCEPTION_EXECUTE_HANDLER) {
+    DDbgPrint("    invalid input buffer\n");
+    status = STATUS_INVALID_USER_BUFFER;
+  }
+  if (duplicateInput != NULL) {
+    ExFreePool(duplicateInput);
+  }
+  if (!NT_SUCCESS(status)) {
+    DokanFreeEventContext(eventContext);
+    return status;
+  }
+
+  // make a MDL for UserBuffer that can be used later on another thread
+  // context
+  if (outputLength > 0 &&
+      METHOD_FROM_CTL_CODE(fsControlCode) == METHOD_NEITHER) {
+    if (Irp->UserBuffer == NULL) {
+      DokanFreeEventContext(eventContext);
+      return STATUS_INVALID_USER_BUFFER;
+    }
+    if (Irp->MdlAddress == NULL) {
+      status = DokanAllocateMdl(Irp, outputLength);
+      if (!NT_SUCCESS(status)) {
+        DokanFreeEventContext(eventContext);
+        return status;
+      }
+      flags = DOKAN_MDL_ALLOCATED;
+    }
+  }
+
+  eventContext->Context = ccb->UserContext;
+  eventContext->Operation.FsControl.FsControlCode = fsControlCode;
+  eventContext->Operation.FsControl.InputLength = inputLength;
+  eventContext->Operation.FsControl.InputOffset = inputOffset;
+  eventContext->Operation.FsControl.OutputLength = outputLength;
+
+  eventContext->Operation.FsControl.FileNameLength = fcb->FileName.Length;
+  RtlCopyMemory(eventContext->Operation.FsControl.FileName,
+                fcb->FileName.Buffer, fcb->FileName.Length);
+
+  if (fsControlCode == FSCTL_SET_ZERO_DATA ||
+      fsControlCode == FSCTL_DUPLICATE_EXTENTS_TO_FILE) {
+    // the cached data of the range is about to be replaced
+    if (fileObject->SectionObjectPointer != NULL &&
+        fileObject->SectionObjectPointer->DataSectionObject != NULL) {
+      ExAcquireResourceExclusiveLite(&fcb->PagingIoResource, TRUE);
+      CcFlushCache(&fcb->SectionObjectPointers, NULL, 0, NULL);
+      CcPurgeCacheSection(&fcb->SectionObjectPointers, NULL, 0, FALSE);
+      ExReleaseResourceLite(&fcb->PagingIoResource);
+    }
+
+    status = FsRtlCheckOplock(DokanGetFcbOplock(fcb), Irp, eventContext,
+                              DokanOplockComplete, DokanPrePostIrp);
+
+    //
+    //  if FsRtlCheckOplock returns STATUS_PENDING the IRP has been posted
+    //  to service an oplock break and we need to leave now.
+    //
+    if (status != STATUS_SUCCESS) {
+      if (status == STATUS_PENDING) {
+        DDbgPrint("   FsRtlCheckOplock returned STATUS_PENDING\n");
+      } else {
+        DokanFreeEventContext(eventContext);
+      }
+      return status;
+    }
+  }
+
+  // register this IRP to pending IRP list and make it pending status
+  return DokanRegisterPendingIrp(DeviceObject, Irp, eventContext, flags);
+}
+
+VOID DokanCompleteFsControl(__in PIRP_ENTRY IrpEntry,
+                            __in PEVENT_INFORMATION EventInfo) {
+  PIRP irp;
+  PIO_STACK_LOCATION irpSp;
+  NTSTATUS status;
+  PVOID buffer = NULL;
+  ULONG bufferLength;
+  ULONG info = 0;
+  PFILE_OBJECT fileObject;
+  PDokanCCB ccb;
+
+  DDbgPrint("==> DokanCompleteFsControl\n");
+
+  irp = IrpEntry->Irp;
+  irpSp = IrpEntry->IrpSp;
+
+  bufferLength = irpSp->Parameters.FileSystemControl.OutputBufferLength;
+  if (METHOD_FROM_CTL_CODE(
+          irpSp->Parameters.FileSystemControl.FsControlCode) ==
+      METHOD_NEITHER) {
+    if (irp->MdlAddress) {
+      buffer = MmGetSystemAddressForMdlNormalSafe(irp->MdlAddress);
+    }
+  } else {
+    buffer = irp->AssociatedIrp.SystemBuffer;
+  }
+
+  status = EventInfo->Status;
+  if (NT_SUCCESS(status) || status == STATUS_BUFFER_OVERFLOW) {
+    // as much of the output as the buffer holds
+    info = EventInfo->BufferLength;
+    if (info > bufferLength) {
+      info = bufferLength;
+      status = STATUS_BUFFER_OVERFLOW;
+    }
+    if (info > 0) {
+      if (buffer != NULL) {
+        RtlCopyMemory(buffer, EventInfo->Buffer, info);
+      } else {
+        info = 0;
+        status = STATUS_INSUFFICIENT_RESOURCES;
+      }
+    }
+  }
+
+  if (IrpEntry->Flags & DOKAN_MDL_ALLOCATED) {
+    DokanFreeMdl(irp);
+    IrpEntry->Flags &= ~DOKAN_MDL_ALLOCATED;
+  }
+
+  fileObject = IrpEntry->FileObject;
+  ASSERT(fileObject != NULL);
+
+  ccb = fileObject->FsContext2;
+  if (ccb != NULL) {
+    ccb->UserContext = EventInfo->Context;
+  } else {
+    DDbgPrint("  ccb == NULL\n");
+  }
+
+  DokanCompleteIrpRequest(irp, status, info);
+
+  DDbgPrint("<== DokanCompleteFsControl\n");
+}
+
 NTSTATUS
 DokanUserFsRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP *pIrp) {
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
   PIO_STACK_LOCATION irpSp;
 
-  UNREFERENCED_PARAMETER(DeviceObject);
-
   irpSp = IoGetCurrentIrpStackLocation(*pIrp);
 
   switch (irpSp->Parameters.FileSystemControl.FsControlCode) {
@@ -434,10 +810,17 @@ DokanUserFsRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP *pIrp) {
 
   case FSCTL_SET_ZERO_DATA:
     DDbgPrint("    FSCTL_SET_ZERO_DATA\n");
+    status = DokanForwardFsControl(DeviceObject, *pIrp);
     break;
 
   case FSCTL_QUERY_ALLOCATED_RANGES:
     DDbgPrint("    FSCTL_QUERY_ALLOCATED_RANGES\n");
+    status = DokanForwardFsControl(DeviceObject, *pIrp);
+    break;
+
+  case FSCTL_DUPLICATE_EXTENTS_TO_FILE:
+    DDbgPrint("    FSCTL_DUPLICATE_EXTENTS_TO_FILE\n");
+    status = DokanForwardFsControl(DeviceObject, *pIrp);
     break;
 
   case FSCTL_SET_ENCRYPTION:
@@ -586,6 +969,7 @@ NTSTATUS DokanMountVolume(__in PDEVICE_OBJECT DiskDevice, __in PIRP Irp) {
   dcb->Vcb = vcb;
 
   InitializeListHead(&vcb->NextFCB);
+  DokanHashTableInit(&vcb->FcbTable, vcb->FcbBuckets, DOKAN_FCB_BUCKETS);
 
   InitializeListHead(&vcb->DirNotifyList);
   FsRtlNotifyInitializeSync(&vcb->NotifySync);
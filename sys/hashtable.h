@@ -0,0 +1,217 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASHTABLE_H_
+#define HASHTABLE_H_
+
+// Chained hash table of LIST_ENTRY. It only uses the LIST_ENTRY routines,
+// DOKAN_HASH_UPCASE, DOKAN_HASH_ALLOCATE and DOKAN_HASH_FREE, so that it
+// builds out of the WDK and can be tested and benchmarked in user mode, see
+// tests/hashtable_test.c. Its user includes their definitions first and
+// takes the locks.
+
+#ifndef DOKAN_HASH_UPCASE
+#define DOKAN_HASH_UPCASE(c) RtlUpcaseUnicodeChar(c)
+#endif
+
+#ifndef DOKAN_HASH_ALLOCATE
+#define DOKAN_HASH_ALLOCATE(Size) ExAllocatePool(Size)
+#define DOKAN_HASH_FREE(Buffer) ExFreePool(Buffer)
+#endif
+
+// entry of a DOKAN_HASH_TABLE, embedded in the hashed structure
+typedef struct _DOKAN_HASH_ENTRY {
+  // in the bucket of Hash, linked to itself when not in a table
+  LIST_ENTRY ListEntry;
+  ULONG Hash;
+} DOKAN_HASH_ENTRY, *PDOKAN_HASH_ENTRY;
+
+typedef struct _DOKAN_HASH_TABLE {
+  PLIST_ENTRY Buckets;
+  // a power of two, the bucket of a hash is given by its low bits
+  ULONG BucketCount;
+  ULONG Count;
+  // given to DokanHashTableInit, never returned to be freed
+  PLIST_ENTRY InitialBuckets;
+} DOKAN_HASH_TABLE, *PDOKAN_HASH_TABLE;
+
+FORCEINLINE
+VOID DokanHashTableInit(PDOKAN_HASH_TABLE Table, PLIST_ENTRY Buckets,
+                        ULONG BucketCount) {
+  ULONG i;
+
+  for (i = 0; i < BucketCount; ++i)
+    InitializeListHead(&Buckets[i]);
+  Table->Buckets = Buckets;
+  Table->BucketCount = BucketCount;
+  Table->Count = 0;
+  Table->InitialBuckets = Buckets;
+}
+
+FORCEINLINE
+VOID DokanHashEntryInit(PDOKAN_HASH_ENTRY Entry) {
+  InitializeListHead(&Entry->ListEntry);
+  Entry->Hash = 0;
+}
+
+// head of the list holding the entries with Hash, among others
+FORCEINLINE
+PLIST_ENTRY
+DokanHashTableBucket(PDOKAN_HASH_TABLE Table, ULONG Hash) {
+  return &Table->Buckets[Hash & (Table->BucketCount - 1)];
+}
+
+// Next entry with Hash after Previous, or the first one when Previous is
+// NULL. The other entries of the bucket are skipped, the caller compares the
+// keys of those returned when different keys can have the same hash.
+FORCEINLINE
+PDOKAN_HASH_ENTRY
+DokanHashTableFind(PDOKAN_HASH_TABLE Table, ULONG Hash,
+                   PDOKAN_HASH_ENTRY Previous) {
+  PLIST_ENTRY bucket = DokanHashTableBucket(Table, Hash);
+  PLIST_ENTRY listEntry =
+      Previous != NULL ? Previous->ListEntry.Flink : bucket->Flink;
+
+  for (; listEntry != bucket; listEntry = listEntry->Flink) {
+    PDOKAN_HASH_ENTRY entry =
+        CONTAINING_RECORD(listEntry, DOKAN_HASH_ENTRY, ListEntry);
+    if (entry->Hash == Hash)
+      return entry;
+  }
+  return NULL;
+}
+
+FORCEINLINE
+VOID DokanHashTableInsert(PDOKAN_HASH_TABLE Table, PDOKAN_HASH_ENTRY Entry,
+                          ULONG Hash) {
+  Entry->Hash = Hash;
+  InsertTailList(DokanHashTableBucket(Table, Hash), &Entry->ListEntry);
+  Table->Count++;
+}
+
+// does nothing when Entry is not in the table
+FORCEINLINE
+VOID DokanHashTableRemove(PDOKAN_HASH_TABLE Table, PDOKAN_HASH_ENTRY Entry) {
+  if (IsListEmpty(&Entry->ListEntry))
+    return;
+  RemoveEntryList(&Entry->ListEntry);
+  InitializeListHead(&Entry->ListEntry);
+  Table->Count--;
+}
+
+// TRUE when the table has more entries than buckets and less than
+// MaxBucketCount buckets, so that it should be resized to twice its size
+FORCEINLINE
+BOOLEAN
+DokanHashTableShouldGrow(PDOKAN_HASH_TABLE Table, ULONG MaxBucketCount) {
+  return (BOOLEAN)(Table->Buckets != NULL &&
+                   Table->Count > Table->BucketCount &&
+                   Table->BucketCount < MaxBucketCount);
+}
+
+// Move the entries to Buckets, BucketCount lists which is a power of two.
+// Returns the previous buckets, for the caller to free, or NULL when they
+// are the ones given to DokanHashTableInit.
+FORCEINLINE
+PLIST_ENTRY
+DokanHashTableResize(PDOKAN_HASH_TABLE Table, PLIST_ENTRY Buckets,
+                     ULONG BucketCount) {
+  PLIST_ENTRY oldBuckets = Table->Buckets;
+  ULONG oldBucketCount = Table->BucketCount;
+  ULONG i;
+
+  for (i = 0; i < BucketCount; ++i)
+    InitializeListHead(&Buckets[i]);
+
+  for (i = 0; i < oldBucketCount; ++i) {
+    while (!IsListEmpty(&oldBuckets[i])) {
+      PDOKAN_HASH_ENTRY entry = CONTAINING_RECORD(
+          RemoveHeadList(&oldBuckets[i]), DOKAN_HASH_ENTRY, ListEntry);
+      InsertTailList(&Buckets[entry->Hash & (BucketCount - 1)],
+                     &entry->ListEntry);
+    }
+  }
+
+  Table->Buckets = Buckets;
+  Table->BucketCount = BucketCount;
+  return oldBuckets == Table->InitialBuckets ? NULL : oldBuckets;
+}
+
+// Buckets for DokanHashTableResize, twice as many as the table has, when
+// DokanHashTableShouldGrow. NULL otherwise or without memory, the chains
+// just get longer then. Can be called without the lock of the table, to
+// allocate out of it, with BucketCount checked again under it.
+FORCEINLINE
+PLIST_ENTRY
+DokanHashTableAllocateGrowth(PDOKAN_HASH_TABLE Table, ULONG MaxBucketCount,
+                             ULONG *BucketCount) {
+  if (!DokanHashTableShouldGrow(Table, MaxBucketCount))
+    return NULL;
+  *BucketCount = Table->BucketCount * 2;
+  return (PLIST_ENTRY)DOKAN_HASH_ALLOCATE(*BucketCount * sizeof(LIST_ENTRY));
+}
+
+// free buckets returned by DokanHashTableResize, or allocated for it
+FORCEINLINE
+VOID DokanHashTableFreeBuckets(PLIST_ENTRY Buckets) {
+  if (Buckets != NULL)
+    DOKAN_HASH_FREE(Buckets);
+}
+
+// Double the buckets of the table when it has more entries than buckets, so
+// that the lookups stay O(1). Called with the lock of the table held
+// exclusive, where allocating is allowed.
+FORCEINLINE
+VOID DokanHashTableGrow(PDOKAN_HASH_TABLE Table, ULONG MaxBucketCount) {
+  ULONG bucketCount;
+  PLIST_ENTRY buckets =
+      DokanHashTableAllocateGrowth(Table, MaxBucketCount, &bucketCount);
+
+  if (buckets != NULL)
+    DokanHashTableFreeBuckets(
+        DokanHashTableResize(Table, buckets, bucketCount));
+}
+
+// Free the buckets allocated for the table once it is not used anymore. It
+// must be given to DokanHashTableInit again to be used.
+FORCEINLINE
+VOID DokanHashTableDelete(PDOKAN_HASH_TABLE Table) {
+  if (Table->Buckets != Table->InitialBuckets)
+    DokanHashTableFreeBuckets(Table->Buckets);
+}
+
+// Hash of the Length characters of Name upcased with DOKAN_HASH_UPCASE, so
+// that the names equal but for the case have the same one. FNV-1a, whose
+// high bits are folded into the low ones given the buckets.
+FORCEINLINE
+ULONG
+DokanHashName(const WCHAR *Name, ULONG Length) {
+  ULONG hash = 2166136261U;
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    hash ^= (WCHAR)DOKAN_HASH_UPCASE(Name[i]);
+    hash *= 16777619U;
+  }
+  return hash ^ (hash >> 16);
+}
+
+#endif // HASHTABLE_H_
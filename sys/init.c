@@ -379,6 +379,21 @@ VOID DokanInitIrpList(__in PIRP_LIST IrpList) {
   InitializeListHead(&IrpList->ListHead);
   KeInitializeSpinLock(&IrpList->ListLock);
   KeInitializeEvent(&IrpList->NotEmpty, NotificationEvent, FALSE);
+  RtlZeroMemory(&IrpList->SerialTable, sizeof(DOKAN_HASH_TABLE));
+}
+
+// the entries of IrpList are also hashed by serial number, starting with
+// SerialBuckets, which has DOKAN_PENDING_IRP_BUCKETS lists
+VOID DokanInitIrpListBuckets(__in PIRP_LIST IrpList,
+                             __in PLIST_ENTRY SerialBuckets) {
+  DokanHashTableInit(&IrpList->SerialTable, SerialBuckets,
+                     DOKAN_PENDING_IRP_BUCKETS);
+}
+
+// free the buckets allocated by DokanGrowIrpList
+VOID DokanDeleteIrpListBuckets(__in PIRP_LIST IrpList) {
+  DokanHashTableDelete(&IrpList->SerialTable);
+  RtlZeroMemory(&IrpList->SerialTable, sizeof(DOKAN_HASH_TABLE));
 }
 
 PDEVICE_ENTRY
@@ -492,6 +507,8 @@ VOID DeleteDeviceDelayed(PDOKAN_GLOBAL dokanGlobal) {
 
               DDbgPrint("  Delete the volume device. ReferenceCount %lu \n",
                         deviceEntry->VolumeDeviceObject->ReferenceCount);
+              DokanDeleteFcbTable(
+                  deviceEntry->VolumeDeviceObject->DeviceExtension);
               IoDeleteDevice(deviceEntry->VolumeDeviceObject);
               deviceEntry->VolumeDeviceObject = NULL;
             } else {
@@ -510,6 +527,7 @@ VOID DeleteDeviceDelayed(PDOKAN_GLOBAL dokanGlobal) {
         if (canDeleteDiskDevice) {
           DDbgPrint("  Delete the disk device. ReferenceCount %lu \n",
                     deviceEntry->DiskDeviceObject->ReferenceCount);
+          DokanDeleteIrpListBuckets(&dcb->PendingIrp);
           IoDeleteDevice(deviceEntry->DiskDeviceObject);
           if (deviceEntry->DiskDeviceObject->Vpb) {
             DDbgPrint("  Volume->DeviceObject set to NULL")
@@ -1205,6 +1223,7 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
 
   // initialize Event and Event queue
   DokanInitIrpList(&dcb->PendingIrp);
+  DokanInitIrpListBuckets(&dcb->PendingIrp, dcb->PendingIrpBuckets);
   DokanInitIrpList(&dcb->PendingEvent);
   DokanInitIrpList(&dcb->NotifyEvent);
 
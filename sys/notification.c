@@ -151,8 +151,9 @@ VOID ReleasePendingIrp(__in PIRP_LIST PendingIrp) {
   KeAcquireSpinLock(&PendingIrp->ListLock, &oldIrql);
 
   while (!IsListEmpty(&PendingIrp->ListHead)) {
-    listHead = RemoveHeadList(&PendingIrp->ListHead);
-    irpEntry = CONTAINING_RECORD(listHead, IRP_ENTRY, ListEntry);
+    irpEntry =
+        CONTAINING_RECORD(PendingIrp->ListHead.Flink, IRP_ENTRY, ListEntry);
+    DokanRemoveIrpEntry(irpEntry);
     irp = irpEntry->Irp;
     if (irp == NULL) {
       // this IRP has already been canceled
@@ -163,7 +164,6 @@ VOID ReleasePendingIrp(__in PIRP_LIST PendingIrp) {
 
     if (IoSetCancelRoutine(irp, NULL) == NULL) {
       // Cancel routine will run as soon as we release the lock
-      InitializeListHead(&irpEntry->ListEntry);
       irpEntry->CancelRoutineFreeMemory = TRUE;
       continue;
     }
@@ -26,9 +26,13 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define DOKAN_MAJOR_API_VERSION L"1"
 #endif
 
-#define DOKAN_DRIVER_VERSION 0x0000190
+#define DOKAN_DRIVER_VERSION 0x0000193
 
+// size of the buffer in which an event is received, unless negotiated with
+// EVENT_START.EventContextMaxSize
 #define EVENT_CONTEXT_MAX_SIZE (1024 * 32)
+// largest size EVENT_START.EventContextMaxSize can negotiate
+#define EVENT_CONTEXT_MAX_SIZE_LIMIT (1024 * 1024 * 16)
 
 #define IOCTL_TEST                                                             \
   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x800, METHOD_BUFFERED, FILE_ANY_ACCESS)
@@ -268,6 +272,32 @@ typedef struct _SET_SECURITY_CONTEXT {
   WCHAR FileName[1];
 } SET_SECURITY_CONTEXT, *PSET_SECURITY_CONTEXT;
 
+typedef struct _FSCTL_CONTEXT {
+  ULONG FsControlCode;
+  ULONG InputLength;
+  ULONG InputOffset;
+  ULONG OutputLength;
+  ULONG FileNameLength;
+  WCHAR FileName[1];
+} FSCTL_CONTEXT, *PFSCTL_CONTEXT;
+
+// older headers lack it
+#ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+#define FSCTL_DUPLICATE_EXTENTS_TO_FILE                                        \
+  CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_DATA)
+#endif
+
+// input of FSCTL_DUPLICATE_EXTENTS_TO_FILE in FSCTL_CONTEXT, with the source
+// file resolved from its handle
+typedef struct _DUPLICATE_EXTENTS_CONTEXT {
+  ULONG64 SourceContext;
+  LONGLONG SourceOffset;
+  LONGLONG TargetOffset;
+  LONGLONG ByteCount;
+  ULONG SourceFileNameLength;
+  WCHAR SourceFileName[1];
+} DUPLICATE_EXTENTS_CONTEXT, *PDUPLICATE_EXTENTS_CONTEXT;
+
 typedef struct _EVENT_CONTEXT {
   ULONG Length;
   ULONG MountId;
@@ -293,6 +323,7 @@ typedef struct _EVENT_CONTEXT {
     UNMOUNT_CONTEXT Unmount;
     SECURITY_CONTEXT Security;
     SET_SECURITY_CONTEXT SetSecurity;
+    FSCTL_CONTEXT FsControl;
   } Operation;
 } EVENT_CONTEXT, *PEVENT_CONTEXT;
 
@@ -346,6 +377,9 @@ typedef struct _EVENT_DRIVER_INFO {
   ULONG DeviceNumber;
   ULONG MountId;
   WCHAR DeviceName[64];
+  // size of the events the driver sends whole, the rest is sent with
+  // IOCTL_EVENT_WRITE
+  ULONG EventContextMaxSize;
 } EVENT_DRIVER_INFO, *PEVENT_DRIVER_INFO;
 
 typedef struct _EVENT_START {
@@ -355,6 +389,9 @@ typedef struct _EVENT_START {
   WCHAR MountPoint[260];
   WCHAR UNCName[64];
   ULONG IrpTimeout;
+  // size of the buffers in which the user-mode receives events, 0 for
+  // EVENT_CONTEXT_MAX_SIZE
+  ULONG EventContextMaxSize;
 } EVENT_START, *PEVENT_START;
 
 typedef struct _DOKAN_RENAME_INFORMATION {
@@ -269,10 +269,10 @@ DokanDispatchSetSecurity(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
     eventLength =
         sizeof(EVENT_CONTEXT) + securityDescLength + fcb->FileName.Length;
 
-    if (EVENT_CONTEXT_MAX_SIZE < eventLength) {
+    if (vcb->Dcb->EventContextMaxSize < eventLength) {
       // TODO: Handle this case like DispatchWrite.
       DDbgPrint("    SecurityDescriptor is too big: %d (limit %d)\n",
-                eventLength, EVENT_CONTEXT_MAX_SIZE);
+                eventLength, vcb->Dcb->EventContextMaxSize);
       status = STATUS_INSUFFICIENT_RESOURCES;
       __leave;
     }
@@ -0,0 +1,249 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Tests and benchmark of the directory listings of dokan/finddata.c, out of
+// Windows. Pages are listed the way MatchFiles does, once from the cursor
+// kept between the queries and once by rescanning the listing from its
+// first entry, as the queries did before the cursor.
+//
+//   cc -O2 -fshort-wchar -Iwin32 -o finddata_test finddata_test.c ../../dokan/finddata.c ../../dokan/names.c
+//   ./finddata_test          runs the tests
+//   ./finddata_test bench    also lists 10k, 100k and 1M entries
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../dokan/finddata.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+// directory query state of a handle, see DOKAN_OPEN_INFO
+typedef struct _LISTING {
+  DOKAN_FIND_DATA_ARENA DirList;
+  DOKAN_FIND_DATA_CURSOR DirListCursor;
+  BOOLEAN DirListCursorValid;
+} LISTING;
+
+static void AddEntry(LISTING *Listing, ULONG Number, BOOLEAN InsertTail) {
+  WIN32_FIND_DATAW findData;
+  char name[32];
+  int i;
+
+  ZeroMemory(&findData, sizeof(findData));
+  snprintf(name, sizeof(name), "file%lu.txt", (unsigned long)Number);
+  for (i = 0; name[i] != '\0'; ++i)
+    findData.cFileName[i] = (WCHAR)name[i];
+  findData.nFileSizeLow = Number;
+  CHECK(DokanFindDataArenaAppend(&Listing->DirList, &findData, Number + 1,
+                                 InsertTail));
+  Listing->DirListCursorValid = FALSE;
+}
+
+static void MakeListing(LISTING *Listing, ULONG Count) {
+  ULONG i;
+
+  ZeroMemory(Listing, sizeof(*Listing));
+  for (i = 0; i < Count; ++i)
+    AddEntry(Listing, i, TRUE);
+}
+
+// One directory query of MatchFiles returning at most PageSize entries from
+// FileIndex in Sizes, the file sizes being the entry numbers. Returns the
+// index of the next query, -1 when there are no more files.
+static LONG QueryPage(LISTING *Listing, ULONG FileIndex, BOOL Restart,
+                      PDOKAN_EXPRESSION Expression, ULONG PageSize,
+                      ULONG *Sizes, ULONG *Count, BOOL UseCursor) {
+  DOKAN_FIND_DATA_CURSOR cursor;
+  PDOKAN_FIND_DATA find;
+
+  *Count = 0;
+  cursor.Offset = 0;
+  cursor.Index = 0;
+  if (UseCursor && Listing->DirListCursorValid && !Restart &&
+      Listing->DirListCursor.Index == FileIndex)
+    cursor = Listing->DirListCursor;
+
+  while ((find = DokanFindDataSeek(&Listing->DirList, &cursor,
+                                   Expression)) != NULL) {
+    if (FileIndex <= cursor.Index) {
+      if (*Count == PageSize)
+        break;
+      Sizes[(*Count)++] = find->FileSizeLow;
+    }
+    DokanFindDataSkip(&Listing->DirList, &cursor);
+  }
+
+  Listing->DirListCursor = cursor;
+  Listing->DirListCursorValid = TRUE;
+
+  if (cursor.Index <= FileIndex)
+    return -1;
+  return cursor.Index;
+}
+
+// entry numbers of the whole listing read in pages of PageSize
+static ULONG ListAll(LISTING *Listing, PDOKAN_EXPRESSION Expression,
+                     ULONG PageSize, ULONG *Sizes, BOOL UseCursor) {
+  ULONG total = 0;
+  ULONG count;
+  LONG index = 0;
+
+  while ((index = QueryPage(Listing, (ULONG)index, FALSE, Expression,
+                            PageSize, Sizes + total, &count, UseCursor)) >=
+         0) {
+    total += count;
+    if (count == 0)
+      break;
+  }
+  return total;
+}
+
+static void TestPaging(void) {
+  static const ULONG pageSizes[] = {1, 2, 3, 7, 32, 1000};
+  DOKAN_EXPRESSION expression;
+  LISTING listing;
+  ULONG cursorSizes[1000], rescanSizes[1000];
+  ULONG p, i, total;
+
+  MakeListing(&listing, 1000);
+  CHECK(listing.DirList.Count == 1000);
+
+  for (p = 0; p < sizeof(pageSizes) / sizeof(pageSizes[0]); ++p) {
+    total = ListAll(&listing, NULL, pageSizes[p], cursorSizes, TRUE);
+    CHECK(total == 1000);
+    for (i = 0; i < total; ++i)
+      CHECK(cursorSizes[i] == i);
+
+    // every name ending with 7.txt
+    DokanCompileExpression(&expression, L"*7.txt", TRUE);
+    total = ListAll(&listing, &expression, pageSizes[p], cursorSizes, TRUE);
+    CHECK(total == 100);
+    CHECK(ListAll(&listing, &expression, pageSizes[p], rescanSizes, FALSE) ==
+          total);
+    for (i = 0; i < total; ++i) {
+      CHECK(cursorSizes[i] % 10 == 7);
+      CHECK(cursorSizes[i] == rescanSizes[i]);
+    }
+  }
+
+  ClearFindData(&listing.DirList);
+  CHECK(listing.DirList.Buffer == NULL && listing.DirList.Size == 0);
+}
+
+static void TestRestart(void) {
+  LISTING listing;
+  ULONG sizes[8];
+  ULONG count;
+
+  MakeListing(&listing, 20);
+
+  CHECK(QueryPage(&listing, 0, FALSE, NULL, 8, sizes, &count, TRUE) == 8);
+  CHECK(count == 8 && sizes[7] == 7);
+
+  // SL_RESTART_SCAN and SL_INDEX_SPECIFIED start again from the index given
+  CHECK(QueryPage(&listing, 0, TRUE, NULL, 8, sizes, &count, TRUE) == 8);
+  CHECK(count == 8 && sizes[0] == 0);
+  CHECK(QueryPage(&listing, 3, TRUE, NULL, 1, sizes, &count, TRUE) == 4);
+  CHECK(count == 1 && sizes[0] == 3);
+
+  // the cursor is on entry 4 now, an other index does not use it
+  CHECK(QueryPage(&listing, 12, FALSE, NULL, 8, sizes, &count, TRUE) == 20);
+  CHECK(count == 8 && sizes[0] == 12 && sizes[7] == 19);
+  CHECK(QueryPage(&listing, 20, FALSE, NULL, 8, sizes, &count, TRUE) == -1);
+  CHECK(count == 0);
+
+  // an entry added in front, as "." and "..", invalidates the cursor
+  AddEntry(&listing, 100, FALSE);
+  CHECK(!listing.DirListCursorValid);
+  CHECK(QueryPage(&listing, 0, FALSE, NULL, 2, sizes, &count, TRUE) == 2);
+  CHECK(count == 2 && sizes[0] == 100 && sizes[1] == 0);
+
+  ClearFindData(&listing.DirList);
+}
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Benchmark(void) {
+  static const ULONG counts[] = {10000, 100000, 1000000};
+  DOKAN_EXPRESSION expression;
+  ULONG *sizes;
+  ULONG c;
+
+  DokanCompileExpression(&expression, L"*.txt", TRUE);
+  printf("ms to list in pages of 32 entries, pattern *.txt\n");
+  printf("entries   cursor   rescan\n");
+  for (c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+    LISTING listing;
+    double start;
+
+    MakeListing(&listing, counts[c]);
+    sizes = (ULONG *)malloc(counts[c] * sizeof(ULONG));
+
+    start = Now();
+    CHECK(ListAll(&listing, &expression, 32, sizes, TRUE) == counts[c]);
+    printf("%7lu  %7.1f", (unsigned long)counts[c], (Now() - start) * 1e3);
+
+    // the rescan is quadratic, it would take minutes for 1M entries
+    if (counts[c] <= 100000) {
+      start = Now();
+      CHECK(ListAll(&listing, &expression, 32, sizes, FALSE) == counts[c]);
+      printf("  %7.1f\n", (Now() - start) * 1e3);
+    } else {
+      printf("  %7s\n", "-");
+    }
+
+    free(sizes);
+    ClearFindData(&listing.DirList);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  DokanInitUpcaseTable();
+
+  TestPaging();
+  TestRestart();
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    Benchmark();
+
+  if (failures != 0) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all tests passed\n");
+  return 0;
+}
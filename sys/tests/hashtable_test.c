@@ -0,0 +1,504 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Unit tests and benchmark of sys/hashtable.h, out of the WDK.
+//
+//   cc -O2 -Wall -o hashtable_test hashtable_test.c
+//   ./hashtable_test          runs the tests
+//   ./hashtable_test bench    also measures the lookups
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// the part of the WDK used by hashtable.h
+typedef unsigned int ULONG;
+typedef unsigned short WCHAR;
+typedef unsigned char BOOLEAN;
+typedef void VOID;
+#define TRUE 1
+#define FALSE 0
+#define FORCEINLINE static inline
+#define CONTAINING_RECORD(address, type, field)                                \
+  ((type *)((char *)(address) - offsetof(type, field)))
+
+typedef struct _LIST_ENTRY {
+  struct _LIST_ENTRY *Flink;
+  struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+FORCEINLINE VOID InitializeListHead(PLIST_ENTRY ListHead) {
+  ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+FORCEINLINE BOOLEAN IsListEmpty(const LIST_ENTRY *ListHead) {
+  return (BOOLEAN)(ListHead->Flink == ListHead);
+}
+
+FORCEINLINE BOOLEAN RemoveEntryList(PLIST_ENTRY Entry) {
+  PLIST_ENTRY Flink = Entry->Flink;
+  PLIST_ENTRY Blink = Entry->Blink;
+  Blink->Flink = Flink;
+  Flink->Blink = Blink;
+  return (BOOLEAN)(Flink == Blink);
+}
+
+FORCEINLINE PLIST_ENTRY RemoveHeadList(PLIST_ENTRY ListHead) {
+  PLIST_ENTRY entry = ListHead->Flink;
+  RemoveEntryList(entry);
+  return entry;
+}
+
+FORCEINLINE VOID InsertTailList(PLIST_ENTRY ListHead, PLIST_ENTRY Entry) {
+  PLIST_ENTRY Blink = ListHead->Blink;
+  Entry->Flink = ListHead;
+  Entry->Blink = Blink;
+  Blink->Flink = Entry;
+  ListHead->Blink = Entry;
+}
+
+// RtlUpcaseUnicodeChar, enough for the names of the tests
+#define DOKAN_HASH_UPCASE(c) ((c) >= 'a' && (c) <= 'z' ? (c) - 'a' + 'A' : (c))
+#define DOKAN_HASH_ALLOCATE(Size) malloc(Size)
+#define DOKAN_HASH_FREE(Buffer) free(Buffer)
+
+#include "../hashtable.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+//
+// pending IRPs, as in sys/event.c
+//
+
+#define PENDING_IRP_BUCKETS 256
+#define PENDING_IRP_MAX_BUCKETS (1 << 17)
+
+typedef struct _TEST_IRP {
+  LIST_ENTRY ListEntry;
+  DOKAN_HASH_ENTRY SerialEntry;
+  ULONG SerialNumber;
+} TEST_IRP, *PTEST_IRP;
+
+typedef struct _TEST_IRP_LIST {
+  LIST_ENTRY ListHead;
+  DOKAN_HASH_TABLE SerialTable;
+  LIST_ENTRY InitialBuckets[PENDING_IRP_BUCKETS];
+  BOOLEAN FixedBuckets;
+} TEST_IRP_LIST, *PTEST_IRP_LIST;
+
+static void IrpListInit(PTEST_IRP_LIST List) {
+  InitializeListHead(&List->ListHead);
+  List->FixedBuckets = FALSE;
+  DokanHashTableInit(&List->SerialTable, List->InitialBuckets,
+                     PENDING_IRP_BUCKETS);
+}
+
+static void IrpListDelete(PTEST_IRP_LIST List) {
+  DokanHashTableDelete(&List->SerialTable);
+}
+
+// DokanGrowIrpList grows the table the same way out of its spin lock
+static void IrpListInsert(PTEST_IRP_LIST List, PTEST_IRP Irp, ULONG Serial) {
+  Irp->SerialNumber = Serial;
+  DokanHashEntryInit(&Irp->SerialEntry);
+  InsertTailList(&List->ListHead, &Irp->ListEntry);
+  DokanHashTableInsert(&List->SerialTable, &Irp->SerialEntry, Serial);
+  if (!List->FixedBuckets)
+    DokanHashTableGrow(&List->SerialTable, PENDING_IRP_MAX_BUCKETS);
+}
+
+// as DokanFindIrpEntry, the serial number is the hash
+static PTEST_IRP IrpListFind(PTEST_IRP_LIST List, ULONG Serial) {
+  PDOKAN_HASH_ENTRY entry =
+      DokanHashTableFind(&List->SerialTable, Serial, NULL);
+  return entry != NULL ? CONTAINING_RECORD(entry, TEST_IRP, SerialEntry)
+                       : NULL;
+}
+
+// the lookup made before the table, for comparison
+static PTEST_IRP IrpListFindLinear(PTEST_IRP_LIST List, ULONG Serial) {
+  PLIST_ENTRY thisEntry;
+
+  for (thisEntry = List->ListHead.Flink; thisEntry != &List->ListHead;
+       thisEntry = thisEntry->Flink) {
+    PTEST_IRP irp = CONTAINING_RECORD(thisEntry, TEST_IRP, ListEntry);
+    if (irp->SerialNumber == Serial)
+      return irp;
+  }
+  return NULL;
+}
+
+// DokanRemoveIrpEntry
+static void IrpListRemove(PTEST_IRP_LIST List, PTEST_IRP Irp) {
+  RemoveEntryList(&Irp->ListEntry);
+  InitializeListHead(&Irp->ListEntry);
+  DokanHashTableRemove(&List->SerialTable, &Irp->SerialEntry);
+}
+
+static ULONG LongestBucket(PDOKAN_HASH_TABLE Table) {
+  ULONG longest = 0;
+  ULONG i;
+
+  for (i = 0; i < Table->BucketCount; ++i) {
+    ULONG length = 0;
+    PLIST_ENTRY entry;
+    for (entry = Table->Buckets[i].Flink; entry != &Table->Buckets[i];
+         entry = entry->Flink)
+      ++length;
+    if (length > longest)
+      longest = length;
+  }
+  return longest;
+}
+
+static void TestInsertFindRemove(void) {
+  TEST_IRP_LIST list;
+  PTEST_IRP irps = calloc(1000, sizeof(TEST_IRP));
+  ULONG i;
+
+  IrpListInit(&list);
+  for (i = 0; i < 1000; ++i)
+    IrpListInsert(&list, &irps[i], i + 1);
+  CHECK(list.SerialTable.Count == 1000);
+
+  for (i = 0; i < 1000; ++i)
+    CHECK(IrpListFind(&list, i + 1) == &irps[i]);
+  CHECK(IrpListFind(&list, 0) == NULL);
+  CHECK(IrpListFind(&list, 1001) == NULL);
+  CHECK(IrpListFind(&list, 1 + list.SerialTable.BucketCount * 7) == NULL);
+
+  for (i = 0; i < 1000; i += 2)
+    IrpListRemove(&list, &irps[i]);
+  CHECK(list.SerialTable.Count == 500);
+  for (i = 0; i < 1000; ++i)
+    CHECK(IrpListFind(&list, i + 1) == (i % 2 ? &irps[i] : NULL));
+
+  // removing an entry twice, or one never inserted, changes nothing
+  IrpListRemove(&list, &irps[0]);
+  CHECK(list.SerialTable.Count == 500);
+
+  IrpListDelete(&list);
+  free(irps);
+}
+
+static void TestGrowth(void) {
+  TEST_IRP_LIST list;
+  PTEST_IRP irps = calloc(300000, sizeof(TEST_IRP));
+  ULONG i;
+
+  IrpListInit(&list);
+  CHECK(list.SerialTable.Buckets == list.InitialBuckets);
+
+  for (i = 0; i < PENDING_IRP_BUCKETS; ++i)
+    IrpListInsert(&list, &irps[i], i + 1);
+  CHECK(list.SerialTable.BucketCount == PENDING_IRP_BUCKETS);
+
+  // one more entry than buckets doubles them
+  IrpListInsert(&list, &irps[i], i + 1);
+  CHECK(list.SerialTable.BucketCount == PENDING_IRP_BUCKETS * 2);
+  CHECK(list.SerialTable.Buckets != list.InitialBuckets);
+
+  for (++i; i < 300000; ++i)
+    IrpListInsert(&list, &irps[i], i + 1);
+  CHECK(list.SerialTable.BucketCount == PENDING_IRP_MAX_BUCKETS);
+  CHECK(list.SerialTable.Count == 300000);
+
+  // sequential serial numbers are spread evenly
+  CHECK(LongestBucket(&list.SerialTable) <=
+        300000 / PENDING_IRP_MAX_BUCKETS + 1);
+
+  for (i = 0; i < 300000; ++i)
+    CHECK(IrpListFind(&list, i + 1) == &irps[i]);
+
+  IrpListDelete(&list);
+  free(irps);
+}
+
+//
+// FCBs by name, as in sys/create.c
+//
+
+#define FCB_BUCKETS 1024
+#define FCB_MAX_BUCKETS (1 << 17)
+
+typedef struct _TEST_FCB {
+  DOKAN_HASH_ENTRY HashEntry;
+  WCHAR Name[64];
+  ULONG Length;
+} TEST_FCB, *PTEST_FCB;
+
+typedef struct _TEST_VCB {
+  DOKAN_HASH_TABLE FcbTable;
+  LIST_ENTRY FcbBuckets[FCB_BUCKETS];
+  BOOLEAN FixedBuckets;
+} TEST_VCB, *PTEST_VCB;
+
+static void SetName(PTEST_FCB Fcb, const char *Name) {
+  ULONG i;
+
+  for (i = 0; Name[i] != '\0' && i < 64; ++i)
+    Fcb->Name[i] = (unsigned char)Name[i];
+  Fcb->Length = i;
+}
+
+static BOOLEAN EqualNames(const WCHAR *Name1, const WCHAR *Name2,
+                          ULONG Length, BOOLEAN CaseSensitive) {
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    if (CaseSensitive ? Name1[i] != Name2[i]
+                      : DOKAN_HASH_UPCASE(Name1[i]) !=
+                            DOKAN_HASH_UPCASE(Name2[i]))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static void VcbInit(PTEST_VCB Vcb) {
+  DokanHashTableInit(&Vcb->FcbTable, Vcb->FcbBuckets, FCB_BUCKETS);
+  Vcb->FixedBuckets = FALSE;
+}
+
+static void VcbDelete(PTEST_VCB Vcb) {
+  DokanHashTableDelete(&Vcb->FcbTable);
+}
+
+// as DokanHashFCB
+static void HashFcb(PTEST_VCB Vcb, PTEST_FCB Fcb) {
+  DokanHashTableInsert(&Vcb->FcbTable, &Fcb->HashEntry,
+                       DokanHashName(Fcb->Name, Fcb->Length));
+  if (!Vcb->FixedBuckets)
+    DokanHashTableGrow(&Vcb->FcbTable, FCB_MAX_BUCKETS);
+}
+
+// as DokanFindFCB, with EqualNames for RtlEqualUnicodeString
+static PTEST_FCB FindFcb(PTEST_VCB Vcb, const WCHAR *Name, ULONG Length,
+                         BOOLEAN CaseSensitive) {
+  ULONG hash = DokanHashName(Name, Length);
+  PDOKAN_HASH_ENTRY entry = NULL;
+
+  while ((entry = DokanHashTableFind(&Vcb->FcbTable, hash, entry)) != NULL) {
+    PTEST_FCB fcb = CONTAINING_RECORD(entry, TEST_FCB, HashEntry);
+    if (fcb->Length == Length &&
+        EqualNames(fcb->Name, Name, Length, CaseSensitive))
+      return fcb;
+  }
+  return NULL;
+}
+
+// the names of the files open on a volume, in a few directories
+static PTEST_FCB AllocateFcbs(ULONG Count) {
+  PTEST_FCB fcbs = calloc(Count, sizeof(TEST_FCB));
+  char name[64];
+  ULONG i;
+
+  for (i = 0; i < Count; ++i) {
+    snprintf(name, sizeof(name), "\\Users\\Dokan\\Project%u\\src\\File%u.cpp",
+             i % 37, i);
+    SetName(&fcbs[i], name);
+    DokanHashEntryInit(&fcbs[i].HashEntry);
+  }
+  return fcbs;
+}
+
+static void TestNameHash(void) {
+  TEST_FCB upper, lower, other;
+
+  SetName(&upper, "\\DIR\\FILE.TXT");
+  SetName(&lower, "\\dir\\file.txt");
+  SetName(&other, "\\dir\\file.txu");
+  CHECK(DokanHashName(upper.Name, upper.Length) ==
+        DokanHashName(lower.Name, lower.Length));
+  CHECK(DokanHashName(upper.Name, upper.Length) !=
+        DokanHashName(other.Name, other.Length));
+  CHECK(DokanHashName(upper.Name, upper.Length - 1) !=
+        DokanHashName(upper.Name, upper.Length));
+}
+
+static void TestFcbs(void) {
+  TEST_VCB vcb;
+  PTEST_FCB fcbs = AllocateFcbs(50000);
+  TEST_FCB lower;
+  ULONG i;
+
+  VcbInit(&vcb);
+  for (i = 0; i < 50000; ++i)
+    HashFcb(&vcb, &fcbs[i]);
+  CHECK(vcb.FcbTable.BucketCount == 65536);
+
+  for (i = 0; i < 50000; ++i)
+    CHECK(FindFcb(&vcb, fcbs[i].Name, fcbs[i].Length, TRUE) == &fcbs[i]);
+
+  // the names of the test are spread about evenly
+  CHECK(LongestBucket(&vcb.FcbTable) <= 10);
+
+  // a case insensitive lookup finds the FCB, a sensitive one does not
+  SetName(&lower, "\\users\\dokan\\project3\\src\\file40.cpp");
+  CHECK(FindFcb(&vcb, lower.Name, lower.Length, FALSE) == &fcbs[40]);
+  CHECK(FindFcb(&vcb, lower.Name, lower.Length, TRUE) == NULL);
+
+  // rename, as in DokanCompleteSetInformation
+  DokanHashTableRemove(&vcb.FcbTable, &fcbs[40].HashEntry);
+  SetName(&fcbs[40], "\\renamed.cpp");
+  HashFcb(&vcb, &fcbs[40]);
+  CHECK(FindFcb(&vcb, lower.Name, lower.Length, FALSE) == NULL);
+  CHECK(FindFcb(&vcb, fcbs[40].Name, fcbs[40].Length, TRUE) == &fcbs[40]);
+  CHECK(vcb.FcbTable.Count == 50000);
+
+  for (i = 0; i < 50000; ++i)
+    DokanHashTableRemove(&vcb.FcbTable, &fcbs[i].HashEntry);
+  CHECK(vcb.FcbTable.Count == 0);
+
+  VcbDelete(&vcb);
+  free(fcbs);
+}
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ULONG Random(ULONG *State) {
+  *State ^= *State << 13;
+  *State ^= *State >> 17;
+  *State ^= *State << 5;
+  return *State;
+}
+
+// completes Operations random pending IRPs out of Pending ones, each replaced
+// by a new one, as with a FileSystem answering out of order
+enum { BENCH_TABLE, BENCH_FIXED_TABLE, BENCH_LIST };
+
+static double BenchmarkIrps(ULONG Pending, ULONG Operations, int Mode) {
+  TEST_IRP_LIST list;
+  PTEST_IRP irps = calloc(Pending, sizeof(TEST_IRP));
+  ULONG serial = 0;
+  ULONG state = 2463534242UL;
+  ULONG found = 0;
+  double start;
+  ULONG i;
+
+  IrpListInit(&list);
+  list.FixedBuckets = Mode == BENCH_FIXED_TABLE;
+  for (i = 0; i < Pending; ++i)
+    IrpListInsert(&list, &irps[i], ++serial);
+
+  start = Now();
+  for (i = 0; i < Operations; ++i) {
+    ULONG slot = Random(&state) % Pending;
+    PTEST_IRP irp =
+        Mode == BENCH_LIST ? IrpListFindLinear(&list, irps[slot].SerialNumber)
+               : IrpListFind(&list, irps[slot].SerialNumber);
+    found += irp != NULL;
+    IrpListRemove(&list, irp);
+    IrpListInsert(&list, irp, ++serial);
+  }
+  start = (Now() - start) * 1e9 / Operations;
+
+  CHECK(found == Operations);
+  IrpListDelete(&list);
+  free(irps);
+  return start;
+}
+
+// looks up each of Count open files in turn, as creates of them do
+static double BenchmarkFcbs(ULONG Count, ULONG Operations, BOOLEAN Fixed,
+                            ULONG *Longest) {
+  TEST_VCB vcb;
+  PTEST_FCB fcbs = AllocateFcbs(Count);
+  ULONG found = 0;
+  double start;
+  ULONG i;
+
+  VcbInit(&vcb);
+  vcb.FixedBuckets = Fixed;
+  for (i = 0; i < Count; ++i)
+    HashFcb(&vcb, &fcbs[i]);
+  *Longest = LongestBucket(&vcb.FcbTable);
+
+  start = Now();
+  for (i = 0; i < Operations; ++i) {
+    PTEST_FCB fcb = &fcbs[(i * 7919) % Count];
+    found += FindFcb(&vcb, fcb->Name, fcb->Length, FALSE) == fcb;
+  }
+  start = (Now() - start) * 1e9 / Operations;
+
+  CHECK(found == Operations);
+  VcbDelete(&vcb);
+  free(fcbs);
+  return start;
+}
+
+static void Benchmark(void) {
+  static const ULONG pending[] = {10, 1000, 100000};
+  static const ULONG files[] = {10, 1000, 50000};
+  ULONG i;
+
+  printf("ns per completion\n");
+  printf("pending IRPs  growing table  256 buckets  list\n");
+  for (i = 0; i < sizeof(pending) / sizeof(pending[0]); ++i) {
+    double table = BenchmarkIrps(pending[i], 1000000, BENCH_TABLE);
+    double fixed = BenchmarkIrps(pending[i], 1000000, BENCH_FIXED_TABLE);
+    // the list walk is too slow for as many completions
+    double linear =
+        BenchmarkIrps(pending[i], 100000000 / pending[i] + 1, BENCH_LIST);
+    printf("%12u  %13.1f  %11.1f  %.1f\n", pending[i], table, fixed, linear);
+  }
+
+  printf("\nns per FCB lookup (longest bucket)\n");
+  printf("open files  growing table  1024 buckets\n");
+  for (i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+    ULONG tableLongest, fixedLongest;
+    double table = BenchmarkFcbs(files[i], 1000000, FALSE, &tableLongest);
+    double fixed = BenchmarkFcbs(files[i], 1000000, TRUE, &fixedLongest);
+    printf("%10u  %8.1f (%2u)  %7.1f (%3u)\n", files[i], table, tableLongest,
+           fixed, fixedLongest);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  TestInsertFindRemove();
+  TestGrowth();
+  TestNameHash();
+  TestFcbs();
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    Benchmark();
+
+  if (failures != 0) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all tests passed\n");
+  return 0;
+}
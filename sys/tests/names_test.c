@@ -0,0 +1,362 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Tests and benchmark of the search expressions and cache keys of
+// dokan/names.c, out of Windows. The matcher is compared on every short
+// expression and name with the recursive one it replaced.
+//
+//   cc -O2 -fshort-wchar -Iwin32 -o names_test names_test.c ../../dokan/names.c
+//   ./names_test          runs the tests
+//   ./names_test full     also compares longer expressions and names
+//   ./names_test bench    also measures the matchers
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wctype.h>
+
+#include "../../dokan/names.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+#define DOS_STAR (L'<')
+#define DOS_QM (L'>')
+#define DOS_DOT (L'"')
+
+// DokanIsNameInExpression before the expressions were compiled. It reads
+// past the end of Name after a ? there, the names given to it are followed
+// by several nulls.
+static BOOL OldIsNameInExpression(LPCWSTR Expression, LPCWSTR Name,
+                                  BOOL IgnoreCase) {
+  ULONG ei = 0;
+  ULONG ni = 0;
+
+  while (Expression[ei] != '\0') {
+
+    if (Expression[ei] == L'*') {
+      ei++;
+      if (Expression[ei] == '\0')
+        return TRUE;
+
+      while (Name[ni] != '\0') {
+        if (OldIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
+          return TRUE;
+        ni++;
+      }
+
+    } else if (Expression[ei] == DOS_STAR) {
+
+      ULONG p = ni;
+      ULONG lastDot = 0;
+      ei++;
+
+      while (Name[p] != '\0') {
+        if (Name[p] == L'.')
+          lastDot = p;
+        p++;
+      }
+
+      BOOL endReached = FALSE;
+      while (!endReached) {
+
+        endReached = (Name[ni] == '\0' || ni == lastDot);
+
+        if (!endReached) {
+          if (OldIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
+            return TRUE;
+
+          ni++;
+        }
+      }
+
+    } else if (Expression[ei] == DOS_QM) {
+
+      ei++;
+      if (Name[ni] != L'.') {
+        ni++;
+      } else {
+
+        ULONG p = ni + 1;
+        while (Name[p] != '\0') {
+          if (Name[p] == L'.')
+            break;
+          p++;
+        }
+
+        if (Name[p] == L'.')
+          ni++;
+      }
+
+    } else if (Expression[ei] == DOS_DOT) {
+      ei++;
+
+      if (Name[ni] == L'.')
+        ni++;
+
+    } else {
+      if (Expression[ei] == L'?') {
+        ei++;
+        ni++;
+      } else if (IgnoreCase && towupper(Expression[ei]) == towupper(Name[ni])) {
+        ei++;
+        ni++;
+      } else if (!IgnoreCase && Expression[ei] == Name[ni]) {
+        ei++;
+        ni++;
+      } else {
+        return FALSE;
+      }
+    }
+  }
+
+  if (ei == wcslen(Expression) && ni == wcslen(Name))
+    return TRUE;
+
+  return FALSE;
+}
+
+// printf of the C library expects 32-bit wchar_t, the tests only use ASCII
+static const char *Ascii(LPCWSTR String) {
+  static char buffers[2][256];
+  static int next = 0;
+  char *buffer = buffers[next++ % 2];
+  ULONG i;
+
+  for (i = 0; String[i] != L'\0' && i < sizeof(buffers[0]) - 1; ++i)
+    buffer[i] = (char)String[i];
+  buffer[i] = '\0';
+  return buffer;
+}
+
+// the Index-th string of Length characters of Alphabet
+static void MakeString(WCHAR *String, LPCWSTR Alphabet, ULONG Length,
+                       ULONG Index) {
+  ULONG base = (ULONG)wcslen(Alphabet);
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    String[i] = Alphabet[Index % base];
+    Index /= base;
+  }
+  String[Length] = L'\0';
+}
+
+static ULONG Power(ULONG Base, ULONG Exponent) {
+  ULONG result = 1;
+  while (Exponent-- > 0)
+    result *= Base;
+  return result;
+}
+
+// every expression of ExpressionAlphabet up to MaxExpressionLength against
+// every name of NameAlphabet up to MaxNameLength, both ignoring case or not
+static void CompareMatchers(ULONG MaxExpressionLength, ULONG MaxNameLength) {
+  static const WCHAR expressionAlphabet[] = L"a.*?<>\"";
+  static const WCHAR nameAlphabet[] = L"aAb.";
+  WCHAR expression[16];
+  // nulls after the name for OldIsNameInExpression
+  WCHAR name[32];
+  unsigned long long cases = 0;
+  ULONG differences = 0;
+  ULONG el, ei, nl, ni;
+  int ignoreCase;
+
+  for (el = 0; el <= MaxExpressionLength; ++el) {
+    ULONG expressions = Power((ULONG)wcslen(expressionAlphabet), el);
+    for (ei = 0; ei < expressions; ++ei) {
+      MakeString(expression, expressionAlphabet, el, ei);
+      for (ignoreCase = 0; ignoreCase <= 1; ++ignoreCase) {
+        DOKAN_EXPRESSION compiled;
+        DokanCompileExpression(&compiled, expression, ignoreCase);
+
+        for (nl = 0; nl <= MaxNameLength; ++nl) {
+          ULONG names = Power((ULONG)wcslen(nameAlphabet), nl);
+          for (ni = 0; ni < names; ++ni) {
+            BOOL expected, match;
+
+            memset(name, 0, sizeof(name));
+            MakeString(name, nameAlphabet, nl, ni);
+            expected = OldIsNameInExpression(expression, name, ignoreCase);
+            match = DokanMatchExpression(&compiled, name, nl);
+            ++cases;
+            if (!expected != !match && ++differences <= 10) {
+              fprintf(stderr, "\"%s\" against \"%s\"%s: %d, expected %d\n",
+                      Ascii(expression), Ascii(name),
+                      ignoreCase ? " ignoring case" : "", match, expected);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  printf("%llu expressions and names compared, %u differences\n", cases,
+         differences);
+  CHECK(differences == 0);
+}
+
+static void TestExpressionTypes(void) {
+  DOKAN_EXPRESSION compiled;
+
+  DokanCompileExpression(&compiled, L"*", TRUE);
+  CHECK(compiled.Type == DOKAN_EXPRESSION_ALL);
+  DokanCompileExpression(&compiled, L"file.txt", TRUE);
+  CHECK(compiled.Type == DOKAN_EXPRESSION_LITERAL);
+  DokanCompileExpression(&compiled, L"file*", TRUE);
+  CHECK(compiled.Type == DOKAN_EXPRESSION_PREFIX);
+  DokanCompileExpression(&compiled, L"*.txt", TRUE);
+  CHECK(compiled.Type == DOKAN_EXPRESSION_SUFFIX);
+  DokanCompileExpression(&compiled, L"<.txt", TRUE);
+  CHECK(compiled.Type == DOKAN_EXPRESSION_GENERAL);
+
+  // more positions than kept on the stack
+  {
+    WCHAR expression[201];
+    WCHAR name[200];
+    ULONG i;
+
+    for (i = 0; i < 200; ++i) {
+      expression[i] = i % 2 ? L'a' : L'*';
+      name[i] = L'a';
+    }
+    expression[200] = L'\0';
+    DokanCompileExpression(&compiled, expression, FALSE);
+    CHECK(DokanMatchExpression(&compiled, name, 100));
+    CHECK(!DokanMatchExpression(&compiled, name, 99));
+  }
+}
+
+// The keys of the caches: \a and \A are different files on the volume,
+// FILE_CASE_SENSITIVE_SEARCH, unless DOKAN_OPTION_CASE_INSENSITIVE_CACHE.
+static void TestCacheKeys(void) {
+  CHECK(DokanCacheHash(L"\\a", 2) == DokanCacheHash(L"\\A", 2));
+  CHECK(DokanCacheHash(L"\\dir\\File.txt", 13) ==
+        DokanCacheHash(L"\\DIR\\file.TXT", 13));
+  CHECK(DokanCacheHash(L"\\a", 2) != DokanCacheHash(L"\\b", 2));
+
+  CHECK(DokanCachePathEqual(L"\\a", 2, L"\\a", 2, FALSE));
+  CHECK(!DokanCachePathEqual(L"\\a", 2, L"\\A", 2, FALSE));
+  CHECK(DokanCachePathEqual(L"\\a", 2, L"\\A", 2, TRUE));
+  CHECK(!DokanCachePathEqual(L"\\dir\\File.txt", 13, L"\\DIR\\file.TXT",
+                             13, FALSE));
+  CHECK(DokanCachePathEqual(L"\\dir\\File.txt", 13, L"\\DIR\\file.TXT",
+                            13, TRUE));
+  // a prefix is not the same key
+  CHECK(!DokanCachePathEqual(L"\\ab", 3, L"\\a", 2, TRUE));
+}
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ns per match of Expression against NameLength a's
+static double BenchmarkMatch(LPCWSTR Expression, ULONG NameLength, BOOL Old) {
+  WCHAR name[256];
+  DOKAN_EXPRESSION compiled;
+  ULONG iterations = 0;
+  double start = Now();
+  double elapsed;
+  int matches = 0;
+
+  memset(name, 0, sizeof(name));
+  for (iterations = 0; iterations < NameLength; ++iterations)
+    name[iterations] = L'a';
+  iterations = 0;
+  DokanCompileExpression(&compiled, Expression, TRUE);
+
+  do {
+    if (Old)
+      matches += OldIsNameInExpression(Expression, name, TRUE);
+    else
+      matches += DokanMatchExpression(&compiled, name, NameLength);
+    ++iterations;
+    elapsed = Now() - start;
+  } while (elapsed < 0.2);
+
+  CHECK(matches == 0);
+  return elapsed * 1e9 / iterations;
+}
+
+static void Benchmark(void) {
+  static const struct {
+    LPCWSTR Expression;
+    // the recursive matcher is too slow for longer names
+    ULONG OldMaxLength;
+  } patterns[] = {
+      {L"*a*b", 128},
+      {L"*a*a*a*a*b", 32},
+      {L"*a*a*a*a*a*a*a*a*b", 16},
+      {L"<a<a<a<a<b", 32},
+  };
+  static const ULONG lengths[] = {16, 32, 128};
+  ULONG p, l;
+
+  printf("ns per match against a's, no match\n");
+  printf("expression            length  compiled  recursive\n");
+  for (p = 0; p < sizeof(patterns) / sizeof(patterns[0]); ++p) {
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+      double compiled = BenchmarkMatch(patterns[p].Expression, lengths[l],
+                                       FALSE);
+      printf("%-20s  %6u  %8.0f", Ascii(patterns[p].Expression),
+             lengths[l], compiled);
+      if (lengths[l] <= patterns[p].OldMaxLength)
+        printf("  %9.0f\n",
+               BenchmarkMatch(patterns[p].Expression, lengths[l], TRUE));
+      else
+        printf("  %9s\n", "-");
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int full = argc > 1 && strcmp(argv[1], "full") == 0;
+
+  DokanInitUpcaseTable();
+
+  TestExpressionTypes();
+  TestCacheKeys();
+  CompareMatchers(4, full ? 8 : 5);
+  if (full)
+    CompareMatchers(6, 5);
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    Benchmark();
+
+  if (failures != 0) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all tests passed\n");
+  return 0;
+}
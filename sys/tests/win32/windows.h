@@ -0,0 +1,86 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2016 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The part of <windows.h> used by the portable files of the library, such as
+// dokan/names.c, to build them out of Windows with -fshort-wchar.
+
+#ifndef DOKAN_TESTS_WINDOWS_H_
+#define DOKAN_TESTS_WINDOWS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define VOID void
+typedef int BOOL;
+typedef unsigned char BOOLEAN, UCHAR;
+typedef char CHAR, *PCHAR;
+typedef unsigned short USHORT;
+typedef int LONG;
+typedef unsigned int ULONG, DWORD;
+typedef uint64_t ULONG64, ULONGLONG, *PULONG64;
+typedef size_t SIZE_T;
+typedef void *PVOID;
+typedef wchar_t WCHAR, *PWCHAR, *LPWSTR;
+typedef const wchar_t *LPCWSTR;
+
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x00000400
+
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define ZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length)                             \
+  memcpy((Destination), (Source), (Length))
+#define RtlMoveMemory(Destination, Source, Length)                             \
+  memmove((Destination), (Source), (Length))
+
+typedef struct _FILETIME {
+  DWORD dwLowDateTime;
+  DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _WIN32_FIND_DATAW {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD dwReserved0;
+  DWORD dwReserved1;
+  WCHAR cFileName[MAX_PATH];
+  WCHAR cAlternateFileName[14];
+} WIN32_FIND_DATAW, *PWIN32_FIND_DATAW;
+
+// the C library works on 32-bit wchar_t, WCHAR is 16-bit here
+static inline SIZE_T DokanTestWcsnlen(LPCWSTR String, SIZE_T MaxLength) {
+  SIZE_T length = 0;
+  while (length < MaxLength && String[length] != L'\0')
+    ++length;
+  return length;
+}
+
+#define wcsnlen DokanTestWcsnlen
+#define wcslen(String) DokanTestWcsnlen((String), (SIZE_T)-1)
+
+#endif // DOKAN_TESTS_WINDOWS_H_
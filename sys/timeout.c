@@ -154,7 +154,7 @@ ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb) {
       break;
     }
 
-    RemoveEntryList(thisEntry);
+    DokanRemoveIrpEntry(irpEntry);
 
     DDbgPrint(" timeout Irp #%X\n", irpEntry->SerialNumber);
 
@@ -170,7 +170,6 @@ ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb) {
     // this IRP is not canceled yet
     if (IoSetCancelRoutine(irp, NULL) == NULL) {
       // Cancel routine will run as soon as we release the lock
-      InitializeListHead(&irpEntry->ListEntry);
       irpEntry->CancelRoutineFreeMemory = TRUE;
       continue;
     }
@@ -200,7 +199,6 @@ ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb) {
 NTSTATUS
 DokanResetPendingIrpTimeout(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KIRQL oldIrql;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PDokanVCB vcb;
   PEVENT_INFORMATION eventInfo;
@@ -224,21 +222,10 @@ DokanResetPendingIrpTimeout(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   KeAcquireSpinLock(&vcb->Dcb->PendingIrp.ListLock, &oldIrql);
 
   // search corresponding IRP through pending IRP list
-  listHead = &vcb->Dcb->PendingIrp.ListHead;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    nextEntry = thisEntry->Flink;
-
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-      continue;
-    }
-
+  irpEntry =
+      DokanFindIrpEntry(&vcb->Dcb->PendingIrp, eventInfo->SerialNumber);
+  if (irpEntry != NULL) {
     DokanUpdateTimeout(&irpEntry->TickCount, timeout);
-    break;
   }
   KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
   DDbgPrint("<== ResetPendingIrpTimeout\n");
@@ -212,7 +212,7 @@ DokanDispatchWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
     // When eventlength is less than event notification buffer,
     // returns it to user-mode using pending event.
-    if (eventLength <= EVENT_CONTEXT_MAX_SIZE) {
+    if (eventLength <= vcb->Dcb->EventContextMaxSize) {
 
       DDbgPrint("   Offset %d:%d, Length %d\n",
                 irpSp->Parameters.Write.ByteOffset.HighPart,